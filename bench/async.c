@@ -0,0 +1,89 @@
+#include "sched/sched.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * Sends n progress updates one commit each and through the background
+ * writer, with synchronous FULL so that every commit syncs.
+ *
+ *     bench_async [n] [directory]
+ */
+
+static char const *dir = ".";
+
+static void check(enum sched_rc rc, char const *what)
+{
+    if (!rc) return;
+    fprintf(stderr, "%s: %s\n", what, sched_error_string(rc));
+    exit(1);
+}
+
+static double now(void)
+{
+    struct timespec ts = {0};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static int64_t setup(struct sched *h)
+{
+    FILE *fp = fopen("bench_async.hmm", "wb");
+    if (!fp || fputs("HMMER3/f bench\n", fp) < 0 || fclose(fp))
+    {
+        perror("bench_async.hmm");
+        exit(1);
+    }
+
+    struct sched_hmm hmm = {0};
+    struct sched_job job = {0};
+    sched_hmm_init(&hmm);
+    check(sched_hmm_set_file(&hmm, "bench_async.hmm"), "hmm_set_file");
+    sched_job_init(&job, SCHED_HMM);
+    check(sched_h_job_submit(h, &job, &hmm), "job_submit");
+    check(sched_h_job_set_run(h, job.id), "job_set_run");
+    return job.id;
+}
+
+int main(int argc, char **argv)
+{
+    int n = argc > 1 ? atoi(argv[1]) : 10000;
+    if (argc > 2) dir = argv[2];
+
+    char sched_path[512] = {0};
+    snprintf(sched_path, sizeof sched_path, "%s/bench_async.sched", dir);
+    remove(sched_path);
+
+    struct sched_options opts = {0};
+    struct sched *h = 0;
+    sched_options_init(&opts);
+    opts.synchronous = SCHED_SYNCHRONOUS_FULL;
+    check(sched_open(&h, sched_path, &opts), "sched_open");
+    int64_t id = setup(h);
+
+    double start = now();
+    for (int i = 0; i < n; ++i)
+        check(sched_h_job_increment_progress(h, id, 0), "increment_progress");
+    double sync_time = now() - start;
+
+    struct sched_future future = {0};
+    sched_future_init(&future, 0, 0);
+    check(sched_async_start(h, 10), "async_start");
+    start = now();
+    for (int i = 0; i < n; ++i)
+        check(sched_async_job_increment_progress(h, id, 0, 0),
+              "async_increment_progress");
+    check(sched_async_job_increment_progress(h, id, 0, &future),
+          "async_increment_progress");
+    check(sched_future_wait(&future), "future_wait");
+    double async_time = now() - start;
+    check(sched_async_stop(h), "async_stop");
+
+    printf("%-8s %12s\n", "path", "updates/s");
+    printf("%-8s %12.0f\n", "sync", n / sync_time);
+    printf("%-8s %12.0f\n", "async", n / async_time);
+
+    check(sched_close(h), "sched_close");
+    remove(sched_path);
+    return 0;
+}
@@ -0,0 +1,153 @@
+#include "sched/sched.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * Inserts n sequences and n products with the single-row path
+ * (one row per INSERT) and with multi-row INSERT batching. Each set of
+ * rows goes in one transaction, so only the statement shape differs.
+ *
+ *     bench_bulk [n] [directory]
+ */
+
+static char const *dir = ".";
+
+static void check(enum sched_rc rc, char const *what)
+{
+    if (!rc) return;
+    fprintf(stderr, "%s: %s\n", what, sched_error_string(rc));
+    exit(1);
+}
+
+static double now(void)
+{
+    struct timespec ts = {0};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void path_of(char *path, size_t size, char const *name)
+{
+    snprintf(path, size, "%s/%s", dir, name);
+}
+
+static void write_file(char const *path, char const *str)
+{
+    FILE *fp = fopen(path, "wb");
+    if (!fp || fputs(str, fp) < 0 || fclose(fp))
+    {
+        perror(path);
+        exit(1);
+    }
+}
+
+static int64_t setup(char const *sched_path, int bulk_rows)
+{
+    struct sched_options opts = {0};
+    sched_options_init(&opts);
+    opts.bulk_rows = bulk_rows;
+
+    remove(sched_path);
+    check(sched_init_ex(sched_path, &opts), "sched_init_ex");
+
+    write_file("bench_bulk.hmm", "HMMER3/f bench\n");
+    write_file("bench_bulk.dcp", "dcp bench\n");
+
+    struct sched_hmm hmm = {0};
+    struct sched_job job = {0};
+    sched_hmm_init(&hmm);
+    check(sched_hmm_set_file(&hmm, "bench_bulk.hmm"), "hmm_set_file");
+    sched_job_init(&job, SCHED_HMM);
+    check(sched_job_submit(&job, &hmm), "job_submit");
+    check(sched_job_set_run(job.id), "job_set_run");
+    check(sched_job_set_done(job.id), "job_set_done");
+
+    struct sched_db db = {0};
+    sched_db_init(&db);
+    check(sched_db_add(&db, "bench_bulk.dcp"), "db_add");
+    return db.id;
+}
+
+static double insert_seqs(int64_t db_id, int n, int64_t *scan_id)
+{
+    static char const data[] = "ACGTTGCAACGTTGCAACGTTGCAACGTTGCAACGTTGCAACGTTGCA"
+                               "ACGTTGCAACGTTGCAACGTTGCAACGTTGCAACGTTGCAACGTTGCA";
+    char name[32] = {0};
+    struct sched_scan scan = {0};
+    struct sched_job job = {0};
+
+    double start = now();
+    sched_scan_init(&scan, db_id, true, false);
+    for (int i = 0; i < n; ++i)
+    {
+        snprintf(name, sizeof name, "read%d", i);
+        check(sched_scan_add_seq(name, data), "scan_add_seq");
+    }
+    sched_job_init(&job, SCHED_SCAN);
+    check(sched_job_submit(&job, &scan), "job_submit");
+    *scan_id = scan.id;
+    return now() - start;
+}
+
+static void write_prods(char const *path, int64_t scan_id, int n)
+{
+    FILE *fp = fopen(path, "wb");
+    if (!fp)
+    {
+        perror(path);
+        exit(1);
+    }
+    fputs("scan_id\tseq_id\tprofile_name\tabc_name\talt_loglik\tnull_loglik\t"
+          "evalue_log\tprofile_typeid\tversion\tmatch\n",
+          fp);
+    for (int i = 0; i < n; ++i)
+        fprintf(fp,
+                "%lld\t%d\tPF00742.20\tdna\t-547.87\t-690.86\t-196.11\t"
+                "protein\t1.0.0\t,S,,;,B,,;CCT,M1,CCT,P;ATC,M2,ATC,I;,E,,;,T,,\n",
+                (long long)scan_id, i + 1);
+    if (fclose(fp))
+    {
+        perror(path);
+        exit(1);
+    }
+}
+
+static double insert_prods(char const *path)
+{
+    double start = now();
+    check(sched_prod_add_file(path), "prod_add_file");
+    return now() - start;
+}
+
+int main(int argc, char **argv)
+{
+    int n = argc > 1 ? atoi(argv[1]) : 1000000;
+    if (argc > 2) dir = argv[2];
+
+    char sched_path[512] = {0};
+    char prod_path[512] = {0};
+    path_of(sched_path, sizeof sched_path, "bench_bulk.sched");
+    path_of(prod_path, sizeof prod_path, "bench_bulk.tsv");
+
+    static int const rows[] = {1, 0};
+    static char const *const names[] = {"single-row", "multi-row"};
+
+    printf("%-12s %12s %12s\n", "path", "seqs/s", "prods/s");
+    for (int i = 0; i < 2; ++i)
+    {
+        int64_t db_id = setup(sched_path, rows[i]);
+
+        int64_t scan_id = 0;
+        double seq_time = insert_seqs(db_id, n, &scan_id);
+        write_prods(prod_path, scan_id, n);
+        double prod_time = insert_prods(prod_path);
+
+        printf("%-12s %12.0f %12.0f\n", names[i], n / seq_time, n / prod_time);
+        check(sched_cleanup(), "sched_cleanup");
+    }
+
+    remove(prod_path);
+    remove(sched_path);
+    return 0;
+}
@@ -0,0 +1,132 @@
+#include "sched/sched.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * Adds the same product file of n rows with a growing number of parser
+ * threads, zero meaning the rows are parsed on the inserting thread.
+ *
+ *     bench_ingest [n] [directory]
+ */
+
+static char const *dir = ".";
+
+enum
+{
+    NUM_SEQS = 1000,
+};
+
+static void check(enum sched_rc rc, char const *what)
+{
+    if (!rc) return;
+    fprintf(stderr, "%s: %s\n", what, sched_error_string(rc));
+    exit(1);
+}
+
+static double now(void)
+{
+    struct timespec ts = {0};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void path_of(char *path, size_t size, char const *name)
+{
+    snprintf(path, size, "%s/%s", dir, name);
+}
+
+static void write_file(char const *path, char const *str)
+{
+    FILE *fp = fopen(path, "wb");
+    if (!fp || fputs(str, fp) < 0 || fclose(fp))
+    {
+        perror(path);
+        exit(1);
+    }
+}
+
+static int64_t setup(char const *sched_path, int threads)
+{
+    struct sched_options opts = {0};
+    sched_options_init(&opts);
+    opts.parse_threads = threads;
+
+    remove(sched_path);
+    check(sched_init_ex(sched_path, &opts), "sched_init_ex");
+
+    write_file("bench_ingest.hmm", "HMMER3/f bench\n");
+    write_file("bench_ingest.dcp", "dcp bench\n");
+
+    struct sched_hmm hmm = {0};
+    struct sched_job job = {0};
+    sched_hmm_init(&hmm);
+    check(sched_hmm_set_file(&hmm, "bench_ingest.hmm"), "hmm_set_file");
+    sched_job_init(&job, SCHED_HMM);
+    check(sched_job_submit(&job, &hmm), "job_submit");
+
+    struct sched_db db = {0};
+    sched_db_init(&db);
+    check(sched_db_add(&db, "bench_ingest.dcp"), "db_add");
+
+    struct sched_scan scan = {0};
+    sched_scan_init(&scan, db.id, true, false);
+    check(sched_scan_begin(&scan, &job), "scan_begin");
+    for (int i = 0; i < NUM_SEQS; ++i)
+        check(sched_scan_push_seq("read", "ACGTTGCAACGTTGCA"), "push_seq");
+    check(sched_scan_commit(), "scan_commit");
+    return scan.id;
+}
+
+static void write_prods(char const *path, int64_t scan_id, int n)
+{
+    FILE *fp = fopen(path, "wb");
+    if (!fp)
+    {
+        perror(path);
+        exit(1);
+    }
+    fputs("scan_id\tseq_id\tprofile_name\tabc_name\talt_loglik\tnull_loglik\t"
+          "evalue_log\tprofile_typeid\tversion\tmatch\n",
+          fp);
+    for (int i = 0; i < n; ++i)
+        fprintf(fp,
+                "%lld\t%d\tPF%05d.20\tdna\t-547.87713623046875\t"
+                "-690.86773681640625\t-196.11220625901211\tprotein\t1.0.0\t"
+                ",S,,;,B,,;CCT,M1,CCT,P;ATC,M2,ATC,I;,E,,;,T,,\n",
+                (long long)scan_id, i % NUM_SEQS + 1, i / NUM_SEQS);
+    if (fclose(fp))
+    {
+        perror(path);
+        exit(1);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int n = argc > 1 ? atoi(argv[1]) : 1000000;
+    if (argc > 2) dir = argv[2];
+
+    char sched_path[512] = {0};
+    char prod_path[512] = {0};
+    path_of(sched_path, sizeof sched_path, "bench_ingest.sched");
+    path_of(prod_path, sizeof prod_path, "bench_ingest.tsv");
+
+    static int const threads[] = {0, 1, 2, 4, 8};
+
+    printf("%-8s %12s\n", "threads", "prods/s");
+    for (unsigned i = 0; i < sizeof threads / sizeof threads[0]; ++i)
+    {
+        int64_t scan_id = setup(sched_path, threads[i]);
+        if (i == 0) write_prods(prod_path, scan_id, n);
+
+        double start = now();
+        check(sched_prod_add_file(prod_path), "prod_add_file");
+        printf("%-8d %12.0f\n", threads[i], n / (now() - start));
+        check(sched_cleanup(), "sched_cleanup");
+    }
+
+    remove(prod_path);
+    remove(sched_path);
+    return 0;
+}
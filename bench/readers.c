@@ -0,0 +1,151 @@
+#include "sched/sched.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * Looks up sequences by id from a growing number of threads sharing one
+ * handle, first with every query on the writer connection and then with
+ * one pooled read-only connection per thread.
+ *
+ *     bench_readers [nseqs] [nlookups] [directory]
+ */
+
+static char const *dir = ".";
+static int nseqs = 100000;
+static int nlookups = 200000;
+
+static void check(enum sched_rc rc, char const *what)
+{
+    if (!rc) return;
+    fprintf(stderr, "%s: %s\n", what, sched_error_string(rc));
+    exit(1);
+}
+
+static double now(void)
+{
+    struct timespec ts = {0};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void path_of(char *path, size_t size, char const *name)
+{
+    snprintf(path, size, "%s/%s", dir, name);
+}
+
+static void write_file(char const *path, char const *str)
+{
+    FILE *fp = fopen(path, "wb");
+    if (!fp || fputs(str, fp) < 0 || fclose(fp))
+    {
+        perror(path);
+        exit(1);
+    }
+}
+
+static void setup(char const *sched_path)
+{
+    remove(sched_path);
+    check(sched_init(sched_path), "sched_init");
+
+    write_file("bench_readers.hmm", "HMMER3/f bench\n");
+    write_file("bench_readers.dcp", "dcp bench\n");
+
+    struct sched_hmm hmm = {0};
+    struct sched_job job = {0};
+    sched_hmm_init(&hmm);
+    check(sched_hmm_set_file(&hmm, "bench_readers.hmm"), "hmm_set_file");
+    sched_job_init(&job, SCHED_HMM);
+    check(sched_job_submit(&job, &hmm), "job_submit");
+    check(sched_job_set_run(job.id), "job_set_run");
+    check(sched_job_set_done(job.id), "job_set_done");
+
+    struct sched_db db = {0};
+    sched_db_init(&db);
+    check(sched_db_add(&db, "bench_readers.dcp"), "db_add");
+
+    static char const data[] = "ACGTTGCAACGTTGCAACGTTGCAACGTTGCAACGTTGCAACGTTGCA";
+    char name[32] = {0};
+    struct sched_scan scan = {0};
+    sched_scan_init(&scan, db.id, true, false);
+    check(sched_scan_begin(&scan, &job), "scan_begin");
+    for (int i = 0; i < nseqs; ++i)
+    {
+        snprintf(name, sizeof name, "read%d", i);
+        check(sched_scan_push_seq(name, data), "scan_push_seq");
+    }
+    check(sched_scan_commit(), "scan_commit");
+    check(sched_cleanup(), "sched_cleanup");
+}
+
+struct task
+{
+    pthread_t thread;
+    struct sched *h;
+    unsigned seed;
+    int n;
+};
+
+static void *lookup(void *arg)
+{
+    struct task *t = arg;
+    struct sched_seq_dyn seq = {0};
+    sched_seq_dyn_init(&seq);
+    for (int i = 0; i < t->n; ++i)
+    {
+        t->seed = t->seed * 1103515245u + 12345u;
+        int64_t id = 1 + (int64_t)((t->seed >> 8) % (unsigned)nseqs);
+        check(sched_h_seq_dyn_get_by_id(t->h, &seq, id), "seq_get_by_id");
+    }
+    sched_seq_dyn_cleanup(&seq);
+    return 0;
+}
+
+static double run(char const *sched_path, int readers, int nthreads)
+{
+    struct sched_options opts = {0};
+    struct sched *h = 0;
+    sched_options_init(&opts);
+    opts.readers = readers;
+    check(sched_open(&h, sched_path, &opts), "sched_open");
+
+    struct task tasks[64] = {0};
+    double start = now();
+    for (int i = 0; i < nthreads; ++i)
+    {
+        tasks[i] = (struct task){0, h, (unsigned)i + 1, nlookups / nthreads};
+        if (pthread_create(&tasks[i].thread, 0, lookup, tasks + i)) exit(1);
+    }
+    for (int i = 0; i < nthreads; ++i)
+        pthread_join(tasks[i].thread, 0);
+    double elapsed = now() - start;
+
+    check(sched_close(h), "sched_close");
+    return (nlookups / nthreads) * nthreads / elapsed;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1) nseqs = atoi(argv[1]);
+    if (argc > 2) nlookups = atoi(argv[2]);
+    if (argc > 3) dir = argv[3];
+
+    char sched_path[512] = {0};
+    path_of(sched_path, sizeof sched_path, "bench_readers.sched");
+    setup(sched_path);
+
+    static int const threads[] = {1, 2, 4, 8, 16};
+
+    printf("%-8s %14s %14s\n", "threads", "writer/s", "pool/s");
+    for (unsigned i = 0; i < sizeof threads / sizeof threads[0]; ++i)
+    {
+        int n = threads[i];
+        printf("%-8d %14.0f %14.0f\n", n, run(sched_path, 0, n),
+               run(sched_path, n, n));
+    }
+
+    remove(sched_path);
+    return 0;
+}
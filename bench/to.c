@@ -0,0 +1,83 @@
+#include "to.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Parses the kind of numbers found in prod.tsv columns with strtod and
+ * with to_doublel.
+ *
+ *     bench_to [millions of numbers]
+ */
+
+enum
+{
+    WIDTH = 32,
+};
+
+static double now(void)
+{
+    struct timespec ts = {0};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static char *make_numbers(long n)
+{
+    char *numbers = malloc((size_t)n * WIDTH);
+    if (!numbers)
+    {
+        perror("malloc");
+        exit(1);
+    }
+    srand(7);
+    for (long i = 0; i < n; ++i)
+    {
+        double x = -(double)rand() / RAND_MAX * 2000.0;
+        char *str = numbers + i * WIDTH;
+        if (i % 3 == 2)
+            snprintf(str, WIDTH, "%.17g", x / 10.0);
+        else
+            snprintf(str, WIDTH, "%.*f", i % 3 ? 1 : 14, x);
+    }
+    return numbers;
+}
+
+int main(int argc, char **argv)
+{
+    long n = (argc > 1 ? atol(argv[1]) : 10) * 1000000;
+    char *numbers = make_numbers(n);
+    double sum = 0;
+
+    double start = now();
+    for (long i = 0; i < n; ++i)
+        sum += strtod(numbers + i * WIDTH, NULL);
+    double strtod_secs = now() - start;
+
+    double check = 0;
+    start = now();
+    for (long i = 0; i < n; ++i)
+    {
+        char const *str = numbers + i * WIDTH;
+        double x = 0;
+        if (!to_doublel((unsigned)strlen(str), str, &x))
+        {
+            fprintf(stderr, "failed to parse %s\n", str);
+            return 1;
+        }
+        check += x;
+    }
+    double to_secs = now() - start;
+
+    if (sum != check)
+    {
+        fprintf(stderr, "results differ\n");
+        return 1;
+    }
+    printf("parser      Mnumbers/s\n");
+    printf("strtod      %.1f\n", (double)n / strtod_secs / 1e6);
+    printf("to_doublel  %.1f\n", (double)n / to_secs / 1e6);
+    free(numbers);
+    return 0;
+}
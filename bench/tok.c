@@ -0,0 +1,112 @@
+#include "sched/sched.h"
+#include "tok.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * Tokenizes a generated prod.tsv of the given size, first memory-mapped
+ * and then streamed through a pipe.
+ *
+ *     bench_tok [megabytes] [directory]
+ */
+
+static char const *dir = ".";
+
+static void check(enum sched_rc rc, char const *what)
+{
+    if (!rc) return;
+    fprintf(stderr, "%s: %s\n", what, sched_error_string(rc));
+    exit(1);
+}
+
+static double now(void)
+{
+    struct timespec ts = {0};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void path_of(char *path, size_t size, char const *name)
+{
+    snprintf(path, size, "%s/%s", dir, name);
+}
+
+static long long write_prods(char const *path, long long bytes)
+{
+    FILE *fp = fopen(path, "wb");
+    if (!fp)
+    {
+        perror(path);
+        exit(1);
+    }
+    fputs("scan_id\tseq_id\tprofile_name\tabc_name\talt_loglik\tnull_loglik\t"
+          "evalue_log\tprofile_typeid\tversion\tmatch\n",
+          fp);
+    long long rows = 0;
+    while (ftell(fp) < bytes)
+    {
+        fprintf(fp,
+                "1\t%lld\tPF00742.20\tdna\t-547.87713623046875\t"
+                "-690.86773681640625\t-196.11220625901211\tprotein\t1.0.0\t"
+                ",S,,;,B,,;CCT,M1,CCT,P;ATC,M2,ATC,I;ATT,M3,ATT,I;CCT,M4,CCT,"
+                "P;ATC,M5,ATC,I;ATT,M6,ATT,I;,E,,;,T,,\n",
+                ++rows);
+    }
+    if (fclose(fp))
+    {
+        perror(path);
+        exit(1);
+    }
+    return rows;
+}
+
+static double tokenize(FILE *fp, long long *words)
+{
+    struct tok tok = {0};
+    double start = now();
+    check(tok_open(&tok, fp), "tok_open");
+    do
+    {
+        check(tok_next(&tok), "tok_next");
+        *words += tok_id(&tok) == TOK_WORD;
+    } while (tok_id(&tok) != TOK_EOF);
+    tok_close(&tok);
+    return now() - start;
+}
+
+int main(int argc, char **argv)
+{
+    long long megabytes = argc > 1 ? atoll(argv[1]) : 4096;
+    if (argc > 2) dir = argv[2];
+
+    char path[512] = {0};
+    char cmd[600] = {0};
+    path_of(path, sizeof path, "bench_tok.tsv");
+    snprintf(cmd, sizeof cmd, "cat '%s'", path);
+
+    long long rows = write_prods(path, megabytes * 1024 * 1024);
+    double mb = (double)megabytes;
+
+    printf("%-8s %12s %12s %12s\n", "mode", "MB/s", "rows/s", "words");
+    for (int i = 0; i < 2; ++i)
+    {
+        FILE *fp = i == 0 ? fopen(path, "rb") : popen(cmd, "r");
+        if (!fp)
+        {
+            perror(path);
+            exit(1);
+        }
+        long long words = 0;
+        double secs = tokenize(fp, &words);
+        if (i == 0)
+            fclose(fp);
+        else
+            pclose(fp);
+        printf("%-8s %12.0f %12.0f %12lld\n", i == 0 ? "mmap" : "stream",
+               mb / secs, (double)rows / secs, words);
+    }
+
+    remove(path);
+    return 0;
+}
@@ -0,0 +1,65 @@
+#ifndef SCHED_ASYNC_H
+#define SCHED_ASYNC_H
+
+#include "sched/rc.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+struct sched;
+
+typedef void(sched_async_func_t)(enum sched_rc, void *arg);
+
+/*
+ * Completion of one asynchronous update. Poll it with sched_future_done
+ * or block on it with sched_future_wait. The callback, if any, runs on
+ * the writer thread once the update has been committed. An update that
+ * could not be queued leaves the future done with the same error the
+ * call returned, without running the callback.
+ */
+struct sched_future
+{
+    atomic_int done;
+    enum sched_rc rc;
+    sched_async_func_t *callb;
+    void *arg;
+    struct sched *h;
+};
+
+void sched_future_init(struct sched_future *, sched_async_func_t *, void *arg);
+bool sched_future_done(struct sched_future *);
+enum sched_rc sched_future_wait(struct sched_future *);
+
+/*
+ * Job state and progress updates can be queued on a handle and written
+ * by a background thread, which commits everything queued within one
+ * interval in a single transaction. Progress increments are written in
+ * that transaction too, whatever progress_flush_ms says. The future can
+ * be null.
+ */
+enum sched_rc sched_async_start(struct sched *, int commit_interval_ms);
+enum sched_rc sched_async_stop(struct sched *);
+
+enum sched_rc sched_async_job_set_run(struct sched *, int64_t id,
+                                      struct sched_future *);
+enum sched_rc sched_async_job_set_fail(struct sched *, int64_t id,
+                                       char const *msg, struct sched_future *);
+enum sched_rc sched_async_job_set_done(struct sched *, int64_t id,
+                                       struct sched_future *);
+enum sched_rc sched_async_job_increment_progress(struct sched *, int64_t id,
+                                                 int progress,
+                                                 struct sched_future *);
+
+/* Token-checked updates, see sched_job_set_done_claimed. */
+enum sched_rc sched_async_job_set_fail_claimed(struct sched *, int64_t id,
+                                               int token, char const *msg,
+                                               struct sched_future *);
+enum sched_rc sched_async_job_set_done_claimed(struct sched *, int64_t id,
+                                               int token,
+                                               struct sched_future *);
+enum sched_rc
+sched_async_job_increment_progress_claimed(struct sched *, int64_t id,
+                                           int token, int progress,
+                                           struct sched_future *);
+
+#endif
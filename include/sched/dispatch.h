@@ -0,0 +1,28 @@
+#ifndef SCHED_DISPATCH_H
+#define SCHED_DISPATCH_H
+
+#include "sched/structs.h"
+#include <stdint.h>
+
+struct sched_dispatch;
+
+/*
+ * Shared-memory dispatch of a scan's sequences to workers on the same
+ * host. A producer preloads the sequences into a POSIX shared-memory
+ * object with sched_dispatch_create; workers attach with
+ * sched_dispatch_open and claim one sequence at a time with
+ * sched_dispatch_next, which returns SCHED_END once every sequence has
+ * been handed out. Views point into the mapping and stay valid until
+ * sched_dispatch_close. The name follows shm_open rules ("/name").
+ */
+enum sched_rc sched_dispatch_create(struct sched_dispatch **, char const *name,
+                                    int64_t scan_id);
+enum sched_rc sched_dispatch_open(struct sched_dispatch **, char const *name);
+enum sched_rc sched_dispatch_next(struct sched_dispatch *,
+                                  struct sched_seq_view *);
+int64_t sched_dispatch_size(struct sched_dispatch const *);
+int64_t sched_dispatch_scan_id(struct sched_dispatch const *);
+void sched_dispatch_close(struct sched_dispatch *);
+enum sched_rc sched_dispatch_unlink(char const *name);
+
+#endif
@@ -0,0 +1,198 @@
+#ifndef SCHED_HANDLE_H
+#define SCHED_HANDLE_H
+
+#include "sched/db.h"
+#include "sched/dispatch.h"
+#include "sched/hmm.h"
+#include "sched/hmmer.h"
+#include "sched/job.h"
+#include "sched/options.h"
+#include "sched/prod.h"
+#include "sched/scan.h"
+#include "sched/seq.h"
+#include "sched/unit.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * A handle owns its connections, prepared statements, parser state and
+ * sequence queues. One handle can be shared between threads: queries run
+ * on the pooled reader connections, each thread leasing its own, and
+ * writes are serialised by the handle's write lock on its writer.
+ *
+ * What a handle keeps between calls is not per thread, so callers must
+ * still agree on who owns it:
+ *  - the scan built by sched_scan_init and sched_scan_add_seq until it is
+ *    submitted;
+ *  - the streamed scan from sched_scan_begin to sched_scan_commit or
+ *    sched_scan_rollback, whose pushes go to the one open stream;
+ *  - sched_close, which must not race with any other call on the handle.
+ *
+ * The handle-less API acts on the handle bound to the calling thread by
+ * sched_use, or else on the process-wide one opened by sched_init.
+ */
+struct sched;
+struct sched_health;
+
+enum sched_rc sched_open(struct sched **, char const *filepath,
+                         struct sched_options const *);
+enum sched_rc sched_close(struct sched *);
+struct sched *sched_use(struct sched *);
+
+enum sched_rc sched_h_db_get_by_id(struct sched *, struct sched_db *db,
+                                   int64_t id);
+enum sched_rc sched_h_db_get_by_xxh3(struct sched *, struct sched_db *db,
+                                     int64_t xxh3);
+enum sched_rc sched_h_db_get_by_filename(struct sched *, struct sched_db *db,
+                                         char const *filename);
+enum sched_rc sched_h_db_get_by_hmm_id(struct sched *, struct sched_db *db,
+                                       int64_t hmm_id);
+enum sched_rc sched_h_db_get_all(struct sched *, sched_db_set_func_t fn,
+                                 struct sched_db *db, void *arg);
+enum sched_rc sched_h_db_add(struct sched *, struct sched_db *db,
+                             char const *filename);
+enum sched_rc sched_h_db_remove(struct sched *, int64_t id);
+
+enum sched_rc sched_h_dispatch_create(struct sched *,
+                                      struct sched_dispatch **,
+                                      char const *name, int64_t scan_id);
+
+enum sched_rc sched_h_hmm_get_by_id(struct sched *, struct sched_hmm *hmm,
+                                    int64_t id);
+enum sched_rc sched_h_hmm_get_by_job_id(struct sched *, struct sched_hmm *hmm,
+                                        int64_t job_id);
+enum sched_rc sched_h_hmm_get_by_xxh3(struct sched *, struct sched_hmm *hmm,
+                                      int64_t xxh3);
+enum sched_rc sched_h_hmm_get_by_filename(struct sched *, struct sched_hmm *hmm,
+                                          char const *filename);
+enum sched_rc sched_h_hmm_get_all(struct sched *, sched_hmm_set_func_t fn,
+                                  struct sched_hmm *hmm, void *arg);
+enum sched_rc sched_h_hmm_remove(struct sched *, int64_t id);
+
+enum sched_rc sched_h_hmmer_get_by_id(struct sched *, struct sched_hmmer *hmmer,
+                                      int64_t id);
+enum sched_rc sched_h_hmmer_get_by_prod_id(struct sched *,
+                                           struct sched_hmmer *hmmer,
+                                           int64_t prod_id);
+enum sched_rc sched_h_hmmer_add(struct sched *, struct sched_hmmer *hmmer,
+                                int len, unsigned char const *data);
+enum sched_rc sched_h_hmmer_remove(struct sched *, int64_t id);
+
+enum sched_rc sched_h_job_get_by_id(struct sched *, struct sched_job *job,
+                                    int64_t id);
+enum sched_rc sched_h_job_get_all(struct sched *, sched_job_set_func_t fn,
+                                  struct sched_job *job, void *arg);
+enum sched_rc sched_h_job_next_pend(struct sched *, struct sched_job *job);
+enum sched_rc sched_h_job_wait_pend(struct sched *, struct sched_job *job,
+                                    int timeout_ms);
+enum sched_rc sched_h_job_claim_next(struct sched *, struct sched_job *job);
+enum sched_rc sched_h_job_claim_batch(struct sched *, struct sched_job *out,
+                                      int max, int *n);
+enum sched_rc sched_h_job_set_run(struct sched *, int64_t id);
+enum sched_rc sched_h_job_set_fail(struct sched *, int64_t id, char const *msg);
+enum sched_rc sched_h_job_set_done(struct sched *, int64_t id);
+enum sched_rc sched_h_job_set_fail_claimed(struct sched *, int64_t id,
+                                           int token, char const *msg);
+enum sched_rc sched_h_job_set_done_claimed(struct sched *, int64_t id,
+                                           int token);
+enum sched_rc sched_h_job_heartbeat(struct sched *, int64_t id, int token);
+enum sched_rc sched_h_job_reap_expired(struct sched *, int *n);
+enum sched_rc sched_h_job_state(struct sched *, int64_t id,
+                                enum sched_job_state *state);
+enum sched_rc sched_h_job_submit(struct sched *, struct sched_job *job,
+                                 void *actual_job);
+enum sched_rc sched_h_job_increment_progress(struct sched *, int64_t id,
+                                             int progress);
+enum sched_rc sched_h_job_increment_progress_claimed(struct sched *,
+                                                     int64_t id, int token,
+                                                     int progress);
+enum sched_rc sched_h_job_flush_progress(struct sched *);
+enum sched_rc sched_h_job_remove(struct sched *, int64_t id);
+
+enum sched_rc sched_h_prod_get_by_id(struct sched *, struct sched_prod *prod,
+                                     int64_t id);
+enum sched_rc sched_h_prod_add(struct sched *, struct sched_prod *prod);
+enum sched_rc sched_h_prod_add_file(struct sched *, char const *filename);
+enum sched_rc sched_h_prod_get_all(struct sched *, sched_prod_set_func_t *fn,
+                                   struct sched_prod *prod,
+                                   struct sched_hmmer *hmmer, void *arg);
+enum sched_rc sched_h_prod_get_all_view(struct sched *,
+                                        sched_prod_view_func_t *fn, void *arg);
+enum sched_rc sched_h_prod_dyn_get_by_id(struct sched *,
+                                         struct sched_prod_dyn *prod,
+                                         int64_t id);
+enum sched_rc sched_h_prod_dyn_get_all(struct sched *,
+                                       sched_prod_dyn_func_t *fn,
+                                       struct sched_prod_dyn *prod,
+                                       struct sched_hmmer *hmmer, void *arg);
+enum sched_rc sched_h_prodset_add(struct sched *, char const *dir);
+
+void sched_h_scan_init(struct sched *, struct sched_scan *scan, int64_t db_id,
+                       bool multi_hits, bool hmmer3_compat);
+enum sched_rc sched_h_scan_get_seqs(struct sched *, int64_t job_id,
+                                    sched_seq_set_func_t fn,
+                                    struct sched_seq *seq, void *arg);
+enum sched_rc sched_h_scan_get_prods(struct sched *, int64_t job_id,
+                                     sched_prod_set_func_t *fn,
+                                     struct sched_prod *prod,
+                                     struct sched_hmmer *hmmer, void *arg);
+enum sched_rc sched_h_scan_get_seqs_dyn(struct sched *, int64_t scan_id,
+                                        sched_seq_dyn_func_t *fn,
+                                        struct sched_seq_dyn *seq, void *arg);
+enum sched_rc sched_h_scan_get_prods_dyn(struct sched *, int64_t scan_id,
+                                         sched_prod_dyn_func_t *fn,
+                                         struct sched_prod_dyn *prod,
+                                         struct sched_hmmer *hmmer, void *arg);
+enum sched_rc sched_h_scan_get_prods_view(struct sched *, int64_t scan_id,
+                                          sched_prod_view_func_t *fn,
+                                          void *arg);
+enum sched_rc sched_h_scan_get_by_id(struct sched *, struct sched_scan *scan,
+                                     int64_t scan_id);
+enum sched_rc sched_h_scan_get_by_job_id(struct sched *,
+                                         struct sched_scan *scan,
+                                         int64_t job_id);
+enum sched_rc sched_h_scan_add_seq(struct sched *, char const *name,
+                                   char const *data);
+enum sched_rc sched_h_scan_get_all(struct sched *, sched_scan_set_func_t fn,
+                                   struct sched_scan *scan, void *arg);
+enum sched_rc sched_h_scan_begin(struct sched *, struct sched_scan *scan,
+                                 struct sched_job *job);
+enum sched_rc sched_h_scan_push_seq(struct sched *, char const *name,
+                                    char const *data);
+enum sched_rc sched_h_scan_push_fasta(struct sched *, FILE *fp);
+enum sched_rc sched_h_scan_push_fasta_fd(struct sched *, int fd);
+enum sched_rc sched_h_scan_commit(struct sched *);
+enum sched_rc sched_h_scan_rollback(struct sched *);
+
+enum sched_rc sched_h_seq_get_by_id(struct sched *, struct sched_seq *seq,
+                                    int64_t id);
+enum sched_rc sched_h_seq_scan_next(struct sched *, struct sched_seq *seq);
+enum sched_rc sched_h_seq_get_all(struct sched *, sched_seq_set_func_t fn,
+                                  struct sched_seq *seq, void *arg);
+enum sched_rc sched_h_seq_dyn_get_by_id(struct sched *,
+                                        struct sched_seq_dyn *seq, int64_t id);
+enum sched_rc sched_h_seq_dyn_scan_next(struct sched *,
+                                        struct sched_seq_dyn *seq);
+enum sched_rc sched_h_seq_dyn_get_all(struct sched *, sched_seq_dyn_func_t *fn,
+                                      struct sched_seq_dyn *seq, void *arg);
+
+enum sched_rc sched_h_unit_split(struct sched *, int64_t job_id,
+                                 int seqs_per_unit, int *n);
+enum sched_rc sched_h_unit_get_by_id(struct sched *, struct sched_unit *unit,
+                                     int64_t id);
+enum sched_rc sched_h_unit_claim_next(struct sched *, struct sched_unit *unit);
+enum sched_rc sched_h_unit_heartbeat(struct sched *, int64_t id, int token);
+enum sched_rc sched_h_unit_reap_expired(struct sched *, int *n);
+enum sched_rc sched_h_unit_get_seqs(struct sched *,
+                                    struct sched_unit const *unit,
+                                    sched_seq_set_func_t fn,
+                                    struct sched_seq *seq, void *arg);
+enum sched_rc sched_h_unit_set_done(struct sched *, int64_t id, int token);
+enum sched_rc sched_h_unit_set_fail(struct sched *, int64_t id, int token,
+                                    char const *msg);
+
+enum sched_rc sched_h_health_check(struct sched *, struct sched_health *health);
+enum sched_rc sched_h_wipe(struct sched *);
+
+#endif
@@ -13,14 +13,38 @@ enum sched_rc sched_job_get_by_id(struct sched_job *, int64_t id);
 enum sched_rc sched_job_get_all(sched_job_set_func_t, struct sched_job *,
                                 void *arg);
 enum sched_rc sched_job_next_pend(struct sched_job *);
+/* Like sched_job_next_pend but blocks until a job is pending or timeout_ms
+ * elapses (negative waits forever), returning SCHED_JOB_NOT_FOUND then. */
+enum sched_rc sched_job_wait_pend(struct sched_job *, int timeout_ms);
+enum sched_rc sched_job_claim_next(struct sched_job *);
+enum sched_rc sched_job_claim_batch(struct sched_job *out, int max, int *n);
 
 enum sched_rc sched_job_set_run(int64_t id);
 enum sched_rc sched_job_set_fail(int64_t id, char const *msg);
 enum sched_rc sched_job_set_done(int64_t id);
 
+/*
+ * The claimed variants take the token of the claim, the retries the job
+ * was claimed with, and return SCHED_JOB_NOT_FOUND unless the job is still
+ * running under that claim: a worker whose lease expired cannot touch a
+ * job that was reaped and claimed again.
+ */
+enum sched_rc sched_job_set_fail_claimed(int64_t id, int token,
+                                         char const *msg);
+enum sched_rc sched_job_set_done_claimed(int64_t id, int token);
+
+/* Renews the lease of a running job under a claim, see sched_options. */
+enum sched_rc sched_job_heartbeat(int64_t id, int token);
+enum sched_rc sched_job_reap_expired(int *n);
+
+enum sched_rc sched_job_state(int64_t id, enum sched_job_state *);
+
 enum sched_rc sched_job_submit(struct sched_job *, void *actual_job);
 
 enum sched_rc sched_job_increment_progress(int64_t id, int progress);
+enum sched_rc sched_job_increment_progress_claimed(int64_t id, int token,
+                                                   int progress);
+enum sched_rc sched_job_flush_progress(void);
 
 enum sched_rc sched_job_remove(int64_t id);
 
@@ -10,6 +10,7 @@ enum sched_limits
     SCHED_MATCH_SIZE = 5 * (1024 * 1024),
     SCHED_MAX_NUM_THREADS = 64,
     SCHED_NUM_SEQS_PER_JOB = 512,
+    SCHED_PAGE_SIZE = 1024,
     SCHED_PROFILE_NAME_SIZE = 64,
     SCHED_PROFILE_TYPEID_SIZE = 16,
     SCHED_SEQ_NAME_SIZE = 256,
@@ -0,0 +1,71 @@
+#ifndef SCHED_OPTIONS_H
+#define SCHED_OPTIONS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+enum sched_synchronous
+{
+    SCHED_SYNCHRONOUS_OFF,
+    SCHED_SYNCHRONOUS_NORMAL,
+    SCHED_SYNCHRONOUS_FULL,
+    SCHED_SYNCHRONOUS_EXTRA,
+};
+
+/*
+ * Connection settings for sched_init_ex and sched_open. Start from
+ * sched_options_init, whose defaults suit many worker processes sharing
+ * one file on a host: WAL, synchronous NORMAL and a 30 s busy timeout.
+ *
+ * Handles from sched_open also keep `readers` read-only connections for
+ * queries. With none, queries share the writer connection.
+ *
+ * With a positive progress_flush_ms, progress increments are merged in
+ * memory and written at most once per interval, on a job state change,
+ * on sched_job_flush_progress and on cleanup. The interval is a lower
+ * bound: once it has passed, the next increment writes them, or the async
+ * writer if it runs. Increments queued on the async writer are not
+ * merged. Job queries from the same process add the unwritten part if
+ * progress_unflushed_reads is set.
+ *
+ * With a positive lease_secs, claiming or running a job leases it for that
+ * long, renewed by sched_job_heartbeat. sched_job_reap_expired puts jobs
+ * with an expired lease back to pend, or fails them after max_retries.
+ * Work units are leased and reaped the same way by their own calls.
+ *
+ * With a positive parse_threads, product files on disk are decoded by that
+ * many threads while the calling thread inserts the rows in file order.
+ *
+ * With a positive io_threads, sched_prodset_add reads the hmmer files of
+ * each batch of products on that many threads besides the calling one.
+ *
+ * Sequences pushed to a streamed scan are held in memory and written in
+ * one transaction once stream_commit_kib worth has been pushed. With a
+ * non-positive value they are all written by sched_scan_commit.
+ *
+ * Sequences and products are inserted bulk_rows to a statement, at most
+ * 256 and fewer if SQLite allows fewer variables. One gives a statement
+ * per row and a non-positive value the maximum.
+ */
+struct sched_options
+{
+    bool wal;
+    enum sched_synchronous synchronous;
+    int64_t mmap_size;
+    int cache_size_kib;
+    int page_size;
+    int busy_timeout_ms;
+    int readers;
+    int progress_flush_ms;
+    bool progress_unflushed_reads;
+    int lease_secs;
+    int max_retries;
+    int parse_threads;
+    int io_threads;
+    int stream_commit_kib;
+    int bulk_rows;
+};
+
+void sched_options_init(struct sched_options *);
+
+#endif
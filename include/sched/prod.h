@@ -5,6 +5,13 @@
 #include <stdint.h>
 #include <stdio.h>
 
+typedef void(sched_prod_set_func_t)(struct sched_prod *, struct sched_hmmer *,
+                                    void *arg);
+typedef void(sched_prod_dyn_func_t)(struct sched_prod_dyn *,
+                                    struct sched_hmmer *, void *arg);
+typedef void(sched_prod_view_func_t)(struct sched_prod_view const *,
+                                     struct sched_hmmer const *, void *arg);
+
 void sched_prod_init(struct sched_prod *, int64_t scan_id);
 enum sched_rc sched_prod_get_by_id(struct sched_prod *, int64_t id);
 enum sched_rc sched_prod_add(struct sched_prod *);
@@ -14,5 +21,13 @@ enum sched_rc sched_prod_get_all(void (*callb)(struct sched_prod *,
                                                struct sched_hmmer *, void *),
                                  struct sched_prod *, struct sched_hmmer *,
                                  void *arg);
+enum sched_rc sched_prod_get_all_view(sched_prod_view_func_t *, void *arg);
+
+void sched_prod_dyn_init(struct sched_prod_dyn *, int64_t scan_id);
+void sched_prod_dyn_cleanup(struct sched_prod_dyn *);
+enum sched_rc sched_prod_dyn_get_by_id(struct sched_prod_dyn *, int64_t id);
+enum sched_rc sched_prod_dyn_get_all(sched_prod_dyn_func_t *,
+                                     struct sched_prod_dyn *,
+                                     struct sched_hmmer *, void *arg);
 
 #endif
@@ -46,8 +46,15 @@ enum sched_rc
     SCHED_FAIL_BEGIN_TRANSACTION,
     SCHED_FAIL_END_TRANSACTION,
     SCHED_FAIL_ROLLBACK_TRANSACTION,
+    SCHED_SCAN_NOT_STREAMING,
+    SCHED_SCAN_ALREADY_STREAMING,
+    SCHED_ASYNC_NOT_RUNNING,
+    SCHED_FAIL_CONNECT,
+    SCHED_INVALID_MESSAGE,
+    SCHED_UNIT_NOT_FOUND,
+    SCHED_DUPLICATE_HMMER,
 };
 
-#define SCHED_LAST_RC SCHED_FAIL_ROLLBACK_TRANSACTION
+#define SCHED_LAST_RC SCHED_DUPLICATE_HMMER
 
 #endif
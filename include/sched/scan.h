@@ -6,6 +6,7 @@
 #include "sched/seq.h"
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 
 struct sched_prod;
 struct sched_seq;
@@ -24,12 +25,32 @@ enum sched_rc sched_scan_get_prods(int64_t job_id,
                                    struct sched_prod *, struct sched_hmmer *,
                                    void *arg);
 
+enum sched_rc sched_scan_get_seqs_dyn(int64_t scan_id, sched_seq_dyn_func_t *,
+                                      struct sched_seq_dyn *, void *arg);
+enum sched_rc sched_scan_get_prods_dyn(int64_t scan_id, sched_prod_dyn_func_t *,
+                                       struct sched_prod_dyn *,
+                                       struct sched_hmmer *, void *arg);
+enum sched_rc sched_scan_get_prods_view(int64_t scan_id,
+                                        sched_prod_view_func_t *, void *arg);
+
 enum sched_rc sched_scan_get_by_id(struct sched_scan *, int64_t scan_id);
 enum sched_rc sched_scan_get_by_job_id(struct sched_scan *, int64_t job_id);
 
-void sched_scan_add_seq(char const *name, char const *data);
+enum sched_rc sched_scan_add_seq(char const *name, char const *data);
 
 enum sched_rc sched_scan_get_all(sched_scan_set_func_t, struct sched_scan *,
                                  void *arg);
 
+/*
+ * Streaming submission: begin, push any number of sequences, then commit.
+ * The job stays on hold and cannot be claimed until the commit. On any
+ * failure the partial scan is removed and the stream is closed.
+ */
+enum sched_rc sched_scan_begin(struct sched_scan *, struct sched_job *);
+enum sched_rc sched_scan_push_seq(char const *name, char const *data);
+enum sched_rc sched_scan_push_fasta(FILE *fp);
+enum sched_rc sched_scan_push_fasta_fd(int fd);
+enum sched_rc sched_scan_commit(void);
+enum sched_rc sched_scan_rollback(void);
+
 #endif
@@ -1,18 +1,23 @@
 #ifndef SCHED_SCHED_H
 #define SCHED_SCHED_H
 
+#include "sched/async.h"
 #include "sched/db.h"
+#include "sched/dispatch.h"
 #include "sched/error.h"
+#include "sched/handle.h"
 #include "sched/hmm.h"
 #include "sched/hmmer.h"
 #include "sched/hmmer_filename.h"
 #include "sched/job.h"
 #include "sched/limits.h"
+#include "sched/options.h"
 #include "sched/prod.h"
 #include "sched/prodset.h"
 #include "sched/rc.h"
 #include "sched/scan.h"
 #include "sched/seq.h"
+#include "sched/unit.h"
 
 struct sched_health
 {
@@ -21,8 +26,11 @@ struct sched_health
 };
 
 enum sched_rc sched_init(char const *filepath);
+enum sched_rc sched_init_ex(char const *filepath, struct sched_options const *);
 enum sched_rc sched_cleanup(void);
 enum sched_rc sched_health_check(struct sched_health *);
 enum sched_rc sched_wipe(void);
 
+void sched_set_page_size(int page_size);
+
 #endif
@@ -5,6 +5,7 @@
 #include <stdint.h>
 
 typedef void(sched_seq_set_func_t)(struct sched_seq *, void *arg);
+typedef void(sched_seq_dyn_func_t)(struct sched_seq_dyn *, void *arg);
 
 void sched_seq_init(struct sched_seq *seq, int64_t seq_id, int64_t scan_id,
                     char const *name, char const *data);
@@ -14,4 +15,11 @@ enum sched_rc sched_seq_scan_next(struct sched_seq *);
 enum sched_rc sched_seq_get_all(sched_seq_set_func_t fn, struct sched_seq *,
                                 void *arg);
 
+void sched_seq_dyn_init(struct sched_seq_dyn *);
+void sched_seq_dyn_cleanup(struct sched_seq_dyn *);
+enum sched_rc sched_seq_dyn_get_by_id(struct sched_seq_dyn *, int64_t id);
+enum sched_rc sched_seq_dyn_scan_next(struct sched_seq_dyn *);
+enum sched_rc sched_seq_dyn_get_all(sched_seq_dyn_func_t *,
+                                    struct sched_seq_dyn *, void *arg);
+
 #endif
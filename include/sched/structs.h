@@ -2,6 +2,7 @@
 #define SCHED_STRUCTS_H
 
 #include "sched/limits.h"
+#include <stddef.h>
 #include <stdint.h>
 
 struct sched_scan
@@ -51,6 +52,57 @@ struct sched_prod
     char match[SCHED_MATCH_SIZE];
 };
 
+/*
+ * Heap-backed product: match grows to fit the row instead of reserving
+ * SCHED_MATCH_SIZE bytes. Release it with sched_prod_dyn_cleanup.
+ */
+struct sched_prod_dyn
+{
+    int64_t id;
+
+    int64_t scan_id;
+    int64_t seq_id;
+
+    char profile_name[SCHED_PROFILE_NAME_SIZE];
+    char abc_name[SCHED_ABC_NAME_SIZE];
+
+    double alt_loglik;
+    double null_loglik;
+    double evalue_log;
+
+    char profile_typeid[SCHED_PROFILE_TYPEID_SIZE];
+    char version[SCHED_VERSION_SIZE];
+
+    int match_len;
+    char *match;
+    size_t match_capacity;
+};
+
+/*
+ * Borrowed view of a product row. Strings point into the database
+ * cursor and are only valid until the callback receiving it returns.
+ */
+struct sched_prod_view
+{
+    int64_t id;
+
+    int64_t scan_id;
+    int64_t seq_id;
+
+    char const *profile_name;
+    char const *abc_name;
+
+    double alt_loglik;
+    double null_loglik;
+    double evalue_log;
+
+    char const *profile_typeid;
+    char const *version;
+
+    int match_len;
+    char const *match;
+};
+
 enum sched_job_type
 {
     SCHED_SCAN,
@@ -62,7 +114,8 @@ enum sched_job_state
     SCHED_PEND,
     SCHED_RUN,
     SCHED_DONE,
-    SCHED_FAIL
+    SCHED_FAIL,
+    SCHED_HOLD
 };
 
 struct sched_job
@@ -77,6 +130,27 @@ struct sched_job
     int64_t submission;
     int64_t exec_started;
     int64_t exec_ended;
+
+    int retries;
+    int64_t lease_expiry;
+};
+
+struct sched_unit
+{
+    int64_t id;
+    int64_t job_id;
+    int64_t scan_id;
+    int64_t seq_min;
+    int64_t seq_max;
+
+    char state[SCHED_JOB_STATE_SIZE];
+    char error[SCHED_JOB_ERROR_SIZE];
+
+    int64_t exec_started;
+    int64_t exec_ended;
+
+    int retries;
+    int64_t lease_expiry;
 };
 
 struct sched_seq
@@ -87,6 +161,40 @@ struct sched_seq
     char data[SCHED_SEQ_SIZE];
 };
 
+/*
+ * Heap-backed sequence: name and data grow to fit the row. Release it
+ * with sched_seq_dyn_cleanup.
+ */
+struct sched_seq_dyn
+{
+    int64_t id;
+    int64_t scan_id;
+
+    int name_len;
+    char *name;
+    size_t name_capacity;
+
+    int data_len;
+    char *data;
+    size_t data_capacity;
+};
+
+/*
+ * Borrowed view of a sequence. Strings are null-terminated and owned by
+ * whoever handed the view out.
+ */
+struct sched_seq_view
+{
+    int64_t id;
+    int64_t scan_id;
+
+    int name_len;
+    char const *name;
+
+    int data_len;
+    char const *data;
+};
+
 struct sched_hmmer
 {
     int64_t id;
@@ -0,0 +1,35 @@
+#ifndef SCHED_UNIT_H
+#define SCHED_UNIT_H
+
+#include "sched/seq.h"
+#include "sched/structs.h"
+#include <stdint.h>
+
+/*
+ * Work units split a pending scan job into contiguous ranges of its
+ * sequence ids so several workers can run it at once. Splitting moves the
+ * job to run; units are then claimed one at a time, and finishing the
+ * last one finishes the job, failed if any of its units failed. The job
+ * progress follows the fraction of finished units.
+ *
+ * Only units of a running job are claimed. Claimed units are leased like
+ * jobs, renewed by sched_unit_heartbeat, and sched_unit_reap_expired puts
+ * expired ones back to pend or fails them after max_retries. Renewing and
+ * finishing a unit take the token of its claim, the retries it was
+ * claimed with, and return SCHED_UNIT_NOT_FOUND once that claim is gone.
+ */
+void sched_unit_init(struct sched_unit *);
+
+enum sched_rc sched_unit_split(int64_t job_id, int seqs_per_unit, int *n);
+enum sched_rc sched_unit_get_by_id(struct sched_unit *, int64_t id);
+enum sched_rc sched_unit_claim_next(struct sched_unit *);
+enum sched_rc sched_unit_heartbeat(int64_t id, int token);
+enum sched_rc sched_unit_reap_expired(int *n);
+enum sched_rc sched_unit_get_seqs(struct sched_unit const *,
+                                  sched_seq_set_func_t, struct sched_seq *,
+                                  void *arg);
+
+enum sched_rc sched_unit_set_done(int64_t id, int token);
+enum sched_rc sched_unit_set_fail(int64_t id, int token, char const *msg);
+
+#endif
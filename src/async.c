@@ -0,0 +1,381 @@
+#include "async.h"
+#include "error.h"
+#include "handle.h"
+#include "job.h"
+#include "progress.h"
+#include "sched/async.h"
+#include "sched/job.h"
+#include "sched/rc.h"
+#include "utc.h"
+#include "xsql.h"
+#include "xstrcpy.h"
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+enum
+{
+    OP_SET_RUN,
+    OP_SET_FAIL,
+    OP_SET_DONE,
+    OP_INC_PROGRESS,
+};
+
+void sched_future_init(struct sched_future *future, sched_async_func_t *callb,
+                       void *arg)
+{
+    atomic_init(&future->done, 0);
+    future->rc = SCHED_OK;
+    future->callb = callb;
+    future->arg = arg;
+    future->h = 0;
+}
+
+bool sched_future_done(struct sched_future *future)
+{
+    return atomic_load_explicit(&future->done, memory_order_acquire);
+}
+
+enum sched_rc sched_future_wait(struct sched_future *future)
+{
+    if (!sched_future_done(future))
+    {
+        struct async *a = &future->h->async;
+        pthread_mutex_lock(&a->lock);
+        while (!sched_future_done(future))
+            pthread_cond_wait(&a->done, &a->lock);
+        pthread_mutex_unlock(&a->lock);
+    }
+    return future->rc;
+}
+
+static void push(struct async *a, struct async_op *op)
+{
+    atomic_store_explicit(&op->next, 0, memory_order_relaxed);
+    struct async_op *prev =
+        atomic_exchange_explicit(&a->head, op, memory_order_acq_rel);
+    atomic_store_explicit(&prev->next, op, memory_order_release);
+}
+
+/*
+ * Returns null when the queue is empty, and also while a producer is
+ * between its exchange and its link; that op is picked up next time.
+ */
+static struct async_op *pop(struct async *a)
+{
+    struct async_op *tail = a->tail;
+    struct async_op *next =
+        atomic_load_explicit(&tail->next, memory_order_acquire);
+
+    if (tail == &a->stub)
+    {
+        if (!next) return 0;
+        a->tail = next;
+        tail = next;
+        next = atomic_load_explicit(&next->next, memory_order_acquire);
+    }
+    if (next)
+    {
+        a->tail = next;
+        return tail;
+    }
+    if (tail != atomic_load_explicit(&a->head, memory_order_acquire)) return 0;
+
+    push(a, &a->stub);
+    next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    if (!next) return 0;
+    a->tail = next;
+    return tail;
+}
+
+static enum sched_rc apply(struct async_op const *op)
+{
+    enum sched_rc rc = SCHED_OK;
+    switch (op->type)
+    {
+    case OP_SET_RUN:
+        return job_set_run(op->id, op->time, job_lease_expiry(op->time));
+    case OP_SET_FAIL:
+        return job_set_error(op->id, op->token, op->msg, op->time);
+    case OP_SET_DONE:
+        return job_set_done(op->id, op->token, op->time);
+    default:
+        /* Not buffered: the future completes once the increment commits. */
+        rc = progress_flush_job(op->id);
+        return rc ? rc : job_inc_progress(op->id, op->token, op->progress);
+    }
+}
+
+static void complete(struct async_op *op, enum sched_rc rc)
+{
+    struct sched_future *future = op->future;
+    if (!future) return;
+    future->rc = rc;
+    if (future->callb) (*future->callb)(rc, future->arg);
+    atomic_store_explicit(&future->done, 1, memory_order_release);
+}
+
+/* Writes everything queued so far in one transaction. */
+static void drain(struct sched *h)
+{
+    struct async *a = &h->async;
+    struct async_op *op = pop(a);
+    if (!op) return;
+
+    struct scope s = scope_write(h);
+    enum sched_rc rc = xsql_begin_transaction() ? EBEGINSTMT : SCHED_OK;
+
+    struct async_op *first = op;
+    struct async_op *last = op;
+    while (op)
+    {
+        op->rc = rc ? rc : apply(op);
+        op->batch = 0;
+        if (op != first) last->batch = op;
+        last = op;
+        op = pop(a);
+    }
+
+    if (!rc && xsql_end_transaction())
+    {
+        rc = EENDSTMT;
+        xsql_rollback_transaction();
+    }
+    scope_end(h, &s);
+
+    while (first)
+    {
+        struct async_op *next = first->batch;
+        complete(first, rc ? rc : first->rc);
+        free(first);
+        first = next;
+    }
+
+    pthread_mutex_lock(&a->lock);
+    pthread_cond_broadcast(&a->done);
+    pthread_mutex_unlock(&a->lock);
+}
+
+/* Progress merged in memory would otherwise wait for the next increment. */
+static void flush_progress(struct sched *h)
+{
+    if (!progress_due(&h->progress, h->options.progress_flush_ms)) return;
+    struct scope s = scope_write(h);
+    progress_flush();
+    scope_end(h, &s);
+}
+
+static void deadline(struct timespec *ts, int ms)
+{
+    clock_gettime(CLOCK_REALTIME, ts);
+    ts->tv_sec += ms / 1000;
+    ts->tv_nsec += (long)(ms % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L)
+    {
+        ts->tv_sec += 1;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+static void *writer_main(void *arg)
+{
+    struct sched *h = arg;
+    struct async *a = &h->async;
+
+    pthread_mutex_lock(&a->lock);
+    while (!a->stop)
+    {
+        struct timespec ts = {0};
+        deadline(&ts, a->interval_ms);
+        while (!a->stop &&
+               pthread_cond_timedwait(&a->wake, &a->lock, &ts) != ETIMEDOUT)
+            ;
+        pthread_mutex_unlock(&a->lock);
+        drain(h);
+        flush_progress(h);
+        pthread_mutex_lock(&a->lock);
+    }
+    pthread_mutex_unlock(&a->lock);
+
+    /* A producer may still be linking its op in. */
+    while (a->tail != &a->stub ||
+           atomic_load_explicit(&a->head, memory_order_acquire) != &a->stub)
+    {
+        drain(h);
+        sched_yield();
+    }
+    return 0;
+}
+
+enum sched_rc sched_async_start(struct sched *h, int commit_interval_ms)
+{
+    struct async *a = &h->async;
+    if (atomic_load(&a->running)) return SCHED_OK;
+
+    atomic_store(&a->stub.next, 0);
+    atomic_store(&a->head, &a->stub);
+    a->tail = &a->stub;
+    atomic_store(&a->producers, 0);
+    a->stop = false;
+    a->interval_ms = commit_interval_ms > 0 ? commit_interval_ms : 10;
+
+    if (pthread_mutex_init(&a->lock, 0)) return error(SCHED_NOT_ENOUGH_MEMORY);
+    if (pthread_cond_init(&a->wake, 0)) goto cleanup_lock;
+    if (pthread_cond_init(&a->done, 0)) goto cleanup_wake;
+    if (pthread_create(&a->thread, 0, writer_main, h)) goto cleanup_done;
+
+    atomic_store(&a->running, true);
+    return SCHED_OK;
+
+cleanup_done:
+    pthread_cond_destroy(&a->done);
+cleanup_wake:
+    pthread_cond_destroy(&a->wake);
+cleanup_lock:
+    pthread_mutex_destroy(&a->lock);
+    return error(SCHED_NOT_ENOUGH_MEMORY);
+}
+
+/* Commits whatever is still queued before the writer thread exits. */
+enum sched_rc sched_async_stop(struct sched *h)
+{
+    struct async *a = &h->async;
+    if (!atomic_load(&a->running)) return error(SCHED_ASYNC_NOT_RUNNING);
+
+    atomic_store(&a->running, false);
+    while (atomic_load(&a->producers))
+        sched_yield();
+
+    pthread_mutex_lock(&a->lock);
+    a->stop = true;
+    pthread_cond_signal(&a->wake);
+    pthread_mutex_unlock(&a->lock);
+    pthread_join(a->thread, 0);
+
+    pthread_cond_destroy(&a->done);
+    pthread_cond_destroy(&a->wake);
+    pthread_mutex_destroy(&a->lock);
+    return SCHED_OK;
+}
+
+void async_close(struct sched *h)
+{
+    if (atomic_load(&h->async.running)) sched_async_stop(h);
+}
+
+/* A future whose update was never queued completes with the error. */
+static enum sched_rc reject(struct sched_future *future, enum sched_rc rc)
+{
+    if (future)
+    {
+        future->rc = rc;
+        atomic_store_explicit(&future->done, 1, memory_order_release);
+    }
+    return rc;
+}
+
+static enum sched_rc enqueue(struct sched *h, struct async_op *op,
+                             struct sched_future *future)
+{
+    if (!op) return reject(future, error(SCHED_NOT_ENOUGH_MEMORY));
+
+    struct async *a = &h->async;
+    atomic_fetch_add(&a->producers, 1);
+    if (!atomic_load(&a->running))
+    {
+        atomic_fetch_sub(&a->producers, 1);
+        free(op);
+        return reject(future, error(SCHED_ASYNC_NOT_RUNNING));
+    }
+
+    /* Armed right before the push: the writer may complete it at once. */
+    op->future = future;
+    if (future)
+    {
+        future->h = h;
+        atomic_store_explicit(&future->done, 0, memory_order_relaxed);
+    }
+    push(a, op);
+    atomic_fetch_sub(&a->producers, 1);
+    return SCHED_OK;
+}
+
+static struct async_op *new_op(int type, int64_t id, int token)
+{
+    struct async_op *op = malloc(sizeof *op);
+    if (!op) return 0;
+    op->type = type;
+    op->id = id;
+    op->token = token;
+    op->time = utc_now();
+    op->progress = 0;
+    op->msg[0] = '\0';
+    return op;
+}
+
+enum sched_rc sched_async_job_set_run(struct sched *h, int64_t id,
+                                      struct sched_future *future)
+{
+    return enqueue(h, new_op(OP_SET_RUN, id, JOB_ANY_CLAIM), future);
+}
+
+static enum sched_rc set_fail(struct sched *h, int64_t id, int token,
+                              char const *msg, struct sched_future *future)
+{
+    struct async_op *op = new_op(OP_SET_FAIL, id, token);
+    if (op) xstrcpy(op->msg, msg, sizeof op->msg);
+    return enqueue(h, op, future);
+}
+
+static enum sched_rc increment_progress(struct sched *h, int64_t id,
+                                        int token, int progress,
+                                        struct sched_future *future)
+{
+    struct async_op *op = new_op(OP_INC_PROGRESS, id, token);
+    if (op) op->progress = progress;
+    return enqueue(h, op, future);
+}
+
+enum sched_rc sched_async_job_set_fail(struct sched *h, int64_t id,
+                                       char const *msg,
+                                       struct sched_future *future)
+{
+    return set_fail(h, id, JOB_ANY_CLAIM, msg, future);
+}
+
+enum sched_rc sched_async_job_set_done(struct sched *h, int64_t id,
+                                       struct sched_future *future)
+{
+    return enqueue(h, new_op(OP_SET_DONE, id, JOB_ANY_CLAIM), future);
+}
+
+enum sched_rc sched_async_job_increment_progress(struct sched *h, int64_t id,
+                                                 int progress,
+                                                 struct sched_future *future)
+{
+    return increment_progress(h, id, JOB_ANY_CLAIM, progress, future);
+}
+
+enum sched_rc sched_async_job_set_fail_claimed(struct sched *h, int64_t id,
+                                               int token, char const *msg,
+                                               struct sched_future *future)
+{
+    return set_fail(h, id, token, msg, future);
+}
+
+enum sched_rc sched_async_job_set_done_claimed(struct sched *h, int64_t id,
+                                               int token,
+                                               struct sched_future *future)
+{
+    return enqueue(h, new_op(OP_SET_DONE, id, token), future);
+}
+
+enum sched_rc
+sched_async_job_increment_progress_claimed(struct sched *h, int64_t id,
+                                           int token, int progress,
+                                           struct sched_future *future)
+{
+    return increment_progress(h, id, token, progress, future);
+}
@@ -0,0 +1,51 @@
+#ifndef ASYNC_H
+#define ASYNC_H
+
+#include "sched/limits.h"
+#include "sched/rc.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+struct sched;
+struct sched_future;
+
+struct async_op
+{
+    struct async_op *_Atomic next;
+    struct async_op *batch;
+    int type;
+    int64_t id;
+    int token;
+    int64_t time;
+    int progress;
+    char msg[SCHED_JOB_ERROR_SIZE];
+    enum sched_rc rc;
+    struct sched_future *future;
+};
+
+/*
+ * Producers push onto an intrusive multi-producer single-consumer queue
+ * (Vyukov's) with one atomic exchange and no lock. Only the writer
+ * thread pops.
+ */
+struct async
+{
+    struct async_op *_Atomic head;
+    struct async_op *tail;
+    struct async_op stub;
+
+    atomic_bool running;
+    atomic_int producers;
+    bool stop;
+    int interval_ms;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+};
+
+void async_close(struct sched *);
+
+#endif
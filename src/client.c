@@ -0,0 +1,520 @@
+#include "error.h"
+#include "sched/sched.h"
+#include "wire.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * The client library: a subset of the public API, with the same
+ * signatures, forwarded to a sched-server that owns the sched file.
+ * Link against sched_client instead of sched to use it. File names are
+ * resolved by the server, so relative ones are taken from its working
+ * directory.
+ */
+
+enum
+{
+    CONNECT_TIMEOUT_MS = 5000,
+    CONNECT_RETRY_MS = 10,
+};
+
+static struct
+{
+    int fd;
+    pthread_mutex_t lock;
+    struct wire out;
+    struct wire in;
+    size_t frame;
+    /* Sequences added since the last scan submission. */
+    struct wire seqs;
+    uint32_t nseqs;
+} client = {.fd = -1, .lock = PTHREAD_MUTEX_INITIALIZER};
+
+static void sleep_ms(int ms)
+{
+    struct timespec ts = {ms / 1000, (long)(ms % 1000) * 1000000L};
+    nanosleep(&ts, 0);
+}
+
+/* Waits a little for a server that is still starting up. */
+static int connect_to(struct sockaddr_un const *addr)
+{
+    for (int waited = 0; waited < CONNECT_TIMEOUT_MS; waited += CONNECT_RETRY_MS)
+    {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+        if (!connect(fd, (struct sockaddr const *)addr, sizeof *addr)) return fd;
+        close(fd);
+        if (errno != ENOENT && errno != ECONNREFUSED) return -1;
+        sleep_ms(CONNECT_RETRY_MS);
+    }
+    return -1;
+}
+
+enum sched_rc sched_init(char const *filepath)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    int n = snprintf(addr.sun_path, sizeof addr.sun_path, "%s.sock", filepath);
+    if (n < 0 || n >= (int)sizeof addr.sun_path)
+        return error(SCHED_TOO_LONG_FILE_PATH);
+
+    pthread_mutex_lock(&client.lock);
+    enum sched_rc rc = SCHED_OK;
+    if (client.fd < 0 && (client.fd = connect_to(&addr)) < 0)
+        rc = error(SCHED_FAIL_CONNECT);
+    pthread_mutex_unlock(&client.lock);
+    return rc;
+}
+
+enum sched_rc sched_cleanup(void)
+{
+    pthread_mutex_lock(&client.lock);
+    enum sched_rc rc = SCHED_OK;
+    if (client.fd >= 0 && close(client.fd)) rc = error(SCHED_FAIL_CLOSE_FILE);
+    client.fd = -1;
+    wire_cleanup(&client.out);
+    wire_cleanup(&client.in);
+    wire_cleanup(&client.seqs);
+    client.nseqs = 0;
+    pthread_mutex_unlock(&client.lock);
+    return rc;
+}
+
+static struct wire *request(enum wire_op op)
+{
+    pthread_mutex_lock(&client.lock);
+    wire_clear(&client.out);
+    client.frame = wire_begin(&client.out);
+    wire_put_u8(&client.out, op);
+    return &client.out;
+}
+
+static enum sched_rc send_all(void)
+{
+    size_t sent = 0;
+    while (sent < client.out.size)
+    {
+        ssize_t n = write(client.fd, client.out.data + sent,
+                          client.out.size - sent);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return error(SCHED_FAIL_WRITE_FILE);
+        sent += (size_t)n;
+    }
+    return SCHED_OK;
+}
+
+static enum sched_rc recv_all(void *data, size_t size)
+{
+    size_t got = 0;
+    while (got < size)
+    {
+        ssize_t n = read(client.fd, (char *)data + got, size - got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return error(SCHED_FAIL_READ_FILE);
+        got += (size_t)n;
+    }
+    return SCHED_OK;
+}
+
+static enum sched_rc recv_frame(void)
+{
+    uint32_t size = 0;
+    enum sched_rc rc = recv_all(&size, sizeof size);
+    if (rc) return rc;
+    if (size > WIRE_MAX_FRAME) return error(SCHED_INVALID_MESSAGE);
+
+    wire_clear(&client.in);
+    if (!wire_reserve(&client.in, size)) return error(SCHED_NOT_ENOUGH_MEMORY);
+    if ((rc = recv_all(client.in.data, size))) return rc;
+    client.in.size = size;
+    return SCHED_OK;
+}
+
+/* Sends the request and waits for its reply, leaving the payload in client.in. */
+static enum sched_rc call(void)
+{
+    if (client.fd < 0) return error(SCHED_FAIL_CONNECT);
+    wire_end(&client.out, client.frame);
+    if (client.out.fail) return error(SCHED_NOT_ENOUGH_MEMORY);
+
+    enum sched_rc rc = send_all();
+    if (!rc) rc = recv_frame();
+    if (rc) return rc;
+
+    unsigned kind = wire_get_u8(&client.in);
+    uint32_t code = wire_get_u32(&client.in);
+    if (client.in.fail || kind != WIRE_REPLY || code > SCHED_LAST_RC)
+        return error(SCHED_INVALID_MESSAGE);
+    if (code == SCHED_OK) wire_get_u32(&client.in);
+    return (enum sched_rc)code;
+}
+
+static enum sched_rc finish(enum sched_rc rc)
+{
+    if (!rc && client.in.fail) rc = error(SCHED_INVALID_MESSAGE);
+    pthread_mutex_unlock(&client.lock);
+    return rc;
+}
+
+void sched_hmm_init(struct sched_hmm *hmm)
+{
+    hmm->id = 0;
+    hmm->xxh3 = 0;
+    hmm->filename[0] = 0;
+    hmm->job_id = 0;
+}
+
+/* The server checks and hashes the file when the job is submitted. */
+enum sched_rc sched_hmm_set_file(struct sched_hmm *hmm, char const *filename)
+{
+    if (strlen(filename) >= sizeof hmm->filename)
+        return error(SCHED_TOO_LONG_FILE_NAME);
+    strcpy(hmm->filename, filename);
+    return SCHED_OK;
+}
+
+void sched_db_init(struct sched_db *db)
+{
+    db->id = 0;
+    db->xxh3 = 0;
+    db->filename[0] = 0;
+    db->hmm_id = 0;
+}
+
+enum sched_rc sched_db_add(struct sched_db *db, char const *filename)
+{
+    wire_put_str(request(WIRE_DB_ADD), filename);
+    enum sched_rc rc = call();
+    if (!rc) wire_get_db(&client.in, db);
+    return finish(rc);
+}
+
+enum sched_rc sched_db_get_by_id(struct sched_db *db, int64_t id)
+{
+    wire_put_i64(request(WIRE_DB_GET_BY_ID), id);
+    enum sched_rc rc = call();
+    if (!rc) wire_get_db(&client.in, db);
+    return finish(rc);
+}
+
+void sched_job_init(struct sched_job *job, enum sched_job_type type)
+{
+    memset(job, 0, sizeof *job);
+    strcpy(job->state, "pend");
+    job->type = (int)type;
+}
+
+enum sched_rc sched_job_get_by_id(struct sched_job *job, int64_t id)
+{
+    wire_put_i64(request(WIRE_JOB_GET_BY_ID), id);
+    enum sched_rc rc = call();
+    if (!rc) wire_get_job(&client.in, job);
+    return finish(rc);
+}
+
+enum sched_rc sched_job_next_pend(struct sched_job *job)
+{
+    request(WIRE_JOB_NEXT_PEND);
+    enum sched_rc rc = call();
+    if (!rc) wire_get_job(&client.in, job);
+    return finish(rc);
+}
+
+enum sched_rc sched_job_claim_next(struct sched_job *job)
+{
+    request(WIRE_JOB_CLAIM_NEXT);
+    enum sched_rc rc = call();
+    if (!rc) wire_get_job(&client.in, job);
+    return finish(rc);
+}
+
+enum sched_rc sched_job_claim_batch(struct sched_job *out, int max, int *n)
+{
+    *n = 0;
+    wire_put_u32(request(WIRE_JOB_CLAIM_BATCH), (uint32_t)(max > 0 ? max : 0));
+    enum sched_rc rc = call();
+    if (!rc)
+    {
+        int size = (int)wire_get_u32(&client.in);
+        if (size > max) size = max;
+        for (int i = 0; i < size; ++i)
+            wire_get_job(&client.in, out + i);
+        *n = size;
+    }
+    return finish(rc);
+}
+
+enum sched_rc sched_job_set_run(int64_t id)
+{
+    wire_put_i64(request(WIRE_JOB_SET_RUN), id);
+    return finish(call());
+}
+
+static enum sched_rc set_fail(int64_t id, int token, char const *msg)
+{
+    struct wire *w = request(WIRE_JOB_SET_FAIL);
+    wire_put_i64(w, id);
+    wire_put_u32(w, (uint32_t)token);
+    wire_put_mem(w, msg, strnlen(msg, SCHED_JOB_ERROR_SIZE - 1));
+    return finish(call());
+}
+
+static enum sched_rc set_done(int64_t id, int token)
+{
+    struct wire *w = request(WIRE_JOB_SET_DONE);
+    wire_put_i64(w, id);
+    wire_put_u32(w, (uint32_t)token);
+    return finish(call());
+}
+
+enum sched_rc sched_job_set_fail(int64_t id, char const *msg)
+{
+    return set_fail(id, WIRE_ANY_CLAIM, msg);
+}
+
+enum sched_rc sched_job_set_done(int64_t id)
+{
+    return set_done(id, WIRE_ANY_CLAIM);
+}
+
+enum sched_rc sched_job_set_fail_claimed(int64_t id, int token,
+                                         char const *msg)
+{
+    return set_fail(id, token, msg);
+}
+
+enum sched_rc sched_job_set_done_claimed(int64_t id, int token)
+{
+    return set_done(id, token);
+}
+
+enum sched_rc sched_job_heartbeat(int64_t id, int token)
+{
+    struct wire *w = request(WIRE_JOB_HEARTBEAT);
+    wire_put_i64(w, id);
+    wire_put_u32(w, (uint32_t)token);
+    return finish(call());
+}
+
+enum sched_rc sched_job_reap_expired(int *n)
+{
+    *n = 0;
+    request(WIRE_JOB_REAP_EXPIRED);
+    enum sched_rc rc = call();
+    if (!rc) *n = (int)wire_get_u32(&client.in);
+    return finish(rc);
+}
+
+enum sched_rc sched_job_state(int64_t id, enum sched_job_state *state)
+{
+    wire_put_i64(request(WIRE_JOB_STATE), id);
+    enum sched_rc rc = call();
+    if (!rc) *state = (enum sched_job_state)wire_get_u32(&client.in);
+    return finish(rc);
+}
+
+static enum sched_rc increment_progress(int64_t id, int token, int progress)
+{
+    struct wire *w = request(WIRE_JOB_INCREMENT_PROGRESS);
+    wire_put_i64(w, id);
+    wire_put_u32(w, (uint32_t)token);
+    wire_put_u32(w, (uint32_t)progress);
+    return finish(call());
+}
+
+enum sched_rc sched_job_increment_progress(int64_t id, int progress)
+{
+    return increment_progress(id, WIRE_ANY_CLAIM, progress);
+}
+
+enum sched_rc sched_job_increment_progress_claimed(int64_t id, int token,
+                                                   int progress)
+{
+    return increment_progress(id, token, progress);
+}
+
+static enum sched_rc submit_hmm(struct sched_job *job, struct sched_hmm *hmm)
+{
+    struct wire *w = request(WIRE_JOB_SUBMIT_HMM);
+    wire_put_job(w, job);
+    wire_put_hmm(w, hmm);
+    enum sched_rc rc = call();
+    if (!rc)
+    {
+        wire_get_job(&client.in, job);
+        wire_get_hmm(&client.in, hmm);
+    }
+    return finish(rc);
+}
+
+static enum sched_rc submit_scan(struct sched_job *job, struct sched_scan *scan)
+{
+    struct wire *w = request(WIRE_JOB_SUBMIT_SCAN);
+    wire_put_job(w, job);
+    wire_put_scan(w, scan);
+    wire_put_u32(w, client.nseqs);
+    if (wire_reserve(w, client.seqs.size))
+    {
+        if (client.seqs.size)
+            memcpy(w->data + w->size, client.seqs.data, client.seqs.size);
+        w->size += client.seqs.size;
+    }
+    wire_clear(&client.seqs);
+    client.nseqs = 0;
+
+    enum sched_rc rc = call();
+    if (!rc)
+    {
+        wire_get_job(&client.in, job);
+        wire_get_scan(&client.in, scan);
+    }
+    return finish(rc);
+}
+
+enum sched_rc sched_job_submit(struct sched_job *job, void *actual_job)
+{
+    if (job->type == SCHED_HMM) return submit_hmm(job, actual_job);
+    return submit_scan(job, actual_job);
+}
+
+void sched_scan_init(struct sched_scan *scan, int64_t db_id, bool multi_hits,
+                     bool hmmer3_compat)
+{
+    scan->id = 0;
+    scan->db_id = db_id;
+    scan->multi_hits = multi_hits;
+    scan->hmmer3_compat = hmmer3_compat;
+    scan->job_id = 0;
+
+    pthread_mutex_lock(&client.lock);
+    wire_clear(&client.seqs);
+    client.nseqs = 0;
+    pthread_mutex_unlock(&client.lock);
+}
+
+/* Sequences are kept here and sent along with the submission. */
+enum sched_rc sched_scan_add_seq(char const *name, char const *data)
+{
+    if (strlen(name) >= SCHED_SEQ_NAME_SIZE || strlen(data) >= SCHED_SEQ_SIZE)
+        return error(SCHED_NOT_ENOUGH_MEMORY);
+
+    pthread_mutex_lock(&client.lock);
+    wire_put_str(&client.seqs, name);
+    wire_put_str(&client.seqs, data);
+    client.nseqs++;
+    enum sched_rc rc = client.seqs.fail ? error(SCHED_NOT_ENOUGH_MEMORY)
+                                        : SCHED_OK;
+    pthread_mutex_unlock(&client.lock);
+    return rc;
+}
+
+enum sched_rc sched_scan_get_by_id(struct sched_scan *scan, int64_t scan_id)
+{
+    wire_put_i64(request(WIRE_SCAN_GET_BY_ID), scan_id);
+    enum sched_rc rc = call();
+    if (!rc) wire_get_scan(&client.in, scan);
+    return finish(rc);
+}
+
+enum sched_rc sched_scan_get_by_job_id(struct sched_scan *scan, int64_t job_id)
+{
+    wire_put_i64(request(WIRE_SCAN_GET_BY_JOB_ID), job_id);
+    enum sched_rc rc = call();
+    if (!rc) wire_get_scan(&client.in, scan);
+    return finish(rc);
+}
+
+/* Copies the rest of the reply, which the next call overwrites. */
+static enum sched_rc take_reply(struct wire *dst)
+{
+    size_t size = client.in.size - client.in.pos;
+    wire_clear(dst);
+    if (!wire_reserve(dst, size)) return error(SCHED_NOT_ENOUGH_MEMORY);
+    memcpy(dst->data, client.in.data + client.in.pos, size);
+    dst->size = size;
+    return SCHED_OK;
+}
+
+/*
+ * The sequences are fetched a page at a time and the callback runs between
+ * pages, so memory stays bounded and the callback is free to call into the
+ * library. Each page is a read of its own.
+ */
+enum sched_rc sched_scan_get_seqs(int64_t scan_id, sched_seq_set_func_t fn,
+                                  struct sched_seq *seq, void *arg)
+{
+    struct wire page = {0};
+    wire_init(&page);
+
+    int64_t last_id = 0;
+    bool more = true;
+    enum sched_rc rc = SCHED_OK;
+    while (!rc && more)
+    {
+        struct wire *w = request(WIRE_SCAN_GET_SEQS);
+        wire_put_i64(w, scan_id);
+        wire_put_i64(w, last_id);
+        wire_put_u32(w, WIRE_SEQ_PAGE);
+        rc = call();
+        if (!rc) rc = take_reply(&page);
+        if ((rc = finish(rc))) break;
+
+        uint32_t n = wire_get_u32(&page);
+        for (uint32_t i = 0; i < n && !page.fail; ++i)
+        {
+            wire_get_seq(&page, seq);
+            if (page.fail) break;
+            last_id = seq->id;
+            (*fn)(seq, arg);
+        }
+        more = wire_get_u8(&page);
+        if (page.fail) rc = error(SCHED_INVALID_MESSAGE);
+    }
+    wire_cleanup(&page);
+    return rc;
+}
+
+void sched_seq_init(struct sched_seq *seq, int64_t seq_id, int64_t scan_id,
+                    char const *name, char const *data)
+{
+    seq->id = seq_id;
+    seq->scan_id = scan_id;
+    snprintf(seq->name, sizeof seq->name, "%s", name);
+    snprintf(seq->data, sizeof seq->data, "%s", data);
+}
+
+enum sched_rc sched_seq_get_by_id(struct sched_seq *seq, int64_t id)
+{
+    wire_put_i64(request(WIRE_SEQ_GET_BY_ID), id);
+    enum sched_rc rc = call();
+    if (!rc) wire_get_seq(&client.in, seq);
+    return finish(rc);
+}
+
+enum sched_rc sched_seq_scan_next(struct sched_seq *seq)
+{
+    struct wire *w = request(WIRE_SEQ_SCAN_NEXT);
+    wire_put_i64(w, seq->id);
+    wire_put_i64(w, seq->scan_id);
+    enum sched_rc rc = call();
+    if (!rc) wire_get_seq(&client.in, seq);
+    return finish(rc);
+}
+
+enum sched_rc sched_prod_add_file(char const *filename)
+{
+    wire_put_str(request(WIRE_PROD_ADD_FILE), filename);
+    return finish(call());
+}
+
+enum sched_rc sched_prodset_add(char const *dir)
+{
+    wire_put_str(request(WIRE_PRODSET_ADD), dir);
+    return finish(call());
+}
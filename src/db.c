@@ -1,5 +1,6 @@
 #include "db.h"
 #include "error.h"
+#include "page.h"
 #include "sched/db.h"
 #include "sched/hmm.h"
 #include "sched/rc.h"
@@ -79,34 +80,37 @@ enum sched_rc sched_db_get_by_hmm_id(struct sched_db *db, int64_t hmm_id)
     return select_db_i64(db, hmm_id, DB_GET_BY_HMM_ID);
 }
 
-static enum sched_rc db_next(struct sched_db *db)
-{
-    struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(DB_GET_NEXT));
-    if (!st) return EFRESH;
-
-    if (xsql_bind_i64(st, 0, db->id)) return EBIND;
-
-    enum sched_rc rc = xsql_step(st);
-    if (rc == SCHED_END) return SCHED_DB_NOT_FOUND;
-    if (rc != SCHED_OK) return ESTEP;
-
-    db->id = xsql_get_i64(st, 0);
-    db->xxh3 = xsql_get_i64(st, 1);
-    if (xsql_cpy_txt(st, 2, XSQL_TXT_OF(*db, filename))) return EGETTXT;
-    db->hmm_id = xsql_get_i64(st, 3);
-
-    return xsql_step(st) != SCHED_END ? ESTEP : SCHED_OK;
-}
-
 enum sched_rc sched_db_get_all(sched_db_set_func_t fn, struct sched_db *db,
                                void *arg)
 {
     enum sched_rc rc = SCHED_OK;
+    int64_t limit = page_limit();
+    int64_t count = 0;
 
     sched_db_init(db);
-    while ((rc = db_next(db)) == SCHED_OK)
-        fn(db, arg);
-    return rc == SCHED_DB_NOT_FOUND ? SCHED_OK : rc;
+    do
+    {
+        struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(DB_GET_PAGE));
+        if (!st) return EFRESH;
+
+        if (xsql_bind_i64(st, 0, db->id)) return EBIND;
+        if (xsql_bind_i64(st, 1, limit)) return EBIND;
+
+        count = 0;
+        while ((rc = xsql_step(st)) == SCHED_OK)
+        {
+            db->id = xsql_get_i64(st, 0);
+            db->xxh3 = xsql_get_i64(st, 1);
+            if (xsql_cpy_txt(st, 2, XSQL_TXT_OF(*db, filename)))
+                return EGETTXT;
+            db->hmm_id = xsql_get_i64(st, 3);
+            fn(db, arg);
+            ++count;
+        }
+        if (rc != SCHED_END) return ESTEP;
+    } while (count == limit);
+
+    return SCHED_OK;
 }
 
 static enum sched_rc init_db(struct sched_db *db, char const *filename)
@@ -0,0 +1,259 @@
+#include "sched/dispatch.h"
+#include "error.h"
+#include "sched/rc.h"
+#include "sched/scan.h"
+#include "sched/seq.h"
+#include <assert.h>
+#include <fcntl.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define DISPATCH_MAGIC 0x6863746170736964ULL /* "dispatch" */
+#define DISPATCH_VERSION 1
+
+/*
+ * Layout of the shared object: the header, then one record per sequence,
+ * then the names and data they point to. The producer writes everything
+ * before anyone attaches, so workers only ever race on the claim counter.
+ */
+struct header
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t reserved;
+    int64_t scan_id;
+    uint64_t size;
+    uint64_t bytes;
+    alignas(64) atomic_ullong next;
+};
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2,
+              "Claims must be lock-free to work across processes");
+
+struct record
+{
+    int64_t id;
+    uint64_t name_offset;
+    uint64_t data_offset;
+    uint32_t name_len;
+    uint32_t data_len;
+};
+
+struct sched_dispatch
+{
+    struct header *header;
+    struct record *records;
+    char const *arena;
+    size_t bytes;
+};
+
+struct fill
+{
+    uint64_t size;
+    uint64_t arena;
+    uint64_t capacity;
+    uint64_t arena_capacity;
+    struct record *records;
+    char *data;
+};
+
+static void measure(struct sched_seq_dyn *seq, void *arg)
+{
+    struct fill *fill = arg;
+    fill->size++;
+    fill->arena += (uint64_t)seq->name_len + (uint64_t)seq->data_len + 2;
+}
+
+static void copy(struct sched_seq_dyn *seq, void *arg)
+{
+    struct fill *fill = arg;
+    uint64_t len = (uint64_t)seq->name_len + (uint64_t)seq->data_len + 2;
+    if (fill->size >= fill->capacity ||
+        fill->arena + len > fill->arena_capacity)
+    {
+        fill->size = fill->capacity + 1;
+        return;
+    }
+    struct record *r = fill->records + fill->size++;
+
+    r->id = seq->id;
+    r->name_len = (uint32_t)seq->name_len;
+    r->data_len = (uint32_t)seq->data_len;
+
+    r->name_offset = fill->arena;
+    memcpy(fill->data + fill->arena, seq->name, r->name_len + 1);
+    fill->arena += r->name_len + 1;
+
+    r->data_offset = fill->arena;
+    memcpy(fill->data + fill->arena, seq->data, r->data_len + 1);
+    fill->arena += r->data_len + 1;
+}
+
+static size_t records_offset(void) { return sizeof(struct header); }
+
+static size_t arena_offset(uint64_t size)
+{
+    return records_offset() + size * sizeof(struct record);
+}
+
+static enum sched_rc wrap(struct sched_dispatch **out, void *addr,
+                          size_t bytes)
+{
+    struct sched_dispatch *d = malloc(sizeof *d);
+    if (!d)
+    {
+        munmap(addr, bytes);
+        return error(SCHED_NOT_ENOUGH_MEMORY);
+    }
+    d->header = addr;
+    d->records = (struct record *)((char *)addr + records_offset());
+    d->arena = (char const *)addr + arena_offset(d->header->size);
+    d->bytes = bytes;
+    *out = d;
+    return SCHED_OK;
+}
+
+static enum sched_rc fill_arena(char *addr, int64_t scan_id,
+                                struct fill const *need,
+                                struct sched_seq_dyn *seq)
+{
+    struct fill fill = {0, 0, need->size, need->arena,
+                        (struct record *)(addr + records_offset()),
+                        addr + arena_offset(need->size)};
+    enum sched_rc rc = sched_scan_get_seqs_dyn(scan_id, copy, seq, &fill);
+    if (rc) return rc;
+    if (fill.size != need->size) return error(SCHED_FAIL_READ_FILE);
+
+    struct header *h = (struct header *)addr;
+    h->version = DISPATCH_VERSION;
+    h->scan_id = scan_id;
+    h->size = need->size;
+    h->bytes = arena_offset(need->size) + need->arena;
+    atomic_init(&h->next, 0);
+    atomic_thread_fence(memory_order_release);
+    h->magic = DISPATCH_MAGIC;
+    return SCHED_OK;
+}
+
+/*
+ * Sequences are measured in a first pass so the object can be sized
+ * exactly, then copied in a second one.
+ */
+enum sched_rc sched_dispatch_create(struct sched_dispatch **out,
+                                    char const *name, int64_t scan_id)
+{
+    struct sched_seq_dyn seq = {0};
+    struct fill need = {0};
+    char *addr = MAP_FAILED;
+
+    sched_seq_dyn_init(&seq);
+    enum sched_rc rc = sched_scan_get_seqs_dyn(scan_id, measure, &seq, &need);
+    if (rc)
+    {
+        sched_seq_dyn_cleanup(&seq);
+        return rc;
+    }
+
+    size_t bytes = arena_offset(need.size) + need.arena;
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0)
+    {
+        sched_seq_dyn_cleanup(&seq);
+        return error(SCHED_FAIL_OPEN_FILE);
+    }
+
+    if (ftruncate(fd, (off_t)bytes))
+        rc = error(SCHED_FAIL_WRITE_FILE);
+    else if ((addr = mmap(0, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                          0)) == MAP_FAILED)
+        rc = error(SCHED_FAIL_WRITE_FILE);
+    else if ((rc = fill_arena(addr, scan_id, &need, &seq)))
+        munmap(addr, bytes);
+    else
+        rc = wrap(out, addr, bytes);
+
+    close(fd);
+    sched_seq_dyn_cleanup(&seq);
+    if (rc) shm_unlink(name);
+    return rc;
+}
+
+enum sched_rc sched_dispatch_open(struct sched_dispatch **out,
+                                  char const *name)
+{
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) return error(SCHED_FAIL_OPEN_FILE);
+
+    struct stat st = {0};
+    void *addr = MAP_FAILED;
+    enum sched_rc rc = SCHED_OK;
+    if (fstat(fd, &st))
+        rc = error(SCHED_FAIL_STAT_FILE);
+    else if ((size_t)st.st_size < sizeof(struct header))
+        rc = error(SCHED_FAIL_PARSE_FILE);
+    else if ((addr = mmap(0, (size_t)st.st_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED, fd, 0)) == MAP_FAILED)
+        rc = error(SCHED_FAIL_READ_FILE);
+    else
+        rc = wrap(out, addr, (size_t)st.st_size);
+    close(fd);
+    if (rc) return rc;
+
+    struct header const *h = (*out)->header;
+    if (h->magic != DISPATCH_MAGIC || h->version != DISPATCH_VERSION ||
+        h->bytes != (uint64_t)st.st_size ||
+        arena_offset(h->size) > (size_t)st.st_size)
+    {
+        sched_dispatch_close(*out);
+        *out = 0;
+        return error(SCHED_FAIL_PARSE_FILE);
+    }
+    return SCHED_OK;
+}
+
+enum sched_rc sched_dispatch_next(struct sched_dispatch *d,
+                                  struct sched_seq_view *view)
+{
+    struct header *h = d->header;
+    if (atomic_load_explicit(&h->next, memory_order_relaxed) >= h->size)
+        return SCHED_END;
+
+    uint64_t i = atomic_fetch_add_explicit(&h->next, 1, memory_order_relaxed);
+    if (i >= h->size) return SCHED_END;
+
+    struct record const *r = d->records + i;
+    view->id = r->id;
+    view->scan_id = h->scan_id;
+    view->name_len = (int)r->name_len;
+    view->name = d->arena + r->name_offset;
+    view->data_len = (int)r->data_len;
+    view->data = d->arena + r->data_offset;
+    return SCHED_OK;
+}
+
+int64_t sched_dispatch_size(struct sched_dispatch const *d)
+{
+    return (int64_t)d->header->size;
+}
+
+int64_t sched_dispatch_scan_id(struct sched_dispatch const *d)
+{
+    return d->header->scan_id;
+}
+
+void sched_dispatch_close(struct sched_dispatch *d)
+{
+    if (!d) return;
+    munmap(d->header, d->bytes);
+    free(d);
+}
+
+enum sched_rc sched_dispatch_unlink(char const *name)
+{
+    return shm_unlink(name) ? error(SCHED_FAIL_REMOVE_FILE) : SCHED_OK;
+}
@@ -44,7 +44,14 @@ static char const strings[][40] = {
     [SCHED_SQLITE3_TOO_OLD] = "sqlite3 is too old",
     [SCHED_FAIL_BEGIN_TRANSACTION] = "failed to begin sql transaction",
     [SCHED_FAIL_END_TRANSACTION] = "failed to end sql transaction",
-    [SCHED_FAIL_ROLLBACK_TRANSACTION] = "failed to rollback sql transaction"};
+    [SCHED_FAIL_ROLLBACK_TRANSACTION] = "failed to rollback sql transaction",
+    [SCHED_SCAN_NOT_STREAMING] = "no scan is being streamed",
+    [SCHED_SCAN_ALREADY_STREAMING] = "a scan is already being streamed",
+    [SCHED_ASYNC_NOT_RUNNING] = "async writer is not running",
+    [SCHED_FAIL_CONNECT] = "failed to connect to sched server",
+    [SCHED_INVALID_MESSAGE] = "invalid sched server message",
+    [SCHED_UNIT_NOT_FOUND] = "unit not found",
+    [SCHED_DUPLICATE_HMMER] = "product has more than one hmmer"};
 
 enum sched_rc __error_print(enum sched_rc rc, char const *ctx, char const *msg)
 {
@@ -0,0 +1,568 @@
+#include "handle.h"
+#include "pool.h"
+#include "sched/handle.h"
+#include "sched/sched.h"
+#include "stmt.h"
+#include "xsql.h"
+#include <stdbool.h>
+
+static struct sched main_handle = {0};
+
+static _Thread_local struct sched *current = 0;
+
+/* Read-only connection leased by this thread from the current handle. */
+static _Thread_local struct conn *reader = 0;
+
+/* Handle whose writer is held by this thread, if any. */
+static _Thread_local struct sched *writing = 0;
+
+struct sched *sched_main(void) { return &main_handle; }
+
+struct sched *sched_self(void) { return current ? current : &main_handle; }
+
+struct sched *sched_use(struct sched *h)
+{
+    struct sched *prev = current;
+    current = h;
+    return prev;
+}
+
+struct conn *sched_conn(void) { return reader ? reader : &sched_self()->writer; }
+
+struct conn *sched_bind(struct conn *conn)
+{
+    struct conn *prev = reader;
+    reader = conn;
+    return prev;
+}
+
+static void lock_writer(struct sched *h, struct scope *s)
+{
+    pthread_mutex_lock(&h->write_lock);
+    s->locked = true;
+    reader = 0;
+    writing = h;
+}
+
+static void step_read_txn(enum stmt idx)
+{
+    struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(idx));
+    if (st) xsql_step(st);
+}
+
+struct scope scope_write(struct sched *h)
+{
+    struct scope s = {sched_use(h), reader, writing, false, false};
+    lock_writer(h, &s);
+    return s;
+}
+
+/*
+ * Queries lease a reader for their whole run, inside one read transaction
+ * so that paged iterations see a single snapshot. A query nested in
+ * another one on the same handle keeps the outer connection, and one made
+ * while holding the writer reads through the writer to see its own
+ * uncommitted changes.
+ */
+struct scope scope_read(struct sched *h)
+{
+    struct scope s = {sched_use(h), reader, writing, false, false};
+    if (s.current == h && (reader || writing == h)) return s;
+
+    if ((reader = pool_acquire(&h->pool)))
+    {
+        s.leased = true;
+        step_read_txn(READ_BEGIN);
+        return s;
+    }
+    lock_writer(h, &s);
+    return s;
+}
+
+void scope_end(struct sched *h, struct scope *s)
+{
+    if (s->leased)
+    {
+        xsql_reset_all();
+        step_read_txn(READ_END);
+        pool_release(&h->pool, reader);
+    }
+    if (s->locked) pthread_mutex_unlock(&h->write_lock);
+    reader = s->reader;
+    writing = s->writing;
+    sched_use(s->current);
+}
+
+#define READ(h, call)                                                          \
+    do                                                                         \
+    {                                                                          \
+        struct scope s = scope_read(h);                                        \
+        enum sched_rc rc = call;                                               \
+        scope_end(h, &s);                                                      \
+        return rc;                                                             \
+    } while (0)
+
+#define WRITE(h, call)                                                         \
+    do                                                                         \
+    {                                                                          \
+        struct scope s = scope_write(h);                                       \
+        enum sched_rc rc = call;                                               \
+        scope_end(h, &s);                                                      \
+        return rc;                                                             \
+    } while (0)
+
+enum sched_rc sched_h_db_get_by_id(struct sched *h, struct sched_db *db,
+                                   int64_t id)
+{
+    READ(h, sched_db_get_by_id(db, id));
+}
+
+enum sched_rc sched_h_db_get_by_xxh3(struct sched *h, struct sched_db *db,
+                                     int64_t xxh3)
+{
+    READ(h, sched_db_get_by_xxh3(db, xxh3));
+}
+
+enum sched_rc sched_h_db_get_by_filename(struct sched *h, struct sched_db *db,
+                                         char const *filename)
+{
+    READ(h, sched_db_get_by_filename(db, filename));
+}
+
+enum sched_rc sched_h_db_get_by_hmm_id(struct sched *h, struct sched_db *db,
+                                       int64_t hmm_id)
+{
+    READ(h, sched_db_get_by_hmm_id(db, hmm_id));
+}
+
+enum sched_rc sched_h_db_get_all(struct sched *h, sched_db_set_func_t fn,
+                                 struct sched_db *db, void *arg)
+{
+    READ(h, sched_db_get_all(fn, db, arg));
+}
+
+enum sched_rc sched_h_db_add(struct sched *h, struct sched_db *db,
+                             char const *filename)
+{
+    WRITE(h, sched_db_add(db, filename));
+}
+
+enum sched_rc sched_h_db_remove(struct sched *h, int64_t id)
+{
+    WRITE(h, sched_db_remove(id));
+}
+
+enum sched_rc sched_h_dispatch_create(struct sched *h,
+                                      struct sched_dispatch **out,
+                                      char const *name, int64_t scan_id)
+{
+    READ(h, sched_dispatch_create(out, name, scan_id));
+}
+
+enum sched_rc sched_h_hmm_get_by_id(struct sched *h, struct sched_hmm *hmm,
+                                    int64_t id)
+{
+    READ(h, sched_hmm_get_by_id(hmm, id));
+}
+
+enum sched_rc sched_h_hmm_get_by_job_id(struct sched *h, struct sched_hmm *hmm,
+                                        int64_t job_id)
+{
+    READ(h, sched_hmm_get_by_job_id(hmm, job_id));
+}
+
+enum sched_rc sched_h_hmm_get_by_xxh3(struct sched *h, struct sched_hmm *hmm,
+                                      int64_t xxh3)
+{
+    READ(h, sched_hmm_get_by_xxh3(hmm, xxh3));
+}
+
+enum sched_rc sched_h_hmm_get_by_filename(struct sched *h,
+                                          struct sched_hmm *hmm,
+                                          char const *filename)
+{
+    READ(h, sched_hmm_get_by_filename(hmm, filename));
+}
+
+enum sched_rc sched_h_hmm_get_all(struct sched *h, sched_hmm_set_func_t fn,
+                                  struct sched_hmm *hmm, void *arg)
+{
+    READ(h, sched_hmm_get_all(fn, hmm, arg));
+}
+
+enum sched_rc sched_h_hmm_remove(struct sched *h, int64_t id)
+{
+    WRITE(h, sched_hmm_remove(id));
+}
+
+enum sched_rc sched_h_hmmer_get_by_id(struct sched *h,
+                                      struct sched_hmmer *hmmer, int64_t id)
+{
+    READ(h, sched_hmmer_get_by_id(hmmer, id));
+}
+
+enum sched_rc sched_h_hmmer_get_by_prod_id(struct sched *h,
+                                           struct sched_hmmer *hmmer,
+                                           int64_t prod_id)
+{
+    READ(h, sched_hmmer_get_by_prod_id(hmmer, prod_id));
+}
+
+enum sched_rc sched_h_hmmer_add(struct sched *h, struct sched_hmmer *hmmer,
+                                int len, unsigned char const *data)
+{
+    WRITE(h, sched_hmmer_add(hmmer, len, data));
+}
+
+enum sched_rc sched_h_hmmer_remove(struct sched *h, int64_t id)
+{
+    WRITE(h, sched_hmmer_remove(id));
+}
+
+enum sched_rc sched_h_job_get_by_id(struct sched *h, struct sched_job *job,
+                                    int64_t id)
+{
+    READ(h, sched_job_get_by_id(job, id));
+}
+
+enum sched_rc sched_h_job_get_all(struct sched *h, sched_job_set_func_t fn,
+                                  struct sched_job *job, void *arg)
+{
+    READ(h, sched_job_get_all(fn, job, arg));
+}
+
+enum sched_rc sched_h_job_next_pend(struct sched *h, struct sched_job *job)
+{
+    READ(h, sched_job_next_pend(job));
+}
+
+/* Each attempt takes its own snapshot; none is held while waiting. */
+enum sched_rc sched_h_job_wait_pend(struct sched *h, struct sched_job *job,
+                                    int timeout_ms)
+{
+    return notify_wait_pend(h, job, timeout_ms, sched_h_job_next_pend);
+}
+
+enum sched_rc sched_h_job_claim_next(struct sched *h, struct sched_job *job)
+{
+    WRITE(h, sched_job_claim_next(job));
+}
+
+enum sched_rc sched_h_job_claim_batch(struct sched *h, struct sched_job *out,
+                                      int max, int *n)
+{
+    WRITE(h, sched_job_claim_batch(out, max, n));
+}
+
+enum sched_rc sched_h_job_set_run(struct sched *h, int64_t id)
+{
+    WRITE(h, sched_job_set_run(id));
+}
+
+enum sched_rc sched_h_job_set_fail(struct sched *h, int64_t id, char const *msg)
+{
+    WRITE(h, sched_job_set_fail(id, msg));
+}
+
+enum sched_rc sched_h_job_set_done(struct sched *h, int64_t id)
+{
+    WRITE(h, sched_job_set_done(id));
+}
+
+enum sched_rc sched_h_job_set_fail_claimed(struct sched *h, int64_t id,
+                                           int token, char const *msg)
+{
+    WRITE(h, sched_job_set_fail_claimed(id, token, msg));
+}
+
+enum sched_rc sched_h_job_set_done_claimed(struct sched *h, int64_t id,
+                                           int token)
+{
+    WRITE(h, sched_job_set_done_claimed(id, token));
+}
+
+enum sched_rc sched_h_job_heartbeat(struct sched *h, int64_t id, int token)
+{
+    WRITE(h, sched_job_heartbeat(id, token));
+}
+
+enum sched_rc sched_h_job_reap_expired(struct sched *h, int *n)
+{
+    WRITE(h, sched_job_reap_expired(n));
+}
+
+enum sched_rc sched_h_job_state(struct sched *h, int64_t id,
+                                enum sched_job_state *state)
+{
+    READ(h, sched_job_state(id, state));
+}
+
+enum sched_rc sched_h_job_submit(struct sched *h, struct sched_job *job,
+                                 void *actual_job)
+{
+    WRITE(h, sched_job_submit(job, actual_job));
+}
+
+enum sched_rc sched_h_job_increment_progress(struct sched *h, int64_t id,
+                                             int progress)
+{
+    WRITE(h, sched_job_increment_progress(id, progress));
+}
+
+enum sched_rc sched_h_job_increment_progress_claimed(struct sched *h,
+                                                     int64_t id, int token,
+                                                     int progress)
+{
+    WRITE(h, sched_job_increment_progress_claimed(id, token, progress));
+}
+
+enum sched_rc sched_h_job_flush_progress(struct sched *h)
+{
+    WRITE(h, sched_job_flush_progress());
+}
+
+enum sched_rc sched_h_job_remove(struct sched *h, int64_t id)
+{
+    WRITE(h, sched_job_remove(id));
+}
+
+enum sched_rc sched_h_prod_get_by_id(struct sched *h, struct sched_prod *prod,
+                                     int64_t id)
+{
+    READ(h, sched_prod_get_by_id(prod, id));
+}
+
+enum sched_rc sched_h_prod_add(struct sched *h, struct sched_prod *prod)
+{
+    WRITE(h, sched_prod_add(prod));
+}
+
+enum sched_rc sched_h_prod_add_file(struct sched *h, char const *filename)
+{
+    WRITE(h, sched_prod_add_file(filename));
+}
+
+enum sched_rc sched_h_prod_get_all(struct sched *h, sched_prod_set_func_t *fn,
+                                   struct sched_prod *prod,
+                                   struct sched_hmmer *hmmer, void *arg)
+{
+    READ(h, sched_prod_get_all(fn, prod, hmmer, arg));
+}
+
+enum sched_rc sched_h_prod_get_all_view(struct sched *h,
+                                        sched_prod_view_func_t *fn, void *arg)
+{
+    READ(h, sched_prod_get_all_view(fn, arg));
+}
+
+enum sched_rc sched_h_prod_dyn_get_by_id(struct sched *h,
+                                         struct sched_prod_dyn *prod,
+                                         int64_t id)
+{
+    READ(h, sched_prod_dyn_get_by_id(prod, id));
+}
+
+enum sched_rc sched_h_prod_dyn_get_all(struct sched *h,
+                                       sched_prod_dyn_func_t *fn,
+                                       struct sched_prod_dyn *prod,
+                                       struct sched_hmmer *hmmer, void *arg)
+{
+    READ(h, sched_prod_dyn_get_all(fn, prod, hmmer, arg));
+}
+
+enum sched_rc sched_h_prodset_add(struct sched *h, char const *dir)
+{
+    WRITE(h, sched_prodset_add(dir));
+}
+
+void sched_h_scan_init(struct sched *h, struct sched_scan *scan, int64_t db_id,
+                       bool multi_hits, bool hmmer3_compat)
+{
+    struct scope s = scope_write(h);
+    sched_scan_init(scan, db_id, multi_hits, hmmer3_compat);
+    scope_end(h, &s);
+}
+
+enum sched_rc sched_h_scan_get_seqs(struct sched *h, int64_t job_id,
+                                    sched_seq_set_func_t fn,
+                                    struct sched_seq *seq, void *arg)
+{
+    READ(h, sched_scan_get_seqs(job_id, fn, seq, arg));
+}
+
+enum sched_rc sched_h_scan_get_prods(struct sched *h, int64_t job_id,
+                                     sched_prod_set_func_t *fn,
+                                     struct sched_prod *prod,
+                                     struct sched_hmmer *hmmer, void *arg)
+{
+    READ(h, sched_scan_get_prods(job_id, fn, prod, hmmer, arg));
+}
+
+enum sched_rc sched_h_scan_get_seqs_dyn(struct sched *h, int64_t scan_id,
+                                        sched_seq_dyn_func_t *fn,
+                                        struct sched_seq_dyn *seq, void *arg)
+{
+    READ(h, sched_scan_get_seqs_dyn(scan_id, fn, seq, arg));
+}
+
+enum sched_rc sched_h_scan_get_prods_dyn(struct sched *h, int64_t scan_id,
+                                         sched_prod_dyn_func_t *fn,
+                                         struct sched_prod_dyn *prod,
+                                         struct sched_hmmer *hmmer, void *arg)
+{
+    READ(h, sched_scan_get_prods_dyn(scan_id, fn, prod, hmmer, arg));
+}
+
+enum sched_rc sched_h_scan_get_prods_view(struct sched *h, int64_t scan_id,
+                                          sched_prod_view_func_t *fn, void *arg)
+{
+    READ(h, sched_scan_get_prods_view(scan_id, fn, arg));
+}
+
+enum sched_rc sched_h_scan_get_by_id(struct sched *h, struct sched_scan *scan,
+                                     int64_t scan_id)
+{
+    READ(h, sched_scan_get_by_id(scan, scan_id));
+}
+
+enum sched_rc sched_h_scan_get_by_job_id(struct sched *h,
+                                         struct sched_scan *scan,
+                                         int64_t job_id)
+{
+    READ(h, sched_scan_get_by_job_id(scan, job_id));
+}
+
+enum sched_rc sched_h_scan_add_seq(struct sched *h, char const *name,
+                                   char const *data)
+{
+    WRITE(h, sched_scan_add_seq(name, data));
+}
+
+enum sched_rc sched_h_scan_get_all(struct sched *h, sched_scan_set_func_t fn,
+                                   struct sched_scan *scan, void *arg)
+{
+    READ(h, sched_scan_get_all(fn, scan, arg));
+}
+
+enum sched_rc sched_h_scan_begin(struct sched *h, struct sched_scan *scan,
+                                 struct sched_job *job)
+{
+    WRITE(h, sched_scan_begin(scan, job));
+}
+
+enum sched_rc sched_h_scan_push_seq(struct sched *h, char const *name,
+                                    char const *data)
+{
+    WRITE(h, sched_scan_push_seq(name, data));
+}
+
+enum sched_rc sched_h_scan_push_fasta(struct sched *h, FILE *fp)
+{
+    WRITE(h, sched_scan_push_fasta(fp));
+}
+
+enum sched_rc sched_h_scan_push_fasta_fd(struct sched *h, int fd)
+{
+    WRITE(h, sched_scan_push_fasta_fd(fd));
+}
+
+enum sched_rc sched_h_scan_commit(struct sched *h)
+{
+    WRITE(h, sched_scan_commit());
+}
+
+enum sched_rc sched_h_scan_rollback(struct sched *h)
+{
+    WRITE(h, sched_scan_rollback());
+}
+
+enum sched_rc sched_h_seq_get_by_id(struct sched *h, struct sched_seq *seq,
+                                    int64_t id)
+{
+    READ(h, sched_seq_get_by_id(seq, id));
+}
+
+enum sched_rc sched_h_seq_scan_next(struct sched *h, struct sched_seq *seq)
+{
+    READ(h, sched_seq_scan_next(seq));
+}
+
+enum sched_rc sched_h_seq_get_all(struct sched *h, sched_seq_set_func_t fn,
+                                  struct sched_seq *seq, void *arg)
+{
+    READ(h, sched_seq_get_all(fn, seq, arg));
+}
+
+enum sched_rc sched_h_seq_dyn_get_by_id(struct sched *h,
+                                        struct sched_seq_dyn *seq, int64_t id)
+{
+    READ(h, sched_seq_dyn_get_by_id(seq, id));
+}
+
+enum sched_rc sched_h_seq_dyn_scan_next(struct sched *h,
+                                        struct sched_seq_dyn *seq)
+{
+    READ(h, sched_seq_dyn_scan_next(seq));
+}
+
+enum sched_rc sched_h_seq_dyn_get_all(struct sched *h, sched_seq_dyn_func_t *fn,
+                                      struct sched_seq_dyn *seq, void *arg)
+{
+    READ(h, sched_seq_dyn_get_all(fn, seq, arg));
+}
+
+enum sched_rc sched_h_unit_split(struct sched *h, int64_t job_id,
+                                 int seqs_per_unit, int *n)
+{
+    WRITE(h, sched_unit_split(job_id, seqs_per_unit, n));
+}
+
+enum sched_rc sched_h_unit_get_by_id(struct sched *h, struct sched_unit *unit,
+                                     int64_t id)
+{
+    READ(h, sched_unit_get_by_id(unit, id));
+}
+
+enum sched_rc sched_h_unit_claim_next(struct sched *h, struct sched_unit *unit)
+{
+    WRITE(h, sched_unit_claim_next(unit));
+}
+
+enum sched_rc sched_h_unit_heartbeat(struct sched *h, int64_t id, int token)
+{
+    WRITE(h, sched_unit_heartbeat(id, token));
+}
+
+enum sched_rc sched_h_unit_reap_expired(struct sched *h, int *n)
+{
+    WRITE(h, sched_unit_reap_expired(n));
+}
+
+enum sched_rc sched_h_unit_get_seqs(struct sched *h,
+                                    struct sched_unit const *unit,
+                                    sched_seq_set_func_t fn,
+                                    struct sched_seq *seq, void *arg)
+{
+    READ(h, sched_unit_get_seqs(unit, fn, seq, arg));
+}
+
+enum sched_rc sched_h_unit_set_done(struct sched *h, int64_t id, int token)
+{
+    WRITE(h, sched_unit_set_done(id, token));
+}
+
+enum sched_rc sched_h_unit_set_fail(struct sched *h, int64_t id, int token,
+                                    char const *msg)
+{
+    WRITE(h, sched_unit_set_fail(id, token, msg));
+}
+
+enum sched_rc sched_h_health_check(struct sched *h, struct sched_health *health)
+{
+    READ(h, sched_health_check(health));
+}
+
+enum sched_rc sched_h_wipe(struct sched *h)
+{
+    WRITE(h, sched_wipe());
+}
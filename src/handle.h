@@ -0,0 +1,58 @@
+#ifndef HANDLE_H
+#define HANDLE_H
+
+#include "async.h"
+#include "notify.h"
+#include "pool.h"
+#include "progress.h"
+#include "scan_stream.h"
+#include "sched/options.h"
+#include "sched/structs.h"
+#include "seq_queue.h"
+#include "stmt.h"
+#include "xsql.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+struct sched
+{
+    struct sched_options options;
+    char filepath[FILENAME_MAX];
+
+    /* Mutations go through the writer, queries through the pool. */
+    struct conn writer;
+    pthread_mutex_t write_lock;
+    struct pool pool;
+    struct async async;
+    struct progress progress;
+    struct notify notify;
+    struct xsql_bulk bulk[BULK_SIZE];
+
+    struct seq_queue queue;
+    struct scan_stream stream;
+
+    /* Rows queued for the next bulk insert, kept for the callbacks. */
+    struct sched_prod_dyn rows[XSQL_BULK_MAX_ROWS];
+};
+
+struct sched *sched_main(void);
+struct sched *sched_self(void);
+struct conn *sched_conn(void);
+struct conn *sched_bind(struct conn *);
+
+/* What a read or write scope replaced, restored by scope_end. */
+struct scope
+{
+    struct sched *current;
+    struct conn *reader;
+    struct sched *writing;
+    bool leased;
+    bool locked;
+};
+
+struct scope scope_read(struct sched *);
+struct scope scope_write(struct sched *);
+void scope_end(struct sched *, struct scope *);
+
+#endif
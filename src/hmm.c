@@ -1,5 +1,6 @@
 #include "hmm.h"
 #include "error.h"
+#include "page.h"
 #include "sched/hmm.h"
 #include "sched/rc.h"
 #include "stmt.h"
@@ -110,34 +111,37 @@ enum sched_rc sched_hmm_get_by_filename(struct sched_hmm *hmm,
     return select_hmm_str(hmm, filename, HMM_GET_BY_FILENAME);
 }
 
-static enum sched_rc hmm_next(struct sched_hmm *hmm)
-{
-    struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(HMM_GET_NEXT));
-    if (!st) return EFRESH;
-
-    if (xsql_bind_i64(st, 0, hmm->id)) return EBIND;
-
-    enum sched_rc rc = xsql_step(st);
-    if (rc == SCHED_END) return SCHED_HMM_NOT_FOUND;
-    if (rc != SCHED_OK) return ESTEP;
-
-    hmm->id = xsql_get_i64(st, 0);
-    hmm->xxh3 = xsql_get_i64(st, 1);
-    if (xsql_cpy_txt(st, 2, XSQL_TXT_OF(*hmm, filename))) return EGETTXT;
-    hmm->job_id = xsql_get_i64(st, 3);
-
-    return xsql_step(st) != SCHED_END ? ESTEP : SCHED_OK;
-}
-
 enum sched_rc sched_hmm_get_all(sched_hmm_set_func_t fn, struct sched_hmm *hmm,
                                 void *arg)
 {
     enum sched_rc rc = SCHED_OK;
+    int64_t limit = page_limit();
+    int64_t count = 0;
 
     sched_hmm_init(hmm);
-    while ((rc = hmm_next(hmm)) == SCHED_OK)
-        fn(hmm, arg);
-    return rc == SCHED_HMM_NOT_FOUND ? SCHED_OK : rc;
+    do
+    {
+        struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(HMM_GET_PAGE));
+        if (!st) return EFRESH;
+
+        if (xsql_bind_i64(st, 0, hmm->id)) return EBIND;
+        if (xsql_bind_i64(st, 1, limit)) return EBIND;
+
+        count = 0;
+        while ((rc = xsql_step(st)) == SCHED_OK)
+        {
+            hmm->id = xsql_get_i64(st, 0);
+            hmm->xxh3 = xsql_get_i64(st, 1);
+            if (xsql_cpy_txt(st, 2, XSQL_TXT_OF(*hmm, filename)))
+                return EGETTXT;
+            hmm->job_id = xsql_get_i64(st, 3);
+            fn(hmm, arg);
+            ++count;
+        }
+        if (rc != SCHED_END) return ESTEP;
+    } while (count == limit);
+
+    return SCHED_OK;
 }
 
 enum sched_rc sched_hmm_remove(int64_t id)
@@ -0,0 +1,195 @@
+#include "hmmer_dir.h"
+#include "error.h"
+#include "sched/hmmer_filename.h"
+#include "sched/structs.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static uint64_t hash_of(int64_t scan_id, int64_t seq_id,
+                        char const *profile_name)
+{
+    uint64_t h = 0xcbf29ce484222325u;
+    for (char const *p = profile_name; *p; ++p)
+        h = (h ^ (unsigned char)*p) * 0x100000001b3u;
+    h ^= (uint64_t)scan_id * 0x9e3779b97f4a7c15u;
+    h ^= (uint64_t)seq_id * 0xc2b2ae3d27d4eb4fu;
+    return h;
+}
+
+static size_t slot_of(struct hmmer_dir const *d, int64_t scan_id,
+                      int64_t seq_id, char const *profile_name)
+{
+    uint64_t h = hash_of(scan_id, seq_id, profile_name) * 0x9e3779b97f4a7c15u;
+    return (size_t)(h >> 32) & (d->capacity - 1);
+}
+
+static bool matches(struct hmmer_dir const *d, struct hmmer_file const *f,
+                    int64_t scan_id, int64_t seq_id, char const *profile_name)
+{
+    return f->scan_id == scan_id && f->seq_id == seq_id &&
+           !strcmp(d->names + f->profile_name, profile_name);
+}
+
+char const *hmmer_dir_find(struct hmmer_dir const *d, int64_t scan_id,
+                           int64_t seq_id, char const *profile_name)
+{
+    if (!d->capacity) return 0;
+    size_t i = slot_of(d, scan_id, seq_id, profile_name);
+    while (d->files[i].scan_id)
+    {
+        struct hmmer_file const *f = d->files + i;
+        if (matches(d, f, scan_id, seq_id, profile_name))
+            return d->names + f->name;
+        i = (i + 1) & (d->capacity - 1);
+    }
+    return 0;
+}
+
+static void insert(struct hmmer_dir *d, struct hmmer_file const *file)
+{
+    char const *profile_name = d->names + file->profile_name;
+    size_t i = slot_of(d, file->scan_id, file->seq_id, profile_name);
+    while (d->files[i].scan_id)
+    {
+        if (matches(d, d->files + i, file->scan_id, file->seq_id, profile_name))
+            return;
+        i = (i + 1) & (d->capacity - 1);
+    }
+    d->files[i] = *file;
+    d->size++;
+}
+
+static enum sched_rc grow(struct hmmer_dir *d)
+{
+    size_t capacity = d->capacity ? d->capacity * 2 : 64;
+    struct hmmer_file *old = d->files;
+    size_t old_capacity = d->capacity;
+
+    if (!(d->files = calloc(capacity, sizeof *d->files)))
+    {
+        d->files = old;
+        return error(SCHED_NOT_ENOUGH_MEMORY);
+    }
+    d->capacity = capacity;
+    d->size = 0;
+    for (size_t i = 0; i < old_capacity; ++i)
+        if (old[i].scan_id) insert(d, old + i);
+    free(old);
+    return SCHED_OK;
+}
+
+static enum sched_rc push_name(struct hmmer_dir *d, char const *str,
+                               uint32_t *offset)
+{
+    size_t len = strlen(str) + 1;
+    if (d->names_size + len > UINT32_MAX) return error(SCHED_NOT_ENOUGH_MEMORY);
+    if (d->names_size + len > d->names_capacity)
+    {
+        size_t capacity = d->names_capacity ? d->names_capacity * 2 : 4096;
+        while (capacity < d->names_size + len)
+            capacity *= 2;
+        char *names = realloc(d->names, capacity);
+        if (!names) return error(SCHED_NOT_ENOUGH_MEMORY);
+        d->names = names;
+        d->names_capacity = capacity;
+    }
+    memcpy(d->names + d->names_size, str, len);
+    *offset = (uint32_t)d->names_size;
+    d->names_size += len;
+    return SCHED_OK;
+}
+
+/* Names that are not hmmer result files are skipped. */
+static enum sched_rc add(struct hmmer_dir *d, char const *name)
+{
+    struct sched_hmmer_filename x = {0};
+    if (sched_hmmer_filename_parse(&x, name)) return SCHED_OK;
+    if (x.scan_id <= 0) return SCHED_OK;
+
+    enum sched_rc rc = SCHED_OK;
+    struct hmmer_file file = {x.scan_id, x.seq_id, 0, 0};
+    if ((rc = push_name(d, name, &file.name))) return rc;
+    if ((rc = push_name(d, x.profile_name, &file.profile_name))) return rc;
+
+    if ((d->size + 1) * 10 > d->capacity * 7 && (rc = grow(d))) return rc;
+    insert(d, &file);
+    return SCHED_OK;
+}
+
+enum sched_rc hmmer_dir_open(struct hmmer_dir *d, char const *path)
+{
+    memset(d, 0, sizeof *d);
+    if (!(d->dir = opendir(path))) return error(SCHED_FAIL_OPEN_FILE);
+
+    enum sched_rc rc = SCHED_OK;
+    struct dirent *entry = 0;
+    errno = 0;
+    while (!rc && (entry = readdir(d->dir)))
+        rc = add(d, entry->d_name);
+    if (!rc && errno) rc = error(SCHED_FAIL_READ_FILE);
+
+    if (rc) hmmer_dir_close(d);
+    return rc;
+}
+
+void hmmer_dir_close(struct hmmer_dir *d)
+{
+    if (d->dir) closedir(d->dir);
+    free(d->files);
+    free(d->names);
+    memset(d, 0, sizeof *d);
+}
+
+static enum sched_rc reserve(struct hmmer_buf *buf, size_t size)
+{
+    if (size <= buf->capacity) return SCHED_OK;
+    unsigned char *data = realloc(buf->data, size);
+    if (!data) return error(SCHED_NOT_ENOUGH_MEMORY);
+    buf->data = data;
+    buf->capacity = size;
+    return SCHED_OK;
+}
+
+static enum sched_rc read_fd(int fd, struct hmmer_buf *buf)
+{
+    struct stat st = {0};
+    if (fstat(fd, &st)) return error(SCHED_FAIL_STAT_FILE);
+
+    enum sched_rc rc = reserve(buf, (size_t)st.st_size);
+    if (rc) return rc;
+
+    buf->size = 0;
+    while (buf->size < (size_t)st.st_size)
+    {
+        ssize_t n = read(fd, buf->data + buf->size,
+                         (size_t)st.st_size - buf->size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return error(SCHED_FAIL_READ_FILE);
+        buf->size += (size_t)n;
+    }
+    return SCHED_OK;
+}
+
+enum sched_rc hmmer_dir_read(struct hmmer_dir const *d, char const *name,
+                             struct hmmer_buf *buf)
+{
+    int fd = openat(dirfd(d->dir), name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return error(SCHED_FAIL_OPEN_FILE);
+
+    enum sched_rc rc = read_fd(fd, buf);
+    if (close(fd) && !rc) rc = error(SCHED_FAIL_CLOSE_FILE);
+    return rc;
+}
+
+void hmmer_buf_del(struct hmmer_buf *buf)
+{
+    free(buf->data);
+    buf->data = 0;
+    buf->size = 0;
+    buf->capacity = 0;
+}
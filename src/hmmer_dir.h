@@ -0,0 +1,49 @@
+#ifndef HMMER_DIR_H
+#define HMMER_DIR_H
+
+#include "sched/rc.h"
+#include <dirent.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct hmmer_file
+{
+    int64_t scan_id;
+    int64_t seq_id;
+    uint32_t name;
+    uint32_t profile_name;
+};
+
+/*
+ * The hmmer result files of a directory, listed once and keyed by
+ * (scan_id, seq_id, profile_name) in an open addressing table. Names live
+ * in one growing arena the entries point into by offset.
+ */
+struct hmmer_dir
+{
+    DIR *dir;
+    size_t size;
+    size_t capacity;
+    struct hmmer_file *files;
+    char *names;
+    size_t names_size;
+    size_t names_capacity;
+};
+
+/* Reused across reads so loading a file costs no allocation. */
+struct hmmer_buf
+{
+    unsigned char *data;
+    size_t size;
+    size_t capacity;
+};
+
+enum sched_rc hmmer_dir_open(struct hmmer_dir *, char const *path);
+void hmmer_dir_close(struct hmmer_dir *);
+char const *hmmer_dir_find(struct hmmer_dir const *, int64_t scan_id,
+                           int64_t seq_id, char const *profile_name);
+enum sched_rc hmmer_dir_read(struct hmmer_dir const *, char const *name,
+                             struct hmmer_buf *);
+void hmmer_buf_del(struct hmmer_buf *);
+
+#endif
@@ -33,22 +33,28 @@ enum sched_rc sched_hmmer_filename_parse(struct sched_hmmer_filename *x,
     size_t n = SCHED_FILENAME_SIZE;
     if (sched_strlcpy(name, filename, n) >= n) return SCHED_FAIL_PARSE_FILENAME;
 
+    /* Profile names may have dots, as in PF00742.20: the last one counts. */
+    char *ext = strrchr(name, '.');
+    if (!ext || strcmp(ext, ".h3r")) return SCHED_FAIL_PARSE_FILENAME;
+    *ext = '\0';
+
     char *ctx = NULL;
     char *tok = strtok_r(name, "_", &ctx);
     if (!tok) return SCHED_FAIL_PARSE_FILENAME;
     if (strcmp(tok, "hmmer")) return SCHED_FAIL_PARSE_FILENAME;
 
     if (!(tok = strtok_r(NULL, "_", &ctx))) return SCHED_FAIL_PARSE_FILENAME;
-    if (!to_int64(tok, &x->scan_id)) return SCHED_FAIL_PARSE_FILENAME;
+    if (!to_int64l((unsigned)strlen(tok), tok, &x->scan_id))
+        return SCHED_FAIL_PARSE_FILENAME;
 
     if (!(tok = strtok_r(NULL, "_", &ctx))) return SCHED_FAIL_PARSE_FILENAME;
-    if (!to_int64(tok, &x->seq_id)) return SCHED_FAIL_PARSE_FILENAME;
-
-    if (!(tok = strtok_r(NULL, ".", &ctx))) return SCHED_FAIL_PARSE_FILENAME;
-    if (!strcpy(x->profile_name, tok)) return SCHED_FAIL_PARSE_FILENAME;
+    if (!to_int64l((unsigned)strlen(tok), tok, &x->seq_id))
+        return SCHED_FAIL_PARSE_FILENAME;
 
     if (!(tok = strtok_r(NULL, "", &ctx))) return SCHED_FAIL_PARSE_FILENAME;
-    if (strcmp(tok, "h3r")) return SCHED_FAIL_PARSE_FILENAME;
+    if (strlen(tok) >= SCHED_PROFILE_NAME_SIZE)
+        return SCHED_FAIL_PARSE_FILENAME;
+    strcpy(x->profile_name, tok);
 
     return 0;
 }
@@ -0,0 +1,78 @@
+#include "idset.h"
+#include "error.h"
+#include <stdlib.h>
+
+void idset_init(struct idset *s)
+{
+    s->size = 0;
+    s->capacity = 0;
+    s->ids = 0;
+}
+
+void idset_del(struct idset *s)
+{
+    free(s->ids);
+    idset_init(s);
+}
+
+static size_t slot_of(struct idset const *s, int64_t id)
+{
+    uint64_t h = (uint64_t)id * 0x9e3779b97f4a7c15u;
+    return (size_t)(h >> 32) & (s->capacity - 1);
+}
+
+bool idset_has(struct idset const *s, int64_t id)
+{
+    if (!s->capacity) return false;
+    size_t i = slot_of(s, id);
+    while (s->ids[i])
+    {
+        if (s->ids[i] == id) return true;
+        i = (i + 1) & (s->capacity - 1);
+    }
+    return false;
+}
+
+static void insert(struct idset *s, int64_t id)
+{
+    size_t i = slot_of(s, id);
+    while (s->ids[i])
+    {
+        if (s->ids[i] == id) return;
+        i = (i + 1) & (s->capacity - 1);
+    }
+    s->ids[i] = id;
+    s->size++;
+}
+
+static enum sched_rc grow(struct idset *s)
+{
+    size_t capacity = s->capacity ? s->capacity * 2 : 64;
+    int64_t *old = s->ids;
+    size_t old_capacity = s->capacity;
+
+    if (!(s->ids = calloc(capacity, sizeof *s->ids)))
+    {
+        s->ids = old;
+        return error(SCHED_NOT_ENOUGH_MEMORY);
+    }
+    s->capacity = capacity;
+    s->size = 0;
+    for (size_t i = 0; i < old_capacity; ++i)
+        if (old[i]) insert(s, old[i]);
+    free(old);
+    return SCHED_OK;
+}
+
+enum sched_rc idset_add(struct idset *s, int64_t id)
+{
+    if (id <= 0) return SCHED_OK;
+    if (idset_has(s, id)) return SCHED_OK;
+    if ((s->size + 1) * 10 > s->capacity * 7)
+    {
+        enum sched_rc rc = grow(s);
+        if (rc) return rc;
+    }
+    insert(s, id);
+    return SCHED_OK;
+}
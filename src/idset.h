@@ -0,0 +1,22 @@
+#ifndef IDSET_H
+#define IDSET_H
+
+#include "sched/rc.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Set of positive ids in an open addressing table; zero marks a free slot. */
+struct idset
+{
+    size_t size;
+    size_t capacity;
+    int64_t *ids;
+};
+
+void idset_init(struct idset *);
+void idset_del(struct idset *);
+bool idset_has(struct idset const *, int64_t id);
+enum sched_rc idset_add(struct idset *, int64_t id);
+
+#endif
@@ -0,0 +1,197 @@
+#include "ingest.h"
+#include "error.h"
+#include "sched/rc.h"
+#include "tok.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHUNK_SIZE (1 << 20)
+
+struct slot
+{
+    char *rows;
+    size_t size;
+    size_t capacity;
+    enum sched_rc rc;
+    bool ready;
+};
+
+struct ingest
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    char const *data;
+    size_t *bounds;
+    size_t nchunks;
+
+    /* Next chunk to parse and number of chunks written. */
+    size_t next;
+    size_t consumed;
+    bool stop;
+
+    size_t nslots;
+    struct slot *slots;
+
+    size_t row_size;
+    ingest_parse_func_t *parse;
+};
+
+static enum sched_rc split(struct ingest *g, size_t size)
+{
+    size_t capacity = size / CHUNK_SIZE + 2;
+    if (!(g->bounds = malloc(capacity * sizeof *g->bounds)))
+        return error(SCHED_NOT_ENOUGH_MEMORY);
+
+    size_t offset = 0;
+    g->bounds[0] = 0;
+    while (offset < size)
+    {
+        size_t next = offset + CHUNK_SIZE;
+        if (next >= size)
+            next = size;
+        else
+        {
+            char const *nl = memchr(g->data + next, '\n', size - next);
+            next = nl ? (size_t)(nl - g->data) + 1 : size;
+        }
+        g->bounds[++g->nchunks] = offset = next;
+    }
+    return SCHED_OK;
+}
+
+static enum sched_rc grow(struct slot *s, size_t row_size)
+{
+    size_t capacity = s->capacity ? s->capacity * 2 : 1024;
+    char *rows = realloc(s->rows, capacity * row_size);
+    if (!rows) return error(SCHED_NOT_ENOUGH_MEMORY);
+    s->rows = rows;
+    s->capacity = capacity;
+    return SCHED_OK;
+}
+
+static void parse_chunk(struct ingest *g, size_t i, struct slot *s)
+{
+    struct tok tok = {0};
+    tok_open_mem(&tok, g->data + g->bounds[i],
+                 g->bounds[i + 1] - g->bounds[i]);
+
+    s->size = 0;
+    s->rc = SCHED_OK;
+    for (;;)
+    {
+        if (s->size == s->capacity && (s->rc = grow(s, g->row_size))) break;
+        enum sched_rc rc = (*g->parse)(&tok, s->rows + s->size * g->row_size);
+        if (rc == SCHED_END) break;
+        if ((s->rc = rc)) break;
+        s->size++;
+    }
+    tok_close(&tok);
+}
+
+static void *parser(void *arg)
+{
+    struct ingest *g = arg;
+
+    pthread_mutex_lock(&g->lock);
+    while (!g->stop && g->next < g->nchunks)
+    {
+        /* Never run further ahead of the writer than there are slots. */
+        if (g->next >= g->consumed + g->nslots)
+        {
+            pthread_cond_wait(&g->cond, &g->lock);
+            continue;
+        }
+        size_t i = g->next++;
+        struct slot *s = g->slots + i % g->nslots;
+        pthread_mutex_unlock(&g->lock);
+
+        parse_chunk(g, i, s);
+
+        pthread_mutex_lock(&g->lock);
+        s->ready = true;
+        pthread_cond_broadcast(&g->cond);
+    }
+    pthread_mutex_unlock(&g->lock);
+    return 0;
+}
+
+static enum sched_rc write_all(struct ingest *g, ingest_write_func_t *write,
+                               void *arg)
+{
+    enum sched_rc rc = SCHED_OK;
+    for (size_t i = 0; i < g->nchunks && !rc; ++i)
+    {
+        struct slot *s = g->slots + i % g->nslots;
+
+        pthread_mutex_lock(&g->lock);
+        while (!s->ready)
+            pthread_cond_wait(&g->cond, &g->lock);
+        pthread_mutex_unlock(&g->lock);
+
+        rc = s->rc;
+        for (size_t j = 0; j < s->size && !rc; ++j)
+            rc = (*write)(s->rows + j * g->row_size, arg);
+
+        pthread_mutex_lock(&g->lock);
+        s->ready = false;
+        g->consumed++;
+        pthread_cond_broadcast(&g->cond);
+        pthread_mutex_unlock(&g->lock);
+    }
+    return rc;
+}
+
+enum sched_rc ingest_parallel(char const *data, size_t size, int threads,
+                              size_t row_size, ingest_parse_func_t *parse,
+                              ingest_write_func_t *write, void *arg)
+{
+    struct ingest g = {0};
+    g.data = data;
+    g.row_size = row_size;
+    g.parse = parse;
+    g.nslots = 2 * (size_t)threads;
+
+    pthread_t *tids = calloc((size_t)threads, sizeof *tids);
+    g.slots = calloc(g.nslots, sizeof *g.slots);
+    enum sched_rc rc = SCHED_OK;
+    if (!tids || !g.slots)
+    {
+        rc = error(SCHED_NOT_ENOUGH_MEMORY);
+        goto cleanup;
+    }
+    if ((rc = split(&g, size))) goto cleanup;
+
+    pthread_mutex_init(&g.lock, 0);
+    pthread_cond_init(&g.cond, 0);
+
+    int started = 0;
+    for (; started < threads; ++started)
+    {
+        if (pthread_create(tids + started, 0, parser, &g)) break;
+    }
+    if (started == 0)
+        rc = error(SCHED_NOT_ENOUGH_MEMORY);
+    else
+        rc = write_all(&g, write, arg);
+
+    pthread_mutex_lock(&g.lock);
+    g.stop = true;
+    pthread_cond_broadcast(&g.cond);
+    pthread_mutex_unlock(&g.lock);
+    for (int i = 0; i < started; ++i)
+        pthread_join(tids[i], 0);
+
+    pthread_cond_destroy(&g.cond);
+    pthread_mutex_destroy(&g.lock);
+
+cleanup:
+    for (size_t i = 0; g.slots && i < g.nslots; ++i)
+        free(g.slots[i].rows);
+    free(g.slots);
+    free(g.bounds);
+    free(tids);
+    return rc;
+}
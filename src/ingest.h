@@ -0,0 +1,21 @@
+#ifndef INGEST_H
+#define INGEST_H
+
+#include <stddef.h>
+
+struct tok;
+
+/* Decodes the next row, returning SCHED_END when none is left. */
+typedef enum sched_rc(ingest_parse_func_t)(struct tok *, void *row);
+typedef enum sched_rc(ingest_write_func_t)(void const *row, void *arg);
+
+/*
+ * Splits data at newlines into chunks that `threads` parser threads decode
+ * into rows, while the calling thread writes them in file order. Rows may
+ * point into data.
+ */
+enum sched_rc ingest_parallel(char const *data, size_t size, int threads,
+                              size_t row_size, ingest_parse_func_t *parse,
+                              ingest_write_func_t *write, void *arg);
+
+#endif
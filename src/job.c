@@ -1,7 +1,11 @@
 #include "job.h"
 #include "bug.h"
 #include "error.h"
+#include "handle.h"
 #include "hmm.h"
+#include "notify.h"
+#include "page.h"
+#include "progress.h"
 #include "scan.h"
 #include "sched/job.h"
 #include "sched/rc.h"
@@ -17,6 +21,21 @@ typedef enum sched_rc (*submit_job_func_t)(void *actual_job, int64_t job_id);
 static submit_job_func_t submit_job_func[] = {
     [SCHED_SCAN] = scan_submit, [SCHED_HMM] = hmm_submit};
 
+static char const job_state_name[][SCHED_JOB_STATE_SIZE] = {
+    [SCHED_PEND] = "pend",
+    [SCHED_RUN] = "run",
+    [SCHED_DONE] = "done",
+    [SCHED_FAIL] = "fail",
+    [SCHED_HOLD] = "hold"};
+
+static enum sched_job_state resolve_job_state(char const *state);
+
+char const *job_state_string(int state)
+{
+    if (state < 0 || state >= (int)ARRAY_SIZE(job_state_name)) BUG();
+    return job_state_name[state];
+}
+
 static void job_init(struct sched_job *job)
 {
     job->id = 0;
@@ -29,6 +48,9 @@ static void job_init(struct sched_job *job)
     job->submission = 0;
     job->exec_started = 0;
     job->exec_ended = 0;
+
+    job->retries = 0;
+    job->lease_expiry = 0;
 }
 
 void sched_job_init(struct sched_job *job, enum sched_job_type type)
@@ -42,14 +64,19 @@ static enum sched_rc set_job(struct sched_job *job, struct sqlite3_stmt *st)
     job->id = xsql_get_i64(st, 0);
     job->type = xsql_get_int(st, 1);
 
-    if (xsql_cpy_txt(st, 2, XSQL_TXT_OF(*job, state))) EGETTXT;
+    XSTRCPY(job, state, job_state_string(xsql_get_int(st, 2)));
     job->progress = xsql_get_int(st, 3);
+    if (sched_self()->options.progress_unflushed_reads)
+        job->progress = progress_merge(job->id, job->progress);
     if (xsql_cpy_txt(st, 4, XSQL_TXT_OF(*job, error))) EGETTXT;
 
     job->submission = xsql_get_i64(st, 5);
     job->exec_started = xsql_get_i64(st, 6);
     job->exec_ended = xsql_get_i64(st, 7);
 
+    job->retries = xsql_get_int(st, 8);
+    job->lease_expiry = xsql_get_i64(st, 9);
+
     return SCHED_OK;
 }
 
@@ -69,31 +96,33 @@ enum sched_rc sched_job_get_by_id(struct sched_job *job, int64_t id)
     return xsql_step(st) != SCHED_END ? ESTEP : SCHED_OK;
 }
 
-static enum sched_rc job_next(struct sched_job *job)
-{
-    struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(JOB_GET_NEXT));
-    if (!st) return EFRESH;
-
-    if (xsql_bind_i64(st, 0, job->id)) return EBIND;
-
-    enum sched_rc rc = xsql_step(st);
-    if (rc == SCHED_END) return SCHED_JOB_NOT_FOUND;
-    if (rc != SCHED_OK) return ESTEP;
-
-    if ((rc = set_job(job, st))) return rc;
-
-    return xsql_step(st) != SCHED_END ? ESTEP : SCHED_OK;
-}
-
 enum sched_rc sched_job_get_all(sched_job_set_func_t fn, struct sched_job *job,
                                 void *arg)
 {
     enum sched_rc rc = SCHED_OK;
+    int64_t limit = page_limit();
+    int64_t count = 0;
 
     job_init(job);
-    while ((rc = job_next(job)) == SCHED_OK)
-        fn(job, arg);
-    return rc == SCHED_JOB_NOT_FOUND ? SCHED_OK : rc;
+    do
+    {
+        struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(JOB_GET_PAGE));
+        if (!st) return EFRESH;
+
+        if (xsql_bind_i64(st, 0, job->id)) return EBIND;
+        if (xsql_bind_i64(st, 1, limit)) return EBIND;
+
+        count = 0;
+        while ((rc = xsql_step(st)) == SCHED_OK)
+        {
+            if ((rc = set_job(job, st))) return rc;
+            fn(job, arg);
+            ++count;
+        }
+        if (rc != SCHED_END) return ESTEP;
+    } while (count == limit);
+
+    return SCHED_OK;
 }
 
 static enum sched_rc next_pend_job_id(int64_t *id)
@@ -118,18 +147,134 @@ enum sched_rc sched_job_next_pend(struct sched_job *job)
     return sched_job_get_by_id(job, job->id);
 }
 
+static enum sched_rc next_pend(struct sched *h, struct sched_job *job)
+{
+    (void)h;
+    return sched_job_next_pend(job);
+}
+
+enum sched_rc sched_job_wait_pend(struct sched_job *job, int timeout_ms)
+{
+    return notify_wait_pend(sched_self(), job, timeout_ms, next_pend);
+}
+
+enum sched_rc sched_job_claim_next(struct sched_job *job)
+{
+    struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(JOB_CLAIM_NEXT));
+    if (!st) return EFRESH;
+
+    int64_t now = utc_now();
+    if (xsql_bind_i64(st, 0, now)) return EBIND;
+    if (xsql_bind_i64(st, 1, job_lease_expiry(now))) return EBIND;
+
+    enum sched_rc rc = xsql_step(st);
+    if (rc == SCHED_END) return SCHED_JOB_NOT_FOUND;
+    if (rc != SCHED_OK) return ESTEP;
+
+    if ((rc = set_job(job, st))) return rc;
+
+    return xsql_step(st) != SCHED_END ? ESTEP : SCHED_OK;
+}
+
+static int cmp_job_id(void const *a, void const *b)
+{
+    int64_t x = ((struct sched_job const *)a)->id;
+    int64_t y = ((struct sched_job const *)b)->id;
+    return (x > y) - (x < y);
+}
+
+enum sched_rc sched_job_claim_batch(struct sched_job *out, int max, int *n)
+{
+    *n = 0;
+    if (max <= 0) return SCHED_JOB_NOT_FOUND;
+
+    struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(JOB_CLAIM_BATCH));
+    if (!st) return EFRESH;
+
+    int64_t now = utc_now();
+    if (xsql_bind_i64(st, 0, now)) return EBIND;
+    if (xsql_bind_i64(st, 1, job_lease_expiry(now))) return EBIND;
+    if (xsql_bind_i64(st, 2, max)) return EBIND;
+
+    enum sched_rc rc = SCHED_OK;
+    while ((rc = xsql_step(st)) == SCHED_OK)
+    {
+        if (*n == max) return ESTEP;
+        if ((rc = set_job(out + *n, st))) return rc;
+        *n += 1;
+    }
+    if (rc != SCHED_END) return ESTEP;
+
+    /* RETURNING does not guarantee any particular row order. */
+    qsort(out, (size_t)*n, sizeof(*out), cmp_job_id);
+    return *n == 0 ? SCHED_JOB_NOT_FOUND : SCHED_OK;
+}
+
 enum sched_rc sched_job_set_run(int64_t id)
 {
-    return job_set_run(id, utc_now());
+    int64_t now = utc_now();
+    return job_set_run(id, now, job_lease_expiry(now));
 }
 
 enum sched_rc sched_job_set_fail(int64_t id, char const *msg)
 {
-    return job_set_error(id, msg, utc_now());
+    return job_set_error(id, JOB_ANY_CLAIM, msg, utc_now());
 }
 enum sched_rc sched_job_set_done(int64_t id)
 {
-    return job_set_done(id, utc_now());
+    return job_set_done(id, JOB_ANY_CLAIM, utc_now());
+}
+
+enum sched_rc sched_job_set_fail_claimed(int64_t id, int token,
+                                         char const *msg)
+{
+    return job_set_error(id, token, msg, utc_now());
+}
+
+enum sched_rc sched_job_set_done_claimed(int64_t id, int token)
+{
+    return job_set_done(id, token, utc_now());
+}
+
+int64_t job_lease_expiry(int64_t now)
+{
+    int secs = sched_self()->options.lease_secs;
+    return secs > 0 ? now + secs : 0;
+}
+
+enum sched_rc sched_job_heartbeat(int64_t id, int token)
+{
+    struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(JOB_HEARTBEAT));
+    if (!st) return EFRESH;
+
+    if (xsql_bind_i64(st, 0, job_lease_expiry(utc_now()))) return EBIND;
+    if (xsql_bind_i64(st, 1, id)) return EBIND;
+    if (xsql_bind_i64(st, 2, token)) return EBIND;
+
+    if (xsql_step(st) != SCHED_END) return ESTEP;
+    return xsql_changes() == 0 ? SCHED_JOB_NOT_FOUND : SCHED_OK;
+}
+
+enum sched_rc sched_job_reap_expired(int *n)
+{
+    *n = 0;
+    struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(JOB_REAP_EXPIRED));
+    if (!st) return EFRESH;
+
+    if (xsql_bind_i64(st, 0, utc_now())) return EBIND;
+    if (xsql_bind_i64(st, 1, sched_self()->options.max_retries)) return EBIND;
+
+    enum sched_rc rc = SCHED_OK;
+    bool requeued = false;
+    while ((rc = xsql_step(st)) == SCHED_OK)
+    {
+        if (xsql_get_int(st, 0) == SCHED_PEND) requeued = true;
+        *n += 1;
+    }
+    if (rc != SCHED_END) return ESTEP;
+
+    if (requeued) notify_post();
+    return SCHED_OK;
 }
 
 static enum sched_rc begin_submission(void)
@@ -151,7 +296,7 @@ static enum sched_rc submit_job(struct sched_job *job)
 
     if (xsql_bind_i64(st, 0, job->type)) return EBIND;
 
-    if (xsql_bind_str(st, 1, job->state)) return EBIND;
+    if (xsql_bind_i64(st, 1, resolve_job_state(job->state))) return EBIND;
     if (xsql_bind_i64(st, 2, job->progress)) return EBIND;
     if (xsql_bind_str(st, 3, job->error)) return EBIND;
 
@@ -174,25 +319,77 @@ enum sched_rc sched_job_submit(struct sched_job *job, void *actual_job)
     if ((rc = submit_job(job))) goto cleanup;
     if ((rc = submit_job_func[job->type](actual_job, job->id))) goto cleanup;
 
-    return end_submission();
+    if ((rc = end_submission())) return rc;
+    notify_post();
+    return SCHED_OK;
 
 cleanup:
     rollback_submission();
     return rc;
 }
 
-enum sched_rc sched_job_increment_progress(int64_t id, int progress)
+/* Updates under a claim find nothing once the job was reaped or finished. */
+static enum sched_rc claimed(int token)
+{
+    if (token != JOB_ANY_CLAIM && xsql_changes() == 0)
+        return SCHED_JOB_NOT_FOUND;
+    return SCHED_OK;
+}
+
+enum sched_rc job_inc_progress(int64_t id, int token, int64_t delta)
 {
     struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(JOB_INC_PROGRESS));
     if (!st) return EFRESH;
 
-    if (xsql_bind_i64(st, 0, progress)) return EBIND;
+    if (xsql_bind_i64(st, 0, delta)) return EBIND;
     if (xsql_bind_i64(st, 1, id)) return EBIND;
+    if (xsql_bind_i64(st, 2, token)) return EBIND;
 
     if (xsql_step(st) != SCHED_END) return ESTEP;
-    return SCHED_OK;
+    return claimed(token);
 }
 
+static enum sched_rc check_claim(int64_t id, int token)
+{
+    struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(JOB_CHECK_CLAIM));
+    if (!st) return EFRESH;
+
+    if (xsql_bind_i64(st, 0, id)) return EBIND;
+    if (xsql_bind_i64(st, 1, token)) return EBIND;
+
+    enum sched_rc rc = xsql_step(st);
+    if (rc == SCHED_END) return SCHED_JOB_NOT_FOUND;
+    if (rc != SCHED_OK) return ESTEP;
+
+    return xsql_step(st) != SCHED_END ? ESTEP : SCHED_OK;
+}
+
+static enum sched_rc increment_progress(int64_t id, int token, int progress)
+{
+    if (sched_self()->options.progress_flush_ms > 0)
+        return progress_add(id, token, progress);
+    return job_inc_progress(id, token, progress);
+}
+
+enum sched_rc sched_job_increment_progress(int64_t id, int progress)
+{
+    return increment_progress(id, JOB_ANY_CLAIM, progress);
+}
+
+enum sched_rc sched_job_increment_progress_claimed(int64_t id, int token,
+                                                   int progress)
+{
+    /* A buffered increment is only accepted while the claim holds. */
+    if (sched_self()->options.progress_flush_ms > 0)
+    {
+        enum sched_rc rc = check_claim(id, token);
+        if (rc) return rc;
+    }
+    return increment_progress(id, token, progress);
+}
+
+enum sched_rc sched_job_flush_progress(void) { return progress_flush(); }
+
 enum sched_rc sched_job_remove(int64_t id)
 {
     struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(JOB_DELETE_BY_ID));
@@ -202,42 +399,72 @@ enum sched_rc sched_job_remove(int64_t id)
 
     enum sched_rc rc = xsql_step(st);
     if (rc != SCHED_END) return ESTEP;
+    progress_drop(id);
     return xsql_changes() == 0 ? SCHED_JOB_NOT_FOUND : SCHED_OK;
 }
 
-enum sched_rc job_set_run(int64_t id, int64_t exec_started)
+enum sched_rc job_release(int64_t id)
 {
+    struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(JOB_RELEASE));
+    if (!st) return EFRESH;
+
+    if (xsql_bind_i64(st, 0, id)) return EBIND;
+
+    if (xsql_step(st) != SCHED_END) return ESTEP;
+    if (xsql_changes() == 0) return SCHED_JOB_NOT_FOUND;
+    notify_post();
+    return SCHED_OK;
+}
+
+enum sched_rc job_set_run(int64_t id, int64_t exec_started,
+                          int64_t lease_expiry)
+{
+    enum sched_rc rc = progress_flush_job(id);
+    if (rc) return rc;
+
     struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(JOB_SET_RUN));
     if (!st) return EFRESH;
 
     if (xsql_bind_i64(st, 0, exec_started)) return EBIND;
-    if (xsql_bind_i64(st, 1, id)) return EBIND;
+    if (xsql_bind_i64(st, 1, lease_expiry)) return EBIND;
+    if (xsql_bind_i64(st, 2, id)) return EBIND;
 
     if (xsql_step(st) != SCHED_END) return ESTEP;
     return SCHED_OK;
 }
 
-enum sched_rc job_set_error(int64_t id, char const *error, int64_t exec_ended)
+enum sched_rc job_set_error(int64_t id, int token, char const *error,
+                            int64_t exec_ended)
 {
+    enum sched_rc rc = progress_flush_job(id);
+    if (rc) return rc;
+
     struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(JOB_SET_ERROR));
     if (!st) return EFRESH;
 
     if (xsql_bind_str(st, 0, error)) return EBIND;
     if (xsql_bind_i64(st, 1, exec_ended)) return EBIND;
     if (xsql_bind_i64(st, 2, id)) return EBIND;
+    if (xsql_bind_i64(st, 3, token)) return EBIND;
 
-    return xsql_step(st) != SCHED_END ? ESTEP : SCHED_OK;
+    if (xsql_step(st) != SCHED_END) return ESTEP;
+    return claimed(token);
 }
 
-enum sched_rc job_set_done(int64_t id, int64_t exec_ended)
+enum sched_rc job_set_done(int64_t id, int token, int64_t exec_ended)
 {
+    enum sched_rc rc = progress_flush_job(id);
+    if (rc) return rc;
+
     struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(JOB_SET_DONE));
     if (!st) return EFRESH;
 
     if (xsql_bind_i64(st, 0, exec_ended)) return EBIND;
     if (xsql_bind_i64(st, 1, id)) return EBIND;
+    if (xsql_bind_i64(st, 2, token)) return EBIND;
 
-    return xsql_step(st) != SCHED_END ? ESTEP : SCHED_OK;
+    if (xsql_step(st) != SCHED_END) return ESTEP;
+    return claimed(token);
 }
 
 enum sched_rc job_wipe(void)
@@ -246,7 +473,9 @@ enum sched_rc job_wipe(void)
     if (!st) return EFRESH;
 
     enum sched_rc rc = xsql_step(st);
-    return rc == SCHED_END ? SCHED_OK : ESTEP;
+    if (rc != SCHED_END) return ESTEP;
+    progress_clear();
+    return SCHED_OK;
 }
 
 static enum sched_job_state resolve_job_state(char const *state)
@@ -259,6 +488,8 @@ static enum sched_job_state resolve_job_state(char const *state)
         return SCHED_DONE;
     else if (strcmp("fail", state) == 0)
         return SCHED_FAIL;
+    else if (strcmp("hold", state) == 0)
+        return SCHED_HOLD;
 
     BUG();
 }
@@ -274,11 +505,9 @@ enum sched_rc sched_job_state(int64_t id, enum sched_job_state *state)
     if (rc == SCHED_END) return SCHED_JOB_NOT_FOUND;
     if (rc != SCHED_OK) return ESTEP;
 
-    char job_state[SCHED_JOB_STATE_SIZE] = {0};
-    rc =
-        xsql_cpy_txt(st, 0, (struct xsql_txt){SCHED_JOB_STATE_SIZE, job_state});
-    if (rc) EGETTXT;
-    *state = resolve_job_state(job_state);
+    int value = xsql_get_int(st, 0);
+    if (value < 0 || value >= (int)ARRAY_SIZE(job_state_name)) BUG();
+    *state = (enum sched_job_state)value;
 
     return xsql_step(st) != SCHED_END ? ESTEP : SCHED_OK;
 }
@@ -5,10 +5,21 @@
 #include <stdbool.h>
 #include <stdint.h>
 
-enum sched_rc job_set_run(int64_t job_id, int64_t exec_started);
-enum sched_rc job_set_error(int64_t job_id, char const *error,
+/* Claim token of updates that apply whatever the job state. */
+enum
+{
+    JOB_ANY_CLAIM = -1
+};
+
+char const *job_state_string(int state);
+enum sched_rc job_release(int64_t job_id);
+int64_t job_lease_expiry(int64_t now);
+enum sched_rc job_set_run(int64_t job_id, int64_t exec_started,
+                          int64_t lease_expiry);
+enum sched_rc job_set_error(int64_t job_id, int token, char const *error,
                             int64_t exec_ended);
-enum sched_rc job_set_done(int64_t job_id, int64_t exec_ended);
+enum sched_rc job_set_done(int64_t job_id, int token, int64_t exec_ended);
+enum sched_rc job_inc_progress(int64_t job_id, int token, int64_t delta);
 enum sched_rc job_wipe(void);
 
 #endif
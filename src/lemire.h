@@ -0,0 +1,13 @@
+#ifndef LEMIRE_H
+#define LEMIRE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Bits of the double nearest to w * 10^q, for w != 0. Returns false in
+ * the rare cases the 128-bit approximation cannot decide the rounding.
+ */
+bool lemire(int64_t q, uint64_t w, uint64_t *bits);
+
+#endif
@@ -0,0 +1,188 @@
+#include "migrate.h"
+#include "compiler.h"
+#include "error.h"
+#include "xsql.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * migrations[i] upgrades a sched file from schema version i to i + 1.
+ * Fresh files are created by schema.sql at the latest version.
+ */
+/* clang-format off */
+static char const *const migrations[] =
+{
+    /* Store job state as enum sched_job_state and index pending jobs. */
+    [0] = "CREATE TABLE job_v1 ("
+          "    id INTEGER PRIMARY KEY UNIQUE NOT NULL,"
+          "    type INTEGER CHECK(type IN (0, 1)) NOT NULL,"
+          "    state INTEGER CHECK(state IN (0, 1, 2, 3)) NOT NULL,"
+          "    progress INTEGER CHECK(0 <= progress AND progress <= 100) NOT NULL,"
+          "    error TEXT NOT NULL,"
+          "    submission INTEGER NOT NULL,"
+          "    exec_started INTEGER NOT NULL,"
+          "    exec_ended INTEGER NOT NULL"
+          ");"
+          "INSERT INTO job_v1 SELECT id, type,"
+          "    CASE state WHEN 'pend' THEN 0 WHEN 'run' THEN 1 WHEN 'done' THEN 2 ELSE 3 END,"
+          "    progress, error, submission, exec_started, exec_ended FROM job;"
+          "DROP TABLE job;"
+          "ALTER TABLE job_v1 RENAME TO job;"
+          "CREATE INDEX job_pend ON job (id) WHERE state = 0;",
+
+    /* Index foreign keys and the by-id lookups on them. */
+    [1] = "CREATE INDEX hmm_job_id ON hmm (job_id);"
+          "CREATE INDEX db_hmm_id ON db (hmm_id);"
+          "CREATE INDEX scan_db_id ON scan (db_id);"
+          "CREATE INDEX scan_job_id ON scan (job_id);"
+          "CREATE INDEX seq_scan_id ON seq (scan_id);"
+          "CREATE INDEX prod_scan_id ON prod (scan_id);"
+          "CREATE INDEX prod_seq_id ON prod (seq_id);"
+          "CREATE INDEX hmmer_prod_id ON hmmer (prod_id);",
+
+    /* Allow held jobs, whose scan is still being streamed in. */
+    [2] = "CREATE TABLE job_v3 ("
+          "    id INTEGER PRIMARY KEY UNIQUE NOT NULL,"
+          "    type INTEGER CHECK(type IN (0, 1)) NOT NULL,"
+          "    state INTEGER CHECK(state IN (0, 1, 2, 3, 4)) NOT NULL,"
+          "    progress INTEGER CHECK(0 <= progress AND progress <= 100) NOT NULL,"
+          "    error TEXT NOT NULL,"
+          "    submission INTEGER NOT NULL,"
+          "    exec_started INTEGER NOT NULL,"
+          "    exec_ended INTEGER NOT NULL"
+          ");"
+          "INSERT INTO job_v3 SELECT * FROM job;"
+          "DROP TABLE job;"
+          "ALTER TABLE job_v3 RENAME TO job;"
+          "CREATE INDEX job_pend ON job (id) WHERE state = 0;",
+
+    /* Let scans be split into work units. */
+    [3] = "CREATE TABLE unit ("
+          "    id INTEGER PRIMARY KEY UNIQUE NOT NULL,"
+          "    job_id INTEGER REFERENCES job (id) NOT NULL,"
+          "    scan_id INTEGER REFERENCES scan (id) NOT NULL,"
+          "    seq_min INTEGER NOT NULL,"
+          "    seq_max INTEGER NOT NULL,"
+          "    state INTEGER CHECK(state IN (0, 1, 2, 3)) NOT NULL,"
+          "    error TEXT NOT NULL,"
+          "    exec_started INTEGER NOT NULL,"
+          "    exec_ended INTEGER NOT NULL"
+          ");"
+          "CREATE INDEX unit_job_id ON unit (job_id);"
+          "CREATE INDEX unit_pend ON unit (id) WHERE state = 0;",
+
+    /* Lease running jobs so stalled ones can be requeued. */
+    [4] = "ALTER TABLE job ADD COLUMN retries INTEGER NOT NULL DEFAULT 0;"
+          "ALTER TABLE job ADD COLUMN lease_expiry INTEGER NOT NULL DEFAULT 0;"
+          "CREATE INDEX job_lease ON job (lease_expiry) WHERE state = 1;",
+
+    /* At most one hmmer row per product, so that paging products joined
+     * to hmmer sees each product once. */
+    [5] = "DROP INDEX hmmer_prod_id;"
+          "CREATE UNIQUE INDEX hmmer_prod_id ON hmmer (prod_id);",
+
+    /* Lease running units so stalled ones can be requeued. */
+    [6] = "ALTER TABLE unit ADD COLUMN retries INTEGER NOT NULL DEFAULT 0;"
+          "ALTER TABLE unit ADD COLUMN lease_expiry INTEGER NOT NULL DEFAULT 0;"
+          "CREATE INDEX unit_lease ON unit (lease_expiry) WHERE state = 1;",
+};
+
+/*
+ * Rows that migrations[i] cannot carry over. The upgrade fails with the
+ * given error instead of picking which rows to drop.
+ */
+static struct
+{
+    char const *sql;
+    enum sched_rc rc;
+} const checks[] =
+{
+    [5] = {"SELECT 1 FROM hmmer GROUP BY prod_id HAVING COUNT(*) > 1 LIMIT 1;",
+           SCHED_DUPLICATE_HMMER},
+};
+/* clang-format on */
+
+static int found_fn(void *found, int argc, char **argv, char **cols)
+{
+    unused(argc);
+    unused(argv);
+    unused(cols);
+    *((bool *)found) = true;
+    return 0;
+}
+
+static enum sched_rc check(int from)
+{
+    if (from >= (int)ARRAY_SIZE(checks) || !checks[from].sql) return SCHED_OK;
+
+    bool found = false;
+    enum sched_rc rc = xsql_exec(checks[from].sql, found_fn, &found);
+    if (rc) return rc;
+    return found ? error(checks[from].rc) : SCHED_OK;
+}
+
+static int get_version_fn(void *version, int argc, char **argv, char **cols)
+{
+    unused(cols);
+    if (argc == 1 && argv[0]) *((int *)version) = atoi(argv[0]);
+    return 0;
+}
+
+static enum sched_rc get_version(int *version)
+{
+    *version = 0;
+    return xsql_exec("PRAGMA user_version;", get_version_fn, version);
+}
+
+static enum sched_rc set_version(int version)
+{
+    char sql[64] = {0};
+    snprintf(sql, sizeof sql, "PRAGMA user_version = %d;", version);
+    return xsql_exec(sql, 0, 0);
+}
+
+/*
+ * The version is read again after the write lock is acquired so that
+ * processes opening the same file at once apply each step only once.
+ */
+static enum sched_rc upgrade(int from)
+{
+    if (xsql_begin_transaction()) return EBEGINSTMT;
+
+    int version = 0;
+    enum sched_rc rc = get_version(&version);
+    if (rc) goto cleanup;
+
+    if (version == from)
+    {
+        if ((rc = check(from))) goto cleanup;
+        if ((rc = xsql_exec(migrations[from], 0, 0))) goto cleanup;
+        if ((rc = set_version(from + 1))) goto cleanup;
+    }
+
+    return xsql_end_transaction() ? EENDSTMT : SCHED_OK;
+
+cleanup:
+    xsql_rollback_transaction();
+    return rc;
+}
+
+enum sched_rc migrate(void)
+{
+    int version = 0;
+    enum sched_rc rc = get_version(&version);
+    if (rc) return rc;
+    if (version >= (int)ARRAY_SIZE(migrations)) return SCHED_OK;
+
+    /* Tables are rebuilt in place, which requires foreign keys off. */
+    if (xsql_exec("PRAGMA foreign_keys = OFF;", 0, 0)) return EEXEC;
+
+    for (int i = version; i < (int)ARRAY_SIZE(migrations); ++i)
+    {
+        if ((rc = upgrade(i))) break;
+    }
+
+    if (xsql_exec("PRAGMA foreign_keys = ON;", 0, 0)) return EEXEC;
+    return rc;
+}
@@ -0,0 +1,8 @@
+#ifndef MIGRATE_H
+#define MIGRATE_H
+
+#include "sched/rc.h"
+
+enum sched_rc migrate(void);
+
+#endif
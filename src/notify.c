@@ -0,0 +1,291 @@
+#include "notify.h"
+#include "error.h"
+#include "handle.h"
+#include "sched/job.h"
+#include "sched/rc.h"
+#include "xsql.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) ||    \
+    defined(__OpenBSD__)
+#define NOTIFY_KQUEUE
+#include <sys/event.h>
+#endif
+
+#define SIDECAR_SUFFIX "-notify"
+
+/* Bumped on every announcement, seen or not by this process. */
+static struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint64_t generation;
+} waiters = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0};
+
+static void wake_all(void)
+{
+    pthread_mutex_lock(&waiters.lock);
+    waiters.generation++;
+    pthread_cond_broadcast(&waiters.cond);
+    pthread_mutex_unlock(&waiters.lock);
+}
+
+static uint64_t generation(void)
+{
+    pthread_mutex_lock(&waiters.lock);
+    uint64_t gen = waiters.generation;
+    pthread_mutex_unlock(&waiters.lock);
+    return gen;
+}
+
+enum sched_rc notify_open(struct notify *n, char const *filepath)
+{
+    char path[FILENAME_MAX] = {0};
+    n->fd = -1;
+    n->watch = -1;
+    n->stop[0] = n->stop[1] = -1;
+    n->started = false;
+    n->pending = false;
+
+    int size = snprintf(path, sizeof path, "%s" SIDECAR_SUFFIX, filepath);
+    if (size < 0 || size >= (int)sizeof path)
+        return error(SCHED_TOO_LONG_FILE_PATH);
+
+    n->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (n->fd < 0) return error(SCHED_FAIL_OPEN_FILE);
+
+    if (pthread_mutex_init(&n->lock, 0))
+    {
+        close(n->fd);
+        n->fd = -1;
+        return error(SCHED_NOT_ENOUGH_MEMORY);
+    }
+    return SCHED_OK;
+}
+
+static void stop_watcher(struct notify *n)
+{
+    if (!n->started) return;
+    char c = 0;
+    if (write(n->stop[1], &c, 1) == 1) pthread_join(n->thread, 0);
+    close(n->stop[0]);
+    close(n->stop[1]);
+    close(n->watch);
+    n->started = false;
+}
+
+void notify_close(struct notify *n)
+{
+    if (n->fd < 0) return;
+    stop_watcher(n);
+    pthread_mutex_destroy(&n->lock);
+    close(n->fd);
+    n->fd = -1;
+}
+
+/*
+ * The sidecar content is irrelevant: any write shows up as a change to
+ * the processes that watch it.
+ */
+static void announce(struct notify *n)
+{
+    wake_all();
+    char c = 0;
+    if (n->fd >= 0 && pwrite(n->fd, &c, 1, 0) != 1)
+        error(SCHED_FAIL_WRITE_FILE);
+}
+
+void notify_post(void)
+{
+    struct notify *n = &sched_self()->notify;
+    if (xsql_in_transaction())
+        n->pending = true;
+    else
+        announce(n);
+}
+
+void notify_on_commit(struct notify *n)
+{
+    if (!n->pending) return;
+    n->pending = false;
+    announce(n);
+}
+
+void notify_on_rollback(struct notify *n) { n->pending = false; }
+
+#if defined(__linux__)
+
+static int watch_open(struct notify *n)
+{
+    int fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (fd < 0) return -1;
+
+    char path[64] = {0};
+    snprintf(path, sizeof path, "/proc/self/fd/%d", n->fd);
+    if (inotify_add_watch(fd, path, IN_MODIFY) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void watch_drain(int fd)
+{
+    char buf[4096];
+    while (read(fd, buf, sizeof buf) > 0)
+        ;
+}
+
+#elif defined(NOTIFY_KQUEUE)
+
+static int watch_open(struct notify *n)
+{
+    int fd = kqueue();
+    if (fd < 0) return -1;
+
+    struct kevent ev;
+    EV_SET(&ev, n->fd, EVFILT_VNODE, EV_ADD | EV_CLEAR, NOTE_WRITE, 0, 0);
+    if (kevent(fd, &ev, 1, 0, 0, 0) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void watch_drain(int fd)
+{
+    struct kevent ev;
+    struct timespec zero = {0, 0};
+    while (kevent(fd, 0, 0, &ev, 1, &zero) > 0)
+        ;
+}
+
+#else
+
+static int watch_open(struct notify *n)
+{
+    (void)n;
+    return -1;
+}
+
+static void watch_drain(int fd) { (void)fd; }
+
+#endif
+
+static void *watcher_main(void *arg)
+{
+    struct notify *n = arg;
+    struct pollfd fds[2] = {{n->watch, POLLIN, 0}, {n->stop[0], POLLIN, 0}};
+
+    while (true)
+    {
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (fds[1].revents) break;
+        if (fds[0].revents & POLLIN)
+        {
+            watch_drain(n->watch);
+            wake_all();
+        }
+    }
+    return 0;
+}
+
+static bool spawn_watcher(struct notify *n)
+{
+    if ((n->watch = watch_open(n)) < 0) return false;
+    if (pipe(n->stop))
+    {
+        close(n->watch);
+        return false;
+    }
+    if (pthread_create(&n->thread, 0, watcher_main, n))
+    {
+        close(n->stop[0]);
+        close(n->stop[1]);
+        close(n->watch);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Without a watcher, waits fall back to checking every so often. Pooled
+ * handles can be waited on from several threads, which race to start it.
+ */
+static bool start_watcher(struct notify *n)
+{
+    if (n->fd < 0) return false;
+    pthread_mutex_lock(&n->lock);
+    if (!n->started) n->started = spawn_watcher(n);
+    bool started = n->started;
+    pthread_mutex_unlock(&n->lock);
+    return started;
+}
+
+static int64_t now_ms(void)
+{
+    struct timespec ts = {0};
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static struct timespec to_timespec(int64_t ms)
+{
+    return (struct timespec){(time_t)(ms / 1000), (long)(ms % 1000) * 1000000L};
+}
+
+enum { FALLBACK_MS = 100 };
+
+/*
+ * The generation is read before each query, so an announcement that
+ * lands between the query and the wait is not missed.
+ */
+enum sched_rc notify_wait_pend(struct sched *h, struct sched_job *job,
+                               int timeout_ms, notify_next_func_t *next)
+{
+    bool watched = start_watcher(&h->notify);
+    int64_t end = timeout_ms < 0 ? INT64_MAX : now_ms() + timeout_ms;
+
+    while (true)
+    {
+        uint64_t gen = generation();
+        enum sched_rc rc = (*next)(h, job);
+        if (rc != SCHED_JOB_NOT_FOUND) return rc;
+
+        int64_t until = end;
+        if (!watched && end - now_ms() > FALLBACK_MS)
+            until = now_ms() + FALLBACK_MS;
+
+        pthread_mutex_lock(&waiters.lock);
+        int code = 0;
+        while (waiters.generation == gen && code != ETIMEDOUT)
+        {
+            if (until == INT64_MAX)
+                code = pthread_cond_wait(&waiters.cond, &waiters.lock);
+            else
+            {
+                struct timespec ts = to_timespec(until);
+                code = pthread_cond_timedwait(&waiters.cond, &waiters.lock,
+                                              &ts);
+            }
+        }
+        pthread_mutex_unlock(&waiters.lock);
+
+        if (code == ETIMEDOUT && now_ms() >= end) return SCHED_JOB_NOT_FOUND;
+    }
+}
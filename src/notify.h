@@ -0,0 +1,39 @@
+#ifndef NOTIFY_H
+#define NOTIFY_H
+
+#include "sched/rc.h"
+#include <pthread.h>
+#include <stdbool.h>
+
+struct sched;
+struct sched_job;
+
+/*
+ * New pending jobs are announced within the process on a condition
+ * variable and to other processes by writing to a sidecar file next to
+ * the sched file, which a watcher thread follows with inotify or kqueue.
+ * Announcements made inside a transaction wait for it to commit, so that
+ * waiters woken by them find the job.
+ */
+struct notify
+{
+    int fd;
+    int watch;
+    int stop[2];
+    pthread_mutex_t lock;
+    bool started;
+    bool pending;
+    pthread_t thread;
+};
+
+typedef enum sched_rc(notify_next_func_t)(struct sched *, struct sched_job *);
+
+enum sched_rc notify_open(struct notify *, char const *filepath);
+void notify_close(struct notify *);
+void notify_post(void);
+void notify_on_commit(struct notify *);
+void notify_on_rollback(struct notify *);
+enum sched_rc notify_wait_pend(struct sched *, struct sched_job *,
+                               int timeout_ms, notify_next_func_t *);
+
+#endif
@@ -0,0 +1,10 @@
+#include "page.h"
+#include "sched/limits.h"
+#include "sched/sched.h"
+
+static int size = SCHED_PAGE_SIZE;
+
+void sched_set_page_size(int page_size) { size = page_size; }
+
+/* LIMIT -1 lets an iteration run in a single pass. */
+int64_t page_limit(void) { return size > 0 ? size : -1; }
@@ -0,0 +1,8 @@
+#ifndef PAGE_H
+#define PAGE_H
+
+#include <stdint.h>
+
+int64_t page_limit(void);
+
+#endif
@@ -0,0 +1,91 @@
+#include "pool.h"
+#include "error.h"
+#include "handle.h"
+#include "sched/options.h"
+#include "sched/rc.h"
+#include "xsql.h"
+#include <stdlib.h>
+
+static void close_conn(struct conn *conn)
+{
+    struct conn *prev = sched_bind(conn);
+    for (int i = 0; i < STMT_SIZE; ++i)
+        xsql_finalize(conn->stmt[i].st);
+    xsql_close();
+    sched_bind(prev);
+}
+
+enum sched_rc pool_open(struct pool *pool, char const *filepath,
+                        struct sched_options const *opts, int size)
+{
+    pool->size = 0;
+    pool->nfree = 0;
+    pool->conns = 0;
+    pool->free = 0;
+    if (pthread_mutex_init(&pool->lock, 0))
+        return error(SCHED_NOT_ENOUGH_MEMORY);
+    if (pthread_cond_init(&pool->ready, 0))
+    {
+        pthread_mutex_destroy(&pool->lock);
+        return error(SCHED_NOT_ENOUGH_MEMORY);
+    }
+    if (size <= 0) return SCHED_OK;
+
+    pool->conns = calloc((size_t)size, sizeof *pool->conns);
+    pool->free = calloc((size_t)size, sizeof *pool->free);
+    if (!pool->conns || !pool->free)
+    {
+        pool_close(pool);
+        return error(SCHED_NOT_ENOUGH_MEMORY);
+    }
+
+    for (int i = 0; i < size; ++i)
+    {
+        struct conn *prev = sched_bind(pool->conns + i);
+        enum sched_rc rc = xsql_open_readonly(filepath, opts);
+        sched_bind(prev);
+        if (rc)
+        {
+            pool_close(pool);
+            return error(SCHED_FAIL_OPEN_SCHED_FILE);
+        }
+        pool->free[pool->nfree++] = pool->conns + i;
+        pool->size++;
+    }
+    return SCHED_OK;
+}
+
+void pool_close(struct pool *pool)
+{
+    for (int i = 0; i < pool->size; ++i)
+        close_conn(pool->conns + i);
+    free(pool->conns);
+    free(pool->free);
+    pool->conns = 0;
+    pool->free = 0;
+    pool->size = 0;
+    pool->nfree = 0;
+    pthread_cond_destroy(&pool->ready);
+    pthread_mutex_destroy(&pool->lock);
+}
+
+/* Blocks until a connection is free. Returns null for an empty pool. */
+struct conn *pool_acquire(struct pool *pool)
+{
+    if (pool->size == 0) return 0;
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->nfree == 0)
+        pthread_cond_wait(&pool->ready, &pool->lock);
+    struct conn *conn = pool->free[--pool->nfree];
+    pthread_mutex_unlock(&pool->lock);
+    return conn;
+}
+
+void pool_release(struct pool *pool, struct conn *conn)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->free[pool->nfree++] = conn;
+    pthread_cond_signal(&pool->ready);
+    pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,41 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include "sched/rc.h"
+#include "stmt.h"
+#include "xsql.h"
+#include <pthread.h>
+
+struct sqlite3;
+struct sched_options;
+
+/* A connection and its own cache of prepared statements. */
+struct conn
+{
+    struct sqlite3 *db;
+    struct xsql_busy busy;
+    struct xsql_hooks hooks;
+    struct xsql_stmt stmt[STMT_SIZE];
+};
+
+/*
+ * Read-only connections handed out one per reading thread. Readers never
+ * take the write lock, and in WAL mode they run alongside the writer.
+ */
+struct pool
+{
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    int size;
+    int nfree;
+    struct conn *conns;
+    struct conn **free;
+};
+
+enum sched_rc pool_open(struct pool *, char const *filepath,
+                        struct sched_options const *, int size);
+void pool_close(struct pool *);
+struct conn *pool_acquire(struct pool *);
+void pool_release(struct pool *, struct conn *);
+
+#endif
@@ -1,15 +1,23 @@
 #include "prod.h"
 #include "error.h"
+#include "handle.h"
+#include "idset.h"
+#include "ingest.h"
+#include "page.h"
+#include "scan.h"
 #include "sched/hmmer.h"
 #include "sched/prod.h"
 #include "sched/rc.h"
 #include "sched/scan.h"
 #include "sched/seq.h"
+#include "seq.h"
 #include "stmt.h"
 #include "to.h"
 #include "tok.h"
 #include "xfile.h"
 #include "xsql.h"
+#include "xstrcpy.h"
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -31,7 +39,6 @@ enum
                 COL_TYPE_DOUBLE, COL_TYPE_TEXT,   COL_TYPE_TEXT,
                 COL_TYPE_TEXT};
 
-static TOK_DECLARE(tok);
 
 static void prod_init(struct sched_prod *prod)
 {
@@ -59,71 +66,222 @@ void sched_prod_init(struct sched_prod *prod, int64_t scan_id)
     prod->scan_id = scan_id;
 }
 
-static enum sched_rc get_prod(struct sched_prod *prod)
+static enum sched_rc set_view(struct sched_prod_view *view,
+                              struct sqlite3_stmt *st)
 {
-    struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(PROD_GET));
-    if (!st) return EFRESH;
+    int i = 0;
+    view->id = xsql_get_i64(st, i++);
+    view->scan_id = xsql_get_i64(st, i++);
+    view->seq_id = xsql_get_i64(st, i++);
 
-    if (xsql_bind_i64(st, 0, prod->id)) return EBIND;
+    if (!(view->profile_name = xsql_get_txt(st, i++).str)) return EGETTXT;
+    if (!(view->abc_name = xsql_get_txt(st, i++).str)) return EGETTXT;
 
-    enum sched_rc rc = xsql_step(st);
-    if (rc == SCHED_END) return SCHED_PROD_NOT_FOUND;
-    if (rc != SCHED_OK) return ESTEP;
+    view->alt_loglik = xsql_get_dbl(st, i++);
+    view->null_loglik = xsql_get_dbl(st, i++);
+    view->evalue_log = xsql_get_dbl(st, i++);
 
-    int i = 0;
-    prod->id = xsql_get_i64(st, i++);
-    prod->scan_id = xsql_get_i64(st, i++);
-    prod->seq_id = xsql_get_i64(st, i++);
+    if (!(view->profile_typeid = xsql_get_txt(st, i++).str)) return EGETTXT;
+    if (!(view->version = xsql_get_txt(st, i++).str)) return EGETTXT;
 
-    if (xsql_cpy_txt(st, i++, XSQL_TXT_OF(*prod, profile_name))) return EGETTXT;
-    if (xsql_cpy_txt(st, i++, XSQL_TXT_OF(*prod, abc_name))) return EGETTXT;
+    struct xsql_txt match = xsql_get_txt(st, i++);
+    if (!match.str) return EGETTXT;
+    view->match_len = match.len;
+    view->match = match.str;
 
-    prod->alt_loglik = xsql_get_dbl(st, i++);
-    prod->null_loglik = xsql_get_dbl(st, i++);
-    prod->evalue_log = xsql_get_dbl(st, i++);
+    return SCHED_OK;
+}
 
-    if (xsql_cpy_txt(st, i++, XSQL_TXT_OF(*prod, profile_typeid)))
-        return EGETTXT;
-    if (xsql_cpy_txt(st, i++, XSQL_TXT_OF(*prod, version))) return EGETTXT;
+/* The hmmer columns come from a LEFT JOIN and are NULL when missing. */
+static enum sched_rc set_hmmer(struct sched_hmmer *hmmer,
+                               struct sqlite3_stmt *st, int64_t prod_id)
+{
+    sched_hmmer_init(hmmer, prod_id);
+    if (xsql_is_null(st, 11)) return SCHED_OK;
 
-    if (xsql_cpy_txt(st, i++, XSQL_TXT_OF(*prod, match))) return EGETTXT;
+    hmmer->id = xsql_get_i64(st, 11);
+    struct xsql_blob blob = xsql_get_blob(st, 12);
+    if (!blob.data && blob.len) return EGETBLOB;
+    hmmer->len = blob.len;
+    hmmer->data = blob.data;
 
-    return xsql_step(st) != SCHED_END ? ESTEP : SCHED_OK;
+    return SCHED_OK;
 }
 
-enum sched_rc prod_scan_next(struct sched_prod *prod)
+static struct sqlite3_stmt *fresh_page(enum stmt stmt, int64_t id,
+                                       int64_t scan_id, int64_t limit)
 {
-    struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(PROD_GET_SCAN_NEXT));
-    if (!st) return EFRESH;
+    struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(stmt));
+    if (!st) return 0;
 
-    if (xsql_bind_i64(st, 0, prod->id)) return EBIND;
-    if (xsql_bind_i64(st, 1, prod->scan_id)) return EBIND;
+    int col = 0;
+    if (xsql_bind_i64(st, col++, id)) return 0;
+    if (stmt == PROD_GET_SCAN_PAGE && xsql_bind_i64(st, col++, scan_id))
+        return 0;
+    if (xsql_bind_i64(st, col++, limit)) return 0;
 
-    enum sched_rc rc = xsql_step(st);
-    if (rc == SCHED_END) return SCHED_PROD_NOT_FOUND;
-    if (rc != SCHED_OK) return ESTEP;
+    return st;
+}
 
-    prod->id = xsql_get_i64(st, 0);
-    if (xsql_step(st) != SCHED_END) return ESTEP;
+typedef enum sched_rc(view_func_t)(struct sched_prod_view const *,
+                                   struct sched_hmmer const *, void *);
 
-    return get_prod(prod);
+/*
+ * Rows are handed out as views into the cursor: no text or blob is
+ * copied, and the pointers are only valid until the callback returns.
+ */
+static enum sched_rc get_all(enum stmt stmt, int64_t scan_id, view_func_t *fn,
+                             void *arg)
+{
+    enum sched_rc rc = SCHED_OK;
+    int64_t limit = page_limit();
+    int64_t count = 0;
+    struct sched_prod_view view = {0};
+    struct sched_hmmer hmmer = {0};
+
+    do
+    {
+        struct sqlite3_stmt *st = fresh_page(stmt, view.id, scan_id, limit);
+        if (!st) return EFRESH;
+
+        count = 0;
+        while ((rc = xsql_step(st)) == SCHED_OK)
+        {
+            if ((rc = set_view(&view, st))) return rc;
+            if ((rc = set_hmmer(&hmmer, st, view.id))) return rc;
+            if ((rc = (*fn)(&view, &hmmer, arg))) return rc;
+            ++count;
+        }
+        if (rc != SCHED_END) return ESTEP;
+    } while (count == limit);
+
+    return SCHED_OK;
 }
 
-enum sched_rc prod_next(struct sched_prod *prod)
+static enum sched_rc view_to_prod(struct sched_prod *prod,
+                                  struct sched_prod_view const *view)
 {
-    struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(PROD_GET_NEXT));
-    if (!st) return EFRESH;
+    prod->id = view->id;
+    prod->scan_id = view->scan_id;
+    prod->seq_id = view->seq_id;
 
-    if (xsql_bind_i64(st, 0, prod->id)) return EBIND;
+    if (XSTRCPY(prod, profile_name, view->profile_name)) return EGETTXT;
+    if (XSTRCPY(prod, abc_name, view->abc_name)) return EGETTXT;
 
-    enum sched_rc rc = xsql_step(st);
-    if (rc == SCHED_END) return SCHED_PROD_NOT_FOUND;
-    if (rc != SCHED_OK) return ESTEP;
+    prod->alt_loglik = view->alt_loglik;
+    prod->null_loglik = view->null_loglik;
+    prod->evalue_log = view->evalue_log;
 
-    prod->id = xsql_get_i64(st, 0);
-    if (xsql_step(st) != SCHED_END) return ESTEP;
+    if (XSTRCPY(prod, profile_typeid, view->profile_typeid)) return EGETTXT;
+    if (XSTRCPY(prod, version, view->version)) return EGETTXT;
+
+    if (view->match_len >= (int)ARRAY_SIZE_OF(*prod, match)) return EGETTXT;
+    memcpy(prod->match, view->match, (size_t)view->match_len + 1);
 
-    return get_prod(prod);
+    return SCHED_OK;
+}
+
+static enum sched_rc view_to_dyn(struct sched_prod_dyn *prod,
+                                 struct sched_prod_view const *view)
+{
+    prod->id = view->id;
+    prod->scan_id = view->scan_id;
+    prod->seq_id = view->seq_id;
+
+    if (XSTRCPY(prod, profile_name, view->profile_name)) return EGETTXT;
+    if (XSTRCPY(prod, abc_name, view->abc_name)) return EGETTXT;
+
+    prod->alt_loglik = view->alt_loglik;
+    prod->null_loglik = view->null_loglik;
+    prod->evalue_log = view->evalue_log;
+
+    if (XSTRCPY(prod, profile_typeid, view->profile_typeid)) return EGETTXT;
+    if (XSTRCPY(prod, version, view->version)) return EGETTXT;
+
+    enum sched_rc rc = xstrcpy_grow(&prod->match, &prod->match_capacity,
+                                    view->match, view->match_len);
+    if (rc) return rc;
+    prod->match_len = view->match_len;
+
+    return SCHED_OK;
+}
+
+struct copy_ctx
+{
+    sched_prod_set_func_t *callb;
+    struct sched_prod *prod;
+    struct sched_hmmer *hmmer;
+    void *arg;
+};
+
+static enum sched_rc copy_view(struct sched_prod_view const *view,
+                               struct sched_hmmer const *hmmer, void *arg)
+{
+    struct copy_ctx *ctx = arg;
+    enum sched_rc rc = view_to_prod(ctx->prod, view);
+    if (rc) return rc;
+
+    *ctx->hmmer = *hmmer;
+    (*ctx->callb)(ctx->prod, ctx->hmmer, ctx->arg);
+    return SCHED_OK;
+}
+
+struct dyn_ctx
+{
+    sched_prod_dyn_func_t *fn;
+    struct sched_prod_dyn *prod;
+    struct sched_hmmer *hmmer;
+    void *arg;
+};
+
+static enum sched_rc copy_view_dyn(struct sched_prod_view const *view,
+                                   struct sched_hmmer const *hmmer, void *arg)
+{
+    struct dyn_ctx *ctx = arg;
+    enum sched_rc rc = view_to_dyn(ctx->prod, view);
+    if (rc) return rc;
+
+    *ctx->hmmer = *hmmer;
+    (*ctx->fn)(ctx->prod, ctx->hmmer, ctx->arg);
+    return SCHED_OK;
+}
+
+struct view_ctx
+{
+    sched_prod_view_func_t *fn;
+    void *arg;
+};
+
+static enum sched_rc pass_view(struct sched_prod_view const *view,
+                               struct sched_hmmer const *hmmer, void *arg)
+{
+    struct view_ctx *ctx = arg;
+    (*ctx->fn)(view, hmmer, ctx->arg);
+    return SCHED_OK;
+}
+
+enum sched_rc prod_scan_get_all(int64_t scan_id, sched_prod_set_func_t *callb,
+                                struct sched_prod *prod,
+                                struct sched_hmmer *hmmer, void *arg)
+{
+    struct copy_ctx ctx = {callb, prod, hmmer, arg};
+    sched_prod_init(prod, scan_id);
+    return get_all(PROD_GET_SCAN_PAGE, scan_id, copy_view, &ctx);
+}
+
+enum sched_rc prod_scan_get_all_dyn(int64_t scan_id, sched_prod_dyn_func_t *fn,
+                                    struct sched_prod_dyn *prod,
+                                    struct sched_hmmer *hmmer, void *arg)
+{
+    struct dyn_ctx ctx = {fn, prod, hmmer, arg};
+    return get_all(PROD_GET_SCAN_PAGE, scan_id, copy_view_dyn, &ctx);
+}
+
+enum sched_rc prod_scan_get_all_view(int64_t scan_id,
+                                     sched_prod_view_func_t *fn, void *arg)
+{
+    struct view_ctx ctx = {fn, arg};
+    return get_all(PROD_GET_SCAN_PAGE, scan_id, pass_view, &ctx);
 }
 
 enum sched_rc prod_wipe(void)
@@ -142,50 +300,52 @@ enum sched_rc prod_wipe(void)
         goto cleanup;                                                          \
     } while (1)
 
-static enum sched_rc expect_word(FILE *fp, char const *field)
+static enum sched_rc expect_word(struct tok *tok, char const *field)
 {
-    if (tok_next(&tok, fp)) return EPARSEFILE;
-    if (tok_id(&tok) != TOK_WORD) return EPARSEFILE;
-    if (strcmp(tok.value, field)) return EPARSEFILE;
+    if (tok_next(tok)) return EPARSEFILE;
+    if (tok_id(tok) != TOK_WORD) return EPARSEFILE;
+    if (!tok_equal(tok, field)) return EPARSEFILE;
     return SCHED_OK;
 }
 
-static enum sched_rc parse_prod_file_header(FILE *fp)
+static enum sched_rc parse_prod_file_header(struct tok *tok)
 {
     enum sched_rc rc = SCHED_OK;
-    if ((rc = expect_word(fp, "scan_id"))) return rc;
-    if ((rc = expect_word(fp, "seq_id"))) return rc;
-    if ((rc = expect_word(fp, "profile_name"))) return rc;
-    if ((rc = expect_word(fp, "abc_name"))) return rc;
-    if ((rc = expect_word(fp, "alt_loglik"))) return rc;
-    if ((rc = expect_word(fp, "null_loglik"))) return rc;
-    if ((rc = expect_word(fp, "evalue_log"))) return rc;
-    if ((rc = expect_word(fp, "profile_typeid"))) return rc;
-    if ((rc = expect_word(fp, "version"))) return rc;
-    if ((rc = expect_word(fp, "match"))) return rc;
-
-    if (tok_next(&tok, fp)) return EPARSEFILE;
-    if (tok_id(&tok) != TOK_NL) return EPARSEFILE;
+    if ((rc = expect_word(tok, "scan_id"))) return rc;
+    if ((rc = expect_word(tok, "seq_id"))) return rc;
+    if ((rc = expect_word(tok, "profile_name"))) return rc;
+    if ((rc = expect_word(tok, "abc_name"))) return rc;
+    if ((rc = expect_word(tok, "alt_loglik"))) return rc;
+    if ((rc = expect_word(tok, "null_loglik"))) return rc;
+    if ((rc = expect_word(tok, "evalue_log"))) return rc;
+    if ((rc = expect_word(tok, "profile_typeid"))) return rc;
+    if ((rc = expect_word(tok, "version"))) return rc;
+    if ((rc = expect_word(tok, "match"))) return rc;
+
+    if (tok_next(tok)) return EPARSEFILE;
+    if (tok_id(tok) != TOK_NL) return EPARSEFILE;
     return rc;
 }
 
-static enum sched_rc scan_exists(int64_t scan_id)
+static bool int64_of(struct tok const *tok, int64_t *val)
 {
-    struct sched_scan scan = {0};
-    return sched_scan_get_by_id(&scan, scan_id);
+    if (tok_id(tok) != TOK_WORD || tok_size(tok) > UINT_MAX) return false;
+    return to_int64l((unsigned)tok_size(tok), tok_value(tok), val);
 }
 
-static enum sched_rc seq_exists(int64_t seq_id)
+static bool double_of(struct tok const *tok, double *val)
 {
-    struct sched_seq seq = {0};
-    return sched_seq_get_by_id(&seq, seq_id);
+    if (tok_id(tok) != TOK_WORD || tok_size(tok) > UINT_MAX) return false;
+    return to_doublel((unsigned)tok_size(tok), tok_value(tok), val);
 }
 
-static int callb(struct sched_prod const *prod, void *arg)
+static enum sched_rc callb(struct sched_prod_dyn const *rows, int n,
+                           void *arg)
 {
-    (void)prod;
+    (void)rows;
+    (void)n;
     (void)arg;
-    return 0;
+    return SCHED_OK;
 }
 
 enum sched_rc sched_prod_add_file(char const *filename)
@@ -208,7 +368,7 @@ cleanup:
     return rc;
 }
 
-enum sched_rc sched_prod_get_by_id(struct sched_prod *prod, int64_t id)
+static enum sched_rc get_view(struct sched_prod_view *view, int64_t id)
 {
     struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(PROD_GET));
     if (!st) return EFRESH;
@@ -217,25 +377,35 @@ enum sched_rc sched_prod_get_by_id(struct sched_prod *prod, int64_t id)
 
     enum sched_rc rc = xsql_step(st);
     if (rc == SCHED_END) return SCHED_PROD_NOT_FOUND;
-    if (rc != SCHED_OK) ESTEP;
-
-    prod->id = xsql_get_i64(st, 0);
-    prod->scan_id = xsql_get_i64(st, 1);
-    prod->seq_id = xsql_get_i64(st, 2);
+    if (rc != SCHED_OK) return ESTEP;
 
-    if (xsql_cpy_txt(st, 3, XSQL_TXT_OF(*prod, profile_name))) return EGETTXT;
-    if (xsql_cpy_txt(st, 4, XSQL_TXT_OF(*prod, abc_name))) return EGETTXT;
+    return set_view(view, st);
+}
 
-    prod->alt_loglik = xsql_get_dbl(st, 5);
-    prod->null_loglik = xsql_get_dbl(st, 6);
-    prod->evalue_log = xsql_get_dbl(st, 7);
+enum sched_rc sched_prod_get_by_id(struct sched_prod *prod, int64_t id)
+{
+    struct sched_prod_view view = {0};
+    enum sched_rc rc = get_view(&view, id);
+    return rc ? rc : view_to_prod(prod, &view);
+}
 
-    if (xsql_cpy_txt(st, 8, XSQL_TXT_OF(*prod, profile_typeid))) return EGETTXT;
-    if (xsql_cpy_txt(st, 9, XSQL_TXT_OF(*prod, version))) return EGETTXT;
+void sched_prod_dyn_init(struct sched_prod_dyn *prod, int64_t scan_id)
+{
+    memset(prod, 0, sizeof *prod);
+    prod->scan_id = scan_id;
+}
 
-    if (xsql_cpy_txt(st, 10, XSQL_TXT_OF(*prod, match))) return EGETTXT;
+void sched_prod_dyn_cleanup(struct sched_prod_dyn *prod)
+{
+    free(prod->match);
+    sched_prod_dyn_init(prod, 0);
+}
 
-    return xsql_step(st) != SCHED_END ? ESTEP : SCHED_OK;
+enum sched_rc sched_prod_dyn_get_by_id(struct sched_prod_dyn *prod, int64_t id)
+{
+    struct sched_prod_view view = {0};
+    enum sched_rc rc = get_view(&view, id);
+    return rc ? rc : view_to_dyn(prod, &view);
 }
 
 enum sched_rc sched_prod_add(struct sched_prod *prod)
@@ -268,90 +438,187 @@ enum sched_rc sched_prod_get_all(void (*callb)(struct sched_prod *,
                                  struct sched_prod *prod,
                                  struct sched_hmmer *hmmer, void *arg)
 {
-    enum sched_rc rc = SCHED_OK;
-
+    struct copy_ctx ctx = {callb, prod, hmmer, arg};
     prod_init(prod);
-    while ((rc = prod_next(prod)) == SCHED_OK)
+    return get_all(PROD_GET_PAGE, 0, copy_view, &ctx);
+}
+
+enum sched_rc sched_prod_dyn_get_all(sched_prod_dyn_func_t *fn,
+                                     struct sched_prod_dyn *prod,
+                                     struct sched_hmmer *hmmer, void *arg)
+{
+    struct dyn_ctx ctx = {fn, prod, hmmer, arg};
+    return get_all(PROD_GET_PAGE, 0, copy_view_dyn, &ctx);
+}
+
+enum sched_rc sched_prod_get_all_view(sched_prod_view_func_t *fn, void *arg)
+{
+    struct view_ctx ctx = {fn, arg};
+    return get_all(PROD_GET_PAGE, 0, pass_view, &ctx);
+}
+
+static enum sched_rc flush_rows(struct xsql_bulk *bulk, prod_add_cb *callb,
+                                void *arg)
+{
+    struct sched_prod_dyn *rows = sched_self()->rows;
+    int n = xsql_bulk_rows(bulk);
+    enum sched_rc rc = xsql_bulk_flush(bulk);
+    if (rc) return rc;
+
+    int64_t id = xsql_last_id() - n + 1;
+    for (int i = 0; i < n; ++i)
+        rows[i].id = id + i;
+    return n ? (*callb)(rows, n, arg) : SCHED_OK;
+}
+
+/* A decoded line, with text pointing into the tokenizer input. */
+struct row
+{
+    union
+    {
+        int64_t i64;
+        double dbl;
+        struct xsql_txt txt;
+    } col[ARRAY_SIZE(col_type)];
+};
+
+static enum sched_rc parse_row(struct tok *tok, void *ptr)
+{
+    struct row *row = ptr;
+
+    if (tok_next(tok)) return EPARSEFILE;
+    if (tok_id(tok) == TOK_EOF) return SCHED_END;
+
+    for (int i = 0; i < (int)ARRAY_SIZE(col_type); i++)
     {
-        rc = sched_hmmer_get_by_prod_id(hmmer, prod->id);
-        if (rc) return rc;
-        (*callb)(prod, hmmer, arg);
-        free((void *)hmmer->data);
+        if (col_type[i] == COL_TYPE_INT64)
+        {
+            if (!int64_of(tok, &row->col[i].i64)) return EPARSEFILE;
+        }
+        else if (col_type[i] == COL_TYPE_DOUBLE)
+        {
+            if (!double_of(tok, &row->col[i].dbl)) return EPARSEFILE;
+        }
+        else if (col_type[i] == COL_TYPE_TEXT)
+        {
+            if (tok_id(tok) != TOK_WORD) return EPARSEFILE;
+            if (tok_size(tok) > INT_MAX) return EPARSEFILE;
+            row->col[i].txt.len = (int)tok_size(tok);
+            row->col[i].txt.str = tok_value(tok);
+        }
+        if (tok_next(tok)) return EPARSEFILE;
     }
+    return tok_id(tok) == TOK_NL ? SCHED_OK : EPARSEFILE;
+}
+
+/*
+ * Files reference the same few scans and sequences over and over, so ids
+ * already seen in this transaction are remembered instead of re-queried.
+ * Nothing can delete them before the transaction ends.
+ */
+struct add_ctx
+{
+    struct xsql_bulk *bulk;
+    prod_add_cb *callb;
+    void *arg;
+    struct idset scans;
+    struct idset seqs;
+};
 
-    return rc == SCHED_PROD_NOT_FOUND ? SCHED_OK : rc;
+static enum sched_rc check_id(struct idset *known, int64_t id,
+                              enum sched_rc (*exists)(int64_t))
+{
+    if (idset_has(known, id)) return SCHED_OK;
+    enum sched_rc rc = exists(id);
+    return rc ? rc : idset_add(known, id);
 }
 
-enum sched_rc sched_prod_add_transaction(FILE *fp, prod_add_cb *callb,
-                                         void *arg)
+static enum sched_rc add_row(void const *ptr, void *arg)
 {
+    struct row const *row = ptr;
+    struct add_ctx *ctx = arg;
+    struct xsql_bulk *bulk = ctx->bulk;
+    struct sched_prod_dyn *prod = sched_self()->rows + xsql_bulk_rows(bulk);
     enum sched_rc rc = SCHED_OK;
-    static struct sched_prod prod = {0};
-
-    if ((rc = parse_prod_file_header(fp))) goto cleanup;
 
-    do
+    for (int i = 0; i < (int)ARRAY_SIZE(col_type); i++)
     {
-        struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(PROD_INSERT));
-        if (!st) CLEANUP(error(SCHED_FAIL_GET_FRESH_STMT));
-        if (tok_next(&tok, fp)) CLEANUP(EPARSEFILE);
-        if (tok_id(&tok) == TOK_EOF) break;
-
-        for (int i = 0; i < (int)ARRAY_SIZE(col_type); i++)
+        if (col_type[i] == COL_TYPE_INT64)
         {
-            if (col_type[i] == COL_TYPE_INT64)
-            {
-                int64_t val = 0;
-                if (!to_int64(tok_value(&tok), &val)) CLEANUP(EPARSEFILE);
-                if (xsql_bind_i64(st, i, val)) CLEANUP(EBIND);
-                if (i == COL_SCAN_ID)
-                {
-                    rc = scan_exists(val);
-                    if (rc) goto cleanup;
-                    prod.scan_id = val;
-                }
-                else if (i == COL_SEQ_ID)
-                {
-                    rc = seq_exists(val);
-                    if (rc) goto cleanup;
-                    prod.seq_id = val;
-                }
-            }
-            else if (col_type[i] == COL_TYPE_DOUBLE)
+            int64_t val = row->col[i].i64;
+            if ((rc = xsql_bulk_i64(bulk, val))) return rc;
+            if (i == COL_SCAN_ID)
             {
-                double val = 0;
-                if (!to_double(tok_value(&tok), &val)) CLEANUP(EPARSEFILE);
-                if (xsql_bind_dbl(st, i, val)) CLEANUP(EBIND);
+                if ((rc = check_id(&ctx->scans, val, scan_exists))) return rc;
+                prod->scan_id = val;
             }
-            else if (col_type[i] == COL_TYPE_TEXT)
+            else if (i == COL_SEQ_ID)
             {
-                struct xsql_txt txt = {tok_size(&tok), tok_value(&tok)};
-                if (xsql_bind_txt(st, i, txt)) CLEANUP(EBIND);
-                if (i == COL_PROFILE_NAME)
-                {
-                    if (txt.len >= SCHED_PROFILE_NAME_SIZE)
-                        CLEANUP(SCHED_TOO_LONG_PROFNAME);
-                    memcpy(prod.profile_name, txt.str, txt.len + 1);
-                }
+                if ((rc = check_id(&ctx->seqs, val, seq_exists))) return rc;
+                prod->seq_id = val;
             }
-            if (tok_next(&tok, fp)) CLEANUP(EPARSEFILE);
         }
-        if (tok_id(&tok) != TOK_NL)
+        else if (col_type[i] == COL_TYPE_DOUBLE)
         {
-            rc = EPARSEFILE;
-            goto cleanup;
+            if ((rc = xsql_bulk_dbl(bulk, row->col[i].dbl))) return rc;
         }
-        rc = xsql_step(st);
-        if (rc != SCHED_END) CLEANUP(ESTEP);
-        prod.id = xsql_last_id();
+        else if (col_type[i] == COL_TYPE_TEXT)
+        {
+            struct xsql_txt txt = row->col[i].txt;
+            if ((rc = xsql_bulk_txt(bulk, txt))) return rc;
+            if (i == COL_PROFILE_NAME)
+            {
+                if (txt.len >= SCHED_PROFILE_NAME_SIZE)
+                    return SCHED_TOO_LONG_PROFNAME;
+                memcpy(prod->profile_name, txt.str, (size_t)txt.len);
+                prod->profile_name[txt.len] = '\0';
+            }
+        }
+    }
 
-        if ((rc = (*callb)(&prod, arg))) goto cleanup;
+    if (!xsql_bulk_full(bulk)) return SCHED_OK;
+    return flush_rows(bulk, ctx->callb, ctx->arg);
+}
 
-    } while (true);
+static enum sched_rc add_rows(struct tok *tok, struct add_ctx *ctx)
+{
+    int threads = sched_self()->options.parse_threads;
+    if (threads > 0 && tok_mapped(tok))
+    {
+        return ingest_parallel(tok->pos, (size_t)(tok->end - tok->pos),
+                               threads, sizeof(struct row), parse_row,
+                               add_row, ctx);
+    }
 
-    return SCHED_OK;
+    struct row row = {0};
+    enum sched_rc rc = SCHED_OK;
+    while ((rc = parse_row(tok, &row)) == SCHED_OK)
+    {
+        if ((rc = add_row(&row, ctx))) return rc;
+    }
+    return rc == SCHED_END ? SCHED_OK : rc;
+}
 
-cleanup:
+enum sched_rc sched_prod_add_transaction(FILE *fp, prod_add_cb *callb,
+                                         void *arg)
+{
+    struct add_ctx ctx = {.bulk = stmt_bulk(PROD_INSERT_BULK),
+                          .callb = callb,
+                          .arg = arg};
+    struct tok tok = {0};
+
+    enum sched_rc rc = tok_open(&tok, fp);
+    if (rc) return rc;
+    idset_init(&ctx.scans);
+    idset_init(&ctx.seqs);
+
+    if (!(rc = parse_prod_file_header(&tok)) && !(rc = add_rows(&tok, &ctx)))
+        rc = flush_rows(ctx.bulk, callb, arg);
+
+    if (rc) xsql_bulk_clear(ctx.bulk);
+    idset_del(&ctx.scans);
+    idset_del(&ctx.seqs);
+    tok_close(&tok);
     return rc;
 }
 
@@ -1,15 +1,23 @@
 #ifndef PROD_H
 #define PROD_H
 
+#include "sched/prod.h"
+#include <stdint.h>
 #include <stdio.h>
 
-struct sched_prod;
-
-typedef int prod_add_cb(struct sched_prod const *, void *);
+/* Called with each batch of inserted rows, ids set, before the next one. */
+typedef enum sched_rc prod_add_cb(struct sched_prod_dyn const *rows, int n,
+                                  void *arg);
 
 enum sched_rc sched_prod_add_transaction(FILE *fp, prod_add_cb *, void *arg);
-enum sched_rc prod_scan_next(struct sched_prod *prod);
-enum sched_rc prod_next(struct sched_prod *prod);
+enum sched_rc prod_scan_get_all(int64_t scan_id, sched_prod_set_func_t *callb,
+                                struct sched_prod *prod,
+                                struct sched_hmmer *hmmer, void *arg);
+enum sched_rc prod_scan_get_all_dyn(int64_t scan_id, sched_prod_dyn_func_t *fn,
+                                    struct sched_prod_dyn *prod,
+                                    struct sched_hmmer *hmmer, void *arg);
+enum sched_rc prod_scan_get_all_view(int64_t scan_id,
+                                     sched_prod_view_func_t *fn, void *arg);
 enum sched_rc prod_wipe(void);
 
 #endif
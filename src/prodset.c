@@ -1,12 +1,15 @@
 #include "sched/prodset.h"
 #include "error.h"
-#include "fs.h"
+#include "handle.h"
+#include "hmmer_dir.h"
 #include "prod.h"
 #include "sched/hmmer.h"
-#include "sched/hmmer_filename.h"
 #include "strlcat.h"
 #include "strlcpy.h"
 #include "xsql.h"
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -18,38 +21,167 @@
         goto cleanup;                                                          \
     } while (1)
 
-static int callb(struct sched_prod const *prod, void *arg)
+struct load
 {
-    char *path = arg;
-    struct sched_hmmer_filename x = {.scan_id = prod->scan_id,
-                                     .seq_id = prod->seq_id};
-    strcpy(x.profile_name, prod->profile_name);
-    int n = (int)strlen(path);
-    path[n] = '/';
-    sched_hmmer_filename_setup(&x, path + n + 1);
-    static struct sched_hmmer hmmer = {0};
-    sched_hmmer_init(&hmmer, prod->id);
-
-    int rc = 0;
-    unsigned char *data = NULL;
-    if (fs_exists(path))
+    char const *name;
+    struct hmmer_buf buf;
+    enum sched_rc rc;
+};
+
+/*
+ * The hmmer files of a batch of products are read by the calling thread
+ * and the io_threads workers, each taking the next file left. Rows are
+ * then inserted in order once the whole batch is in memory.
+ */
+struct loader
+{
+    struct hmmer_dir dir;
+
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t done;
+    int size;
+    int next;
+    int finished;
+    bool stop;
+
+    int nthreads;
+    pthread_t *threads;
+    struct load loads[XSQL_BULK_MAX_ROWS];
+};
+
+static void load(struct loader *l, int i)
+{
+    struct load *x = l->loads + i;
+    x->rc = x->name ? hmmer_dir_read(&l->dir, x->name, &x->buf) : SCHED_OK;
+}
+
+static void *worker(void *arg)
+{
+    struct loader *l = arg;
+    pthread_mutex_lock(&l->lock);
+    while (true)
     {
-        long size = 0;
-        rc = fs_readall(path, &size, &data);
-        if (rc) goto cleanup;
+        while (!l->stop && l->next >= l->size)
+            pthread_cond_wait(&l->work, &l->lock);
+        if (l->stop) break;
 
-        rc = sched_hmmer_add(&hmmer, (int)size, data);
+        int i = l->next++;
+        pthread_mutex_unlock(&l->lock);
+        load(l, i);
+        pthread_mutex_lock(&l->lock);
+        if (++l->finished == l->size) pthread_cond_signal(&l->done);
     }
+    pthread_mutex_unlock(&l->lock);
+    return 0;
+}
 
-cleanup:
-    free(data);
-    path[n] = '\0';
-    return rc;
+static void load_all(struct loader *l, int size)
+{
+    pthread_mutex_lock(&l->lock);
+    l->size = size;
+    l->next = 0;
+    l->finished = 0;
+    pthread_cond_broadcast(&l->work);
+
+    while (l->next < l->size)
+    {
+        int i = l->next++;
+        pthread_mutex_unlock(&l->lock);
+        load(l, i);
+        pthread_mutex_lock(&l->lock);
+        ++l->finished;
+    }
+    while (l->finished < l->size)
+        pthread_cond_wait(&l->done, &l->lock);
+    pthread_mutex_unlock(&l->lock);
+}
+
+static void loader_stop(struct loader *l)
+{
+    pthread_mutex_lock(&l->lock);
+    l->stop = true;
+    pthread_cond_broadcast(&l->work);
+    pthread_mutex_unlock(&l->lock);
+
+    for (int i = 0; i < l->nthreads; ++i)
+        pthread_join(l->threads[i], 0);
+    free(l->threads);
+
+    pthread_cond_destroy(&l->done);
+    pthread_cond_destroy(&l->work);
+    pthread_mutex_destroy(&l->lock);
+    for (int i = 0; i < XSQL_BULK_MAX_ROWS; ++i)
+        hmmer_buf_del(&l->loads[i].buf);
+    hmmer_dir_close(&l->dir);
+}
+
+static enum sched_rc loader_start(struct loader *l, char const *dir,
+                                  int nthreads)
+{
+    memset(l, 0, sizeof *l);
+    enum sched_rc rc = hmmer_dir_open(&l->dir, dir);
+    if (rc) return rc;
+
+    if (pthread_mutex_init(&l->lock, 0)) goto fail_lock;
+    if (pthread_cond_init(&l->work, 0)) goto fail_work;
+    if (pthread_cond_init(&l->done, 0)) goto fail_done;
+
+    if (nthreads > 0 && !(l->threads = malloc(sizeof(pthread_t) * nthreads)))
+    {
+        loader_stop(l);
+        return error(SCHED_NOT_ENOUGH_MEMORY);
+    }
+    for (; l->nthreads < nthreads; ++l->nthreads)
+    {
+        if (pthread_create(l->threads + l->nthreads, 0, worker, l))
+        {
+            loader_stop(l);
+            return error(SCHED_NOT_ENOUGH_MEMORY);
+        }
+    }
+    return SCHED_OK;
+
+fail_done:
+    pthread_cond_destroy(&l->work);
+fail_work:
+    pthread_mutex_destroy(&l->lock);
+fail_lock:
+    hmmer_dir_close(&l->dir);
+    return error(SCHED_NOT_ENOUGH_MEMORY);
+}
+
+/* Products with no hmmer file in the directory have no hmmer row. */
+static enum sched_rc callb(struct sched_prod_dyn const *rows, int n,
+                           void *arg)
+{
+    struct loader *l = arg;
+    for (int i = 0; i < n; ++i)
+    {
+        l->loads[i].name = hmmer_dir_find(&l->dir, rows[i].scan_id,
+                                          rows[i].seq_id, rows[i].profile_name);
+    }
+    load_all(l, n);
+
+    enum sched_rc rc = SCHED_OK;
+    for (int i = 0; i < n; ++i)
+    {
+        struct load const *x = l->loads + i;
+        if (!x->name) continue;
+        if (x->rc) return x->rc;
+        if (x->buf.size > INT_MAX) return error(SCHED_FAIL_READ_FILE);
+
+        struct sched_hmmer hmmer = {0};
+        sched_hmmer_init(&hmmer, rows[i].id);
+        if ((rc = sched_hmmer_add(&hmmer, (int)x->buf.size, x->buf.data)))
+            return rc;
+    }
+    return SCHED_OK;
 }
 
 enum sched_rc sched_prodset_add(char const *dir)
 {
-    static char filename[FILENAME_MAX] = {0};
+    char filename[FILENAME_MAX] = {0};
 
     size_t n = sizeof filename;
     sched_strlcpy(filename, dir, n);
@@ -58,19 +190,37 @@ enum sched_rc sched_prodset_add(char const *dir)
     FILE *fp = fopen(filename, "rb");
     if (!fp) return error(SCHED_FAIL_OPEN_FILE);
 
-    enum sched_rc rc = SCHED_OK;
+    struct loader *loader = malloc(sizeof *loader);
+    if (!loader)
+    {
+        fclose(fp);
+        return error(SCHED_NOT_ENOUGH_MEMORY);
+    }
+
+    int nthreads = sched_self()->options.io_threads;
+    enum sched_rc rc = loader_start(loader, dir, nthreads);
+    if (rc)
+    {
+        free(loader);
+        fclose(fp);
+        return rc;
+    }
+
     if (xsql_begin_transaction()) CLEANUP(EBEGINSTMT);
 
-    sched_strlcpy(filename, dir, n);
-    if ((rc = sched_prod_add_transaction(fp, &callb, filename))) goto cleanup;
+    if ((rc = sched_prod_add_transaction(fp, &callb, loader))) goto cleanup;
 
     if (xsql_end_transaction()) CLEANUP(EENDSTMT);
 
+    loader_stop(loader);
+    free(loader);
     fclose(fp);
     return rc;
 
 cleanup:
     xsql_rollback_transaction();
+    loader_stop(loader);
+    free(loader);
     fclose(fp);
     return rc;
 }
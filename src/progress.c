@@ -0,0 +1,303 @@
+#include "progress.h"
+#include "error.h"
+#include "handle.h"
+#include "job.h"
+#include "sched/rc.h"
+#include "xsql.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static struct progress *self(void) { return &sched_self()->progress; }
+
+static int64_t now_ms(void)
+{
+    struct timespec ts = {0};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+enum sched_rc progress_init(struct progress *p)
+{
+    p->size = 0;
+    p->capacity = 0;
+    p->entries = 0;
+    p->last_flush = now_ms();
+    p->nlog = 0;
+    p->log_capacity = 0;
+    p->log = 0;
+    return pthread_mutex_init(&p->lock, 0) ? error(SCHED_NOT_ENOUGH_MEMORY)
+                                           : SCHED_OK;
+}
+
+void progress_del(struct progress *p)
+{
+    free(p->entries);
+    p->entries = 0;
+    p->size = 0;
+    p->capacity = 0;
+    free(p->log);
+    p->log = 0;
+    p->nlog = 0;
+    p->log_capacity = 0;
+    pthread_mutex_destroy(&p->lock);
+}
+
+static size_t slot_of(struct progress const *p, int64_t job_id)
+{
+    uint64_t h = (uint64_t)job_id * 0x9e3779b97f4a7c15u;
+    return (size_t)(h >> 32) & (p->capacity - 1);
+}
+
+static struct progress_entry *find(struct progress *p, int64_t job_id)
+{
+    if (!p->capacity) return 0;
+    size_t i = slot_of(p, job_id);
+    while (p->entries[i].job_id)
+    {
+        if (p->entries[i].job_id == job_id) return p->entries + i;
+        i = (i + 1) & (p->capacity - 1);
+    }
+    return 0;
+}
+
+static void insert(struct progress *p, struct progress_entry const *e)
+{
+    size_t i = slot_of(p, e->job_id);
+    while (p->entries[i].job_id)
+        i = (i + 1) & (p->capacity - 1);
+    p->entries[i] = *e;
+    p->size++;
+}
+
+static enum sched_rc grow(struct progress *p)
+{
+    size_t capacity = p->capacity ? p->capacity * 2 : 64;
+    struct progress_entry *old = p->entries;
+    size_t old_capacity = p->capacity;
+
+    p->entries = calloc(capacity, sizeof *p->entries);
+    if (!p->entries)
+    {
+        p->entries = old;
+        return error(SCHED_NOT_ENOUGH_MEMORY);
+    }
+    p->capacity = capacity;
+    p->size = 0;
+    for (size_t i = 0; i < old_capacity; ++i)
+        if (old[i].job_id) insert(p, old + i);
+    free(old);
+    return SCHED_OK;
+}
+
+/*
+ * progress_add writes an entry of another claim before adding, so tokens
+ * only differ here when a rollback brings back an older claim, which
+ * loses to the later one: tokens never go down.
+ */
+static enum sched_rc add(struct progress *p, struct progress_entry const *x)
+{
+    struct progress_entry *e = find(p, x->job_id);
+    if (e && e->token == x->token)
+        e->delta += x->delta;
+    else if (e && e->token < x->token)
+        *e = *x;
+    if (e) return SCHED_OK;
+
+    enum sched_rc rc = SCHED_OK;
+    if ((p->size + 1) * 10 > p->capacity * 7 && (rc = grow(p))) return rc;
+    insert(p, x);
+    return SCHED_OK;
+}
+
+/* Backward-shift deletion keeps probe sequences intact. */
+static void erase(struct progress *p, struct progress_entry *e)
+{
+    size_t mask = p->capacity - 1;
+    size_t i = (size_t)(e - p->entries);
+    size_t j = i;
+    while (true)
+    {
+        j = (j + 1) & mask;
+        if (!p->entries[j].job_id) break;
+        size_t k = slot_of(p, p->entries[j].job_id);
+        if ((j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j)))
+        {
+            p->entries[i] = p->entries[j];
+            i = j;
+        }
+    }
+    memset(p->entries + i, 0, sizeof *p->entries);
+    p->size--;
+}
+
+static enum sched_rc reserve_log(struct progress *p, size_t n)
+{
+    if (p->nlog + n <= p->log_capacity) return SCHED_OK;
+    size_t capacity = p->log_capacity ? p->log_capacity : 64;
+    while (capacity < p->nlog + n)
+        capacity *= 2;
+    struct progress_entry *log = realloc(p->log, capacity * sizeof *log);
+    if (!log) return error(SCHED_NOT_ENOUGH_MEMORY);
+    p->log = log;
+    p->log_capacity = capacity;
+    return SCHED_OK;
+}
+
+static enum sched_rc write_all(struct progress *p)
+{
+    for (size_t i = 0; i < p->capacity; ++i)
+    {
+        struct progress_entry *e = p->entries + i;
+        if (!e->job_id) continue;
+        enum sched_rc rc = job_inc_progress(e->job_id, e->token, e->delta);
+        if (rc && rc != SCHED_JOB_NOT_FOUND) return rc;
+    }
+    return SCHED_OK;
+}
+
+/*
+ * Writes every pending increment, in one transaction unless the caller
+ * already holds one. Nothing is dropped if the write fails, and what is
+ * written in the caller's transaction comes back if that rolls back.
+ */
+enum sched_rc progress_flush(void)
+{
+    struct progress *p = self();
+    pthread_mutex_lock(&p->lock);
+    p->last_flush = now_ms();
+    pthread_mutex_unlock(&p->lock);
+    if (!p->size) return SCHED_OK;
+
+    enum sched_rc rc = SCHED_OK;
+    bool own = !xsql_in_transaction();
+    if (!own && (rc = reserve_log(p, p->size))) return rc;
+    if (own && xsql_begin_transaction()) return EBEGINSTMT;
+    if ((rc = write_all(p)))
+    {
+        if (own) xsql_rollback_transaction();
+        return rc;
+    }
+    if (own && xsql_end_transaction())
+    {
+        xsql_rollback_transaction();
+        return EENDSTMT;
+    }
+    for (size_t i = 0; i < p->capacity && !own; ++i)
+        if (p->entries[i].job_id) p->log[p->nlog++] = p->entries[i];
+
+    pthread_mutex_lock(&p->lock);
+    memset(p->entries, 0, p->capacity * sizeof *p->entries);
+    p->size = 0;
+    pthread_mutex_unlock(&p->lock);
+    return SCHED_OK;
+}
+
+enum sched_rc progress_flush_job(int64_t job_id)
+{
+    struct progress *p = self();
+    struct progress_entry *e = find(p, job_id);
+    if (!e) return SCHED_OK;
+
+    enum sched_rc rc = SCHED_OK;
+    bool staged = xsql_in_transaction();
+    if (staged && (rc = reserve_log(p, 1))) return rc;
+    rc = job_inc_progress(job_id, e->token, e->delta);
+    if (rc && rc != SCHED_JOB_NOT_FOUND) return rc;
+    if (staged) p->log[p->nlog++] = *e;
+
+    pthread_mutex_lock(&p->lock);
+    erase(p, e);
+    pthread_mutex_unlock(&p->lock);
+    return SCHED_OK;
+}
+
+bool progress_due(struct progress *p, int interval_ms)
+{
+    if (interval_ms <= 0) return false;
+    pthread_mutex_lock(&p->lock);
+    bool due = p->size && now_ms() - p->last_flush >= interval_ms;
+    pthread_mutex_unlock(&p->lock);
+    return due;
+}
+
+/*
+ * Increments are only merged while they are non-negative and under one
+ * claim, for which
+ * MIN(MIN(x + a, 100) + b, 100) equals MIN(x + a + b, 100).
+ */
+enum sched_rc progress_add(int64_t job_id, int token, int delta)
+{
+    struct sched *h = sched_self();
+    struct progress *p = &h->progress;
+    enum sched_rc rc = SCHED_OK;
+    struct progress_entry *e = find(p, job_id);
+    if (delta < 0 || (e && e->token != token))
+    {
+        if ((rc = progress_flush_job(job_id))) return rc;
+        if (delta < 0) return job_inc_progress(job_id, token, delta);
+    }
+
+    struct progress_entry x = {job_id, token, delta};
+    pthread_mutex_lock(&p->lock);
+    rc = add(p, &x);
+    bool due = now_ms() - p->last_flush >= h->options.progress_flush_ms;
+    pthread_mutex_unlock(&p->lock);
+
+    if (rc) return rc;
+    return due ? progress_flush() : SCHED_OK;
+}
+
+void progress_drop(int64_t job_id)
+{
+    struct progress *p = self();
+    pthread_mutex_lock(&p->lock);
+    struct progress_entry *e = find(p, job_id);
+    if (e) erase(p, e);
+    pthread_mutex_unlock(&p->lock);
+}
+
+void progress_clear(void)
+{
+    struct progress *p = self();
+    pthread_mutex_lock(&p->lock);
+    if (p->entries) memset(p->entries, 0, p->capacity * sizeof *p->entries);
+    p->size = 0;
+    pthread_mutex_unlock(&p->lock);
+}
+
+/* Progress as it will read once pending increments are written. */
+int progress_merge(int64_t job_id, int progress)
+{
+    struct progress *p = self();
+    pthread_mutex_lock(&p->lock);
+    struct progress_entry *e = find(p, job_id);
+    if (e) progress = (int)(progress + e->delta < 100 ? progress + e->delta : 100);
+    pthread_mutex_unlock(&p->lock);
+    return progress;
+}
+
+size_t progress_mark(void) { return self()->nlog; }
+
+static void restore(struct progress *p, size_t mark)
+{
+    if (p->nlog == mark) return;
+    pthread_mutex_lock(&p->lock);
+    for (size_t i = mark; i < p->nlog; ++i)
+        add(p, p->log + i);
+    pthread_mutex_unlock(&p->lock);
+    p->nlog = mark;
+}
+
+/* For a rollback to a savepoint taken when the log was at mark. */
+void progress_rollback_to(size_t mark) { restore(self(), mark); }
+
+/* Transaction hooks of the writer connection. */
+int progress_on_commit(void *progress)
+{
+    ((struct progress *)progress)->nlog = 0;
+    return 0;
+}
+
+void progress_on_rollback(void *progress) { restore(progress, 0); }
@@ -0,0 +1,58 @@
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include "sched/rc.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct progress_entry
+{
+    int64_t job_id;
+    int token;
+    int64_t delta;
+};
+
+/*
+ * Progress increments not yet written, keyed by job id in an open
+ * addressing table. Only the writer changes the table, under the lock,
+ * since queries on reader connections look pending increments up while
+ * the writer adds them; the writer itself reads it without the lock.
+ *
+ * An entry belongs to one claim token of its job, see job.h, and one
+ * whose claim is gone by the time it is written is dropped.
+ *
+ * Increments written inside a transaction the caller owns are moved to
+ * the log, which is emptied when that transaction commits and put back
+ * into the table when it rolls back. Only the writer touches the log.
+ */
+struct progress
+{
+    pthread_mutex_t lock;
+    size_t size;
+    size_t capacity;
+    struct progress_entry *entries;
+    int64_t last_flush;
+
+    size_t nlog;
+    size_t log_capacity;
+    struct progress_entry *log;
+};
+
+enum sched_rc progress_init(struct progress *);
+void progress_del(struct progress *);
+
+enum sched_rc progress_add(int64_t job_id, int token, int delta);
+enum sched_rc progress_flush(void);
+bool progress_due(struct progress *, int interval_ms);
+enum sched_rc progress_flush_job(int64_t job_id);
+void progress_drop(int64_t job_id);
+void progress_clear(void);
+int progress_merge(int64_t job_id, int progress);
+size_t progress_mark(void);
+void progress_rollback_to(size_t mark);
+int progress_on_commit(void *progress);
+void progress_on_rollback(void *progress);
+
+#endif
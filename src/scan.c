@@ -1,5 +1,7 @@
 #include "scan.h"
 #include "error.h"
+#include "handle.h"
+#include "page.h"
 #include "prod.h"
 #include "sched/db.h"
 #include "sched/hmmer.h"
@@ -12,9 +14,12 @@
 #include "stmt.h"
 #include "utc.h"
 #include "xsql.h"
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 
+static struct seq_queue *queue(void) { return &sched_self()->queue; }
+
 void scan_init(struct sched_scan *scan)
 {
     scan->id = 0;
@@ -22,7 +27,7 @@ void scan_init(struct sched_scan *scan)
     scan->multi_hits = 0;
     scan->hmmer3_compat = 0;
     scan->job_id = 0;
-    seq_queue_init();
+    seq_queue_init(queue());
 }
 
 void sched_scan_init(struct sched_scan *scan, int64_t db_id, bool multi_hits,
@@ -41,13 +46,17 @@ enum sched_rc sched_scan_get_seqs(int64_t scan_id, sched_seq_set_func_t fn,
     enum sched_rc rc = sched_scan_get_by_id(&scan, scan_id);
     if (rc) return rc;
 
-    seq->id = 0;
-    seq->scan_id = scan_id;
-    while ((rc = sched_seq_scan_next(seq)) == SCHED_OK)
-    {
-        fn(seq, arg);
-    }
-    return rc == SCHED_SEQ_NOT_FOUND ? SCHED_OK : rc;
+    return seq_scan_get_all(scan_id, fn, seq, arg);
+}
+
+enum sched_rc sched_scan_get_seqs_dyn(int64_t scan_id, sched_seq_dyn_func_t *fn,
+                                      struct sched_seq_dyn *seq, void *arg)
+{
+    struct sched_scan scan = {0};
+    enum sched_rc rc = sched_scan_get_by_id(&scan, scan_id);
+    if (rc) return rc;
+
+    return seq_scan_get_all_dyn(scan_id, fn, seq, arg);
 }
 
 enum sched_rc sched_scan_get_prods(int64_t scan_id,
@@ -60,15 +69,28 @@ enum sched_rc sched_scan_get_prods(int64_t scan_id,
     enum sched_rc rc = sched_scan_get_by_id(&scan, scan_id);
     if (rc) return rc;
 
-    sched_prod_init(prod, scan_id);
-    while ((rc = prod_scan_next(prod)) == SCHED_OK)
-    {
-        rc = sched_hmmer_get_by_prod_id(hmmer, prod->id);
-        if (rc) return rc;
-        (*callb)(prod, hmmer, arg);
-        free((void *)hmmer->data);
-    }
-    return rc == SCHED_PROD_NOT_FOUND ? SCHED_OK : rc;
+    return prod_scan_get_all(scan_id, callb, prod, hmmer, arg);
+}
+
+enum sched_rc sched_scan_get_prods_dyn(int64_t scan_id, sched_prod_dyn_func_t *fn,
+                                       struct sched_prod_dyn *prod,
+                                       struct sched_hmmer *hmmer, void *arg)
+{
+    struct sched_scan scan = {0};
+    enum sched_rc rc = sched_scan_get_by_id(&scan, scan_id);
+    if (rc) return rc;
+
+    return prod_scan_get_all_dyn(scan_id, fn, prod, hmmer, arg);
+}
+
+enum sched_rc sched_scan_get_prods_view(int64_t scan_id,
+                                        sched_prod_view_func_t *fn, void *arg)
+{
+    struct sched_scan scan = {0};
+    enum sched_rc rc = sched_scan_get_by_id(&scan, scan_id);
+    if (rc) return rc;
+
+    return prod_scan_get_all_view(scan_id, fn, arg);
 }
 
 static enum sched_rc set_scan(struct sched_scan *scan, struct sqlite3_stmt *st)
@@ -125,9 +147,9 @@ static enum sched_rc submit(struct sched_scan *scan)
     return SCHED_OK;
 }
 
-void sched_scan_add_seq(char const *name, char const *data)
+enum sched_rc sched_scan_add_seq(char const *name, char const *data)
 {
-    seq_queue_add(name, data);
+    return seq_queue_add(queue(), name, data);
 }
 
 static enum sched_rc db_exists(int64_t db_id)
@@ -147,49 +169,74 @@ enum sched_rc scan_submit(void *scan, int64_t job_id)
     rc = submit(s);
     if (rc) return rc;
 
-    for (unsigned i = 0; i < seq_queue_size(); ++i)
-    {
-        struct sched_seq *seq = seq_queue_get(i);
-        seq->scan_id = s->id;
-        if ((rc = seq_submit(seq))) break;
-    }
+    struct seq_queue *q = queue();
+    for (unsigned i = 0; i < seq_queue_size(q) && !rc; ++i)
+        rc = seq_bulk_add(s->id, seq_queue_name(q, i), seq_queue_data(q, i));
+    if (!rc) rc = seq_bulk_flush();
 
-    seq_queue_init();
+    if (rc) seq_bulk_clear();
+    seq_queue_init(q);
     return rc;
 }
 
-enum sched_rc scan_wipe(void)
+enum sched_rc scan_exists(int64_t id)
 {
-    struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(SCAN_DELETE));
+    struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(SCAN_EXISTS));
     if (!st) return EFRESH;
 
-    enum sched_rc rc = xsql_step(st);
-    return rc == SCHED_END ? SCHED_OK : ESTEP;
+    if (xsql_bind_i64(st, 0, id)) return EBIND;
+
+    if (xsql_step(st) != SCHED_OK) return ESTEP;
+    bool found = xsql_get_int(st, 0);
+
+    if (xsql_step(st) != SCHED_END) return ESTEP;
+    return found ? SCHED_OK : SCHED_SCAN_NOT_FOUND;
 }
 
-static enum sched_rc scan_next(struct sched_scan *scan)
+enum sched_rc scan_delete_by_id(int64_t id)
 {
-    struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(SCAN_GET_NEXT));
+    struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(SCAN_DELETE_BY_ID));
     if (!st) return EFRESH;
 
-    if (xsql_bind_i64(st, 0, scan->id)) return EBIND;
+    if (xsql_bind_i64(st, 0, id)) return EBIND;
 
-    enum sched_rc rc = xsql_step(st);
-    if (rc == SCHED_END) return SCHED_SCAN_NOT_FOUND;
-    if (rc != SCHED_OK) return ESTEP;
+    return xsql_step(st) != SCHED_END ? ESTEP : SCHED_OK;
+}
 
-    if ((rc = set_scan(scan, st))) return rc;
+enum sched_rc scan_wipe(void)
+{
+    struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(SCAN_DELETE));
+    if (!st) return EFRESH;
 
-    return xsql_step(st) != SCHED_END ? ESTEP : SCHED_OK;
+    enum sched_rc rc = xsql_step(st);
+    return rc == SCHED_END ? SCHED_OK : ESTEP;
 }
 
 enum sched_rc sched_scan_get_all(sched_scan_set_func_t fn,
                                  struct sched_scan *scan, void *arg)
 {
     enum sched_rc rc = SCHED_OK;
+    int64_t limit = page_limit();
+    int64_t count = 0;
 
     scan_init(scan);
-    while ((rc = scan_next(scan)) == SCHED_OK)
-        fn(scan, arg);
-    return rc == SCHED_SCAN_NOT_FOUND ? SCHED_OK : rc;
+    do
+    {
+        struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(SCAN_GET_PAGE));
+        if (!st) return EFRESH;
+
+        if (xsql_bind_i64(st, 0, scan->id)) return EBIND;
+        if (xsql_bind_i64(st, 1, limit)) return EBIND;
+
+        count = 0;
+        while ((rc = xsql_step(st)) == SCHED_OK)
+        {
+            if ((rc = set_scan(scan, st))) return rc;
+            fn(scan, arg);
+            ++count;
+        }
+        if (rc != SCHED_END) return ESTEP;
+    } while (count == limit);
+
+    return SCHED_OK;
 }
@@ -4,6 +4,8 @@
 #include <stdint.h>
 
 enum sched_rc scan_submit(void *scan, int64_t job_id);
+enum sched_rc scan_exists(int64_t id);
+enum sched_rc scan_delete_by_id(int64_t id);
 enum sched_rc scan_wipe(void);
 
 #endif
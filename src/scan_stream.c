@@ -0,0 +1,276 @@
+#include "scan_stream.h"
+#include "error.h"
+#include "handle.h"
+#include "job.h"
+#include "sched/job.h"
+#include "sched/limits.h"
+#include "sched/rc.h"
+#include "sched/scan.h"
+#include "scan.h"
+#include "seq.h"
+#include "seq_queue.h"
+#include "xsql.h"
+#include "xstrcpy.h"
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * A streamed scan is created with its job on hold, so that workers do not
+ * claim it while sequences are still arriving. Sequences are queued in
+ * memory and, once stream_commit_kib worth has arrived, written in one
+ * transaction by the push that fills the queue, so no transaction outlives
+ * an API call. The job is released with the last batch on commit.
+ */
+static struct scan_stream *stream(void) { return &sched_self()->stream; }
+
+struct buf
+{
+    size_t len;
+    size_t capacity;
+    char *data;
+};
+
+static enum sched_rc buf_append(struct buf *buf, char const *str, size_t len)
+{
+    if (buf->len + len + 1 > buf->capacity)
+    {
+        size_t cap = buf->capacity ? buf->capacity : 256;
+        while (cap < buf->len + len + 1)
+            cap *= 2;
+        char *data = realloc(buf->data, cap);
+        if (!data) return error(SCHED_NOT_ENOUGH_MEMORY);
+        buf->data = data;
+        buf->capacity = cap;
+    }
+    memcpy(buf->data + buf->len, str, len);
+    buf->len += len;
+    buf->data[buf->len] = '\0';
+    return SCHED_OK;
+}
+
+static void buf_clear(struct buf *buf)
+{
+    buf->len = 0;
+    if (buf->data) buf->data[0] = '\0';
+}
+
+static void buf_del(struct buf *buf) { free(buf->data); }
+
+static enum sched_rc remove_scan(void)
+{
+    if (xsql_begin_transaction()) return EBEGINSTMT;
+
+    enum sched_rc rc = SCHED_OK;
+    if ((rc = seq_delete_by_scan_id(stream()->scan_id))) goto cleanup;
+    if ((rc = scan_delete_by_id(stream()->scan_id))) goto cleanup;
+    if ((rc = sched_job_remove(stream()->job_id))) goto cleanup;
+
+    return xsql_end_transaction() ? EENDSTMT : SCHED_OK;
+
+cleanup:
+    xsql_rollback_transaction();
+    return rc;
+}
+
+static enum sched_rc abort_stream(enum sched_rc rc)
+{
+    seq_queue_init(&stream()->queue);
+    seq_bulk_clear();
+    remove_scan();
+    stream()->active = false;
+    return rc;
+}
+
+enum sched_rc sched_scan_begin(struct sched_scan *scan, struct sched_job *job)
+{
+    if (stream()->active) return error(SCHED_SCAN_ALREADY_STREAMING);
+
+    sched_job_init(job, SCHED_SCAN);
+    XSTRCPY(job, state, "hold");
+    enum sched_rc rc = sched_job_submit(job, scan);
+    if (rc) return rc;
+
+    stream()->active = true;
+    stream()->job_id = job->id;
+    stream()->scan_id = scan->id;
+    return SCHED_OK;
+}
+
+static enum sched_rc write_batch(bool release)
+{
+    bool own = !xsql_in_transaction();
+    if (own && xsql_begin_transaction()) return EBEGINSTMT;
+
+    struct seq_queue *q = &stream()->queue;
+    int64_t scan_id = stream()->scan_id;
+    enum sched_rc rc = SCHED_OK;
+    for (unsigned i = 0; i < seq_queue_size(q) && !rc; ++i)
+        rc = seq_bulk_add(scan_id, seq_queue_name(q, i), seq_queue_data(q, i));
+    if (!rc) rc = seq_bulk_flush();
+    if (!rc && release) rc = job_release(stream()->job_id);
+    if (rc)
+    {
+        if (own) xsql_rollback_transaction();
+        return rc;
+    }
+
+    if (own && xsql_end_transaction()) return EENDSTMT;
+    seq_queue_init(q);
+    return SCHED_OK;
+}
+
+static bool batch_full(void)
+{
+    int kib = sched_self()->options.stream_commit_kib;
+    return kib > 0 && stream()->queue.used >= (size_t)kib * 1024;
+}
+
+enum sched_rc sched_scan_push_seq(char const *name, char const *data)
+{
+    if (!stream()->active) return error(SCHED_SCAN_NOT_STREAMING);
+
+    enum sched_rc rc = seq_queue_add(&stream()->queue, name, data);
+    if (rc) return abort_stream(rc);
+
+    if (batch_full() && (rc = write_batch(false))) return abort_stream(rc);
+
+    return SCHED_OK;
+}
+
+static char *trim_right(char *str, size_t *len)
+{
+    while (*len > 0 && isspace((unsigned char)str[*len - 1]))
+        str[--*len] = '\0';
+    return str;
+}
+
+static size_t first_word_len(char const *str)
+{
+    size_t n = 0;
+    while (str[n] && !isspace((unsigned char)str[n]))
+        ++n;
+    return n;
+}
+
+static enum sched_rc append_residues(struct buf *data, char const *line)
+{
+    enum sched_rc rc = SCHED_OK;
+    while (*line)
+    {
+        while (*line && isspace((unsigned char)*line))
+            ++line;
+        size_t n = first_word_len(line);
+        if (n && (rc = buf_append(data, line, n))) return rc;
+        line += n;
+    }
+    return rc;
+}
+
+/*
+ * Sequence names are the first word of the header line. Lines longer
+ * than the read buffer are handled as continuations of the same line.
+ */
+static enum sched_rc push_fasta(FILE *fp, struct buf *name, struct buf *data)
+{
+    enum sched_rc rc = SCHED_OK;
+    char line[4096];
+    bool line_start = true;
+    bool in_header = false;
+    bool has_seq = false;
+
+    while (fgets(line, sizeof line, fp))
+    {
+        size_t len = strlen(line);
+        bool line_end = len > 0 && line[len - 1] == '\n';
+        trim_right(line, &len);
+
+        if (line_start && line[0] == '>')
+        {
+            if (has_seq && (rc = sched_scan_push_seq(name->data, data->data)))
+                return rc;
+
+            buf_clear(name);
+            buf_clear(data);
+            char const *header = line + 1;
+            if ((rc = buf_append(name, header, first_word_len(header))))
+                return rc;
+            if (name->len == 0) return EPARSEFILE;
+            has_seq = true;
+            in_header = !line_end;
+        }
+        else if (in_header)
+        {
+            in_header = !line_end;
+        }
+        else if (len > 0)
+        {
+            if (!has_seq) return EPARSEFILE;
+            if ((rc = append_residues(data, line))) return rc;
+        }
+        line_start = line_end;
+    }
+    if (ferror(fp)) return error(SCHED_FAIL_READ_FILE);
+
+    if (has_seq) rc = sched_scan_push_seq(name->data, data->data);
+    return rc;
+}
+
+enum sched_rc sched_scan_push_fasta(FILE *fp)
+{
+    if (!stream()->active) return error(SCHED_SCAN_NOT_STREAMING);
+
+    struct buf name = {0};
+    struct buf data = {0};
+    enum sched_rc rc = push_fasta(fp, &name, &data);
+    buf_del(&name);
+    buf_del(&data);
+
+    /* A failed push has already aborted the stream. */
+    if (rc && stream()->active) return abort_stream(rc);
+    return rc;
+}
+
+enum sched_rc sched_scan_push_fasta_fd(int fd)
+{
+    if (!stream()->active) return error(SCHED_SCAN_NOT_STREAMING);
+
+    int dup_fd = dup(fd);
+    if (dup_fd < 0) return abort_stream(error(SCHED_FAIL_OPEN_FILE));
+
+    FILE *fp = fdopen(dup_fd, "rb");
+    if (!fp)
+    {
+        close(dup_fd);
+        return abort_stream(error(SCHED_FAIL_OPEN_FILE));
+    }
+
+    enum sched_rc rc = sched_scan_push_fasta(fp);
+    if (fclose(fp) && !rc) return abort_stream(error(SCHED_FAIL_CLOSE_FILE));
+    return rc;
+}
+
+enum sched_rc sched_scan_commit(void)
+{
+    if (!stream()->active) return error(SCHED_SCAN_NOT_STREAMING);
+
+    enum sched_rc rc = write_batch(true);
+    if (rc) return abort_stream(rc);
+
+    stream()->active = false;
+    return SCHED_OK;
+}
+
+enum sched_rc sched_scan_rollback(void)
+{
+    if (!stream()->active) return error(SCHED_SCAN_NOT_STREAMING);
+
+    seq_queue_init(&stream()->queue);
+    seq_bulk_clear();
+    enum sched_rc rc = remove_scan();
+    stream()->active = false;
+    return rc;
+}
@@ -0,0 +1,16 @@
+#ifndef SCAN_STREAM_H
+#define SCAN_STREAM_H
+
+#include "seq_queue.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+struct scan_stream
+{
+    bool active;
+    int64_t job_id;
+    int64_t scan_id;
+    struct seq_queue queue;
+};
+
+#endif
@@ -1,12 +1,17 @@
 #include "sched/sched.h"
+#include "async.h"
 #include "bug.h"
 #include "compiler.h"
 #include "db.h"
 #include "error.h"
+#include "handle.h"
 #include "hmm.h"
 #include "hmmer.h"
 #include "job.h"
+#include "migrate.h"
+#include "pool.h"
 #include "prod.h"
+#include "progress.h"
 #include "scan.h"
 #include "sched/rc.h"
 #include "sched_health.h"
@@ -14,24 +19,82 @@
 #include "seq.h"
 #include "seq_queue.h"
 #include "stmt.h"
+#include "unit.h"
 #include "utc.h"
 #include "xfile.h"
 #include "xsql.h"
 #include "xstrcpy.h"
 #include <assert.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
-char sched_filepath[FILENAME_MAX] = {0};
-
 enum sched_rc emerge_sched(char const *filepath);
 enum sched_rc is_empty(char const *filepath, bool *empty);
 
+void sched_options_init(struct sched_options *opts)
+{
+    opts->wal = true;
+    opts->synchronous = SCHED_SYNCHRONOUS_NORMAL;
+    opts->mmap_size = 256 * 1024 * 1024;
+    opts->cache_size_kib = 64 * 1024;
+    opts->page_size = 4096;
+    opts->busy_timeout_ms = 30000;
+    opts->readers = 4;
+    opts->progress_flush_ms = 0;
+    opts->progress_unflushed_reads = true;
+    opts->lease_secs = 300;
+    opts->max_retries = 3;
+    opts->parse_threads = 0;
+    opts->io_threads = 0;
+    opts->stream_commit_kib = 8 * 1024;
+    opts->bulk_rows = 256;
+}
+
 enum sched_rc sched_init(char const *filepath)
 {
-    if (xstrcpy(sched_filepath, filepath, ARRAY_SIZE(sched_filepath)))
+    return sched_init_ex(filepath, 0);
+}
+
+static enum sched_rc init_write_lock(struct sched *h)
+{
+    pthread_mutexattr_t attr;
+    if (pthread_mutexattr_init(&attr)) return error(SCHED_NOT_ENOUGH_MEMORY);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    int code = pthread_mutex_init(&h->write_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    return code ? error(SCHED_NOT_ENOUGH_MEMORY) : SCHED_OK;
+}
+
+/* Pending progress and announcements follow the writer's transactions. */
+static int on_commit(void *h)
+{
+    return progress_on_commit(&((struct sched *)h)->progress);
+}
+
+static void on_rollback(void *h)
+{
+    progress_on_rollback(&((struct sched *)h)->progress);
+    notify_on_rollback(&((struct sched *)h)->notify);
+}
+
+static void on_committed(void *h)
+{
+    notify_on_commit(&((struct sched *)h)->notify);
+}
+
+static enum sched_rc open_handle(struct sched *h, char const *filepath,
+                                 struct sched_options const *opts)
+{
+    if (opts)
+        h->options = *opts;
+    else
+        sched_options_init(&h->options);
+
+    if (xstrcpy(h->filepath, filepath, ARRAY_SIZE(h->filepath)))
         return error(SCHED_TOO_LONG_FILE_PATH);
 
     if (!xsql_is_thread_safe()) return error(SCHED_SQLITE3_NOT_THREAD_SAFE);
@@ -50,8 +113,96 @@ enum sched_rc sched_init(char const *filepath)
         if (rc) return rc;
     }
 
-    if (xsql_open(sched_filepath)) return error(SCHED_FAIL_OPEN_SCHED_FILE);
-    return stmt_init() ? (xsql_close(), EEXEC) : SCHED_OK;
+    if ((rc = progress_init(&h->progress))) return rc;
+    if (xsql_open(h->filepath, &h->options))
+    {
+        progress_del(&h->progress);
+        return error(SCHED_FAIL_OPEN_SCHED_FILE);
+    }
+    xsql_set_hooks(
+        &(struct xsql_hooks){on_commit, on_rollback, on_committed, h});
+    if ((rc = migrate())) return (progress_del(&h->progress), xsql_close(), rc);
+    if (stmt_init())
+        return (progress_del(&h->progress), stmt_del(), xsql_close(), EEXEC);
+    if ((rc = notify_open(&h->notify, h->filepath)))
+        return (progress_del(&h->progress), stmt_del(), xsql_close(), rc);
+    return SCHED_OK;
+}
+
+static enum sched_rc close_handle(void)
+{
+    enum sched_rc rc = progress_flush();
+    notify_close(&sched_self()->notify);
+    progress_del(&sched_self()->progress);
+    stmt_del();
+    seq_queue_cleanup(&sched_self()->queue);
+    seq_queue_cleanup(&sched_self()->stream.queue);
+    enum sched_rc close_rc = xsql_close();
+    return rc ? rc : close_rc;
+}
+
+static enum sched_rc open_pool(struct sched *h, int size)
+{
+    enum sched_rc rc = init_write_lock(h);
+    if (rc) return rc;
+    if ((rc = pool_open(&h->pool, h->filepath, &h->options, size)))
+        pthread_mutex_destroy(&h->write_lock);
+    return rc;
+}
+
+static void close_pool(struct sched *h)
+{
+    pool_close(&h->pool);
+    pthread_mutex_destroy(&h->write_lock);
+}
+
+enum sched_rc sched_init_ex(char const *filepath,
+                            struct sched_options const *opts)
+{
+    struct sched *h = sched_main();
+    memset(h, 0, sizeof *h);
+    struct sched *prev = sched_use(h);
+    struct conn *reader = sched_bind(0);
+    enum sched_rc rc = open_handle(h, filepath, opts);
+    if (!rc && (rc = open_pool(h, 0))) close_handle();
+    sched_bind(reader);
+    sched_use(prev);
+    return rc;
+}
+
+enum sched_rc sched_open(struct sched **out, char const *filepath,
+                         struct sched_options const *opts)
+{
+    struct sched *h = calloc(1, sizeof *h);
+    if (!h) return error(SCHED_NOT_ENOUGH_MEMORY);
+
+    struct sched *prev = sched_use(h);
+    struct conn *reader = sched_bind(0);
+    enum sched_rc rc = open_handle(h, filepath, opts);
+    if (!rc && (rc = open_pool(h, h->options.readers))) close_handle();
+    sched_bind(reader);
+    sched_use(prev);
+
+    if (rc)
+    {
+        free(h);
+        return rc;
+    }
+    *out = h;
+    return SCHED_OK;
+}
+
+enum sched_rc sched_close(struct sched *h)
+{
+    async_close(h);
+    struct sched *prev = sched_use(h);
+    struct conn *reader = sched_bind(0);
+    close_pool(h);
+    enum sched_rc rc = close_handle();
+    sched_bind(reader);
+    sched_use(prev == h ? 0 : prev);
+    free(h);
+    return rc;
 }
 
 enum sched_rc sched_health_check(struct sched_health *health)
@@ -67,8 +218,13 @@ enum sched_rc sched_health_check(struct sched_health *health)
 
 enum sched_rc sched_cleanup(void)
 {
-    stmt_del();
-    return xsql_close();
+    struct sched *prev = sched_use(sched_main());
+    struct conn *reader = sched_bind(0);
+    close_pool(sched_main());
+    enum sched_rc rc = close_handle();
+    sched_bind(reader);
+    sched_use(prev == sched_main() ? 0 : prev);
+    return rc;
 }
 
 static void delete_db_file(struct sched_db *db, void *arg)
@@ -92,6 +248,9 @@ enum sched_rc sched_wipe(void)
         goto cleanup;
     }
 
+    rc = unit_wipe();
+    if (rc) goto cleanup;
+
     rc = hmmer_wipe();
     if (rc) goto cleanup;
 
@@ -130,7 +289,8 @@ cleanup:
 
 enum sched_rc emerge_sched(char const *filepath)
 {
-    if (xsql_open(filepath)) return error(SCHED_FAIL_OPEN_SCHED_FILE);
+    if (xsql_open(filepath, &sched_self()->options))
+        return error(SCHED_FAIL_OPEN_SCHED_FILE);
 
     if (xsql_exec((char const *)schema, 0, 0)) return (xsql_close(), EEXEC);
 
@@ -148,7 +308,8 @@ static int is_empty_fn(void *empty, int argc, char **argv, char **cols)
 
 enum sched_rc is_empty(char const *filepath, bool *empty)
 {
-    if (xsql_open(filepath)) return error(SCHED_FAIL_OPEN_SCHED_FILE);
+    if (xsql_open(filepath, &sched_self()->options))
+        return error(SCHED_FAIL_OPEN_SCHED_FILE);
 
     *empty = true;
     static char const *const sql = "SELECT name FROM sqlite_master;";
@@ -7,15 +7,23 @@ CREATE TABLE job (
     -- type: 0 for scan jobs; 1 for hmm jobs.
     type INTEGER CHECK(type IN (0, 1)) NOT NULL,
 
-    state TEXT CHECK(state IN ('pend', 'run', 'done', 'fail')) NOT NULL,
+    -- state: 0 for pend; 1 for run; 2 for done; 3 for fail; 4 for hold.
+    state INTEGER CHECK(state IN (0, 1, 2, 3, 4)) NOT NULL,
     progress INTEGER CHECK(0 <= progress AND progress <= 100) NOT NULL,
     error TEXT NOT NULL,
 
     submission INTEGER NOT NULL,
     exec_started INTEGER NOT NULL,
-    exec_ended INTEGER NOT NULL
+    exec_ended INTEGER NOT NULL,
+
+    -- A running job whose lease expires is requeued, at most max retries.
+    retries INTEGER NOT NULL DEFAULT 0,
+    lease_expiry INTEGER NOT NULL DEFAULT 0
 );
 
+CREATE INDEX job_pend ON job (id) WHERE state = 0;
+CREATE INDEX job_lease ON job (lease_expiry) WHERE state = 1;
+
 CREATE TABLE hmm (
     id INTEGER PRIMARY KEY UNIQUE NOT NULL,
     xxh3 INTEGER UNIQUE NOT NULL,
@@ -49,6 +57,27 @@ CREATE TABLE seq (
     data TEXT NOT NULL
 );
 
+-- Contiguous ranges of a scan's sequences, claimed and run separately.
+CREATE TABLE unit (
+    id INTEGER PRIMARY KEY UNIQUE NOT NULL,
+    job_id INTEGER REFERENCES job (id) NOT NULL,
+    scan_id INTEGER REFERENCES scan (id) NOT NULL,
+
+    seq_min INTEGER NOT NULL,
+    seq_max INTEGER NOT NULL,
+
+    -- state: 0 for pend; 1 for run; 2 for done; 3 for fail.
+    state INTEGER CHECK(state IN (0, 1, 2, 3)) NOT NULL,
+    error TEXT NOT NULL,
+
+    exec_started INTEGER NOT NULL,
+    exec_ended INTEGER NOT NULL,
+
+    -- Leased like jobs: an expired unit is requeued, at most max retries.
+    retries INTEGER NOT NULL DEFAULT 0,
+    lease_expiry INTEGER NOT NULL DEFAULT 0
+);
+
 CREATE TABLE prod (
     id INTEGER PRIMARY KEY UNIQUE NOT NULL,
 
@@ -76,6 +105,21 @@ CREATE TABLE hmmer (
     prod_id INTEGER REFERENCES prod (id) NOT NULL
 );
 
+-- Lookup and foreign key indexes.
+CREATE INDEX hmm_job_id ON hmm (job_id);
+CREATE INDEX db_hmm_id ON db (hmm_id);
+CREATE INDEX scan_db_id ON scan (db_id);
+CREATE INDEX scan_job_id ON scan (job_id);
+CREATE INDEX seq_scan_id ON seq (scan_id);
+CREATE INDEX prod_scan_id ON prod (scan_id);
+CREATE INDEX prod_seq_id ON prod (seq_id);
+CREATE UNIQUE INDEX hmmer_prod_id ON hmmer (prod_id);
+CREATE INDEX unit_job_id ON unit (job_id);
+CREATE INDEX unit_pend ON unit (id) WHERE state = 0;
+CREATE INDEX unit_lease ON unit (lease_expiry) WHERE state = 1;
+
+PRAGMA user_version = 7;
+
 COMMIT TRANSACTION;
 
 PRAGMA foreign_keys = ON;
@@ -1,10 +1,14 @@
 #include "seq.h"
 #include "error.h"
+#include "page.h"
 #include "sched/rc.h"
 #include "sched/seq.h"
 #include "stmt.h"
 #include "xsql.h"
 #include "xstrcpy.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
 
 void sched_seq_init(struct sched_seq *seq, int64_t seq_id, int64_t scan_id,
                     char const *name, char const *data)
@@ -20,18 +24,53 @@ static void seq_init(struct sched_seq *seq)
     sched_seq_init(seq, 0, 0, "", "");
 }
 
-enum sched_rc seq_submit(struct sched_seq *seq)
+static struct xsql_txt txt_of(char const *str)
 {
-    struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(SEQ_INSERT));
+    return (struct xsql_txt){(int)strlen(str), str};
+}
+
+/* Queued rows are written once a full batch is ready or on flush. */
+enum sched_rc seq_bulk_add(int64_t scan_id, char const *name, char const *data)
+{
+    struct xsql_bulk *bulk = stmt_bulk(SEQ_INSERT_BULK);
+    enum sched_rc rc = SCHED_OK;
+
+    if ((rc = xsql_bulk_i64(bulk, scan_id))) return rc;
+    if ((rc = xsql_bulk_txt(bulk, txt_of(name)))) return rc;
+    if ((rc = xsql_bulk_txt(bulk, txt_of(data)))) return rc;
+
+    return xsql_bulk_full(bulk) ? xsql_bulk_flush(bulk) : SCHED_OK;
+}
+
+enum sched_rc seq_bulk_flush(void)
+{
+    return xsql_bulk_flush(stmt_bulk(SEQ_INSERT_BULK));
+}
+
+void seq_bulk_clear(void) { xsql_bulk_clear(stmt_bulk(SEQ_INSERT_BULK)); }
+
+enum sched_rc seq_exists(int64_t id)
+{
+    struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(SEQ_EXISTS));
     if (!st) return EFRESH;
 
-    if (xsql_bind_i64(st, 0, seq->scan_id)) return EBIND;
-    if (xsql_bind_str(st, 1, seq->name)) return EBIND;
-    if (xsql_bind_str(st, 2, seq->data)) return EBIND;
+    if (xsql_bind_i64(st, 0, id)) return EBIND;
+
+    if (xsql_step(st) != SCHED_OK) return ESTEP;
+    bool found = xsql_get_int(st, 0);
 
     if (xsql_step(st) != SCHED_END) return ESTEP;
-    seq->id = xsql_last_id();
-    return SCHED_OK;
+    return found ? SCHED_OK : SCHED_SEQ_NOT_FOUND;
+}
+
+enum sched_rc seq_delete_by_scan_id(int64_t scan_id)
+{
+    struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(SEQ_DELETE_BY_SCAN_ID));
+    if (!st) return EFRESH;
+
+    if (xsql_bind_i64(st, 0, scan_id)) return EBIND;
+
+    return xsql_step(st) != SCHED_END ? ESTEP : SCHED_OK;
 }
 
 enum sched_rc seq_wipe(void)
@@ -43,80 +82,243 @@ enum sched_rc seq_wipe(void)
     return rc == SCHED_END ? SCHED_OK : ESTEP;
 }
 
-static enum sched_rc next_seq_scan_id(int64_t scan_id, int64_t *seq_id)
+static enum sched_rc set_seq(struct sched_seq *seq, struct sqlite3_stmt *st)
 {
-    struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(SEQ_GET_SCAN_NEXT));
-    if (!st) return EFRESH;
+    seq->id = xsql_get_i64(st, 0);
+    seq->scan_id = xsql_get_i64(st, 1);
 
-    if (xsql_bind_i64(st, 0, *seq_id)) return EBIND;
-    if (xsql_bind_i64(st, 1, scan_id)) return EBIND;
+    if (xsql_cpy_txt(st, 2, XSQL_TXT_OF(*seq, name))) return EGETTXT;
+    if (xsql_cpy_txt(st, 3, XSQL_TXT_OF(*seq, data))) return EGETTXT;
 
-    enum sched_rc rc = xsql_step(st);
-    if (rc == SCHED_END) return SCHED_SEQ_NOT_FOUND;
-    if (rc != SCHED_OK) return ESTEP;
-    *seq_id = xsql_get_i64(st, 0);
+    return SCHED_OK;
+}
 
-    return xsql_step(st) != SCHED_END ? ESTEP : SCHED_OK;
+static enum sched_rc set_dyn(struct sched_seq_dyn *seq,
+                             struct sqlite3_stmt *st)
+{
+    seq->id = xsql_get_i64(st, 0);
+    seq->scan_id = xsql_get_i64(st, 1);
+
+    struct xsql_txt name = xsql_get_txt(st, 2);
+    if (!name.str) return EGETTXT;
+    enum sched_rc rc =
+        xstrcpy_grow(&seq->name, &seq->name_capacity, name.str, name.len);
+    if (rc) return rc;
+    seq->name_len = name.len;
+
+    struct xsql_txt data = xsql_get_txt(st, 3);
+    if (!data.str) return EGETTXT;
+    rc = xstrcpy_grow(&seq->data, &seq->data_capacity, data.str, data.len);
+    if (rc) return rc;
+    seq->data_len = data.len;
+
+    return SCHED_OK;
 }
 
-static enum sched_rc next_seq_id(int64_t *seq_id)
+static struct sqlite3_stmt *fresh_page(enum stmt stmt, int64_t id,
+                                       int64_t scan_id, int64_t max_id,
+                                       int64_t limit)
 {
-    struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(SEQ_GET_NEXT));
-    if (!st) return EFRESH;
+    struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(stmt));
+    if (!st) return 0;
 
-    if (xsql_bind_i64(st, 0, *seq_id)) return EBIND;
+    int col = 0;
+    if (xsql_bind_i64(st, col++, id)) return 0;
+    if (stmt != SEQ_GET_PAGE && xsql_bind_i64(st, col++, scan_id)) return 0;
+    if (stmt == SEQ_GET_RANGE_PAGE && xsql_bind_i64(st, col++, max_id))
+        return 0;
+    if (xsql_bind_i64(st, col++, limit)) return 0;
 
-    enum sched_rc rc = xsql_step(st);
-    if (rc == SCHED_END) return SCHED_SEQ_NOT_FOUND;
-    if (rc != SCHED_OK) return ESTEP;
-    *seq_id = xsql_get_i64(st, 0);
+    return st;
+}
 
-    return xsql_step(st) != SCHED_END ? ESTEP : SCHED_OK;
+typedef enum sched_rc(row_func_t)(struct sqlite3_stmt *, void *ctx);
+
+static enum sched_rc get_range(enum stmt stmt, int64_t scan_id, int64_t id,
+                               int64_t max_id, row_func_t *row, void *ctx)
+{
+    enum sched_rc rc = SCHED_OK;
+    int64_t limit = page_limit();
+    int64_t count = 0;
+
+    do
+    {
+        struct sqlite3_stmt *st = fresh_page(stmt, id, scan_id, max_id, limit);
+        if (!st) return EFRESH;
+
+        count = 0;
+        while ((rc = xsql_step(st)) == SCHED_OK)
+        {
+            id = xsql_get_i64(st, 0);
+            if ((rc = (*row)(st, ctx))) return rc;
+            ++count;
+        }
+        if (rc != SCHED_END) return ESTEP;
+    } while (count == limit);
+
+    return SCHED_OK;
 }
 
-enum sched_rc sched_seq_get_by_id(struct sched_seq *seq, int64_t id)
+static enum sched_rc get_all(enum stmt stmt, int64_t scan_id, row_func_t *row,
+                             void *ctx)
 {
-    struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(SEQ_GET));
-    if (!st) return EFRESH;
+    return get_range(stmt, scan_id, 0, 0, row, ctx);
+}
 
-    if (xsql_bind_i64(st, 0, id)) return EBIND;
+struct fixed_ctx
+{
+    sched_seq_set_func_t *fn;
+    struct sched_seq *seq;
+    void *arg;
+};
+
+static enum sched_rc fixed_row(struct sqlite3_stmt *st, void *ctx)
+{
+    struct fixed_ctx *c = ctx;
+    enum sched_rc rc = set_seq(c->seq, st);
+    if (rc) return rc;
+    (*c->fn)(c->seq, c->arg);
+    return SCHED_OK;
+}
 
+struct dyn_ctx
+{
+    sched_seq_dyn_func_t *fn;
+    struct sched_seq_dyn *seq;
+    void *arg;
+};
+
+static enum sched_rc dyn_row(struct sqlite3_stmt *st, void *ctx)
+{
+    struct dyn_ctx *c = ctx;
+    enum sched_rc rc = set_dyn(c->seq, st);
+    if (rc) return rc;
+    (*c->fn)(c->seq, c->arg);
+    return SCHED_OK;
+}
+
+static struct sqlite3_stmt *fresh_get(int64_t id)
+{
+    struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(SEQ_GET));
+    if (!st) return 0;
+    return xsql_bind_i64(st, 0, id) ? 0 : st;
+}
+
+static enum sched_rc step_one(struct sqlite3_stmt *st)
+{
     enum sched_rc rc = xsql_step(st);
     if (rc == SCHED_END) return SCHED_SEQ_NOT_FOUND;
-    if (rc != SCHED_OK) ESTEP;
+    return rc != SCHED_OK ? ESTEP : SCHED_OK;
+}
 
-    seq->id = xsql_get_i64(st, 0);
-    seq->scan_id = xsql_get_i64(st, 1);
+enum sched_rc sched_seq_get_by_id(struct sched_seq *seq, int64_t id)
+{
+    struct sqlite3_stmt *st = fresh_get(id);
+    if (!st) return EFRESH;
 
-    if (xsql_cpy_txt(st, 2, XSQL_TXT_OF(*seq, name))) return EGETTXT;
-    if (xsql_cpy_txt(st, 3, XSQL_TXT_OF(*seq, data))) return EGETTXT;
+    enum sched_rc rc = step_one(st);
+    if (rc) return rc;
+
+    if ((rc = set_seq(seq, st))) return rc;
 
     return xsql_step(st) != SCHED_END ? ESTEP : SCHED_OK;
 }
 
 enum sched_rc sched_seq_scan_next(struct sched_seq *seq)
 {
-    enum sched_rc rc = next_seq_scan_id(seq->scan_id, &seq->id);
-    if (rc == SCHED_SEQ_NOT_FOUND) return SCHED_SEQ_NOT_FOUND;
-    if (rc != SCHED_OK) return rc;
-    return sched_seq_get_by_id(seq, seq->id);
+    struct sqlite3_stmt *st =
+        fresh_page(SEQ_GET_SCAN_PAGE, seq->id, seq->scan_id, 0, 1);
+    if (!st) return EFRESH;
+
+    enum sched_rc rc = step_one(st);
+    if (rc) return rc;
+
+    if ((rc = set_seq(seq, st))) return rc;
+
+    return xsql_step(st) != SCHED_END ? ESTEP : SCHED_OK;
 }
 
-static enum sched_rc next_seq(struct sched_seq *seq)
+enum sched_rc seq_scan_get_all(int64_t scan_id, sched_seq_set_func_t fn,
+                               struct sched_seq *seq, void *arg)
 {
-    enum sched_rc rc = next_seq_id(&seq->id);
-    if (rc == SCHED_SEQ_NOT_FOUND) return SCHED_SEQ_NOT_FOUND;
-    if (rc != SCHED_OK) return rc;
-    return sched_seq_get_by_id(seq, seq->id);
+    struct fixed_ctx ctx = {fn, seq, arg};
+    seq->id = 0;
+    seq->scan_id = scan_id;
+    return get_all(SEQ_GET_SCAN_PAGE, scan_id, fixed_row, &ctx);
 }
 
-enum sched_rc sched_seq_get_all(sched_seq_set_func_t fn, struct sched_seq *seq,
+enum sched_rc seq_range_get_all(int64_t scan_id, int64_t min_id, int64_t max_id,
+                                sched_seq_set_func_t fn, struct sched_seq *seq,
                                 void *arg)
 {
-    enum sched_rc rc = SCHED_OK;
+    struct fixed_ctx ctx = {fn, seq, arg};
+    seq->id = 0;
+    seq->scan_id = scan_id;
+    return get_range(SEQ_GET_RANGE_PAGE, scan_id, min_id - 1, max_id, fixed_row,
+                     &ctx);
+}
 
+enum sched_rc sched_seq_get_all(sched_seq_set_func_t fn, struct sched_seq *seq,
+                                void *arg)
+{
+    struct fixed_ctx ctx = {fn, seq, arg};
     seq_init(seq);
-    while ((rc = next_seq(seq)) == SCHED_OK)
-        fn(seq, arg);
-    return rc == SCHED_SEQ_NOT_FOUND ? SCHED_OK : rc;
+    return get_all(SEQ_GET_PAGE, 0, fixed_row, &ctx);
+}
+
+void sched_seq_dyn_init(struct sched_seq_dyn *seq)
+{
+    memset(seq, 0, sizeof *seq);
+}
+
+void sched_seq_dyn_cleanup(struct sched_seq_dyn *seq)
+{
+    free(seq->name);
+    free(seq->data);
+    sched_seq_dyn_init(seq);
+}
+
+enum sched_rc sched_seq_dyn_get_by_id(struct sched_seq_dyn *seq, int64_t id)
+{
+    struct sqlite3_stmt *st = fresh_get(id);
+    if (!st) return EFRESH;
+
+    enum sched_rc rc = step_one(st);
+    if (rc) return rc;
+
+    if ((rc = set_dyn(seq, st))) return rc;
+
+    return xsql_step(st) != SCHED_END ? ESTEP : SCHED_OK;
+}
+
+enum sched_rc sched_seq_dyn_scan_next(struct sched_seq_dyn *seq)
+{
+    struct sqlite3_stmt *st =
+        fresh_page(SEQ_GET_SCAN_PAGE, seq->id, seq->scan_id, 0, 1);
+    if (!st) return EFRESH;
+
+    enum sched_rc rc = step_one(st);
+    if (rc) return rc;
+
+    if ((rc = set_dyn(seq, st))) return rc;
+
+    return xsql_step(st) != SCHED_END ? ESTEP : SCHED_OK;
+}
+
+enum sched_rc seq_scan_get_all_dyn(int64_t scan_id, sched_seq_dyn_func_t *fn,
+                                   struct sched_seq_dyn *seq, void *arg)
+{
+    struct dyn_ctx ctx = {fn, seq, arg};
+    seq->id = 0;
+    seq->scan_id = scan_id;
+    return get_all(SEQ_GET_SCAN_PAGE, scan_id, dyn_row, &ctx);
+}
+
+enum sched_rc sched_seq_dyn_get_all(sched_seq_dyn_func_t *fn,
+                                    struct sched_seq_dyn *seq, void *arg)
+{
+    struct dyn_ctx ctx = {fn, seq, arg};
+    seq->id = 0;
+    seq->scan_id = 0;
+    return get_all(SEQ_GET_PAGE, 0, dyn_row, &ctx);
 }
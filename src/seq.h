@@ -1,11 +1,21 @@
 #ifndef SEQ_H
 #define SEQ_H
 
+#include "sched/seq.h"
 #include <stdint.h>
 
-struct sched_seq;
-
-enum sched_rc seq_submit(struct sched_seq *seq);
+enum sched_rc seq_bulk_add(int64_t scan_id, char const *name, char const *data);
+enum sched_rc seq_bulk_flush(void);
+void seq_bulk_clear(void);
+enum sched_rc seq_scan_get_all(int64_t scan_id, sched_seq_set_func_t fn,
+                               struct sched_seq *seq, void *arg);
+enum sched_rc seq_range_get_all(int64_t scan_id, int64_t min_id, int64_t max_id,
+                                sched_seq_set_func_t fn, struct sched_seq *seq,
+                                void *arg);
+enum sched_rc seq_scan_get_all_dyn(int64_t scan_id, sched_seq_dyn_func_t *fn,
+                                   struct sched_seq_dyn *seq, void *arg);
+enum sched_rc seq_exists(int64_t id);
+enum sched_rc seq_delete_by_scan_id(int64_t scan_id);
 enum sched_rc seq_wipe(void);
 
 #endif
@@ -1,20 +1,78 @@
 #include "seq_queue.h"
-#include "sched/limits.h"
-#include "sched/seq.h"
+#include "error.h"
+#include "sched/rc.h"
+#include <stdlib.h>
+#include <string.h>
 
-struct seq_queue
+void seq_queue_init(struct seq_queue *q)
 {
-    unsigned curr;
-    struct sched_seq seq[SCHED_NUM_SEQS_PER_JOB];
-} queue = {0};
+    q->size = 0;
+    q->used = 0;
+}
+
+void seq_queue_cleanup(struct seq_queue *q)
+{
+    free(q->entries);
+    free(q->arena);
+    memset(q, 0, sizeof *q);
+}
+
+static enum sched_rc grow_entries(struct seq_queue *q)
+{
+    unsigned capacity = q->capacity ? q->capacity * 2 : 64;
+    struct seq_queue_entry *entries =
+        realloc(q->entries, capacity * sizeof *entries);
+    if (!entries) return error(SCHED_NOT_ENOUGH_MEMORY);
+    q->entries = entries;
+    q->capacity = capacity;
+    return SCHED_OK;
+}
 
-void seq_queue_init(void) { queue.curr = 0; }
+static enum sched_rc grow_arena(struct seq_queue *q, size_t size)
+{
+    size_t avail = q->avail ? q->avail : 4096;
+    while (avail < size)
+        avail *= 2;
+    char *arena = realloc(q->arena, avail);
+    if (!arena) return error(SCHED_NOT_ENOUGH_MEMORY);
+    q->arena = arena;
+    q->avail = avail;
+    return SCHED_OK;
+}
 
-void seq_queue_add(char const *name, char const *data)
+static size_t push(struct seq_queue *q, char const *str, size_t size)
 {
-    sched_seq_init(queue.seq + queue.curr++, 0, 0, name, data);
+    size_t offset = q->used;
+    memcpy(q->arena + offset, str, size);
+    q->used += size;
+    return offset;
 }
 
-unsigned seq_queue_size(void) { return queue.curr; }
+enum sched_rc seq_queue_add(struct seq_queue *q, char const *name,
+                            char const *data)
+{
+    enum sched_rc rc = SCHED_OK;
+    if (q->size == q->capacity && (rc = grow_entries(q))) return rc;
 
-struct sched_seq *seq_queue_get(unsigned i) { return queue.seq + i; }
+    size_t name_size = strlen(name) + 1;
+    size_t data_size = strlen(data) + 1;
+    size_t size = q->used + name_size + data_size;
+    if (size > q->avail && (rc = grow_arena(q, size))) return rc;
+
+    struct seq_queue_entry *e = q->entries + q->size++;
+    e->name = push(q, name, name_size);
+    e->data = push(q, data, data_size);
+    return SCHED_OK;
+}
+
+unsigned seq_queue_size(struct seq_queue const *q) { return q->size; }
+
+char const *seq_queue_name(struct seq_queue const *q, unsigned i)
+{
+    return q->arena + q->entries[i].name;
+}
+
+char const *seq_queue_data(struct seq_queue const *q, unsigned i)
+{
+    return q->arena + q->entries[i].data;
+}
@@ -1,11 +1,38 @@
 #ifndef SEQ_QUEUE_H
 #define SEQ_QUEUE_H
 
+#include "sched/rc.h"
+#include <stddef.h>
 #include <stdint.h>
 
-void seq_queue_init(void);
-void seq_queue_add(char const *name, char const *data);
-unsigned seq_queue_size(void);
-struct sched_seq *seq_queue_get(unsigned i);
+struct seq_queue_entry
+{
+    size_t name;
+    size_t data;
+};
+
+/*
+ * Names and sequences are packed back to back into a single arena that
+ * grows on demand, so memory follows the size of what was queued.
+ * Offsets are kept instead of pointers since the arena can move.
+ */
+struct seq_queue
+{
+    unsigned size;
+    unsigned capacity;
+    struct seq_queue_entry *entries;
+
+    size_t used;
+    size_t avail;
+    char *arena;
+};
+
+void seq_queue_init(struct seq_queue *);
+void seq_queue_cleanup(struct seq_queue *);
+enum sched_rc seq_queue_add(struct seq_queue *, char const *name,
+                            char const *data);
+unsigned seq_queue_size(struct seq_queue const *);
+char const *seq_queue_name(struct seq_queue const *, unsigned i);
+char const *seq_queue_data(struct seq_queue const *, unsigned i);
 
 #endif
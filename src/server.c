@@ -0,0 +1,702 @@
+#include "compiler.h"
+#include "error.h"
+#include "progress.h"
+#include "sched/sched.h"
+#include "wire.h"
+#include "xsql.h"
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/*
+ * Owns the only connection to a sched file and serves its API to local
+ * worker processes over a Unix domain socket (<file>.sock by default).
+ * Requests that arrive together, from one or many clients, are run in a
+ * single transaction and answered once it commits, each request under a
+ * savepoint of its own. Handlers write their reply payload to out.
+ */
+
+enum
+{
+    MAX_CLIENTS = 1024,
+    MAX_CLAIM_BATCH = 1024,
+    MAX_SEQ_PAGE = WIRE_SEQ_PAGE,
+    SEQ_PAGE_BYTES = 1024 * 1024,
+    READ_CHUNK = 64 * 1024,
+};
+
+struct client
+{
+    int fd;
+    bool closed;
+    struct wire in;
+    struct wire out;
+};
+
+/* Replies written inside the open transaction, failed if it does not commit. */
+struct mark
+{
+    struct client *client;
+    size_t frame;
+};
+
+static struct
+{
+    int fd;
+    char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    struct client *clients[MAX_CLIENTS];
+    int nclients;
+    struct mark *marks;
+    int nmarks;
+    int capmarks;
+    bool in_txn;
+    struct wire reply;
+    struct sched_seq seq;
+} server = {.fd = -1};
+
+static volatile sig_atomic_t stop = 0;
+
+static void on_signal(int signo)
+{
+    (void)signo;
+    stop = 1;
+}
+
+static enum sched_rc job_get_by_id(struct wire *req, struct wire *out)
+{
+    struct sched_job job = {0};
+    enum sched_rc rc = sched_job_get_by_id(&job, wire_get_i64(req));
+    if (!rc) wire_put_job(out, &job);
+    return rc;
+}
+
+static enum sched_rc job_next_pend(struct wire *req, struct wire *out)
+{
+    (void)req;
+    struct sched_job job = {0};
+    enum sched_rc rc = sched_job_next_pend(&job);
+    if (!rc) wire_put_job(out, &job);
+    return rc;
+}
+
+static enum sched_rc job_claim_next(struct wire *req, struct wire *out)
+{
+    (void)req;
+    struct sched_job job = {0};
+    enum sched_rc rc = sched_job_claim_next(&job);
+    if (!rc) wire_put_job(out, &job);
+    return rc;
+}
+
+static enum sched_rc job_claim_batch(struct wire *req, struct wire *out)
+{
+    int max = (int)wire_get_u32(req);
+    if (max > MAX_CLAIM_BATCH) max = MAX_CLAIM_BATCH;
+    if (max <= 0)
+    {
+        wire_put_u32(out, 0);
+        return SCHED_OK;
+    }
+
+    struct sched_job *jobs = calloc((size_t)max, sizeof *jobs);
+    if (!jobs) return error(SCHED_NOT_ENOUGH_MEMORY);
+
+    int n = 0;
+    enum sched_rc rc = sched_job_claim_batch(jobs, max, &n);
+    if (!rc)
+    {
+        wire_put_u32(out, (uint32_t)n);
+        for (int i = 0; i < n; ++i)
+            wire_put_job(out, jobs + i);
+    }
+    free(jobs);
+    return rc;
+}
+
+static enum sched_rc job_set_run(struct wire *req, struct wire *out)
+{
+    (void)out;
+    return sched_job_set_run(wire_get_i64(req));
+}
+
+static enum sched_rc job_set_fail(struct wire *req, struct wire *out)
+{
+    (void)out;
+    char msg[SCHED_JOB_ERROR_SIZE] = {0};
+    int64_t id = wire_get_i64(req);
+    int token = (int)wire_get_u32(req);
+    wire_get_str(req, msg, sizeof msg);
+    if (req->fail) return SCHED_INVALID_MESSAGE;
+    if (token == WIRE_ANY_CLAIM) return sched_job_set_fail(id, msg);
+    return sched_job_set_fail_claimed(id, token, msg);
+}
+
+static enum sched_rc job_set_done(struct wire *req, struct wire *out)
+{
+    (void)out;
+    int64_t id = wire_get_i64(req);
+    int token = (int)wire_get_u32(req);
+    if (token == WIRE_ANY_CLAIM) return sched_job_set_done(id);
+    return sched_job_set_done_claimed(id, token);
+}
+
+static enum sched_rc job_heartbeat(struct wire *req, struct wire *out)
+{
+    (void)out;
+    int64_t id = wire_get_i64(req);
+    return sched_job_heartbeat(id, (int)wire_get_u32(req));
+}
+
+static enum sched_rc job_reap_expired(struct wire *req, struct wire *out)
+{
+    (void)req;
+    int n = 0;
+    enum sched_rc rc = sched_job_reap_expired(&n);
+    if (!rc) wire_put_u32(out, (uint32_t)n);
+    return rc;
+}
+
+static enum sched_rc job_state(struct wire *req, struct wire *out)
+{
+    enum sched_job_state state = 0;
+    enum sched_rc rc = sched_job_state(wire_get_i64(req), &state);
+    if (!rc) wire_put_u32(out, (uint32_t)state);
+    return rc;
+}
+
+static enum sched_rc job_increment_progress(struct wire *req, struct wire *out)
+{
+    (void)out;
+    int64_t id = wire_get_i64(req);
+    int token = (int)wire_get_u32(req);
+    int progress = (int)wire_get_u32(req);
+    if (token == WIRE_ANY_CLAIM)
+        return sched_job_increment_progress(id, progress);
+    return sched_job_increment_progress_claimed(id, token, progress);
+}
+
+static enum sched_rc job_submit_hmm(struct wire *req, struct wire *out)
+{
+    struct sched_job job = {0};
+    struct sched_hmm hmm = {0};
+    wire_get_job(req, &job);
+    wire_get_hmm(req, &hmm);
+    if (req->fail) return SCHED_INVALID_MESSAGE;
+
+    char filename[SCHED_FILENAME_SIZE] = {0};
+    strcpy(filename, hmm.filename);
+    enum sched_rc rc = sched_hmm_set_file(&hmm, filename);
+    if (!rc) rc = sched_job_submit(&job, &hmm);
+    if (rc) return rc;
+
+    wire_put_job(out, &job);
+    wire_put_hmm(out, &hmm);
+    return SCHED_OK;
+}
+
+static enum sched_rc job_submit_scan(struct wire *req, struct wire *out)
+{
+    struct sched_job job = {0};
+    struct sched_scan scan = {0};
+    wire_get_job(req, &job);
+    wire_get_scan(req, &scan);
+    sched_scan_init(&scan, scan.db_id, scan.multi_hits, scan.hmmer3_compat);
+
+    uint32_t nseqs = wire_get_u32(req);
+    for (uint32_t i = 0; i < nseqs && !req->fail; ++i)
+    {
+        struct sched_seq *seq = &server.seq;
+        wire_get_str(req, seq->name, sizeof seq->name);
+        wire_get_str(req, seq->data, sizeof seq->data);
+        if (req->fail) break;
+        enum sched_rc rc = sched_scan_add_seq(seq->name, seq->data);
+        if (rc) return rc;
+    }
+    if (req->fail) return SCHED_INVALID_MESSAGE;
+
+    enum sched_rc rc = sched_job_submit(&job, &scan);
+    if (rc) return rc;
+
+    wire_put_job(out, &job);
+    wire_put_scan(out, &scan);
+    return SCHED_OK;
+}
+
+static enum sched_rc db_add(struct wire *req, struct wire *out)
+{
+    char filename[SCHED_FILENAME_SIZE] = {0};
+    wire_get_str(req, filename, sizeof filename);
+    if (req->fail) return SCHED_INVALID_MESSAGE;
+
+    struct sched_db db = {0};
+    sched_db_init(&db);
+    enum sched_rc rc = sched_db_add(&db, filename);
+    if (!rc) wire_put_db(out, &db);
+    return rc;
+}
+
+static enum sched_rc db_get_by_id(struct wire *req, struct wire *out)
+{
+    struct sched_db db = {0};
+    enum sched_rc rc = sched_db_get_by_id(&db, wire_get_i64(req));
+    if (!rc) wire_put_db(out, &db);
+    return rc;
+}
+
+static enum sched_rc scan_get_by_id(struct wire *req, struct wire *out)
+{
+    struct sched_scan scan = {0};
+    enum sched_rc rc = sched_scan_get_by_id(&scan, wire_get_i64(req));
+    if (!rc) wire_put_scan(out, &scan);
+    return rc;
+}
+
+static enum sched_rc scan_get_by_job_id(struct wire *req, struct wire *out)
+{
+    struct sched_scan scan = {0};
+    enum sched_rc rc = sched_scan_get_by_job_id(&scan, wire_get_i64(req));
+    if (!rc) wire_put_scan(out, &scan);
+    return rc;
+}
+
+/*
+ * Replies with the sequences of a scan that follow a given id, as a count,
+ * the sequences and whether more may follow. Pages end after a number of
+ * sequences or once they grow past SEQ_PAGE_BYTES, so the client asks for
+ * the next one only after handling this one.
+ */
+static enum sched_rc scan_get_seqs(struct wire *req, struct wire *out)
+{
+    struct sched_seq *seq = &server.seq;
+    sched_seq_init(seq, 0, 0, "", "");
+    seq->scan_id = wire_get_i64(req);
+    seq->id = wire_get_i64(req);
+    uint32_t max = wire_get_u32(req);
+    if (max > MAX_SEQ_PAGE) max = MAX_SEQ_PAGE;
+    if (req->fail) return SCHED_INVALID_MESSAGE;
+
+    struct sched_scan scan = {0};
+    enum sched_rc rc = sched_scan_get_by_id(&scan, seq->scan_id);
+    if (rc) return rc;
+
+    uint32_t n = 0;
+    size_t count = out->size;
+    wire_put_u32(out, 0);
+    while (n < max && out->size < SEQ_PAGE_BYTES && !out->fail)
+    {
+        if ((rc = sched_seq_scan_next(seq))) break;
+        wire_put_seq(out, seq);
+        ++n;
+    }
+    if (rc && rc != SCHED_SEQ_NOT_FOUND) return rc;
+    wire_put_u8(out, rc != SCHED_SEQ_NOT_FOUND);
+
+    if (!out->fail) memcpy(out->data + count, &n, sizeof n);
+    return SCHED_OK;
+}
+
+static enum sched_rc seq_get_by_id(struct wire *req, struct wire *out)
+{
+    struct sched_seq *seq = &server.seq;
+    enum sched_rc rc = sched_seq_get_by_id(seq, wire_get_i64(req));
+    if (!rc) wire_put_seq(out, seq);
+    return rc;
+}
+
+static enum sched_rc seq_scan_next(struct wire *req, struct wire *out)
+{
+    struct sched_seq *seq = &server.seq;
+    sched_seq_init(seq, 0, 0, "", "");
+    seq->id = wire_get_i64(req);
+    seq->scan_id = wire_get_i64(req);
+    enum sched_rc rc = sched_seq_scan_next(seq);
+    if (!rc) wire_put_seq(out, seq);
+    return rc;
+}
+
+static enum sched_rc prod_add_file(struct wire *req, struct wire *out)
+{
+    (void)out;
+    char filename[FILENAME_MAX] = {0};
+    wire_get_str(req, filename, sizeof filename);
+    return req->fail ? SCHED_INVALID_MESSAGE : sched_prod_add_file(filename);
+}
+
+static enum sched_rc prodset_add(struct wire *req, struct wire *out)
+{
+    (void)out;
+    char dir[FILENAME_MAX] = {0};
+    wire_get_str(req, dir, sizeof dir);
+    return req->fail ? SCHED_INVALID_MESSAGE : sched_prodset_add(dir);
+}
+
+typedef enum sched_rc(handler_t)(struct wire *req, struct wire *out);
+
+static struct
+{
+    handler_t *handler;
+    /* Opens a transaction of its own, so cannot join the batch. */
+    bool alone;
+} const ops[] = {
+    [WIRE_JOB_GET_BY_ID] = {job_get_by_id, false},
+    [WIRE_JOB_NEXT_PEND] = {job_next_pend, false},
+    [WIRE_JOB_CLAIM_NEXT] = {job_claim_next, false},
+    [WIRE_JOB_CLAIM_BATCH] = {job_claim_batch, false},
+    [WIRE_JOB_SET_RUN] = {job_set_run, false},
+    [WIRE_JOB_SET_FAIL] = {job_set_fail, false},
+    [WIRE_JOB_SET_DONE] = {job_set_done, false},
+    [WIRE_JOB_HEARTBEAT] = {job_heartbeat, false},
+    [WIRE_JOB_REAP_EXPIRED] = {job_reap_expired, false},
+    [WIRE_JOB_STATE] = {job_state, false},
+    [WIRE_JOB_INCREMENT_PROGRESS] = {job_increment_progress, false},
+    [WIRE_JOB_SUBMIT_HMM] = {job_submit_hmm, true},
+    [WIRE_JOB_SUBMIT_SCAN] = {job_submit_scan, true},
+    [WIRE_DB_ADD] = {db_add, false},
+    [WIRE_DB_GET_BY_ID] = {db_get_by_id, false},
+    [WIRE_SCAN_GET_BY_ID] = {scan_get_by_id, false},
+    [WIRE_SCAN_GET_BY_JOB_ID] = {scan_get_by_job_id, false},
+    [WIRE_SCAN_GET_SEQS] = {scan_get_seqs, false},
+    [WIRE_SEQ_GET_BY_ID] = {seq_get_by_id, false},
+    [WIRE_SEQ_SCAN_NEXT] = {seq_scan_next, false},
+    [WIRE_PROD_ADD_FILE] = {prod_add_file, true},
+    [WIRE_PRODSET_ADD] = {prodset_add, true},
+};
+
+static_assert(ARRAY_SIZE(ops) == WIRE_OP_SIZE, "Cover all enum cases");
+
+static void set_reply_rc(struct wire *out, size_t frame, enum sched_rc rc)
+{
+    uint32_t val = (uint32_t)rc;
+    memcpy(out->data + frame + WIRE_RC_OFFSET, &val, sizeof val);
+}
+
+static void commit(void)
+{
+    if (!server.in_txn) return;
+    server.in_txn = false;
+
+    if (xsql_end_transaction())
+    {
+        xsql_rollback_transaction();
+        for (int i = 0; i < server.nmarks; ++i)
+        {
+            struct mark *m = server.marks + i;
+            set_reply_rc(&m->client->out, m->frame, EENDSTMT);
+        }
+    }
+    server.nmarks = 0;
+}
+
+static bool add_mark(struct client *c, size_t frame)
+{
+    if (server.nmarks == server.capmarks)
+    {
+        int cap = server.capmarks ? 2 * server.capmarks : 64;
+        struct mark *marks = realloc(server.marks, (size_t)cap * sizeof *marks);
+        if (!marks) return false;
+        server.marks = marks;
+        server.capmarks = cap;
+    }
+    server.marks[server.nmarks++] = (struct mark){c, frame};
+    return true;
+}
+
+static enum sched_rc begin(void)
+{
+    if (server.in_txn) return SCHED_OK;
+    if (xsql_begin_transaction()) return EBEGINSTMT;
+    server.in_txn = true;
+    return SCHED_OK;
+}
+
+static enum sched_rc run(unsigned op, struct wire *req)
+{
+    enum sched_rc rc = (*ops[op].handler)(req, &server.reply);
+    if (!rc && req->fail) rc = error(SCHED_INVALID_MESSAGE);
+    if (!rc && server.reply.fail) rc = error(SCHED_NOT_ENOUGH_MEMORY);
+    return rc;
+}
+
+/* A failed request is undone alone, leaving the rest of the batch. */
+static enum sched_rc run_in_batch(unsigned op, struct wire *req)
+{
+    size_t mark = progress_mark();
+    if (xsql_savepoint("request")) return EBEGINSTMT;
+
+    enum sched_rc rc = run(op, req);
+    if (rc)
+    {
+        xsql_rollback_to("request");
+        progress_rollback_to(mark);
+    }
+    if (xsql_release("request") && !rc) rc = EENDSTMT;
+    return rc;
+}
+
+static void dispatch(struct client *c, struct wire *req)
+{
+    unsigned op = wire_get_u8(req);
+    enum sched_rc rc = SCHED_OK;
+
+    wire_clear(&server.reply);
+    if (req->fail || op >= WIRE_OP_SIZE)
+        rc = error(SCHED_INVALID_MESSAGE);
+    else if (ops[op].alone)
+    {
+        commit();
+        rc = run(op, req);
+    }
+    else if (!(rc = begin()))
+        rc = run_in_batch(op, req);
+
+    size_t frame = wire_begin(&c->out);
+    wire_put_u8(&c->out, WIRE_REPLY);
+    wire_put_u32(&c->out, (uint32_t)rc);
+    if (!rc) wire_put_mem(&c->out, server.reply.data, server.reply.size);
+    wire_end(&c->out, frame);
+
+    if (c->out.fail || (server.in_txn && !add_mark(c, frame))) c->closed = true;
+}
+
+/* Runs every complete request received so far, then commits once. */
+static void run_batch(void)
+{
+    for (int i = 0; i < server.nclients; ++i)
+    {
+        struct client *c = server.clients[i];
+        size_t size = 0;
+        while (!c->closed && wire_frame(&c->in, &size))
+        {
+            struct wire req = c->in;
+            req.pos = WIRE_HEADER_SIZE;
+            req.size = size;
+            dispatch(c, &req);
+            wire_consume(&c->in, size);
+        }
+    }
+    commit();
+}
+
+static void drop_client(int i)
+{
+    struct client *c = server.clients[i];
+    close(c->fd);
+    wire_cleanup(&c->in);
+    wire_cleanup(&c->out);
+    free(c);
+    server.clients[i] = server.clients[--server.nclients];
+}
+
+static void accept_clients(void)
+{
+    int fd = -1;
+    while ((fd = accept(server.fd, 0, 0)) >= 0)
+    {
+        struct client *c = calloc(1, sizeof *c);
+        if (!c || server.nclients == MAX_CLIENTS)
+        {
+            free(c);
+            close(fd);
+            continue;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        c->fd = fd;
+        wire_init(&c->in);
+        wire_init(&c->out);
+        server.clients[server.nclients++] = c;
+    }
+}
+
+static void receive(struct client *c)
+{
+    while (!c->closed)
+    {
+        if (!wire_reserve(&c->in, READ_CHUNK))
+        {
+            c->closed = true;
+            return;
+        }
+        ssize_t n = read(c->fd, c->in.data + c->in.size, READ_CHUNK);
+        if (n > 0)
+            c->in.size += (size_t)n;
+        else if (n < 0 && errno == EINTR)
+            continue;
+        else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        else
+            c->closed = true;
+    }
+
+    size_t size = 0;
+    if (wire_frame(&c->in, &size) && size > WIRE_MAX_FRAME) c->closed = true;
+}
+
+static void transmit(struct client *c)
+{
+    size_t sent = 0;
+    while (sent < c->out.size && !c->closed)
+    {
+        ssize_t n = write(c->fd, c->out.data + sent, c->out.size - sent);
+        if (n > 0)
+            sent += (size_t)n;
+        else if (n < 0 && errno == EINTR)
+            continue;
+        else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        else
+            c->closed = true;
+    }
+    wire_consume(&c->out, sent);
+}
+
+static int serve(void)
+{
+    static struct pollfd fds[MAX_CLIENTS + 1];
+
+    while (!stop)
+    {
+        fds[0] = (struct pollfd){server.fd, POLLIN, 0};
+        for (int i = 0; i < server.nclients; ++i)
+        {
+            struct client *c = server.clients[i];
+            short events = c->out.size ? POLLIN | POLLOUT : POLLIN;
+            fds[i + 1] = (struct pollfd){c->fd, events, 0};
+        }
+
+        int nfds = server.nclients + 1;
+        if (poll(fds, (nfds_t)nfds, -1) < 0)
+        {
+            if (errno == EINTR) continue;
+            perror("poll");
+            return 1;
+        }
+
+        for (int i = 0; i < server.nclients; ++i)
+        {
+            if (fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR))
+                receive(server.clients[i]);
+        }
+        if (fds[0].revents & POLLIN) accept_clients();
+
+        run_batch();
+
+        for (int i = server.nclients - 1; i >= 0; --i)
+        {
+            struct client *c = server.clients[i];
+            if (c->out.size) transmit(c);
+            if (c->closed) drop_client(i);
+        }
+    }
+    return 0;
+}
+
+static bool already_running(struct sockaddr_un const *addr)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return false;
+    bool alive = !connect(fd, (struct sockaddr const *)addr, sizeof *addr);
+    close(fd);
+    return alive;
+}
+
+static int listen_on(char const *path)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof addr.sun_path)
+    {
+        fprintf(stderr, "socket path is too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    if (already_running(&addr))
+    {
+        fprintf(stderr, "a server is already listening on %s\n", path);
+        return -1;
+    }
+    unlink(path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return (perror("socket"), -1);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof addr) || listen(fd, 128))
+    {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+static void usage(char const *prog)
+{
+    fprintf(stderr, "usage: %s [-s socket] sched-file\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+    char const *socket_path = 0;
+    int opt = 0;
+    while ((opt = getopt(argc, argv, "s:h")) != -1)
+    {
+        if (opt == 's')
+            socket_path = optarg;
+        else
+            return (usage(argv[0]), opt == 'h' ? 0 : 1);
+    }
+    if (optind + 1 != argc) return (usage(argv[0]), 1);
+    char const *filepath = argv[optind];
+
+    if (!socket_path)
+    {
+        int n = snprintf(server.path, sizeof server.path, "%s.sock", filepath);
+        if (n < 0 || n >= (int)sizeof server.path)
+            return (fprintf(stderr, "socket path is too long\n"), 1);
+        socket_path = server.path;
+    }
+    else if (strlen(socket_path) < sizeof server.path)
+        strcpy(server.path, socket_path);
+
+    struct sigaction sa = {0};
+    sa.sa_handler = on_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, 0);
+    sigaction(SIGTERM, &sa, 0);
+    signal(SIGPIPE, SIG_IGN);
+
+    enum sched_rc rc = sched_init(filepath);
+    if (rc)
+    {
+        fprintf(stderr, "%s: %s\n", filepath, sched_error_string(rc));
+        return 1;
+    }
+
+    wire_init(&server.reply);
+    int code = 1;
+    if ((server.fd = listen_on(socket_path)) >= 0)
+    {
+        code = serve();
+        close(server.fd);
+        unlink(server.path);
+    }
+
+    while (server.nclients)
+        drop_client(server.nclients - 1);
+    free(server.marks);
+    wire_cleanup(&server.reply);
+
+    if ((rc = sched_cleanup()))
+    {
+        fprintf(stderr, "%s: %s\n", filepath, sched_error_string(rc));
+        code = 1;
+    }
+    return code;
+}
@@ -1,6 +1,7 @@
 #include "stmt.h"
 #include "compiler.h"
 #include "error.h"
+#include "handle.h"
 #include "sched.h"
 #include "sched/sched.h"
 #include "xsql.h"
@@ -16,7 +17,7 @@ static char const *const queries[] =
     [HMM_GET_BY_JOB_ID]   = "SELECT * FROM hmm WHERE   job_id = ?;",
     [HMM_GET_BY_XXH3]     = "SELECT * FROM hmm WHERE    xxh3  = ?;",
     [HMM_GET_BY_FILENAME] = "SELECT * FROM hmm WHERE filename = ?;",
-    [HMM_GET_NEXT]        = "SELECT * FROM hmm WHERE id > ? ORDER BY id ASC LIMIT 1;",
+    [HMM_GET_PAGE]        = "SELECT * FROM hmm WHERE id > ? ORDER BY id ASC LIMIT ?;",
 
     [HMM_DELETE_BY_ID]    = "DELETE FROM hmm WHERE id = ?;",
     [HMM_DELETE]          = "DELETE FROM hmm;",
@@ -28,24 +29,43 @@ static char const *const queries[] =
     [DB_GET_BY_XXH3]     = "SELECT * FROM db WHERE     xxh3 = ?;",
     [DB_GET_BY_FILENAME] = "SELECT * FROM db WHERE filename = ?;",
     [DB_GET_BY_HMM_ID]   = "SELECT * FROM db WHERE   hmm_id = ?;",
-    [DB_GET_NEXT]        = "SELECT * FROM db WHERE id > ? ORDER BY id ASC LIMIT 1;",
+    [DB_GET_PAGE]        = "SELECT * FROM db WHERE id > ? ORDER BY id ASC LIMIT ?;",
 
     [DB_DELETE_BY_ID] = "DELETE FROM db WHERE id = ?;",
     [DB_DELETE]       = "DELETE FROM db;",
 
     /* --- JOB queries --- */
+    /* state: 0 for pend; 1 for run; 2 for done; 3 for fail; 4 for hold. */
     [JOB_INSERT] = "INSERT INTO job (type, state, progress, error, submission, exec_started, exec_ended) "
                    "VALUES          (   ?,     ?,        ?,     ?,          ?,            ?,          ?);",
 
-    [JOB_GET_PEND]  = "SELECT    id FROM job WHERE state = 'pend' ORDER BY id LIMIT 1;",
+    [JOB_GET_PEND]  = "SELECT    id FROM job WHERE state = 0 ORDER BY id LIMIT 1;",
     [JOB_GET_STATE] = "SELECT state FROM job WHERE    id = ?;",
     [JOB_GET]       = "SELECT     * FROM job WHERE    id = ?;",
-    [JOB_GET_NEXT]  = "SELECT     * FROM job WHERE    id > ? ORDER BY id ASC LIMIT 1;",
-
-    [JOB_SET_RUN]      = "UPDATE job SET state =  'run', exec_started = ?                 WHERE id = ? AND state = 'pend';",
-    [JOB_SET_ERROR]    = "UPDATE job SET state = 'fail', error        = ?, exec_ended = ? WHERE id = ?;",
-    [JOB_SET_DONE]     = "UPDATE job SET state = 'done', exec_ended   = ?                 WHERE id = ?;",
-    [JOB_INC_PROGRESS] = "UPDATE job SET progress = MIN(progress + ?, 100)                WHERE id = ?;",
+    [JOB_GET_PAGE]  = "SELECT     * FROM job WHERE    id > ? ORDER BY id ASC LIMIT ?;",
+
+    [JOB_CLAIM_NEXT]  = "UPDATE job SET state = 1, exec_started = ?, lease_expiry = ? "
+                        "WHERE id = (SELECT id FROM job WHERE state = 0 ORDER BY id LIMIT 1) RETURNING *;",
+    [JOB_CLAIM_BATCH] = "UPDATE job SET state = 1, exec_started = ?, lease_expiry = ? "
+                        "WHERE id IN (SELECT id FROM job WHERE state = 0 ORDER BY id LIMIT ?) RETURNING *;",
+
+    [JOB_RELEASE]      = "UPDATE job SET state = 0                                   WHERE id = ? AND state = 4;",
+    [JOB_SET_RUN]      = "UPDATE job SET state = 1, exec_started = ?, lease_expiry = ? WHERE id = ? AND state = 0;",
+    /* Claim token: the retries the job was claimed with, negative for any. */
+    [JOB_HEARTBEAT]    = "UPDATE job SET lease_expiry = ?                            WHERE id = ? AND state = 1 AND retries = ? AND lease_expiry > 0;",
+    [JOB_SET_ERROR]    = "UPDATE job SET state = 3, error      = ?1, exec_ended = ?2 WHERE id = ?3 AND (?4 < 0 OR (state = 1 AND retries = ?4));",
+    [JOB_SET_DONE]     = "UPDATE job SET state = 2, exec_ended = ?1                  WHERE id = ?2 AND (?3 < 0 OR (state = 1 AND retries = ?3));",
+    [JOB_INC_PROGRESS] = "UPDATE job SET progress = MIN(progress + ?1, 100)          WHERE id = ?2 AND (?3 < 0 OR (state = 1 AND retries = ?3));",
+    [JOB_CHECK_CLAIM]  = "SELECT 1 FROM job                                          WHERE id = ?  AND state = 1 AND retries = ?;",
+
+    /* Expired jobs go back to pend until they run out of retries. */
+    [JOB_REAP_EXPIRED] = "UPDATE job SET "
+                         "state        = CASE WHEN retries < ?2 THEN 0 ELSE 3 END, "
+                         "error        = CASE WHEN retries < ?2 THEN error ELSE 'lease expired' END, "
+                         "exec_ended   = CASE WHEN retries < ?2 THEN exec_ended ELSE ?1 END, "
+                         "retries      = retries + 1, "
+                         "lease_expiry = 0 "
+                         "WHERE state = 1 AND lease_expiry > 0 AND lease_expiry <= ?1 RETURNING state;",
 
     [JOB_DELETE_BY_ID] = "DELETE FROM job WHERE id = ?;",
     [JOB_DELETE]       = "DELETE FROM job;",
@@ -55,29 +75,34 @@ static char const *const queries[] =
                     "VALUES           (    ?,          ?,             ?,      ?);",
 
     [SCAN_GET_BY_ID]     = "SELECT     * FROM scan WHERE     id = ?;",
+    [SCAN_EXISTS]        = "SELECT EXISTS (SELECT 1 FROM scan WHERE id = ?);",
     [SCAN_GET_BY_JOB_ID] = "SELECT     * FROM scan WHERE job_id = ?;",
-    [SCAN_GET_NEXT]      = "SELECT     * FROM scan WHERE     id > ? ORDER BY id ASC LIMIT 1;",
+    [SCAN_GET_PAGE]      = "SELECT     * FROM scan WHERE     id > ? ORDER BY id ASC LIMIT ?;",
 
-    [SCAN_DELETE] = "DELETE FROM scan;",
+    [SCAN_DELETE_BY_ID] = "DELETE FROM scan WHERE id = ?;",
+    [SCAN_DELETE]       = "DELETE FROM scan;",
 
     /* --- PROD queries --- */
     [PROD_INSERT] = "INSERT INTO prod (scan_id, seq_id, profile_name, abc_name, alt_loglik, null_loglik, evalue_log, profile_typeid, version, match) "
                     "VALUES           (      ?,      ?,            ?,        ?,          ?,           ?,          ?,              ?,       ?,     ?);",
 
-    [PROD_GET]           = "SELECT  * FROM prod WHERE id = ?;",
-    [PROD_GET_NEXT]      = "SELECT id FROM prod WHERE id > ? ORDER BY id ASC LIMIT 1;",
-    [PROD_GET_SCAN_NEXT] = "SELECT id FROM prod WHERE id > ? AND scan_id = ? ORDER BY id ASC LIMIT 1;",
+    [PROD_GET]           = "SELECT * FROM prod WHERE id = ?;",
+    [PROD_GET_PAGE]      = "SELECT prod.*, hmmer.id, hmmer.data FROM prod LEFT JOIN hmmer ON hmmer.prod_id = prod.id "
+                           "WHERE prod.id > ? ORDER BY prod.id ASC LIMIT ?;",
+    [PROD_GET_SCAN_PAGE] = "SELECT prod.*, hmmer.id, hmmer.data FROM prod LEFT JOIN hmmer ON hmmer.prod_id = prod.id "
+                           "WHERE prod.id > ? AND prod.scan_id = ? ORDER BY prod.id ASC LIMIT ?;",
 
     [PROD_DELETE] = "DELETE FROM prod;",
 
     /* --- SEQ queries --- */
-    [SEQ_INSERT] = "INSERT INTO seq (scan_id, name, data) VALUES (?, ?, ?);",
-
     [SEQ_GET]           = "SELECT id, scan_id, name, upper(data) FROM seq WHERE id = ?;",
-    [SEQ_GET_NEXT]      = "SELECT id                             FROM seq WHERE id > ? ORDER BY id ASC LIMIT 1;",
-    [SEQ_GET_SCAN_NEXT] = "SELECT id                             FROM seq WHERE id > ? AND scan_id = ? ORDER BY id ASC LIMIT 1;",
+    [SEQ_EXISTS]        = "SELECT EXISTS (SELECT 1 FROM seq WHERE id = ?);",
+    [SEQ_GET_PAGE]      = "SELECT id, scan_id, name, upper(data) FROM seq WHERE id > ? ORDER BY id ASC LIMIT ?;",
+    [SEQ_GET_SCAN_PAGE] = "SELECT id, scan_id, name, upper(data) FROM seq WHERE id > ? AND scan_id = ? ORDER BY id ASC LIMIT ?;",
+    [SEQ_GET_RANGE_PAGE] = "SELECT id, scan_id, name, upper(data) FROM seq WHERE id > ? AND scan_id = ? AND id <= ? ORDER BY id ASC LIMIT ?;",
 
-    [SEQ_DELETE] = "DELETE FROM seq;",
+    [SEQ_DELETE_BY_SCAN_ID] = "DELETE FROM seq WHERE scan_id = ?;",
+    [SEQ_DELETE]            = "DELETE FROM seq;",
 
     /* --- HMMER queries --- */
     [HMMER_INSERT] = "INSERT INTO hmmer (data, prod_id) VALUES (?, ?);",
@@ -87,30 +112,112 @@ static char const *const queries[] =
 
     [HMMER_DELETE_BY_ID] = "DELETE FROM hmmer WHERE id = ?;",
     [HMMER_DELETE] =       "DELETE FROM hmmer;",
+
+    /* --- UNIT queries --- */
+    /* state: 0 for pend; 1 for run; 2 for done; 3 for fail. */
+    [UNIT_SPLIT] = "INSERT INTO unit (job_id, scan_id, seq_min, seq_max, state, error, exec_started, exec_ended) "
+                   "SELECT ?1, ?2, MIN(id), MAX(id), 0, '', 0, 0 FROM "
+                   "(SELECT id, (ROW_NUMBER() OVER (ORDER BY id) - 1) / ?3 AS part FROM seq WHERE scan_id = ?2) "
+                   "GROUP BY part ORDER BY part;",
+
+    [UNIT_GET]        = "SELECT * FROM unit WHERE id = ?;",
+    [UNIT_CLAIM_NEXT] = "UPDATE unit SET state = 1, exec_started = ?, lease_expiry = ? "
+                        "WHERE id = (SELECT unit.id FROM unit JOIN job ON job.id = unit.job_id "
+                        "            WHERE unit.state = 0 AND job.state = 1 ORDER BY unit.id LIMIT 1) RETURNING *;",
+    /* Claim token: the retries the unit was claimed with. */
+    [UNIT_HEARTBEAT]  = "UPDATE unit SET lease_expiry = ? WHERE id = ? AND state = 1 AND retries = ? AND lease_expiry > 0;",
+
+    [UNIT_SET_DONE]  = "UPDATE unit SET state = 2,            exec_ended = ? WHERE id = ? AND state = 1 AND retries = ? RETURNING job_id;",
+    [UNIT_SET_ERROR] = "UPDATE unit SET state = 3, error = ?, exec_ended = ? WHERE id = ? AND state = 1 AND retries = ? RETURNING job_id;",
+
+    /* Progress follows finished units; the job ends with its last unit. */
+    [UNIT_ROLLUP] = "UPDATE job SET "
+                    "progress   = (SELECT 100 * SUM(state >= 2) / COUNT(*) FROM unit WHERE job_id = ?1), "
+                    "state      = CASE WHEN EXISTS (SELECT 1 FROM unit WHERE job_id = ?1 AND state < 2) THEN state "
+                    "                  WHEN EXISTS (SELECT 1 FROM unit WHERE job_id = ?1 AND state = 3) THEN 3 ELSE 2 END, "
+                    "error      = CASE WHEN EXISTS (SELECT 1 FROM unit WHERE job_id = ?1 AND state < 2) THEN error "
+                    "                  ELSE COALESCE((SELECT error FROM unit WHERE job_id = ?1 AND state = 3 ORDER BY id LIMIT 1), error) END, "
+                    "exec_ended = CASE WHEN EXISTS (SELECT 1 FROM unit WHERE job_id = ?1 AND state < 2) THEN exec_ended ELSE ?2 END "
+                    "WHERE id = ?1;",
+
+    /* Expired units go back to pend until they run out of retries. */
+    [UNIT_REAP_EXPIRED] = "UPDATE unit SET "
+                          "state        = CASE WHEN retries < ?2 THEN 0 ELSE 3 END, "
+                          "error        = CASE WHEN retries < ?2 THEN error ELSE 'lease expired' END, "
+                          "exec_ended   = CASE WHEN retries < ?2 THEN exec_ended ELSE ?1 END, "
+                          "retries      = retries + 1, "
+                          "lease_expiry = 0 "
+                          "WHERE state = 1 AND lease_expiry > 0 AND lease_expiry <= ?1 RETURNING state, job_id;",
+
+    [UNIT_DELETE] = "DELETE FROM unit;",
+
+    /* --- Read transactions --- */
+    [READ_BEGIN] = "BEGIN DEFERRED TRANSACTION;",
+    [READ_END]   = "COMMIT TRANSACTION;",
 };
-static_assert(ARRAY_SIZE(queries) == HMMER_DELETE + 1, "Cover all enum cases");
+static_assert(ARRAY_SIZE(queries) == STMT_SIZE, "Cover all enum cases");
 /* clang-format on */
 
-static struct sqlite3_stmt *stmts[ARRAY_SIZE(queries)] = {0};
-
-static struct xsql_stmt stmt[ARRAY_SIZE(queries)] = {0};
+/* clang-format off */
+static struct
+{
+    char const *head;
+    char const *row;
+    int ncols;
+} const bulk_queries[] = {
+    [SEQ_INSERT_BULK]  = {"INSERT INTO seq (scan_id, name, data) VALUES ", "(?, ?, ?)", 3},
+    [PROD_INSERT_BULK] = {"INSERT INTO prod (scan_id, seq_id, profile_name, abc_name, alt_loglik, null_loglik, evalue_log, profile_typeid, version, match) VALUES ",
+                          "(?, ?, ?, ?, ?, ?, ?, ?, ?, ?)", 10},
+};
+static_assert(ARRAY_SIZE(bulk_queries) == BULK_SIZE, "Cover all enum cases");
+/* clang-format on */
 
 enum sched_rc stmt_init(void)
 {
+    struct xsql_stmt *stmt = sched_self()->writer.stmt;
+    struct xsql_bulk *bulk = sched_self()->bulk;
+    int rows = sched_self()->options.bulk_rows;
+    if (rows <= 0) rows = XSQL_BULK_MAX_ROWS;
     for (unsigned i = 0; i < ARRAY_SIZE(queries); ++i)
     {
-        stmt[i].st = stmts[i];
+        stmt[i].st = 0;
         stmt[i].query = queries[i];
 
         if (xsql_prepare(stmt + i)) return error(SCHED_FAIL_PREPARE_STMT);
     }
+    for (unsigned i = 0; i < ARRAY_SIZE(bulk_queries); ++i)
+    {
+        enum sched_rc rc =
+            xsql_bulk_init(bulk + i, bulk_queries[i].head, bulk_queries[i].row,
+                           bulk_queries[i].ncols, rows);
+        if (rc) return rc;
+    }
     return SCHED_OK;
 }
 
-struct xsql_stmt *stmt_get(int idx) { return stmt + idx; }
+/* Reader connections prepare their statements on first use. */
+struct xsql_stmt *stmt_get(int idx)
+{
+    struct xsql_stmt *stmt = sched_conn()->stmt + idx;
+    if (!stmt->st)
+    {
+        stmt->query = queries[idx];
+        xsql_prepare(stmt);
+    }
+    return stmt;
+}
+
+struct xsql_bulk *stmt_bulk(int idx) { return sched_self()->bulk + idx; }
 
 void stmt_del(void)
 {
-    for (unsigned i = 0; i < ARRAY_SIZE(stmt); ++i)
+    struct xsql_stmt *stmt = sched_self()->writer.stmt;
+    struct xsql_bulk *bulk = sched_self()->bulk;
+    for (unsigned i = 0; i < STMT_SIZE; ++i)
+    {
         xsql_finalize(stmt[i].st);
+        stmt[i].st = 0;
+    }
+    for (unsigned i = 0; i < BULK_SIZE; ++i)
+        xsql_bulk_del(bulk + i);
 }
@@ -10,7 +10,7 @@ enum stmt
     HMM_GET_BY_JOB_ID,
     HMM_GET_BY_XXH3,
     HMM_GET_BY_FILENAME,
-    HMM_GET_NEXT,
+    HMM_GET_PAGE,
     HMM_DELETE_BY_ID,
     HMM_DELETE,
     DB_INSERT,
@@ -18,47 +18,79 @@ enum stmt
     DB_GET_BY_XXH3,
     DB_GET_BY_FILENAME,
     DB_GET_BY_HMM_ID,
-    DB_GET_NEXT,
+    DB_GET_PAGE,
     DB_DELETE_BY_ID,
     DB_DELETE,
     JOB_INSERT,
     JOB_GET_PEND,
+    JOB_CLAIM_NEXT,
+    JOB_CLAIM_BATCH,
     JOB_GET_STATE,
     JOB_GET,
-    JOB_GET_NEXT,
+    JOB_GET_PAGE,
+    JOB_RELEASE,
     JOB_SET_RUN,
+    JOB_HEARTBEAT,
     JOB_SET_ERROR,
     JOB_SET_DONE,
     JOB_INC_PROGRESS,
+    JOB_CHECK_CLAIM,
+    JOB_REAP_EXPIRED,
     JOB_DELETE_BY_ID,
     JOB_DELETE,
     SCAN_INSERT,
     SCAN_GET_BY_ID,
+    SCAN_EXISTS,
     SCAN_GET_BY_JOB_ID,
-    SCAN_GET_NEXT,
+    SCAN_GET_PAGE,
+    SCAN_DELETE_BY_ID,
     SCAN_DELETE,
     PROD_INSERT,
     PROD_GET,
-    PROD_GET_NEXT,
-    PROD_GET_SCAN_NEXT,
+    PROD_GET_PAGE,
+    PROD_GET_SCAN_PAGE,
     PROD_DELETE,
-    SEQ_INSERT,
     SEQ_GET,
-    SEQ_GET_NEXT,
-    SEQ_GET_SCAN_NEXT,
+    SEQ_EXISTS,
+    SEQ_GET_PAGE,
+    SEQ_GET_SCAN_PAGE,
+    SEQ_GET_RANGE_PAGE,
+    SEQ_DELETE_BY_SCAN_ID,
     SEQ_DELETE,
     HMMER_INSERT,
     HMMER_GET_BY_ID,
     HMMER_GET_BY_PROD_ID,
     HMMER_DELETE_BY_ID,
     HMMER_DELETE,
+    UNIT_SPLIT,
+    UNIT_GET,
+    UNIT_CLAIM_NEXT,
+    UNIT_HEARTBEAT,
+    UNIT_SET_DONE,
+    UNIT_SET_ERROR,
+    UNIT_ROLLUP,
+    UNIT_REAP_EXPIRED,
+    UNIT_DELETE,
+
+    READ_BEGIN,
+    READ_END,
+    STMT_SIZE,
+};
+
+enum bulk
+{
+    SEQ_INSERT_BULK,
+    PROD_INSERT_BULK,
+    BULK_SIZE,
 };
 
 struct sqlite3_stmt;
 struct xsql_stmt;
+struct xsql_bulk;
 
 enum sched_rc stmt_init(void);
 struct xsql_stmt *stmt_get(int idx);
+struct xsql_bulk *stmt_bulk(int idx);
 void stmt_del(void);
 
 #endif
@@ -1,5 +1,10 @@
 #include "to.h"
+#include "lemire.h"
+#include <float.h>
+#include <inttypes.h>
 #include <limits.h>
+#include <math.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -17,14 +22,189 @@ bool to_int64(char const *str, int64_t *val)
     return (v <= INT64_MAX || !(v == 0 && !(str[0] == '0' && str[1] == '\0')));
 }
 
+static bool is_digit(char c) { return (unsigned)(c - '0') < 10; }
+
 bool to_int64l(unsigned len, char const *str, int64_t *val)
 {
-    char *s = (char *)str;
-    char c = str[len];
-    s[len] = '\0';
-    bool ret = to_int64(str, val);
-    s[len] = c;
-    return ret;
+    char const *p = str;
+    char const *end = str + len;
+    bool negative = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+')) ++p;
+    if (p == end) return false;
+
+    uint64_t limit = negative ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX;
+    uint64_t x = 0;
+    for (; p < end; ++p)
+    {
+        if (!is_digit(*p)) return false;
+        unsigned digit = (unsigned)(*p - '0');
+        if (x > (limit - digit) / 10) return false;
+        x = x * 10 + digit;
+    }
+    *val = negative ? (int64_t)(0 - x) : (int64_t)x;
+    return true;
+}
+
+/* Decimal significand and exponent, as in w * 10^exp10. */
+struct decimal
+{
+    uint64_t w;
+    int64_t exp10;
+    int kept;
+    bool truncated;
+};
+
+/* Keeps up to 19 significant digits, which always fit in w. */
+static char const *digits(char const *p, char const *end, bool frac,
+                          struct decimal *d)
+{
+    for (; p < end && is_digit(*p); ++p)
+    {
+        unsigned digit = (unsigned)(*p - '0');
+        if (d->kept < 19)
+        {
+            if (d->kept || digit)
+            {
+                d->w = d->w * 10 + digit;
+                d->kept++;
+            }
+            if (frac) d->exp10--;
+        }
+        else
+        {
+            if (digit) d->truncated = true;
+            if (!frac) d->exp10++;
+        }
+    }
+    return p;
+}
+
+static bool equal_nocase(char const *p, char const *end, char const *word)
+{
+    for (; *word; ++p, ++word)
+    {
+        if (p == end || (*p | 0x20) != *word) return false;
+    }
+    return p == end;
+}
+
+static bool special(char const *p, char const *end, double *val)
+{
+    if (equal_nocase(p, end, "inf") || equal_nocase(p, end, "infinity"))
+        *val = HUGE_VAL;
+    else if (equal_nocase(p, end, "nan"))
+        *val = NAN;
+    else
+        return false;
+    return true;
+}
+
+static double const exact_pow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+/* Both w and 10^|exp10| are exact doubles, so one operation rounds right. */
+static bool clinger(struct decimal const *d, double *val)
+{
+#if FLT_EVAL_METHOD == 0
+    if (d->truncated || d->w > (UINT64_C(1) << 53)) return false;
+    if (d->exp10 < -22 || d->exp10 > 22) return false;
+    double x = (double)d->w;
+    *val = d->exp10 < 0 ? x / exact_pow10[-d->exp10] : x * exact_pow10[d->exp10];
+    return true;
+#else
+    (void)d;
+    (void)val;
+    (void)exact_pow10;
+    return false;
+#endif
+}
+
+/* A truncated significand lies between w and w + 1: both must agree. */
+static bool eisel_lemire(struct decimal const *d, double *val)
+{
+    uint64_t bits = 0;
+    uint64_t upper = 0;
+    if (!lemire(d->exp10, d->w, &bits)) return false;
+    if (d->truncated && (!lemire(d->exp10, d->w + 1, &upper) || upper != bits))
+        return false;
+    memcpy(val, &bits, sizeof bits);
+    return true;
+}
+
+/*
+ * The slow path rewrites the number with no decimal point, which strtod
+ * reads the same way under any locale. Numbers too long for the stack
+ * buffer are rewritten on the heap, as every digit can decide rounding.
+ */
+static bool fallback(char const *p, char const *end, int64_t exp10,
+                     double *val)
+{
+    char stack[512];
+    size_t size = (size_t)(end - p) + sizeof "e-9223372036854775808";
+    char *buf = size <= sizeof stack ? stack : malloc(size);
+    if (!buf) return false;
+
+    size_t n = 0;
+    for (; p < end && *p != 'e' && *p != 'E'; ++p)
+    {
+        if (*p != '.') buf[n++] = *p;
+    }
+    snprintf(buf + n, size - n, "e%" PRId64, exp10);
+    *val = strtod(buf, NULL);
+
+    if (buf != stack) free(buf);
+    return true;
+}
+
+bool to_doublel(unsigned len, char const *str, double *val)
+{
+    char const *p = str;
+    char const *end = str + len;
+    bool negative = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+')) ++p;
+
+    double x = 0;
+    if (special(p, end, &x))
+    {
+        *val = negative ? -x : x;
+        return true;
+    }
+
+    struct decimal d = {0};
+    char const *start = p;
+    p = digits(p, end, false, &d);
+    size_t count = (size_t)(p - start);
+    int64_t frac_len = 0;
+    if (p < end && *p == '.')
+    {
+        char const *frac = ++p;
+        p = digits(p, end, true, &d);
+        frac_len = p - frac;
+        count += (size_t)frac_len;
+    }
+    if (!count) return false;
+
+    int64_t exp10 = 0;
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        bool minus = ++p < end && *p == '-';
+        if (p < end && (*p == '-' || *p == '+')) ++p;
+        if (p == end) return false;
+        for (; p < end && is_digit(*p); ++p)
+        {
+            if (exp10 < 0x10000) exp10 = exp10 * 10 + (*p - '0');
+        }
+        if (minus) exp10 = -exp10;
+    }
+    if (p != end) return false;
+
+    d.exp10 += exp10;
+    if (d.w && !clinger(&d, &x) && !eisel_lemire(&d, &x) &&
+        !fallback(start, end, exp10 - frac_len, &x))
+        return false;
+    *val = negative ? -x : x;
+    return true;
 }
 
 bool to_int(char const *str, int *val)
@@ -7,6 +7,7 @@
 bool to_double(char const *str, double *val);
 bool to_int64(char const *str, int64_t *val);
 bool to_int64l(unsigned len, char const *str, int64_t *val);
+bool to_doublel(unsigned len, char const *str, double *val);
 bool to_int(char const *str, int *val);
 unsigned to_str(char *str, uint16_t num);
 
@@ -1,87 +1,194 @@
 #include "tok.h"
-#include "compiler.h"
 #include "error.h"
 #include "sched/rc.h"
-#include <assert.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-#define DELIM " \t\r"
+#define CHUNK_SIZE (1 << 20)
 
-static void add_space_before_newline(char *line);
-static enum sched_rc next_line(FILE *restrict fd, unsigned size, char *line);
+static char const newline[] = "\n";
 
-enum tok_id tok_id(struct tok const *tok) { return tok->id; }
+static inline bool is_blank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
 
-char const *tok_value(struct tok const *tok) { return tok->value; }
+static inline bool is_delim(char c) { return is_blank(c) || c == '\n'; }
+
+#define ONES UINT64_C(0x0101010101010101)
+#define HIGHS UINT64_C(0x8080808080808080)
 
-unsigned tok_size(struct tok const *tok)
+static inline uint64_t has_byte(uint64_t x, unsigned char c)
 {
-    return (unsigned)strlen(tok->value);
+    x ^= ONES * c;
+    return (x - ONES) & ~x & HIGHS;
 }
 
-enum sched_rc tok_next(struct tok *tok, FILE *restrict fd)
+/*
+ * Eight bytes at a time: a word is skipped whole unless it holds one of
+ * the delimiters, which is then located byte by byte.
+ */
+static char const *find_delim(char const *p, char const *end)
 {
-    if (tok->line.consumed)
+    while (end - p >= 8)
     {
-        enum sched_rc rc =
-            next_line(fd, MEMBER_SIZE(tok->line, data), tok->line.data);
-        if (rc && rc == SCHED_END)
-        {
-            tok->value = NULL;
-            tok->id = TOK_EOF;
-            tok->line.data[0] = '\0';
-            return SCHED_OK;
-        }
-        if (rc && rc != SCHED_END) return error(SCHED_FAIL_READ_FILE);
-        tok->value = strtok_r(tok->line.data, DELIM, &tok->line.ctx);
-        tok->line.number++;
+        uint64_t x = 0;
+        memcpy(&x, p, sizeof x);
+        if (has_byte(x, '\t') | has_byte(x, '\n') | has_byte(x, ' ') |
+            has_byte(x, '\r'))
+            break;
+        p += 8;
     }
-    else
-        tok->value = strtok_r(NULL, DELIM, &tok->line.ctx);
+    while (p < end && !is_delim(*p))
+        ++p;
+    return p;
+}
+
+static enum sched_rc map_file(struct tok *tok)
+{
+    int fd = fileno(tok->fp);
+    struct stat st = {0};
+    if (fd < 0 || fstat(fd, &st) || !S_ISREG(st.st_mode)) return SCHED_END;
 
-    if (!tok->value) return error(SCHED_FAIL_PARSE_FILE);
+    off_t offset = ftello(tok->fp);
+    if (offset < 0 || offset > st.st_size) return SCHED_END;
 
-    if (!strcmp(tok->value, "\n"))
-        tok->id = TOK_NL;
-    else
-        tok->id = TOK_WORD;
+    tok->eof = true;
+    if (st.st_size == 0) return SCHED_OK;
 
-    tok->line.consumed = tok->id == TOK_NL;
+    void *map = mmap(0, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) return error(SCHED_FAIL_READ_FILE);
+    madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
 
+    tok->map = map;
+    tok->map_size = (size_t)st.st_size;
+    tok->pos = tok->map + offset;
+    tok->end = tok->map + tok->map_size;
     return SCHED_OK;
 }
 
-static enum sched_rc next_line(FILE *restrict fd, unsigned size, char *line)
+enum sched_rc tok_open(struct tok *tok, FILE *fp)
 {
-    /* -1 to append space before newline if required */
-    assert(size > 0);
-    if (!fgets(line, (int)(size - 1), fd))
+    memset(tok, 0, sizeof *tok);
+    tok->id = TOK_NL;
+    tok->fp = fp;
+
+    enum sched_rc rc = map_file(tok);
+    if (rc == SCHED_END)
     {
-        if (feof(fd)) return SCHED_END;
+        tok->eof = false;
+        return SCHED_OK;
+    }
+    return rc;
+}
+
+void tok_open_mem(struct tok *tok, char const *data, size_t size)
+{
+    memset(tok, 0, sizeof *tok);
+    tok->id = TOK_NL;
+    tok->pos = data;
+    tok->end = data + size;
+    tok->eof = true;
+}
+
+bool tok_mapped(struct tok const *tok) { return tok->map != 0; }
+
+void tok_close(struct tok *tok)
+{
+    if (tok->map) munmap(tok->map, tok->map_size);
+    free(tok->buf);
+    memset(tok, 0, sizeof *tok);
+    tok->id = TOK_EOF;
+}
+
+enum tok_id tok_id(struct tok const *tok) { return tok->id; }
+
+char const *tok_value(struct tok const *tok) { return tok->value; }
+
+size_t tok_size(struct tok const *tok) { return tok->size; }
+
+bool tok_equal(struct tok const *tok, char const *str)
+{
+    return strlen(str) == tok->size && !memcmp(tok->value, str, tok->size);
+}
+
+/* Moves [keep, end) to the front of the buffer and appends a chunk. */
+static enum sched_rc refill(struct tok *tok, char const *keep)
+{
+    size_t used = (size_t)(tok->end - keep);
+    if (used) memmove(tok->buf, keep, used);
 
-        return error(SCHED_FAIL_READ_FILE);
+    if (tok->capacity - used < CHUNK_SIZE)
+    {
+        size_t capacity = tok->capacity ? tok->capacity * 2 : CHUNK_SIZE;
+        while (capacity - used < CHUNK_SIZE)
+            capacity *= 2;
+        char *buf = realloc(tok->buf, capacity);
+        if (!buf) return error(SCHED_NOT_ENOUGH_MEMORY);
+        tok->buf = buf;
+        tok->capacity = capacity;
     }
 
-    add_space_before_newline(line);
+    size_t n = fread(tok->buf + used, 1, tok->capacity - used, tok->fp);
+    if (n == 0 && ferror(tok->fp)) return error(SCHED_FAIL_READ_FILE);
+    if (n == 0) tok->eof = true;
+
+    tok->pos = tok->buf;
+    tok->end = tok->buf + used + n;
+    return SCHED_OK;
+}
+
+/* Reads on until the buffer holds the whole next line. */
+static enum sched_rc load_line(struct tok *tok)
+{
+    size_t offset = 0;
+    while (!tok->eof)
+    {
+        size_t size = (size_t)(tok->end - tok->pos);
+        if (size > offset && memchr(tok->pos + offset, '\n', size - offset))
+            break;
+        offset = size;
+        enum sched_rc rc = refill(tok, tok->pos);
+        if (rc) return rc;
+    }
     return SCHED_OK;
 }
 
-static void add_space_before_newline(char *line)
+static void set(struct tok *tok, enum tok_id id, char const *value,
+                size_t size)
+{
+    tok->id = id;
+    tok->value = value;
+    tok->size = size;
+    tok->line_open = id == TOK_WORD;
+}
+
+enum sched_rc tok_next(struct tok *tok)
 {
-    unsigned n = (unsigned)strlen(line);
-    if (n > 0)
+    enum sched_rc rc = SCHED_OK;
+    if (tok->id == TOK_NL && (rc = load_line(tok))) return rc;
+
+    while (tok->pos < tok->end && is_blank(*tok->pos))
+        ++tok->pos;
+
+    if (tok->pos == tok->end)
     {
-        if (line[n - 1] == '\n')
-        {
-            line[n - 1] = ' ';
-            line[n] = '\n';
-            line[n + 1] = '\0';
-        }
+        /* A last line without its newline still ends with one. */
+        if (tok->line_open)
+            set(tok, TOK_NL, newline, 1);
         else
-        {
-            line[n - 1] = '\n';
-            line[n] = '\0';
-        }
+            set(tok, TOK_EOF, 0, 0);
+        return SCHED_OK;
     }
+
+    if (*tok->pos == '\n')
+    {
+        set(tok, TOK_NL, tok->pos++, 1);
+        return SCHED_OK;
+    }
+
+    char const *p = find_delim(tok->pos, tok->end);
+    set(tok, TOK_WORD, tok->pos, (size_t)(p - tok->pos));
+    tok->pos = p;
+    return SCHED_OK;
 }
@@ -2,6 +2,7 @@
 #define TOK_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 
 enum tok_id
@@ -11,25 +12,38 @@ enum tok_id
     TOK_EOF,
 };
 
+/*
+ * Splits a file into words separated by blanks (space, tab, carriage
+ * return) and newlines. Regular files are memory-mapped, anything else
+ * is read in large chunks holding whole lines. Words are views into the
+ * mapping or chunk and are not NUL-terminated. Views into a mapping live
+ * as long as the tokenizer, others until the next line is read.
+ */
 struct tok
 {
     unsigned id;
     char const *value;
-    struct
-    {
-        unsigned number;
-        bool consumed;
-        char *ctx;
-        char data[128000];
-    } line;
-};
+    size_t size;
 
-#define TOK_DECLARE(var)                                                       \
-    struct tok var = {TOK_NL, var.line.data, {0, true, 0, {0}}};
+    FILE *fp;
+    char *map;
+    size_t map_size;
+    char *buf;
+    size_t capacity;
+    char const *pos;
+    char const *end;
+    bool eof;
+    bool line_open;
+};
 
+enum sched_rc tok_open(struct tok *tok, FILE *fp);
+void tok_open_mem(struct tok *tok, char const *data, size_t size);
+bool tok_mapped(struct tok const *tok);
+void tok_close(struct tok *tok);
 enum tok_id tok_id(struct tok const *tok);
 char const *tok_value(struct tok const *tok);
-unsigned tok_size(struct tok const *tok);
-enum sched_rc tok_next(struct tok *tok, FILE *restrict fd);
+size_t tok_size(struct tok const *tok);
+bool tok_equal(struct tok const *tok, char const *str);
+enum sched_rc tok_next(struct tok *tok);
 
 #endif
@@ -0,0 +1,272 @@
+#include "unit.h"
+#include "error.h"
+#include "handle.h"
+#include "job.h"
+#include "progress.h"
+#include "sched/rc.h"
+#include "sched/scan.h"
+#include "sched/unit.h"
+#include "seq.h"
+#include "stmt.h"
+#include "utc.h"
+#include "xsql.h"
+#include "xstrcpy.h"
+#include <stdbool.h>
+
+void sched_unit_init(struct sched_unit *unit)
+{
+    unit->id = 0;
+    unit->job_id = 0;
+    unit->scan_id = 0;
+    unit->seq_min = 0;
+    unit->seq_max = 0;
+
+    XSTRCPY(unit, state, "pend");
+    unit->error[0] = 0;
+
+    unit->exec_started = 0;
+    unit->exec_ended = 0;
+
+    unit->retries = 0;
+    unit->lease_expiry = 0;
+}
+
+static enum sched_rc set_unit(struct sched_unit *unit, struct sqlite3_stmt *st)
+{
+    unit->id = xsql_get_i64(st, 0);
+    unit->job_id = xsql_get_i64(st, 1);
+    unit->scan_id = xsql_get_i64(st, 2);
+    unit->seq_min = xsql_get_i64(st, 3);
+    unit->seq_max = xsql_get_i64(st, 4);
+
+    XSTRCPY(unit, state, job_state_string(xsql_get_int(st, 5)));
+    if (xsql_cpy_txt(st, 6, XSQL_TXT_OF(*unit, error))) return EGETTXT;
+
+    unit->exec_started = xsql_get_i64(st, 7);
+    unit->exec_ended = xsql_get_i64(st, 8);
+
+    unit->retries = xsql_get_int(st, 9);
+    unit->lease_expiry = xsql_get_i64(st, 10);
+
+    return SCHED_OK;
+}
+
+static enum sched_rc split(int64_t job_id, int64_t scan_id, int seqs_per_unit,
+                           int *n)
+{
+    /* The job holds no lease: its units are leased and reaped instead. */
+    enum sched_rc rc = job_set_run(job_id, utc_now(), 0);
+    if (rc) return rc;
+    if (xsql_changes() == 0) return SCHED_JOB_NOT_FOUND;
+
+    struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(UNIT_SPLIT));
+    if (!st) return EFRESH;
+
+    if (xsql_bind_i64(st, 0, job_id)) return EBIND;
+    if (xsql_bind_i64(st, 1, scan_id)) return EBIND;
+    if (xsql_bind_i64(st, 2, seqs_per_unit)) return EBIND;
+
+    if (xsql_step(st) != SCHED_END) return ESTEP;
+    *n = xsql_changes();
+
+    /* Nothing to run: the job is done as soon as it starts. */
+    return *n == 0 ? job_set_done(job_id, JOB_ANY_CLAIM, utc_now()) : SCHED_OK;
+}
+
+enum sched_rc sched_unit_split(int64_t job_id, int seqs_per_unit, int *n)
+{
+    *n = 0;
+    if (seqs_per_unit < 1) seqs_per_unit = 1;
+
+    struct sched_scan scan = {0};
+    enum sched_rc rc = sched_scan_get_by_job_id(&scan, job_id);
+    if (rc) return rc;
+
+    bool own = !xsql_in_transaction();
+    if (own && xsql_begin_transaction()) return EBEGINSTMT;
+
+    if ((rc = split(job_id, scan.id, seqs_per_unit, n)))
+    {
+        *n = 0;
+        if (own) xsql_rollback_transaction();
+        return rc;
+    }
+    if (own && xsql_end_transaction())
+    {
+        *n = 0;
+        xsql_rollback_transaction();
+        return EENDSTMT;
+    }
+    return SCHED_OK;
+}
+
+enum sched_rc sched_unit_get_by_id(struct sched_unit *unit, int64_t id)
+{
+    struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(UNIT_GET));
+    if (!st) return EFRESH;
+
+    if (xsql_bind_i64(st, 0, id)) return EBIND;
+
+    enum sched_rc rc = xsql_step(st);
+    if (rc == SCHED_END) return SCHED_UNIT_NOT_FOUND;
+    if (rc != SCHED_OK) return ESTEP;
+
+    if ((rc = set_unit(unit, st))) return rc;
+
+    return xsql_step(st) != SCHED_END ? ESTEP : SCHED_OK;
+}
+
+enum sched_rc sched_unit_claim_next(struct sched_unit *unit)
+{
+    struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(UNIT_CLAIM_NEXT));
+    if (!st) return EFRESH;
+
+    int64_t now = utc_now();
+    if (xsql_bind_i64(st, 0, now)) return EBIND;
+    if (xsql_bind_i64(st, 1, job_lease_expiry(now))) return EBIND;
+
+    enum sched_rc rc = xsql_step(st);
+    if (rc == SCHED_END) return SCHED_UNIT_NOT_FOUND;
+    if (rc != SCHED_OK) return ESTEP;
+
+    if ((rc = set_unit(unit, st))) return rc;
+
+    return xsql_step(st) != SCHED_END ? ESTEP : SCHED_OK;
+}
+
+enum sched_rc sched_unit_heartbeat(int64_t id, int token)
+{
+    struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(UNIT_HEARTBEAT));
+    if (!st) return EFRESH;
+
+    if (xsql_bind_i64(st, 0, job_lease_expiry(utc_now()))) return EBIND;
+    if (xsql_bind_i64(st, 1, id)) return EBIND;
+    if (xsql_bind_i64(st, 2, token)) return EBIND;
+
+    if (xsql_step(st) != SCHED_END) return ESTEP;
+    return xsql_changes() == 0 ? SCHED_UNIT_NOT_FOUND : SCHED_OK;
+}
+
+enum sched_rc sched_unit_get_seqs(struct sched_unit const *unit,
+                                  sched_seq_set_func_t fn,
+                                  struct sched_seq *seq, void *arg)
+{
+    return seq_range_get_all(unit->scan_id, unit->seq_min, unit->seq_max, fn,
+                             seq, arg);
+}
+
+static enum sched_rc rollup(int64_t job_id, int64_t exec_ended)
+{
+    /* The roll-up owns the job progress from now on. */
+    progress_drop(job_id);
+
+    struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(UNIT_ROLLUP));
+    if (!st) return EFRESH;
+
+    if (xsql_bind_i64(st, 0, job_id)) return EBIND;
+    if (xsql_bind_i64(st, 1, exec_ended)) return EBIND;
+
+    return xsql_step(st) != SCHED_END ? ESTEP : SCHED_OK;
+}
+
+static enum sched_rc finish(int64_t id, int token, char const *error)
+{
+    int64_t exec_ended = utc_now();
+    struct sqlite3_stmt *st =
+        xsql_fresh_stmt(stmt_get(error ? UNIT_SET_ERROR : UNIT_SET_DONE));
+    if (!st) return EFRESH;
+
+    int col = 0;
+    if (error && xsql_bind_str(st, col++, error)) return EBIND;
+    if (xsql_bind_i64(st, col++, exec_ended)) return EBIND;
+    if (xsql_bind_i64(st, col++, id)) return EBIND;
+    if (xsql_bind_i64(st, col++, token)) return EBIND;
+
+    enum sched_rc rc = xsql_step(st);
+    if (rc == SCHED_END) return SCHED_UNIT_NOT_FOUND;
+    if (rc != SCHED_OK) return ESTEP;
+
+    int64_t job_id = xsql_get_i64(st, 0);
+    if (xsql_step(st) != SCHED_END) return ESTEP;
+
+    return rollup(job_id, exec_ended);
+}
+
+static enum sched_rc set_finished(int64_t id, int token, char const *error)
+{
+    bool own = !xsql_in_transaction();
+    if (own && xsql_begin_transaction()) return EBEGINSTMT;
+
+    enum sched_rc rc = finish(id, token, error);
+    if (rc)
+    {
+        if (own) xsql_rollback_transaction();
+        return rc;
+    }
+    if (own && xsql_end_transaction())
+    {
+        xsql_rollback_transaction();
+        return EENDSTMT;
+    }
+    return SCHED_OK;
+}
+
+enum sched_rc sched_unit_set_done(int64_t id, int token)
+{
+    return set_finished(id, token, 0);
+}
+
+enum sched_rc sched_unit_set_fail(int64_t id, int token, char const *msg)
+{
+    return set_finished(id, token, msg);
+}
+
+/* A unit failed for its lease may finish its job, as any failed unit. */
+static enum sched_rc reap(int *n)
+{
+    struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(UNIT_REAP_EXPIRED));
+    if (!st) return EFRESH;
+
+    int64_t now = utc_now();
+    if (xsql_bind_i64(st, 0, now)) return EBIND;
+    if (xsql_bind_i64(st, 1, sched_self()->options.max_retries)) return EBIND;
+
+    enum sched_rc rc = SCHED_OK;
+    while ((rc = xsql_step(st)) == SCHED_OK)
+    {
+        *n += 1;
+        if (xsql_get_int(st, 0) != SCHED_FAIL) continue;
+        if ((rc = rollup(xsql_get_i64(st, 1), now))) return rc;
+    }
+    return rc == SCHED_END ? SCHED_OK : ESTEP;
+}
+
+enum sched_rc sched_unit_reap_expired(int *n)
+{
+    *n = 0;
+    bool own = !xsql_in_transaction();
+    if (own && xsql_begin_transaction()) return EBEGINSTMT;
+
+    enum sched_rc rc = reap(n);
+    if (rc)
+    {
+        *n = 0;
+        if (own) xsql_rollback_transaction();
+        return rc;
+    }
+    if (own && xsql_end_transaction())
+    {
+        *n = 0;
+        xsql_rollback_transaction();
+        return EENDSTMT;
+    }
+    return SCHED_OK;
+}
+
+enum sched_rc unit_wipe(void)
+{
+    struct sqlite3_stmt *st = xsql_fresh_stmt(stmt_get(UNIT_DELETE));
+    if (!st) return EFRESH;
+
+    return xsql_step(st) != SCHED_END ? ESTEP : SCHED_OK;
+}
@@ -0,0 +1,6 @@
+#ifndef UNIT_H
+#define UNIT_H
+
+enum sched_rc unit_wipe(void);
+
+#endif
@@ -0,0 +1,261 @@
+#include "wire.h"
+#include <stdlib.h>
+#include <string.h>
+
+void wire_init(struct wire *w)
+{
+    w->data = 0;
+    w->size = 0;
+    w->capacity = 0;
+    w->pos = 0;
+    w->fail = false;
+}
+
+void wire_cleanup(struct wire *w)
+{
+    free(w->data);
+    wire_init(w);
+}
+
+void wire_clear(struct wire *w)
+{
+    w->size = 0;
+    w->pos = 0;
+    w->fail = false;
+}
+
+/* Drops the first size bytes, typically a frame already handled. */
+void wire_consume(struct wire *w, size_t size)
+{
+    memmove(w->data, w->data + size, w->size - size);
+    w->size -= size;
+    w->pos = 0;
+    w->fail = false;
+}
+
+bool wire_reserve(struct wire *w, size_t size)
+{
+    if (w->size + size <= w->capacity) return true;
+
+    size_t cap = w->capacity ? w->capacity : 4096;
+    while (cap < w->size + size)
+        cap *= 2;
+
+    unsigned char *data = realloc(w->data, cap);
+    if (!data) return !(w->fail = true);
+    w->data = data;
+    w->capacity = cap;
+    return true;
+}
+
+static void put(struct wire *w, void const *data, size_t size)
+{
+    if (!wire_reserve(w, size)) return;
+    if (size) memcpy(w->data + w->size, data, size);
+    w->size += size;
+}
+
+static void get(struct wire *w, void *data, size_t size)
+{
+    if (w->fail || w->size - w->pos < size)
+    {
+        w->fail = true;
+        memset(data, 0, size);
+        return;
+    }
+    memcpy(data, w->data + w->pos, size);
+    w->pos += size;
+}
+
+size_t wire_begin(struct wire *w)
+{
+    size_t frame = w->size;
+    wire_put_u32(w, 0);
+    return frame;
+}
+
+void wire_end(struct wire *w, size_t frame)
+{
+    if (w->fail) return;
+    uint32_t size = (uint32_t)(w->size - frame - WIRE_HEADER_SIZE);
+    memcpy(w->data + frame, &size, sizeof size);
+}
+
+/* Tells whether a whole frame sits at the front and how long it is. */
+bool wire_frame(struct wire const *w, size_t *size)
+{
+    if (w->size < WIRE_HEADER_SIZE) return false;
+    uint32_t len = 0;
+    memcpy(&len, w->data, sizeof len);
+    *size = WIRE_HEADER_SIZE + (size_t)len;
+    return w->size >= *size;
+}
+
+void wire_put_u8(struct wire *w, unsigned val)
+{
+    unsigned char c = (unsigned char)val;
+    put(w, &c, 1);
+}
+
+void wire_put_u32(struct wire *w, uint32_t val) { put(w, &val, sizeof val); }
+
+void wire_put_i64(struct wire *w, int64_t val) { put(w, &val, sizeof val); }
+
+void wire_put_f64(struct wire *w, double val) { put(w, &val, sizeof val); }
+
+void wire_put_str(struct wire *w, char const *str)
+{
+    wire_put_mem(w, str, strlen(str));
+}
+
+void wire_put_mem(struct wire *w, void const *data, size_t size)
+{
+    wire_put_u32(w, (uint32_t)size);
+    put(w, data, size);
+}
+
+unsigned wire_get_u8(struct wire *w)
+{
+    unsigned char c = 0;
+    get(w, &c, 1);
+    return c;
+}
+
+uint32_t wire_get_u32(struct wire *w)
+{
+    uint32_t val = 0;
+    get(w, &val, sizeof val);
+    return val;
+}
+
+int64_t wire_get_i64(struct wire *w)
+{
+    int64_t val = 0;
+    get(w, &val, sizeof val);
+    return val;
+}
+
+double wire_get_f64(struct wire *w)
+{
+    double val = 0;
+    get(w, &val, sizeof val);
+    return val;
+}
+
+void wire_get_str(struct wire *w, char *dst, size_t capacity)
+{
+    size_t size = 0;
+    char const *src = wire_get_mem(w, &size);
+    if (!src || size >= capacity)
+    {
+        w->fail = true;
+        if (capacity) dst[0] = 0;
+        return;
+    }
+    memcpy(dst, src, size);
+    dst[size] = 0;
+}
+
+/* Points into the buffer, so the bytes are not null-terminated. */
+char const *wire_get_mem(struct wire *w, size_t *size)
+{
+    *size = wire_get_u32(w);
+    if (w->fail || w->size - w->pos < *size) return (w->fail = true, NULL);
+    char const *data = (char const *)w->data + w->pos;
+    w->pos += *size;
+    return data;
+}
+
+void wire_put_job(struct wire *w, struct sched_job const *job)
+{
+    wire_put_i64(w, job->id);
+    wire_put_u32(w, (uint32_t)job->type);
+    wire_put_str(w, job->state);
+    wire_put_u32(w, (uint32_t)job->progress);
+    wire_put_str(w, job->error);
+    wire_put_i64(w, job->submission);
+    wire_put_i64(w, job->exec_started);
+    wire_put_i64(w, job->exec_ended);
+    wire_put_u32(w, (uint32_t)job->retries);
+    wire_put_i64(w, job->lease_expiry);
+}
+
+void wire_get_job(struct wire *w, struct sched_job *job)
+{
+    job->id = wire_get_i64(w);
+    job->type = (int)wire_get_u32(w);
+    wire_get_str(w, job->state, sizeof job->state);
+    job->progress = (int)wire_get_u32(w);
+    wire_get_str(w, job->error, sizeof job->error);
+    job->submission = wire_get_i64(w);
+    job->exec_started = wire_get_i64(w);
+    job->exec_ended = wire_get_i64(w);
+    job->retries = (int)wire_get_u32(w);
+    job->lease_expiry = wire_get_i64(w);
+}
+
+void wire_put_hmm(struct wire *w, struct sched_hmm const *hmm)
+{
+    wire_put_i64(w, hmm->id);
+    wire_put_i64(w, hmm->xxh3);
+    wire_put_str(w, hmm->filename);
+    wire_put_i64(w, hmm->job_id);
+}
+
+void wire_get_hmm(struct wire *w, struct sched_hmm *hmm)
+{
+    hmm->id = wire_get_i64(w);
+    hmm->xxh3 = wire_get_i64(w);
+    wire_get_str(w, hmm->filename, sizeof hmm->filename);
+    hmm->job_id = wire_get_i64(w);
+}
+
+void wire_put_db(struct wire *w, struct sched_db const *db)
+{
+    wire_put_i64(w, db->id);
+    wire_put_i64(w, db->xxh3);
+    wire_put_str(w, db->filename);
+    wire_put_i64(w, db->hmm_id);
+}
+
+void wire_get_db(struct wire *w, struct sched_db *db)
+{
+    db->id = wire_get_i64(w);
+    db->xxh3 = wire_get_i64(w);
+    wire_get_str(w, db->filename, sizeof db->filename);
+    db->hmm_id = wire_get_i64(w);
+}
+
+void wire_put_scan(struct wire *w, struct sched_scan const *scan)
+{
+    wire_put_i64(w, scan->id);
+    wire_put_i64(w, scan->db_id);
+    wire_put_u8(w, (unsigned)scan->multi_hits);
+    wire_put_u8(w, (unsigned)scan->hmmer3_compat);
+    wire_put_i64(w, scan->job_id);
+}
+
+void wire_get_scan(struct wire *w, struct sched_scan *scan)
+{
+    scan->id = wire_get_i64(w);
+    scan->db_id = wire_get_i64(w);
+    scan->multi_hits = (int)wire_get_u8(w);
+    scan->hmmer3_compat = (int)wire_get_u8(w);
+    scan->job_id = wire_get_i64(w);
+}
+
+void wire_put_seq(struct wire *w, struct sched_seq const *seq)
+{
+    wire_put_i64(w, seq->id);
+    wire_put_i64(w, seq->scan_id);
+    wire_put_str(w, seq->name);
+    wire_put_str(w, seq->data);
+}
+
+void wire_get_seq(struct wire *w, struct sched_seq *seq)
+{
+    seq->id = wire_get_i64(w);
+    seq->scan_id = wire_get_i64(w);
+    wire_get_str(w, seq->name, sizeof seq->name);
+    wire_get_str(w, seq->data, sizeof seq->data);
+}
@@ -0,0 +1,110 @@
+#ifndef WIRE_H
+#define WIRE_H
+
+#include "sched/structs.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Framing of the sched-server protocol. Both ends live on the same host,
+ * so numbers travel in native byte order. A request frame is
+ *
+ *     u32 size | u8 op | payload
+ *
+ * and its response is one reply frame:
+ *
+ *     u32 size | u8 kind | u32 rc | payload
+ *
+ * where size counts the bytes after itself. Strings are a u32 length
+ * followed by that many bytes, without terminator.
+ */
+
+enum wire_op
+{
+    WIRE_JOB_GET_BY_ID,
+    WIRE_JOB_NEXT_PEND,
+    WIRE_JOB_CLAIM_NEXT,
+    WIRE_JOB_CLAIM_BATCH,
+    WIRE_JOB_SET_RUN,
+    WIRE_JOB_SET_FAIL,
+    WIRE_JOB_SET_DONE,
+    WIRE_JOB_HEARTBEAT,
+    WIRE_JOB_REAP_EXPIRED,
+    WIRE_JOB_STATE,
+    WIRE_JOB_INCREMENT_PROGRESS,
+    WIRE_JOB_SUBMIT_HMM,
+    WIRE_JOB_SUBMIT_SCAN,
+    WIRE_DB_ADD,
+    WIRE_DB_GET_BY_ID,
+    WIRE_SCAN_GET_BY_ID,
+    WIRE_SCAN_GET_BY_JOB_ID,
+    WIRE_SCAN_GET_SEQS,
+    WIRE_SEQ_GET_BY_ID,
+    WIRE_SEQ_SCAN_NEXT,
+    WIRE_PROD_ADD_FILE,
+    WIRE_PRODSET_ADD,
+    WIRE_OP_SIZE,
+};
+
+enum wire_kind
+{
+    WIRE_REPLY,
+};
+
+enum
+{
+    WIRE_HEADER_SIZE = 4,
+    WIRE_RC_OFFSET = WIRE_HEADER_SIZE + 1,
+    WIRE_MAX_FRAME = 64 * 1024 * 1024,
+    /* Sequences asked for per WIRE_SCAN_GET_SEQS page. */
+    WIRE_SEQ_PAGE = 256,
+    /* Claim token of job updates that are not tied to a claim. */
+    WIRE_ANY_CLAIM = -1,
+};
+
+struct wire
+{
+    unsigned char *data;
+    size_t size;
+    size_t capacity;
+    size_t pos;
+    bool fail;
+};
+
+void wire_init(struct wire *);
+void wire_cleanup(struct wire *);
+void wire_clear(struct wire *);
+void wire_consume(struct wire *, size_t size);
+bool wire_reserve(struct wire *, size_t size);
+
+size_t wire_begin(struct wire *);
+void wire_end(struct wire *, size_t frame);
+bool wire_frame(struct wire const *, size_t *size);
+
+void wire_put_u8(struct wire *, unsigned val);
+void wire_put_u32(struct wire *, uint32_t val);
+void wire_put_i64(struct wire *, int64_t val);
+void wire_put_f64(struct wire *, double val);
+void wire_put_str(struct wire *, char const *str);
+void wire_put_mem(struct wire *, void const *data, size_t size);
+
+unsigned wire_get_u8(struct wire *);
+uint32_t wire_get_u32(struct wire *);
+int64_t wire_get_i64(struct wire *);
+double wire_get_f64(struct wire *);
+void wire_get_str(struct wire *, char *dst, size_t capacity);
+char const *wire_get_mem(struct wire *, size_t *size);
+
+void wire_put_job(struct wire *, struct sched_job const *);
+void wire_get_job(struct wire *, struct sched_job *);
+void wire_put_hmm(struct wire *, struct sched_hmm const *);
+void wire_get_hmm(struct wire *, struct sched_hmm *);
+void wire_put_db(struct wire *, struct sched_db const *);
+void wire_get_db(struct wire *, struct sched_db *);
+void wire_put_scan(struct wire *, struct sched_scan const *);
+void wire_get_scan(struct wire *, struct sched_scan *);
+void wire_put_seq(struct wire *, struct sched_seq const *);
+void wire_get_seq(struct wire *, struct sched_seq *);
+
+#endif
@@ -1,16 +1,21 @@
 #include "xsql.h"
 #include "error.h"
+#include "handle.h"
+#include "sched/options.h"
 #include "sched/rc.h"
 #include "sqlite3/sqlite3.h"
 #include "xstrcpy.h"
 #include <assert.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 static_assert(SQLITE_VERSION_NUMBER >= XSQL_REQUIRED_VERSION,
               "Minimum sqlite requirement.");
 
-static struct sqlite3 *sched = NULL;
+static struct sqlite3 *db(void) { return sched_conn()->db; }
 
 bool xsql_is_thread_safe(void) { return sqlite3_threadsafe(); }
 
@@ -73,6 +78,24 @@ double xsql_get_dbl(struct sqlite3_stmt *stmt, int col)
     return sqlite3_column_double(stmt, col);
 }
 
+bool xsql_is_null(struct sqlite3_stmt *stmt, int col)
+{
+    return sqlite3_column_type(stmt, col) == SQLITE_NULL;
+}
+
+/* Borrowed column access: valid until the next step or reset of stmt. */
+struct xsql_txt xsql_get_txt(struct sqlite3_stmt *stmt, int col)
+{
+    char const *str = (char const *)sqlite3_column_text(stmt, col);
+    return (struct xsql_txt){sqlite3_column_bytes(stmt, col), str};
+}
+
+struct xsql_blob xsql_get_blob(struct sqlite3_stmt *stmt, int col)
+{
+    unsigned char const *data = sqlite3_column_blob(stmt, col);
+    return (struct xsql_blob){sqlite3_column_bytes(stmt, col), data};
+}
+
 enum sched_rc xsql_cpy_txt(struct sqlite3_stmt *stmt, int col,
                            struct xsql_txt txt)
 {
@@ -96,12 +119,113 @@ enum sched_rc xsql_cpy_blob(struct sqlite3_stmt *stmt, int col,
     return 0;
 }
 
-enum sched_rc xsql_open(char const *filepath)
+static uint32_t xorshift32(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+/*
+ * Exponential backoff from 1 ms up to 100 ms, with each sleep drawn from
+ * the upper half of the step so that contending processes spread out.
+ */
+static int busy_handler(void *arg, int count)
+{
+    struct xsql_busy *busy = arg;
+    if (count == 0) busy->waited = 0;
+    if (busy->waited >= busy->timeout) return 0;
+
+    int step = count < 7 ? 1 << count : 100;
+    if (step > 100) step = 100;
+    int ms = step / 2 + (int)(xorshift32(&busy->seed) % (uint32_t)(step / 2 + 1));
+    if (ms > busy->timeout - busy->waited) ms = busy->timeout - busy->waited;
+
+    sqlite3_sleep(ms);
+    busy->waited += ms;
+    return 1;
+}
+
+static char const *const synchronous[] = {
+    [SCHED_SYNCHRONOUS_OFF] = "OFF",
+    [SCHED_SYNCHRONOUS_NORMAL] = "NORMAL",
+    [SCHED_SYNCHRONOUS_FULL] = "FULL",
+    [SCHED_SYNCHRONOUS_EXTRA] = "EXTRA",
+};
+
+static enum sched_rc set_busy_handler(struct sched_options const *opts)
+{
+    struct xsql_busy *busy = &sched_conn()->busy;
+    busy->timeout = opts->busy_timeout_ms;
+    busy->seed = (uint32_t)time(0) ^ ((uint32_t)getpid() << 16) ^
+                 (uint32_t)(uintptr_t)busy ^ 0x9e3779b9u;
+    if (!busy->seed) busy->seed = 1;
+    return sqlite3_busy_handler(db(), busy_handler, busy) ? EEXEC : SCHED_OK;
+}
+
+static enum sched_rc configure(struct sched_options const *opts)
 {
-    if (sqlite3_open(filepath, &sched)) return error(SCHED_FAIL_OPEN_FILE);
-    if (xsql_exec("PRAGMA foreign_keys = ON;", 0, 0))
+    if (set_busy_handler(opts)) return EEXEC;
+
+    if (opts->synchronous < SCHED_SYNCHRONOUS_OFF ||
+        opts->synchronous > SCHED_SYNCHRONOUS_EXTRA)
+        return EEXEC;
+
+    char sql[256] = {0};
+    /* page_size only applies to a file that has no tables yet. */
+    snprintf(sql, sizeof sql,
+             "PRAGMA page_size = %d;"
+             "PRAGMA journal_mode = %s;"
+             "PRAGMA synchronous = %s;"
+             "PRAGMA mmap_size = %" PRId64 ";"
+             "PRAGMA cache_size = %d;"
+             "PRAGMA foreign_keys = ON;",
+             opts->page_size, opts->wal ? "WAL" : "DELETE",
+             synchronous[opts->synchronous], opts->mmap_size,
+             -opts->cache_size_kib);
+    return xsql_exec(sql, 0, 0);
+}
+
+enum sched_rc xsql_open(char const *filepath, struct sched_options const *opts)
+{
+    struct conn *conn = sched_conn();
+    if (sqlite3_open(filepath, &conn->db)) return error(SCHED_FAIL_OPEN_FILE);
+    if (configure(opts))
     {
-        sqlite3_close(sched);
+        sqlite3_close(conn->db);
+        conn->db = 0;
+        return SCHED_FAIL_EXEC_STMT;
+    }
+    return SCHED_OK;
+}
+
+/*
+ * Journal mode is a property of the file, set by the writer. Readers are
+ * never shared between threads at once, so they skip SQLite's own mutex.
+ */
+enum sched_rc xsql_open_readonly(char const *filepath,
+                                 struct sched_options const *opts)
+{
+    struct conn *conn = sched_conn();
+    int flags = SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX;
+    if (sqlite3_open_v2(filepath, &conn->db, flags, 0))
+    {
+        sqlite3_close(conn->db);
+        conn->db = 0;
+        return error(SCHED_FAIL_OPEN_FILE);
+    }
+
+    char sql[128] = {0};
+    snprintf(sql, sizeof sql,
+             "PRAGMA mmap_size = %" PRId64 ";"
+             "PRAGMA cache_size = %d;",
+             opts->mmap_size, -opts->cache_size_kib);
+    if (set_busy_handler(opts) || xsql_exec(sql, 0, 0))
+    {
+        sqlite3_close(conn->db);
+        conn->db = 0;
         return SCHED_FAIL_EXEC_STMT;
     }
     return SCHED_OK;
@@ -109,23 +233,41 @@ enum sched_rc xsql_open(char const *filepath)
 
 enum sched_rc xsql_close(void)
 {
-    return sqlite3_close(sched) ? error(SCHED_FAIL_CLOSE_SCHED_FILE) : SCHED_OK;
+    struct conn *conn = sched_conn();
+    if (sqlite3_close(conn->db)) return error(SCHED_FAIL_CLOSE_SCHED_FILE);
+    conn->db = 0;
+    return SCHED_OK;
+}
+
+void xsql_set_hooks(struct xsql_hooks const *hooks)
+{
+    sched_conn()->hooks = *hooks;
+    sqlite3_commit_hook(db(), hooks->commit, hooks->arg);
+    sqlite3_rollback_hook(db(), hooks->rollback, hooks->arg);
 }
 
 enum sched_rc xsql_exec(char const *sql, xsql_func_t fn, void *arg)
 {
-    return sqlite3_exec(sched, sql, fn, arg, 0) ? error(SCHED_FAIL_EXEC_STMT)
+    return sqlite3_exec(db(), sql, fn, arg, 0) ? error(SCHED_FAIL_EXEC_STMT)
                                                 : SCHED_OK;
 }
 
+/*
+ * Every transaction here writes, so take the write lock up front: a
+ * deferred transaction that later upgrades can fail with SQLITE_BUSY
+ * without the busy handler ever being called.
+ */
 enum sched_rc xsql_begin_transaction(void)
 {
-    return xsql_exec("BEGIN TRANSACTION;", 0, 0);
+    return xsql_exec("BEGIN IMMEDIATE TRANSACTION;", 0, 0);
 }
 
 enum sched_rc xsql_end_transaction(void)
 {
-    return xsql_exec("END TRANSACTION;", 0, 0);
+    enum sched_rc rc = xsql_exec("END TRANSACTION;", 0, 0);
+    struct xsql_hooks const *hooks = &sched_conn()->hooks;
+    if (!rc && hooks->committed) hooks->committed(hooks->arg);
+    return rc;
 }
 
 enum sched_rc xsql_rollback_transaction(void)
@@ -133,9 +275,32 @@ enum sched_rc xsql_rollback_transaction(void)
     return xsql_exec("ROLLBACK TRANSACTION;", 0, 0);
 }
 
+static enum sched_rc exec_named(char const *verb, char const *name)
+{
+    char sql[128] = {0};
+    int size = snprintf(sql, sizeof sql, "%s %s;", verb, name);
+    if (size < 0 || size >= (int)sizeof sql) return error(SCHED_FAIL_EXEC_STMT);
+    return xsql_exec(sql, 0, 0);
+}
+
+enum sched_rc xsql_savepoint(char const *name)
+{
+    return exec_named("SAVEPOINT", name);
+}
+
+enum sched_rc xsql_release(char const *name)
+{
+    return exec_named("RELEASE", name);
+}
+
+enum sched_rc xsql_rollback_to(char const *name)
+{
+    return exec_named("ROLLBACK TO", name);
+}
+
 enum sched_rc xsql_prepare(struct xsql_stmt *stmt)
 {
-    return sqlite3_prepare_v2(sched, stmt->query, -1, &stmt->st, 0)
+    return sqlite3_prepare_v2(db(), stmt->query, -1, &stmt->st, 0)
                ? error(SCHED_FAIL_PREPARE_STMT)
                : SCHED_OK;
 }
@@ -150,25 +315,223 @@ struct sqlite3_stmt *xsql_fresh_stmt(struct xsql_stmt *stmt)
     if (sqlite3_reset(stmt->st))
     {
         if (sqlite3_finalize(stmt->st)) return 0;
-        if (sqlite3_prepare_v2(sched, stmt->query, -1, &stmt->st, 0)) return 0;
+        if (sqlite3_prepare_v2(db(), stmt->query, -1, &stmt->st, 0)) return 0;
         return reset(stmt->st) ? 0 : stmt->st;
     }
     return stmt->st;
 }
-#include <stdio.h>
 
 enum sched_rc xsql_step(struct sqlite3_stmt *stmt)
 {
     int code = sqlite3_step(stmt);
     if (code == SQLITE_DONE) return SCHED_END;
     if (code == SQLITE_ROW) return SCHED_OK;
-    puts(sqlite3_errmsg(sched));
+    puts(sqlite3_errmsg(db()));
     fflush(stdout);
     return error(SCHED_FAIL_EVAL_STMT);
 }
 
 void xsql_finalize(struct sqlite3_stmt *stmt) { sqlite3_finalize(stmt); }
 
-int xsql_changes(void) { return sqlite3_changes(sched); }
+/* Resets every statement still in progress, e.g. after an early return. */
+void xsql_reset_all(void)
+{
+    struct sqlite3_stmt *stmt = 0;
+    while ((stmt = sqlite3_next_stmt(db(), stmt)))
+        if (sqlite3_stmt_busy(stmt)) sqlite3_reset(stmt);
+}
+
+bool xsql_in_transaction(void) { return !sqlite3_get_autocommit(db()); }
+
+int xsql_changes(void) { return sqlite3_changes(db()); }
+
+int64_t xsql_last_id(void) { return sqlite3_last_insert_rowid(db()); }
+
+enum
+{
+    VALUE_I64,
+    VALUE_DBL,
+    VALUE_TXT
+};
 
-int64_t xsql_last_id(void) { return sqlite3_last_insert_rowid(sched); }
+struct xsql_value
+{
+    int type;
+    int len;
+    union
+    {
+        int64_t i64;
+        double dbl;
+        size_t offset;
+    };
+};
+
+static char *bulk_query(char const *head, char const *row, int nrows)
+{
+    size_t head_len = strlen(head);
+    size_t row_len = strlen(row);
+    char *sql = malloc(head_len + (row_len + 2) * (size_t)nrows + 2);
+    if (!sql) return 0;
+
+    char *p = sql;
+    memcpy(p, head, head_len);
+    p += head_len;
+    for (int i = 0; i < nrows; ++i)
+    {
+        if (i > 0) *p++ = ',';
+        memcpy(p, row, row_len);
+        p += row_len;
+    }
+    memcpy(p, ";", 2);
+    return sql;
+}
+
+static enum sched_rc prepare_bulk(struct xsql_stmt *stmt, char const *head,
+                                  char const *row, int nrows)
+{
+    char *sql = bulk_query(head, row, nrows);
+    if (!sql) return error(SCHED_NOT_ENOUGH_MEMORY);
+    stmt->query = sql;
+    return xsql_prepare(stmt);
+}
+
+enum sched_rc xsql_bulk_init(struct xsql_bulk *bulk, char const *head,
+                             char const *row, int ncols, int max_rows)
+{
+    memset(bulk, 0, sizeof *bulk);
+    int max_vars = sqlite3_limit(db(), SQLITE_LIMIT_VARIABLE_NUMBER, -1);
+    bulk->ncols = ncols;
+    if (max_rows > XSQL_BULK_MAX_ROWS) max_rows = XSQL_BULK_MAX_ROWS;
+    bulk->nrows = max_vars / ncols < max_rows ? max_vars / ncols : max_rows;
+    if (bulk->nrows < 1) bulk->nrows = 1;
+
+    bulk->values = malloc(sizeof(*bulk->values) * bulk->nrows * ncols);
+    if (!bulk->values) return error(SCHED_NOT_ENOUGH_MEMORY);
+
+    enum sched_rc rc = prepare_bulk(&bulk->many, head, row, bulk->nrows);
+    if (rc) return rc;
+    return prepare_bulk(&bulk->one, head, row, 1);
+}
+
+void xsql_bulk_del(struct xsql_bulk *bulk)
+{
+    xsql_finalize(bulk->many.st);
+    xsql_finalize(bulk->one.st);
+    free((void *)bulk->many.query);
+    free((void *)bulk->one.query);
+    free(bulk->values);
+    free(bulk->arena);
+    memset(bulk, 0, sizeof *bulk);
+}
+
+static struct xsql_value *next_value(struct xsql_bulk *bulk, int type)
+{
+    assert(bulk->nvalues < bulk->nrows * bulk->ncols);
+    struct xsql_value *v = bulk->values + bulk->nvalues++;
+    v->type = type;
+    return v;
+}
+
+enum sched_rc xsql_bulk_i64(struct xsql_bulk *bulk, int64_t val)
+{
+    next_value(bulk, VALUE_I64)->i64 = val;
+    return SCHED_OK;
+}
+
+enum sched_rc xsql_bulk_dbl(struct xsql_bulk *bulk, double val)
+{
+    next_value(bulk, VALUE_DBL)->dbl = val;
+    return SCHED_OK;
+}
+
+/* Text goes into an arena so that rows can be bound without copies. */
+enum sched_rc xsql_bulk_txt(struct xsql_bulk *bulk, struct xsql_txt txt)
+{
+    size_t size = bulk->used + (size_t)txt.len;
+    if (size > bulk->avail || !bulk->arena)
+    {
+        size_t avail = bulk->avail ? bulk->avail : 4096;
+        while (avail < size)
+            avail *= 2;
+        char *arena = realloc(bulk->arena, avail);
+        if (!arena) return error(SCHED_NOT_ENOUGH_MEMORY);
+        bulk->arena = arena;
+        bulk->avail = avail;
+    }
+    struct xsql_value *v = next_value(bulk, VALUE_TXT);
+    v->len = txt.len;
+    v->offset = bulk->used;
+    memcpy(bulk->arena + bulk->used, txt.str, (size_t)txt.len);
+    bulk->used += (size_t)txt.len;
+    return SCHED_OK;
+}
+
+int xsql_bulk_rows(struct xsql_bulk const *bulk)
+{
+    return bulk->nvalues / bulk->ncols;
+}
+
+bool xsql_bulk_full(struct xsql_bulk const *bulk)
+{
+    return bulk->nvalues == bulk->nrows * bulk->ncols;
+}
+
+static enum sched_rc bind_value(struct sqlite3_stmt *st, int col,
+                                struct xsql_bulk const *bulk,
+                                struct xsql_value const *v)
+{
+    int rc = SQLITE_OK;
+    if (v->type == VALUE_I64)
+        rc = sqlite3_bind_int64(st, col + 1, v->i64);
+    else if (v->type == VALUE_DBL)
+        rc = sqlite3_bind_double(st, col + 1, v->dbl);
+    else
+        rc = sqlite3_bind_text(st, col + 1, bulk->arena + v->offset, v->len,
+                               SQLITE_STATIC);
+    return rc ? error(SCHED_FAIL_BIND_STMT) : SCHED_OK;
+}
+
+static enum sched_rc insert(struct xsql_stmt *stmt, struct xsql_bulk *bulk,
+                            int first, int nvalues)
+{
+    struct sqlite3_stmt *st = xsql_fresh_stmt(stmt);
+    if (!st) return error(SCHED_FAIL_GET_FRESH_STMT);
+
+    enum sched_rc rc = SCHED_OK;
+    for (int i = 0; i < nvalues; ++i)
+    {
+        if ((rc = bind_value(st, i, bulk, bulk->values + first + i))) break;
+    }
+    if (!rc && xsql_step(st) != SCHED_END) rc = error(SCHED_FAIL_EVAL_STMT);
+
+    /* Text was bound as static: detach it before the arena is reused. */
+    sqlite3_clear_bindings(st);
+    return rc;
+}
+
+/*
+ * Rows get consecutive ids, so the i-th flushed row of n has
+ * id xsql_last_id() - n + 1 + i once this returns.
+ */
+enum sched_rc xsql_bulk_flush(struct xsql_bulk *bulk)
+{
+    assert(bulk->nvalues % bulk->ncols == 0);
+    enum sched_rc rc = SCHED_OK;
+
+    if (xsql_bulk_full(bulk))
+        rc = insert(&bulk->many, bulk, 0, bulk->nvalues);
+    else
+    {
+        for (int i = 0; i < bulk->nvalues && !rc; i += bulk->ncols)
+            rc = insert(&bulk->one, bulk, i, bulk->ncols);
+    }
+
+    xsql_bulk_clear(bulk);
+    return rc;
+}
+
+void xsql_bulk_clear(struct xsql_bulk *bulk)
+{
+    bulk->nvalues = 0;
+    bulk->used = 0;
+}
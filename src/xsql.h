@@ -3,8 +3,9 @@
 
 #include <inttypes.h>
 #include <stdbool.h>
+#include <stddef.h>
 
-#define XSQL_REQUIRED_VERSION 3031001
+#define XSQL_REQUIRED_VERSION 3035000
 
 typedef int(xsql_func_t)(void *, int, char **, char **);
 
@@ -29,6 +30,49 @@ struct xsql_stmt
     char const *query;
 };
 
+/* State of the busy handler, one per connection. */
+struct xsql_busy
+{
+    int timeout;
+    int waited;
+    uint32_t seed;
+};
+
+/*
+ * Transaction hooks of a connection. commit and rollback are SQLite's
+ * own; committed runs once xsql_end_transaction has committed, when other
+ * connections can see the changes.
+ */
+struct xsql_hooks
+{
+    int (*commit)(void *);
+    void (*rollback)(void *);
+    void (*committed)(void *);
+    void *arg;
+};
+
+#define XSQL_BULK_MAX_ROWS 256
+
+struct xsql_value;
+
+/*
+ * Rows are buffered and written with one multi-row INSERT once nrows of
+ * them are queued. A partial batch is written with the single-row form.
+ */
+struct xsql_bulk
+{
+    int ncols;
+    int nrows;
+    int nvalues;
+    struct xsql_stmt many;
+    struct xsql_stmt one;
+    struct xsql_value *values;
+
+    size_t used;
+    size_t avail;
+    char *arena;
+};
+
 #define XSQL_TXT_OF(var, member)                                               \
     (struct xsql_txt)                                                          \
     {                                                                          \
@@ -50,25 +94,49 @@ enum sched_rc xsql_bind_blob(struct sqlite3_stmt *stmt, int col,
 int xsql_get_int(struct sqlite3_stmt *stmt, int col);
 int64_t xsql_get_i64(struct sqlite3_stmt *stmt, int col);
 double xsql_get_dbl(struct sqlite3_stmt *stmt, int col);
+bool xsql_is_null(struct sqlite3_stmt *stmt, int col);
+struct xsql_txt xsql_get_txt(struct sqlite3_stmt *stmt, int col);
+struct xsql_blob xsql_get_blob(struct sqlite3_stmt *stmt, int col);
 enum sched_rc xsql_cpy_txt(struct sqlite3_stmt *stmt, int col,
                            struct xsql_txt txt);
 enum sched_rc xsql_cpy_blob(struct sqlite3_stmt *stmt, int col,
                             struct xsql_blob *);
 
-enum sched_rc xsql_open(char const *filepath);
+struct sched_options;
+
+enum sched_rc xsql_open(char const *filepath, struct sched_options const *);
+enum sched_rc xsql_open_readonly(char const *filepath,
+                                 struct sched_options const *);
 enum sched_rc xsql_close(void);
+void xsql_set_hooks(struct xsql_hooks const *);
 enum sched_rc xsql_exec(char const *, xsql_func_t, void *);
 
 enum sched_rc xsql_begin_transaction(void);
 enum sched_rc xsql_end_transaction(void);
 enum sched_rc xsql_rollback_transaction(void);
+enum sched_rc xsql_savepoint(char const *name);
+enum sched_rc xsql_release(char const *name);
+enum sched_rc xsql_rollback_to(char const *name);
 
 enum sched_rc xsql_prepare(struct xsql_stmt *stmt);
 struct sqlite3_stmt *xsql_fresh_stmt(struct xsql_stmt *stmt);
 enum sched_rc xsql_step(struct sqlite3_stmt *stmt);
 void xsql_finalize(struct sqlite3_stmt *stmt);
+void xsql_reset_all(void);
+bool xsql_in_transaction(void);
 int xsql_changes(void);
 
 int64_t xsql_last_id(void);
 
+enum sched_rc xsql_bulk_init(struct xsql_bulk *, char const *head,
+                             char const *row, int ncols, int max_rows);
+void xsql_bulk_del(struct xsql_bulk *);
+enum sched_rc xsql_bulk_i64(struct xsql_bulk *, int64_t val);
+enum sched_rc xsql_bulk_dbl(struct xsql_bulk *, double val);
+enum sched_rc xsql_bulk_txt(struct xsql_bulk *, struct xsql_txt txt);
+int xsql_bulk_rows(struct xsql_bulk const *);
+bool xsql_bulk_full(struct xsql_bulk const *);
+enum sched_rc xsql_bulk_flush(struct xsql_bulk *);
+void xsql_bulk_clear(struct xsql_bulk *);
+
 #endif
@@ -7,6 +7,8 @@
 #include "zc.h"
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
 
 static inline enum sched_rc xstrcpy(char *dst, char const *src, size_t dsize)
 {
@@ -17,4 +19,23 @@ static inline enum sched_rc xstrcpy(char *dst, char const *src, size_t dsize)
 #define XSTRCPY(ptr, member, src)                                              \
     xstrcpy((ptr)->member, src, ARRAY_SIZE_OF(*(ptr), member))
 
+/* Copy len bytes of src into a heap buffer, growing it as needed. */
+static inline enum sched_rc xstrcpy_grow(char **dst, size_t *capacity,
+                                         char const *src, size_t len)
+{
+    if (len + 1 > *capacity)
+    {
+        size_t cap = *capacity ? *capacity : 64;
+        while (cap < len + 1)
+            cap *= 2;
+        char *ptr = realloc(*dst, cap);
+        if (!ptr) return error(SCHED_NOT_ENOUGH_MEMORY);
+        *dst = ptr;
+        *capacity = cap;
+    }
+    memcpy(*dst, src, len);
+    (*dst)[len] = '\0';
+    return SCHED_OK;
+}
+
 #endif
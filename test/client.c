@@ -0,0 +1,260 @@
+#include "sched/sched.h"
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "hope.h"
+
+static char const sched_path[] = TMPDIR "/client.sched";
+
+static pid_t start_server(void);
+static int stop_server(pid_t);
+static void test_worker_api(void);
+static void test_concurrent_claims(void);
+static void test_scan_pages(void);
+
+int main(void)
+{
+    remove(sched_path);
+    pid_t server = start_server();
+    eq(server > 0, 1);
+
+    eq(sched_init(sched_path), SCHED_OK);
+    test_worker_api();
+    test_concurrent_claims();
+    test_scan_pages();
+    eq(sched_cleanup(), SCHED_OK);
+
+    eq(stop_server(server), 0);
+    return hope_status();
+}
+
+static pid_t start_server(void)
+{
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        execl(SCHED_SERVER, SCHED_SERVER, sched_path, (char *)0);
+        _exit(127);
+    }
+    return pid;
+}
+
+static int stop_server(pid_t pid)
+{
+    int status = 0;
+    kill(pid, SIGTERM);
+    if (waitpid(pid, &status, 0) != pid) return -1;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static void create_file(char const *path, int seed)
+{
+    FILE *fp = fopen(path, "wb");
+    notnull(fp);
+    char const data[] = {
+        0x64, 0x29, 0x20, 0x4e, 0x4f, 0x0a, 0x20, 0x20, 0x20,
+        0x20, 0x69, 0x74, 0x73, 0x20, 0x49, 0x4e, 0x4f, 0x54,
+        0x20, 0x4e, 0x20, 0x20, 0x68, 0x6d, 0x6d, 0x70, 0x61,
+        0x74, 0x20, 0x49, 0x4e, 0x4f, 0x54, 0x20, 0x4e, 0x20,
+        0x20, 0x73, 0x74, 0x61, 0x20, 0x43, 0x48, 0x45, (char)seed,
+    };
+    eq(fwrite(data, sizeof data, 1, fp), 1);
+    eq(fclose(fp), 0);
+}
+
+static void count_seq(struct sched_seq *seq, void *arg)
+{
+    (void)seq;
+    ++*(int *)arg;
+}
+
+static int64_t db_id = 0;
+
+static void test_worker_api(void)
+{
+    struct sched_hmm hmm = {0};
+    struct sched_db db = {0};
+    struct sched_scan scan = {0};
+    struct sched_job job = {0};
+    struct sched_job x = {0};
+    struct sched_seq seq = {0};
+
+    create_file("client.hmm", 0);
+    create_file("client.dcp", 0);
+
+    sched_hmm_init(&hmm);
+    eq(sched_hmm_set_file(&hmm, "client.hmm"), SCHED_OK);
+    sched_job_init(&job, SCHED_HMM);
+    eq(sched_job_submit(&job, &hmm), SCHED_OK);
+    eq(job.id, 1);
+    eq(hmm.job_id, 1);
+
+    eq(sched_job_claim_next(&x), SCHED_OK);
+    eq(x.id, job.id);
+    eq(x.state, "run");
+    eq(sched_job_set_done(x.id), SCHED_OK);
+    eq(sched_job_claim_next(&x), SCHED_JOB_NOT_FOUND);
+
+    sched_db_init(&db);
+    eq(sched_db_add(&db, "client.dcp"), SCHED_OK);
+    eq(db.hmm_id, hmm.id);
+    db_id = db.id;
+
+    sched_scan_init(&scan, db.id, true, false);
+    eq(sched_scan_add_seq("seq0", "ACAAGCAG"), SCHED_OK);
+    eq(sched_scan_add_seq("seq1", "ACTTGCCG"), SCHED_OK);
+    sched_job_init(&job, SCHED_SCAN);
+    eq(sched_job_submit(&job, &scan), SCHED_OK);
+    eq(scan.job_id, job.id);
+
+    eq(sched_job_next_pend(&x), SCHED_OK);
+    eq(x.id, job.id);
+
+    int n = 0;
+    struct sched_job batch[4] = {0};
+    eq(sched_job_claim_batch(batch, 4, &n), SCHED_OK);
+    eq(n, 1);
+    eq(batch[0].id, job.id);
+
+    eq(sched_scan_get_by_job_id(&scan, job.id), SCHED_OK);
+    eq(scan.db_id, db.id);
+
+    int count = 0;
+    eq(sched_scan_get_seqs(scan.id, count_seq, &seq, &count), SCHED_OK);
+    eq(count, 2);
+
+    sched_seq_init(&seq, 0, scan.id, "", "");
+    eq(sched_seq_scan_next(&seq), SCHED_OK);
+    eq(seq.name, "seq0");
+    eq(seq.data, "ACAAGCAG");
+    eq(sched_seq_scan_next(&seq), SCHED_OK);
+    eq(seq.name, "seq1");
+    eq(sched_seq_scan_next(&seq), SCHED_SEQ_NOT_FOUND);
+
+    eq(sched_job_heartbeat(job.id, batch[0].retries), SCHED_OK);
+    eq(sched_job_reap_expired(&n), SCHED_OK);
+    eq(n, 0);
+
+    eq(sched_job_increment_progress(job.id, 40), SCHED_OK);
+    eq(sched_job_get_by_id(&x, job.id), SCHED_OK);
+    eq(x.progress, 40);
+
+    enum sched_job_state state = 0;
+    eq(sched_job_set_done_claimed(job.id, batch[0].retries + 1),
+       SCHED_JOB_NOT_FOUND);
+    eq(sched_job_set_fail(job.id, "boom"), SCHED_OK);
+    eq(sched_job_state(job.id, &state), SCHED_OK);
+    eq((int)state, SCHED_FAIL);
+    eq(sched_job_get_by_id(&x, job.id), SCHED_OK);
+    eq(x.error, "boom");
+
+    eq(sched_job_get_by_id(&x, 999), SCHED_JOB_NOT_FOUND);
+    eq(sched_prodset_add(TMPDIR "/missing"), SCHED_FAIL_OPEN_FILE);
+}
+
+enum
+{
+    NUM_WORKERS = 4,
+    NUM_SCANS = 40,
+};
+
+/* Each worker process claims until nothing is left. */
+static int claim_all(void)
+{
+    struct sched_job job = {0};
+    int count = 0;
+    sched_cleanup();
+    if (sched_init(sched_path)) return 255;
+    while (sched_job_claim_next(&job) == SCHED_OK)
+    {
+        if (sched_job_set_done(job.id)) return 255;
+        ++count;
+    }
+    sched_cleanup();
+    return count;
+}
+
+static void test_concurrent_claims(void)
+{
+    struct sched_scan scan = {0};
+    struct sched_job job = {0};
+
+    for (int i = 0; i < NUM_SCANS; ++i)
+    {
+        sched_scan_init(&scan, db_id, true, false);
+        eq(sched_scan_add_seq("seq", "ACGT"), SCHED_OK);
+        sched_job_init(&job, SCHED_SCAN);
+        eq(sched_job_submit(&job, &scan), SCHED_OK);
+    }
+
+    pid_t workers[NUM_WORKERS] = {0};
+    for (int i = 0; i < NUM_WORKERS; ++i)
+    {
+        if ((workers[i] = fork()) == 0) _exit(claim_all());
+    }
+
+    int total = 0;
+    for (int i = 0; i < NUM_WORKERS; ++i)
+    {
+        int status = 0;
+        eq(waitpid(workers[i], &status, 0), workers[i]);
+        eq(WIFEXITED(status), 1);
+        total += WEXITSTATUS(status);
+    }
+    eq(total, NUM_SCANS);
+    eq(sched_job_claim_next(&job), SCHED_JOB_NOT_FOUND);
+}
+
+enum
+{
+    NUM_PAGED_SEQS = 600,
+};
+
+struct paged
+{
+    int count;
+    int misses;
+};
+
+/* Calls back into the library, as the sequences come a page at a time. */
+static void check_seq(struct sched_seq *seq, void *arg)
+{
+    struct paged *paged = arg;
+    struct sched_seq x = {0};
+    char name[32] = {0};
+    snprintf(name, sizeof name, "seq%d", paged->count++);
+    if (strcmp(seq->name, name) || sched_seq_get_by_id(&x, seq->id) ||
+        strcmp(x.name, name))
+        ++paged->misses;
+}
+
+static void test_scan_pages(void)
+{
+    struct sched_scan scan = {0};
+    struct sched_job job = {0};
+    struct sched_seq seq = {0};
+    char name[32] = {0};
+
+    sched_scan_init(&scan, db_id, true, false);
+    for (int i = 0; i < NUM_PAGED_SEQS; ++i)
+    {
+        snprintf(name, sizeof name, "seq%d", i);
+        eq(sched_scan_add_seq(name, "ACGT"), SCHED_OK);
+    }
+    sched_job_init(&job, SCHED_SCAN);
+    eq(sched_job_submit(&job, &scan), SCHED_OK);
+
+    struct paged paged = {0};
+    eq(sched_scan_get_seqs(scan.id, check_seq, &seq, &paged), SCHED_OK);
+    eq(paged.count, NUM_PAGED_SEQS);
+    eq(paged.misses, 0);
+
+    paged.count = 0;
+    eq(sched_scan_get_seqs(scan.id + 1, check_seq, &seq, &paged),
+       SCHED_SCAN_NOT_FOUND);
+    eq(paged.count, 0);
+}
@@ -1,6 +1,15 @@
 #include "sched/sched.h"
 #include "fs.h"
+#include "handle.h"
+#include <sys/wait.h>
+#include <unistd.h>
+
 #include "hope.h"
+#include "sqlite3/sqlite3.h"
+#include "xsql.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
 
 struct sched_hmm hmm = {0};
 struct sched_db db = {0};
@@ -12,6 +21,8 @@ struct sched_hmmer hmmer = {0};
 
 static void test_hmmer_filename(void);
 static void test_reopen(void);
+static void test_migrate(void);
+static void test_init_options(void);
 static void test_submit_hmm(void);
 static void test_submit_hmm_nofile(void);
 static void test_submit_hmm_same_file(void);
@@ -19,15 +30,33 @@ static void test_submit_hmm_wrong_extension(void);
 static void test_add_db(void);
 static void test_submit_scan(void);
 static void test_submit_and_fetch_scan_job(void);
+static void test_claim_next_job(void);
+static void test_claim_batch_job(void);
 static void test_submit_and_fetch_seq(void);
+static void test_scan_get_seqs_paged(void);
+static void test_seq_dyn(void);
+static void test_scan_stream(void);
 static void test_submit_prod(void);
+static void test_submit_prod_long_line(void);
+static void test_submit_prod_parallel(void);
 static void test_submit_prodset(void);
+static void test_handles(void);
+static void test_pool(void);
+static void test_async(void);
+static void test_progress(void);
+static void test_wait_pend(void);
+static void test_dispatch(void);
+static void test_unit(void);
+static void test_lease(void);
 static void test_wipe(void);
+static void file_write(char const *path, char const *str);
 
 int main(void)
 {
     test_hmmer_filename();
     test_reopen();
+    test_migrate();
+    test_init_options();
     test_submit_hmm();
     test_submit_hmm_nofile();
     test_submit_hmm_same_file();
@@ -35,9 +64,24 @@ int main(void)
     test_add_db();
     test_submit_scan();
     test_submit_and_fetch_scan_job();
+    test_claim_next_job();
+    test_claim_batch_job();
     test_submit_and_fetch_seq();
+    test_scan_get_seqs_paged();
+    test_seq_dyn();
+    test_scan_stream();
     test_submit_prod();
+    test_submit_prod_long_line();
+    test_submit_prod_parallel();
     test_submit_prodset();
+    test_handles();
+    test_pool();
+    test_async();
+    test_progress();
+    test_wait_pend();
+    test_dispatch();
+    test_unit();
+    test_lease();
     test_wipe();
     return hope_status();
 }
@@ -54,6 +98,17 @@ static void test_hmmer_filename(void)
     eq(x.scan_id, 1);
     eq(x.seq_id, 2);
     eq(x.profile_name, "profname");
+
+    eq(sched_hmmer_filename_parse(&x, "hmmer_3_4_PF00742.20.h3r"), 0);
+    eq(x.scan_id, 3);
+    eq(x.seq_id, 4);
+    eq(x.profile_name, "PF00742.20");
+
+    eq(sched_hmmer_filename_parse(&x, "hmmer_3_4_PF00742.20.txt"),
+       SCHED_FAIL_PARSE_FILENAME);
+    eq(sched_hmmer_filename_parse(&x, "hmmer_3_x_PF00742.20.h3r"),
+       SCHED_FAIL_PARSE_FILENAME);
+    eq(sched_hmmer_filename_parse(&x, "prod.tsv"), SCHED_FAIL_PARSE_FILENAME);
 }
 
 static void test_reopen()
@@ -66,6 +121,167 @@ static void test_reopen()
     eq(sched_cleanup(), SCHED_OK);
 }
 
+enum
+{
+    SCHEMA_VERSION = 7,
+};
+
+static void exec_sql(char const *db_path, char const *sql)
+{
+    sqlite3 *db = 0;
+    eq(sqlite3_open(db_path, &db), SQLITE_OK);
+    eq(sqlite3_exec(db, sql, 0, 0, 0), SQLITE_OK);
+    eq(sqlite3_close(db), SQLITE_OK);
+}
+
+static void run_script(char const *db_path, char const *sql_path)
+{
+    long size = 0;
+    unsigned char *sql = 0;
+    eq(fs_readall(sql_path, &size, &sql), 0);
+    sql = realloc(sql, (size_t)size + 1);
+    notnull(sql);
+    sql[size] = '\0';
+    exec_sql(db_path, (char const *)sql);
+    free(sql);
+}
+
+/* First column of the first row, as text the caller frees. */
+static char *query(char const *db_path, char const *sql)
+{
+    sqlite3 *db = 0;
+    sqlite3_stmt *st = 0;
+    char *text = 0;
+    eq(sqlite3_open(db_path, &db), SQLITE_OK);
+    eq(sqlite3_prepare_v2(db, sql, -1, &st, 0), SQLITE_OK);
+    if (sqlite3_step(st) == SQLITE_ROW && sqlite3_column_text(st, 0))
+        text = strdup((char const *)sqlite3_column_text(st, 0));
+    sqlite3_finalize(st);
+    eq(sqlite3_close(db), SQLITE_OK);
+    return text ? text : strdup("");
+}
+
+/* Tables, indexes and columns, in a form two files can be compared by. */
+static char const layout_sql[] =
+    "SELECT group_concat(item, '\n') FROM ("
+    "  SELECT m.type || ' ' || m.name || ' ' || m.tbl_name || ' ' ||"
+    "         ifnull(CASE m.type WHEN 'index' THEN m.sql END, '') AS item"
+    "  FROM sqlite_master m"
+    "  UNION ALL"
+    "  SELECT m.name || '.' || p.name || ' ' || p.type || ' ' || p.\"notnull\""
+    "         || ' ' || ifnull(p.dflt_value, '') || ' ' || p.pk"
+    "  FROM sqlite_master m, pragma_table_info(m.name) p"
+    "  WHERE m.type = 'table'"
+    "  ORDER BY item);";
+
+static void test_migrate(void)
+{
+    char const old_path[] = TMPDIR "/migrate_old.sched";
+    char const new_path[] = TMPDIR "/migrate_new.sched";
+    struct sched_job x = {0};
+
+    remove(old_path);
+    remove(new_path);
+    run_script(old_path, TESTDIR "/schema_v0.sql");
+
+    eq(sched_init(old_path), SCHED_OK);
+
+    eq(sched_job_get_by_id(&x, 1), SCHED_OK);
+    eq(x.state, "done");
+    eq(x.exec_ended, 12);
+    eq(sched_job_get_by_id(&x, 2), SCHED_OK);
+    eq(x.state, "pend");
+    eq(x.retries, 0);
+    eq(x.lease_expiry, 0);
+    eq(sched_job_get_by_id(&x, 3), SCHED_OK);
+    eq(x.state, "run");
+    eq(x.progress, 40);
+    eq(sched_job_get_by_id(&x, 4), SCHED_OK);
+    eq(x.state, "fail");
+    eq(x.error, "boom");
+
+    eq(sched_job_next_pend(&x), SCHED_OK);
+    eq(x.id, 2);
+
+    eq(sched_hmmer_get_by_prod_id(&hmmer, 1), SCHED_OK);
+    eq(hmmer.id, 1);
+    eq(hmmer.len, 2);
+    free((void *)hmmer.data);
+    eq(sched_cleanup(), SCHED_OK);
+
+    /* Opening an upgraded file again changes nothing. */
+    eq(sched_init(old_path), SCHED_OK);
+    eq(sched_cleanup(), SCHED_OK);
+
+    eq(sched_init(new_path), SCHED_OK);
+    eq(sched_cleanup(), SCHED_OK);
+
+    char *version = query(old_path, "PRAGMA user_version;");
+    eq(atoi(version), SCHEMA_VERSION);
+    free(version);
+
+    char *migrated = query(old_path, layout_sql);
+    char *fresh = query(new_path, layout_sql);
+    eq(migrated, fresh);
+    free(migrated);
+    free(fresh);
+
+    /* A product with two hmmer rows stops the upgrade, leaving both. */
+    remove(old_path);
+    run_script(old_path, TESTDIR "/schema_v0.sql");
+    exec_sql(old_path, "INSERT INTO hmmer VALUES (2, X'0102030405', 1);");
+    eq(sched_init(old_path), SCHED_DUPLICATE_HMMER);
+
+    version = query(old_path, "PRAGMA user_version;");
+    eq(atoi(version), 5);
+    free(version);
+    char *count = query(old_path, "SELECT COUNT(*) FROM hmmer;");
+    eq(count, "2");
+    free(count);
+
+    exec_sql(old_path, "DELETE FROM hmmer WHERE id = 1;");
+    eq(sched_init(old_path), SCHED_OK);
+    eq(sched_hmmer_get_by_prod_id(&hmmer, 1), SCHED_OK);
+    eq(hmmer.id, 2);
+    eq(hmmer.len, 5);
+    free((void *)hmmer.data);
+    eq(sched_cleanup(), SCHED_OK);
+}
+
+static int file_exists(char const *path)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp) fclose(fp);
+    return fp != 0;
+}
+
+static void test_init_options(void)
+{
+    char const sched_path[] = TMPDIR "/init_options.sched";
+    char const wal_path[] = TMPDIR "/init_options.sched-wal";
+    struct sched_options opts = {0};
+
+    remove(sched_path);
+    sched_options_init(&opts);
+    eq((int)opts.wal, 1);
+    eq(opts.synchronous, SCHED_SYNCHRONOUS_NORMAL);
+
+    eq(sched_init_ex(sched_path, &opts), SCHED_OK);
+    eq(file_exists(wal_path), 1);
+    eq(sched_cleanup(), SCHED_OK);
+    eq(file_exists(wal_path), 0);
+
+    opts.wal = false;
+    opts.synchronous = SCHED_SYNCHRONOUS_FULL;
+    opts.busy_timeout_ms = 0;
+    eq(sched_init_ex(sched_path, &opts), SCHED_OK);
+    eq(file_exists(wal_path), 0);
+    eq(sched_cleanup(), SCHED_OK);
+
+    opts.synchronous = 42;
+    eq(sched_init_ex(sched_path, &opts), SCHED_FAIL_OPEN_SCHED_FILE);
+}
+
 static void create_file(char const *path, int seed)
 {
     FILE *fp = fopen(path, "wb");
@@ -316,6 +532,122 @@ static void test_submit_and_fetch_scan_job()
     eq(sched_cleanup(), SCHED_OK);
 }
 
+static void test_claim_next_job(void)
+{
+    char const sched_path[] = TMPDIR "/claim_next_job.sched";
+    char const file_hmm[] = "claim_next_job.hmm";
+    char const file_dcp[] = "claim_next_job.dcp";
+
+    remove(sched_path);
+    create_file(file_hmm, 0);
+    create_file(file_dcp, 0);
+
+    eq(sched_init(sched_path), SCHED_OK);
+
+    sched_db_init(&db);
+    sched_hmm_init(&hmm);
+
+    eq(sched_hmm_set_file(&hmm, file_hmm), SCHED_OK);
+    sched_job_init(&job, SCHED_HMM);
+    eq(sched_job_submit(&job, &hmm), SCHED_OK);
+    eq(job.id, 1);
+
+    eq(sched_job_claim_next(&job), SCHED_OK);
+    eq(job.id, 1);
+    eq(job.type, SCHED_HMM);
+    eq(job.state, "run");
+    eq(job.exec_started > 0, 1);
+
+    eq(sched_job_set_done(job.id), SCHED_OK);
+    eq(sched_db_add(&db, file_dcp), SCHED_OK);
+    eq(db.id, 1);
+
+    sched_scan_init(&scan, db.id, true, false);
+    sched_scan_add_seq("seq0", "ACAAGCAG");
+
+    sched_job_init(&job, SCHED_SCAN);
+    eq(sched_job_submit(&job, &scan), SCHED_OK);
+
+    sched_scan_init(&scan, db.id, true, true);
+    sched_scan_add_seq("seq0_2", "XXGG");
+
+    sched_job_init(&job, SCHED_SCAN);
+    eq(sched_job_submit(&job, &scan), SCHED_OK);
+
+    eq(sched_job_claim_next(&job), SCHED_OK);
+    eq(job.id, 2);
+    eq(job.type, SCHED_SCAN);
+    eq(job.state, "run");
+
+    eq(sched_job_claim_next(&job), SCHED_OK);
+    eq(job.id, 3);
+    eq(job.state, "run");
+
+    eq(sched_job_claim_next(&job), SCHED_JOB_NOT_FOUND);
+    eq(sched_job_next_pend(&job), SCHED_JOB_NOT_FOUND);
+
+    eq(sched_job_get_by_id(&job, 2), SCHED_OK);
+    eq(job.state, "run");
+
+    eq(sched_cleanup(), SCHED_OK);
+}
+
+static void test_claim_batch_job(void)
+{
+    char const sched_path[] = TMPDIR "/claim_batch_job.sched";
+    char const file_hmm[] = "claim_batch_job.hmm";
+    char const file_dcp[] = "claim_batch_job.dcp";
+
+    remove(sched_path);
+    create_file(file_hmm, 0);
+    create_file(file_dcp, 0);
+
+    eq(sched_init(sched_path), SCHED_OK);
+
+    sched_db_init(&db);
+    sched_hmm_init(&hmm);
+
+    eq(sched_hmm_set_file(&hmm, file_hmm), SCHED_OK);
+    sched_job_init(&job, SCHED_HMM);
+    eq(sched_job_submit(&job, &hmm), SCHED_OK);
+    eq(sched_job_set_run(job.id), SCHED_OK);
+    eq(sched_job_set_done(job.id), SCHED_OK);
+    eq(sched_db_add(&db, file_dcp), SCHED_OK);
+    eq(db.id, 1);
+
+    for (int i = 0; i < 5; ++i)
+    {
+        sched_scan_init(&scan, db.id, true, false);
+        sched_scan_add_seq("seq0", "ACAAGCAG");
+        sched_job_init(&job, SCHED_SCAN);
+        eq(sched_job_submit(&job, &scan), SCHED_OK);
+    }
+
+    struct sched_job jobs[3] = {0};
+    int n = -1;
+
+    eq(sched_job_claim_batch(jobs, 3, &n), SCHED_OK);
+    eq(n, 3);
+    eq(jobs[0].id, 2);
+    eq(jobs[1].id, 3);
+    eq(jobs[2].id, 4);
+    eq(jobs[0].state, "run");
+    eq(jobs[2].state, "run");
+
+    eq(sched_job_claim_batch(jobs, 3, &n), SCHED_OK);
+    eq(n, 2);
+    eq(jobs[0].id, 5);
+    eq(jobs[1].id, 6);
+
+    eq(sched_job_claim_batch(jobs, 3, &n), SCHED_JOB_NOT_FOUND);
+    eq(n, 0);
+
+    eq(sched_job_get_by_id(&job, 6), SCHED_OK);
+    eq(job.state, "run");
+
+    eq(sched_cleanup(), SCHED_OK);
+}
+
 static void test_submit_and_fetch_seq()
 {
     char const sched_path[] = TMPDIR "/submit_and_fetch_seq.sched";
@@ -375,13 +707,284 @@ static void test_submit_and_fetch_seq()
     eq(sched_cleanup(), SCHED_OK);
 }
 
+static void collect_seq(struct sched_seq *x, void *arg)
+{
+    int64_t *ids = arg;
+    ids[++ids[0]] = x->id;
+}
+
+static void collect_job(struct sched_job *x, void *arg)
+{
+    int64_t *ids = arg;
+    ids[++ids[0]] = x->id;
+}
+
+static void test_scan_get_seqs_paged(void)
+{
+    char const sched_path[] = TMPDIR "/scan_get_seqs_paged.sched";
+    char const file_hmm[] = "scan_get_seqs_paged.hmm";
+    char const file_dcp[] = "scan_get_seqs_paged.dcp";
+
+    remove(sched_path);
+    create_file(file_hmm, 0);
+    create_file(file_dcp, 0);
+
+    eq(sched_init(sched_path), SCHED_OK);
+
+    sched_db_init(&db);
+    sched_hmm_init(&hmm);
+
+    eq(sched_hmm_set_file(&hmm, file_hmm), SCHED_OK);
+    sched_job_init(&job, SCHED_HMM);
+    eq(sched_job_submit(&job, &hmm), SCHED_OK);
+    eq(sched_job_set_run(job.id), SCHED_OK);
+    eq(sched_job_set_done(job.id), SCHED_OK);
+    eq(sched_db_add(&db, file_dcp), SCHED_OK);
+
+    sched_scan_init(&scan, db.id, true, false);
+    sched_scan_add_seq("seq0", "ACAAGCAG");
+    sched_scan_add_seq("seq1", "ACTTGCCG");
+    sched_job_init(&job, SCHED_SCAN);
+    eq(sched_job_submit(&job, &scan), SCHED_OK);
+
+    sched_scan_init(&scan, db.id, true, true);
+    sched_scan_add_seq("seq0_2", "XXGG");
+    sched_scan_add_seq("seq1_2", "YXYX");
+    sched_scan_add_seq("seq2_2", "GGXX");
+    sched_job_init(&job, SCHED_SCAN);
+    eq(sched_job_submit(&job, &scan), SCHED_OK);
+
+    int64_t ids[8] = {0};
+    int page_sizes[] = {1, 2, 3, 0};
+    for (int i = 0; i < 4; ++i)
+    {
+        sched_set_page_size(page_sizes[i]);
+
+        ids[0] = 0;
+        eq(sched_scan_get_seqs(2, collect_seq, &seq, ids), SCHED_OK);
+        eq(ids[0], 3);
+        eq(ids[1], 3);
+        eq(ids[2], 4);
+        eq(ids[3], 5);
+
+        ids[0] = 0;
+        eq(sched_seq_get_all(collect_seq, &seq, ids), SCHED_OK);
+        eq(ids[0], 5);
+        eq(ids[5], 5);
+
+        ids[0] = 0;
+        eq(sched_job_get_all(collect_job, &job, ids), SCHED_OK);
+        eq(ids[0], 3);
+        eq(ids[3], 3);
+    }
+    sched_set_page_size(SCHED_PAGE_SIZE);
+
+    eq(sched_cleanup(), SCHED_OK);
+}
+
+static void collect_seq_dyn(struct sched_seq_dyn *x, void *arg)
+{
+    int64_t *lens = arg;
+    lens[++lens[0]] = x->data_len;
+    eq((int)strlen(x->data), x->data_len);
+}
+
+static void test_seq_dyn(void)
+{
+    char const sched_path[] = TMPDIR "/seq_dyn.sched";
+    char const file_hmm[] = "seq_dyn.hmm";
+    char const file_dcp[] = "seq_dyn.dcp";
+
+    remove(sched_path);
+    create_file(file_hmm, 0);
+    create_file(file_dcp, 0);
+
+    eq(sched_init(sched_path), SCHED_OK);
+
+    sched_db_init(&db);
+    sched_hmm_init(&hmm);
+
+    eq(sched_hmm_set_file(&hmm, file_hmm), SCHED_OK);
+    sched_job_init(&job, SCHED_HMM);
+    eq(sched_job_submit(&job, &hmm), SCHED_OK);
+    eq(sched_job_set_run(job.id), SCHED_OK);
+    eq(sched_job_set_done(job.id), SCHED_OK);
+    eq(sched_db_add(&db, file_dcp), SCHED_OK);
+
+    int const big_len = 2 * SCHED_SEQ_SIZE;
+    char *big = malloc(big_len + 1);
+    memset(big, 'A', big_len);
+    big[big_len] = '\0';
+
+    sched_scan_init(&scan, db.id, true, false);
+    eq(sched_scan_add_seq("seq0", "ACAAGCAG"), SCHED_OK);
+    eq(sched_scan_add_seq("big", big), SCHED_OK);
+    for (int i = 0; i < 2 * SCHED_NUM_SEQS_PER_JOB; ++i)
+        eq(sched_scan_add_seq("seq", "ACGT"), SCHED_OK);
+    sched_job_init(&job, SCHED_SCAN);
+    eq(sched_job_submit(&job, &scan), SCHED_OK);
+    free(big);
+
+    struct sched_seq_dyn dyn = {0};
+    sched_seq_dyn_init(&dyn);
+    eq(sched_seq_dyn_get_by_id(&dyn, 2), SCHED_OK);
+    eq(dyn.name, "big");
+    eq(dyn.name_len, 3);
+    eq(dyn.data_len, big_len);
+    eq(dyn.data[big_len - 1], 'A');
+    eq(sched_seq_get_by_id(&seq, 2), SCHED_FAIL_GET_COLUMN_TEXT);
+
+    dyn.id = 0;
+    dyn.scan_id = scan.id;
+    eq(sched_seq_dyn_scan_next(&dyn), SCHED_OK);
+    eq(dyn.id, 1);
+    eq(dyn.data, "ACAAGCAG");
+    eq(dyn.data_len, 8);
+
+    static int64_t lens[2 * SCHED_NUM_SEQS_PER_JOB + 3] = {0};
+    eq(sched_scan_get_seqs_dyn(scan.id, collect_seq_dyn, &dyn, lens),
+       SCHED_OK);
+    eq(lens[0], 2 * SCHED_NUM_SEQS_PER_JOB + 2);
+    eq(lens[1], 8);
+    eq(lens[2], big_len);
+    eq(lens[3], 4);
+    sched_seq_dyn_cleanup(&dyn);
+
+    eq(sched_cleanup(), SCHED_OK);
+}
+
+static void test_scan_stream(void)
+{
+    char const sched_path[] = TMPDIR "/scan_stream.sched";
+    char const file_hmm[] = "scan_stream.hmm";
+    char const file_dcp[] = "scan_stream.dcp";
+    char const fasta_path[] = TMPDIR "/scan_stream.fasta";
+
+    remove(sched_path);
+    create_file(file_hmm, 0);
+    create_file(file_dcp, 0);
+
+    struct sched_options opts = {0};
+    sched_options_init(&opts);
+    opts.stream_commit_kib = 1;
+    opts.bulk_rows = 7;
+    eq(sched_init_ex(sched_path, &opts), SCHED_OK);
+
+    sched_db_init(&db);
+    sched_hmm_init(&hmm);
+
+    eq(sched_hmm_set_file(&hmm, file_hmm), SCHED_OK);
+    sched_job_init(&job, SCHED_HMM);
+    eq(sched_job_submit(&job, &hmm), SCHED_OK);
+    eq(sched_job_set_run(job.id), SCHED_OK);
+    eq(sched_job_set_done(job.id), SCHED_OK);
+    eq(sched_db_add(&db, file_dcp), SCHED_OK);
+
+    struct sched_hmm other_hmm = {0};
+    struct sched_job other = {0};
+    create_file("scan_stream2.hmm", 1);
+    sched_hmm_init(&other_hmm);
+    eq(sched_hmm_set_file(&other_hmm, "scan_stream2.hmm"), SCHED_OK);
+    sched_job_init(&other, SCHED_HMM);
+    eq(sched_job_submit(&other, &other_hmm), SCHED_OK);
+    eq(sched_job_set_run(other.id), SCHED_OK);
+
+    int const nseqs = 4 * XSQL_BULK_MAX_ROWS + 7;
+    FILE *fp = fopen(fasta_path, "wb");
+    for (int i = 0; i < nseqs; ++i)
+        fprintf(fp, ">seq%d some description\nACGT\r\nAC GT\n\n", i);
+    fclose(fp);
+
+    eq(sched_scan_push_seq("seq", "ACGT"), SCHED_SCAN_NOT_STREAMING);
+
+    sched_scan_init(&scan, db.id, true, false);
+    eq(sched_scan_begin(&scan, &job), SCHED_OK);
+    eq(job.state, "hold");
+    eq(sched_scan_begin(&scan, &job), SCHED_SCAN_ALREADY_STREAMING);
+
+    struct sched_seq_dyn dyn = {0};
+    eq(sched_scan_push_seq("first", "GGGG"), SCHED_OK);
+    eq(sched_seq_dyn_get_by_id(&dyn, 1), SCHED_SEQ_NOT_FOUND);
+    fp = fopen(fasta_path, "rb");
+    eq(sched_scan_push_fasta(fp), SCHED_OK);
+    fclose(fp);
+    eq(sched_seq_dyn_get_by_id(&dyn, 1), SCHED_OK);
+    eq(sched_seq_dyn_get_by_id(&dyn, nseqs + 1), SCHED_SEQ_NOT_FOUND);
+
+    enum sched_job_state state = SCHED_PEND;
+    struct sched_job claimed = {0};
+    eq(sched_job_state(job.id, &state), SCHED_OK);
+    eq(state, SCHED_HOLD);
+    eq(sched_job_claim_next(&claimed), SCHED_JOB_NOT_FOUND);
+
+    eq(sched_scan_commit(), SCHED_OK);
+    eq(sched_job_state(job.id, &state), SCHED_OK);
+    eq(state, SCHED_PEND);
+    eq(sched_job_claim_next(&claimed), SCHED_OK);
+    eq(claimed.id, job.id);
+
+    eq(sched_seq_dyn_get_by_id(&dyn, 1), SCHED_OK);
+    eq(dyn.name, "first");
+    eq(sched_seq_dyn_get_by_id(&dyn, 2), SCHED_OK);
+    eq(dyn.name, "seq0");
+    eq(dyn.data, "ACGTACGT");
+    eq(sched_seq_dyn_get_by_id(&dyn, nseqs + 1), SCHED_OK);
+    eq(dyn.scan_id, scan.id);
+    eq(sched_seq_dyn_get_by_id(&dyn, nseqs + 2), SCHED_SEQ_NOT_FOUND);
+    sched_seq_dyn_cleanup(&dyn);
+
+    sched_scan_init(&scan, db.id, true, false);
+    eq(sched_scan_begin(&scan, &job), SCHED_OK);
+    eq(sched_scan_push_seq("seq", "ACGT"), SCHED_OK);
+    eq(sched_job_set_done(other.id), SCHED_OK);
+    eq(sched_scan_rollback(), SCHED_OK);
+    eq(sched_scan_get_by_id(&scan, scan.id), SCHED_SCAN_NOT_FOUND);
+    eq(sched_job_get_by_id(&job, job.id), SCHED_JOB_NOT_FOUND);
+    eq(sched_job_state(other.id, &state), SCHED_OK);
+    eq(state, SCHED_DONE);
+
+    file_write(fasta_path, "ACGT\n>seq\nACGT\n");
+    sched_scan_init(&scan, db.id, true, false);
+    eq(sched_scan_begin(&scan, &job), SCHED_OK);
+    fp = fopen(fasta_path, "rb");
+    eq(sched_scan_push_fasta(fp), SCHED_FAIL_PARSE_FILE);
+    fclose(fp);
+    eq(sched_scan_commit(), SCHED_SCAN_NOT_STREAMING);
+    eq(sched_scan_get_by_id(&scan, scan.id), SCHED_SCAN_NOT_FOUND);
+
+    eq(sched_cleanup(), SCHED_OK);
+}
+
 static void callb(struct sched_prod *prod, struct sched_hmmer *hmmer, void *arg)
 {
-    (void)arg;
+    int const *lens = arg;
     static double evalue_logs[] = {-196.11220625901211, 0};
-    static int lens[] = {5, 5};
     close(evalue_logs[prod->id - 1], prod->evalue_log);
     eq(lens[prod->id - 1], hmmer->len);
+    eq(hmmer->prod_id, prod->id);
+}
+
+static void view_callb(struct sched_prod_view const *prod,
+                       struct sched_hmmer const *hmmer, void *arg)
+{
+    int const *lens = arg;
+    static char const *matches[] = {
+        ",S,,;,B,,;CCT,M1,CCT,P;ATC,M2,ATC,I;ATT,M3,ATT,I;,E,,;,T,,",
+        ",S,,;,B,,;AAA,M1,AAA,K;,E,,;,T,,"};
+    char const *match = matches[prod->id - 1];
+    eq(prod->match_len, (int)strlen(match));
+    eq(prod->match, match);
+    eq(prod->profile_name, prod->id == 1 ? "PF00742.20" : "PF00696.29");
+    eq(lens[prod->id - 1], hmmer->len);
+    if (hmmer->len) eq(memcmp(hmmer->data, "hello", 5), 0);
+}
+
+static void dyn_callb(struct sched_prod_dyn *prod, struct sched_hmmer *hmmer,
+                      void *arg)
+{
+    int const *lens = arg;
+    eq(prod->match_len, (int)strlen(prod->match));
+    eq(lens[prod->id - 1], hmmer->len);
 }
 
 static void test_submit_prod(void)
@@ -449,17 +1052,174 @@ static void test_submit_prod(void)
 
     sched_prod_init(&prod, 0);
     sched_hmmer_init(&hmmer, 0);
-    eq(sched_prod_get_all(&callb, &prod, &hmmer, NULL), SCHED_HMMER_NOT_FOUND);
+    int lens[] = {5, 0};
+    eq(sched_prod_get_all(&callb, &prod, &hmmer, lens), SCHED_OK);
+    eq(sched_scan_get_prods(1, &callb, &prod, &hmmer, lens), SCHED_OK);
+    eq(sched_prod_get_all_view(&view_callb, lens), SCHED_OK);
 
     sched_hmmer_init(&hmmer, 2);
     eq(sched_hmmer_add(&hmmer, 5, (unsigned char const *)"hello"), 0);
     eq(hmmer.id, 2);
-    eq(sched_prod_get_all(&callb, &prod, &hmmer, NULL), 0);
+    eq(sched_hmmer_add(&hmmer, 5, (unsigned char const *)"again"),
+       SCHED_FAIL_EVAL_STMT);
+    lens[1] = 5;
+    eq(sched_prod_get_all(&callb, &prod, &hmmer, lens), 0);
+    eq(sched_scan_get_prods(1, &callb, &prod, &hmmer, lens), SCHED_OK);
+    eq(sched_scan_get_prods_view(1, &view_callb, lens), SCHED_OK);
+
+    struct sched_prod_dyn dyn = {0};
+    sched_prod_dyn_init(&dyn, 0);
+    eq(sched_prod_dyn_get_all(&dyn_callb, &dyn, &hmmer, lens), SCHED_OK);
+    eq(sched_scan_get_prods_dyn(1, &dyn_callb, &dyn, &hmmer, lens), SCHED_OK);
+    eq(sched_prod_dyn_get_by_id(&dyn, 2), SCHED_OK);
+    eq(dyn.match, ",S,,;,B,,;AAA,M1,AAA,K;,E,,;,T,,");
+    eq(dyn.profile_name, "PF00696.29");
+    sched_prod_dyn_cleanup(&dyn);
+    eq(sched_scan_get_prods_view(3, &view_callb, lens), SCHED_SCAN_NOT_FOUND);
 
     eq(sched_cleanup(), SCHED_OK);
 }
 
-static void file_write(char const *path, char const *str);
+static void test_submit_prod_long_line(void)
+{
+    char const sched_path[] = TMPDIR "/prod_long_line.sched";
+    char const file_hmm[] = "prod_long_line.hmm";
+    char const file_dcp[] = "prod_long_line.dcp";
+    char const prod_path[] = TMPDIR "/prod_long_line.tsv";
+    char const header[] = "scan_id\tseq_id\tprofile_name\tabc_name\t"
+                          "alt_loglik\tnull_loglik\tevalue_log\t"
+                          "profile_typeid\tversion\tmatch\r\n"
+                          "1\t1\tPF00742.20\tdna\t-547.8\t-690.8\t-196.1\t"
+                          "protein\t1.0.0\t";
+    size_t const match_len = 300000;
+
+    remove(sched_path);
+    create_file(file_hmm, 16);
+    create_file(file_dcp, 16);
+
+    /* Longer than any line buffer, and with no final newline. */
+    char *str = malloc(sizeof header + match_len);
+    notnull(str);
+    memcpy(str, header, sizeof header - 1);
+    memset(str + sizeof header - 1, 'A', match_len);
+    str[sizeof header - 1 + match_len] = '\0';
+    file_write(prod_path, str);
+    free(str);
+
+    eq(sched_init(sched_path), SCHED_OK);
+    sched_hmm_init(&hmm);
+    eq(sched_hmm_set_file(&hmm, file_hmm), SCHED_OK);
+    sched_job_init(&job, SCHED_HMM);
+    eq(sched_job_submit(&job, &hmm), SCHED_OK);
+    sched_db_init(&db);
+    eq(sched_db_add(&db, file_dcp), SCHED_OK);
+    sched_scan_init(&scan, db.id, true, false);
+    eq(sched_scan_add_seq("seq0", "ACAAGCAG"), SCHED_OK);
+    sched_job_init(&job, SCHED_SCAN);
+    eq(sched_job_submit(&job, &scan), SCHED_OK);
+
+    eq(sched_prod_add_file(prod_path), SCHED_OK);
+
+    struct sched_prod_dyn dyn = {0};
+    sched_prod_dyn_init(&dyn, 0);
+    eq(sched_prod_dyn_get_by_id(&dyn, 1), SCHED_OK);
+    eq(dyn.profile_name, "PF00742.20");
+    eq(dyn.match_len, (int)match_len);
+    eq(dyn.match[match_len - 1], 'A');
+    sched_prod_dyn_cleanup(&dyn);
+    eq(sched_prod_dyn_get_by_id(&dyn, 2), SCHED_PROD_NOT_FOUND);
+
+    eq(sched_cleanup(), SCHED_OK);
+}
+
+enum
+{
+    PARALLEL_ROWS = 30000,
+};
+
+static void write_parallel_prods(char const *path, int bad_row)
+{
+    FILE *fp = fopen(path, "wb");
+    notnull(fp);
+    fputs("scan_id\tseq_id\tprofile_name\tabc_name\talt_loglik\t"
+          "null_loglik\tevalue_log\tprofile_typeid\tversion\tmatch\n",
+          fp);
+    for (int i = 0; i < PARALLEL_ROWS; ++i)
+        fprintf(fp,
+                "1\t%d\tP%d\tdna\t-%d.5\t-690.8\t%s\tprotein\t1.0.0\t"
+                ",S,,;,B,,;CCT,M1,CCT,P;ATC,M2,ATC,I;ATT,M3,ATT,I;,E,,;,T,,\n",
+                i % 2 + 1, i, i, i == bad_row ? "x" : "-196.1");
+    eq(fclose(fp), 0);
+}
+
+static void check_parallel_prod(struct sched_prod_view const *prod,
+                                struct sched_hmmer const *hmmer, void *arg)
+{
+    (void)hmmer;
+    int *count = arg;
+    char name[16] = {0};
+    snprintf(name, sizeof name, "P%d", *count);
+    eq(prod->profile_name, name);
+    eq(prod->seq_id, *count % 2 + 1);
+    close(prod->alt_loglik, -(*count + 0.5));
+    ++*count;
+}
+
+static void test_submit_prod_parallel(void)
+{
+    char const sched_path[] = TMPDIR "/prod_parallel.sched";
+    char const file_hmm[] = "prod_parallel.hmm";
+    char const file_dcp[] = "prod_parallel.dcp";
+    char const prod_path[] = TMPDIR "/prod_parallel.tsv";
+    struct sched_options opts = {0};
+
+    remove(sched_path);
+    create_file(file_hmm, 17);
+    create_file(file_dcp, 17);
+
+    sched_options_init(&opts);
+    opts.parse_threads = 3;
+    eq(sched_init_ex(sched_path, &opts), SCHED_OK);
+    sched_hmm_init(&hmm);
+    eq(sched_hmm_set_file(&hmm, file_hmm), SCHED_OK);
+    sched_job_init(&job, SCHED_HMM);
+    eq(sched_job_submit(&job, &hmm), SCHED_OK);
+    sched_db_init(&db);
+    eq(sched_db_add(&db, file_dcp), SCHED_OK);
+    sched_scan_init(&scan, db.id, true, false);
+    eq(sched_scan_add_seq("seq0", "ACAAGCAG"), SCHED_OK);
+    eq(sched_scan_add_seq("seq1", "ACTTGCCG"), SCHED_OK);
+    sched_job_init(&job, SCHED_SCAN);
+    eq(sched_job_submit(&job, &scan), SCHED_OK);
+
+    write_parallel_prods(prod_path, PARALLEL_ROWS - 10);
+    eq(sched_prod_add_file(prod_path), SCHED_FAIL_PARSE_FILE);
+    eq(sched_prod_get_by_id(&prod, 1), SCHED_PROD_NOT_FOUND);
+
+    write_parallel_prods(prod_path, -1);
+    eq(sched_prod_add_file(prod_path), SCHED_OK);
+
+    int count = 0;
+    eq(sched_prod_get_all_view(check_parallel_prod, &count), SCHED_OK);
+    eq(count, PARALLEL_ROWS);
+
+    char const unknown_seq[] =
+        "scan_id\tseq_id\tprofile_name\tabc_name\talt_loglik\t"
+        "null_loglik\tevalue_log\tprofile_typeid\tversion\tmatch\n"
+        "1\t2\tPX\tdna\t-1.0\t-2.0\t-3.0\tprotein\t1.0.0\t,S,,\n"
+        "1\t3\tPY\tdna\t-1.0\t-2.0\t-3.0\tprotein\t1.0.0\t,S,,\n";
+    file_write(prod_path, unknown_seq);
+    eq(sched_prod_add_file(prod_path), SCHED_SEQ_NOT_FOUND);
+    char const unknown_scan[] =
+        "scan_id\tseq_id\tprofile_name\tabc_name\talt_loglik\t"
+        "null_loglik\tevalue_log\tprofile_typeid\tversion\tmatch\n"
+        "2\t1\tPX\tdna\t-1.0\t-2.0\t-3.0\tprotein\t1.0.0\t,S,,\n";
+    file_write(prod_path, unknown_scan);
+    eq(sched_prod_add_file(prod_path), SCHED_SCAN_NOT_FOUND);
+    eq(sched_prod_get_by_id(&prod, PARALLEL_ROWS + 1), SCHED_PROD_NOT_FOUND);
+
+    eq(sched_cleanup(), SCHED_OK);
+}
 
 static void test_submit_prodset(void)
 {
@@ -468,11 +1228,15 @@ static void test_submit_prodset(void)
     char const file_dcp[] = "submit_and_fetch_seq.dcp";
     // char const prod_path[] = TESTDIR "/prod.tsv";
 
+    struct sched_options opts = {0};
+
     remove(sched_path);
     create_file(file_hmm, 0);
     create_file(file_dcp, 0);
 
-    eq(sched_init(sched_path), SCHED_OK);
+    sched_options_init(&opts);
+    opts.io_threads = 2;
+    eq(sched_init_ex(sched_path, &opts), SCHED_OK);
 
     sched_db_init(&db);
     sched_hmm_init(&hmm);
@@ -533,11 +1297,751 @@ static void test_submit_prodset(void)
     strcpy(hmmer_path1, dir);
     strcat(hmmer_path1, "/hmmer_1_2_PF00696.29.h3r");
 
+    char other_path[256] = {0};
+    strcpy(other_path, dir);
+    strcat(other_path, "/hmmer_9_9_PF00742.20.h3r");
+
+    /* A third product has no file; the other file matches no product. */
     eq(fs_copy(prod_path, TESTDIR "/prod.tsv"), 0);
+    FILE *fp = fopen(prod_path, "ab");
+    notnull(fp);
+    fputs("1\t2\tPF00001.1\tdna\t-1.0\t-2.0\t0\tprotein\t1.0.0\t"
+          ",S,,;,B,,;,E,,;,T,,\n",
+          fp);
+    fclose(fp);
     file_write(hmmer_path0, "content0");
     file_write(hmmer_path1, "content1");
+    file_write(other_path, "unused");
+
+    eq(sched_prodset_add(dir), SCHED_OK);
+
+    eq(sched_hmmer_get_by_prod_id(&hmmer, 1), SCHED_OK);
+    eq(hmmer.len, 8);
+    eq(memcmp(hmmer.data, "content0", 8), 0);
+    free((void *)hmmer.data);
+
+    eq(sched_hmmer_get_by_prod_id(&hmmer, 2), SCHED_OK);
+    eq(hmmer.len, 8);
+    eq(memcmp(hmmer.data, "content1", 8), 0);
+    free((void *)hmmer.data);
+
+    eq(sched_prod_get_by_id(&prod, 3), SCHED_OK);
+    eq(prod.profile_name, "PF00001.1");
+    eq(sched_hmmer_get_by_prod_id(&hmmer, 3), SCHED_HMMER_NOT_FOUND);
+
+    eq(sched_cleanup(), SCHED_OK);
+}
+
+static void count_job(struct sched_job *x, void *arg)
+{
+    (void)x;
+    ++*(int *)arg;
+}
+
+struct worker
+{
+    pthread_t thread;
+    char const *path;
+    int64_t db_id;
+    int nscans;
+    enum sched_rc rc;
+};
+
+static void *submit_scans(void *arg)
+{
+    struct worker *w = arg;
+    struct sched *h = 0;
+    struct sched_scan x = {0};
+    struct sched_job j = {0};
+
+    if ((w->rc = sched_open(&h, w->path, 0))) return 0;
+    for (int i = 0; i < w->nscans && !w->rc; ++i)
+    {
+        sched_h_scan_init(h, &x, w->db_id, true, false);
+        if ((w->rc = sched_h_scan_add_seq(h, "seq0", "ACAAGCAG"))) break;
+        if ((w->rc = sched_h_scan_add_seq(h, "seq1", "ACTTGCCG"))) break;
+        sched_job_init(&j, SCHED_SCAN);
+        w->rc = sched_h_job_submit(h, &j, &x);
+    }
+    enum sched_rc rc = sched_close(h);
+    if (!w->rc) w->rc = rc;
+    return 0;
+}
+
+static void test_handles(void)
+{
+    char const path1[] = TMPDIR "/handles1.sched";
+    char const path2[] = TMPDIR "/handles2.sched";
+    char const file_hmm[] = "handles.hmm";
+    char const file_dcp[] = "handles.dcp";
+    struct sched *h1 = 0;
+    struct sched *h2 = 0;
+
+    create_file(file_hmm, 2);
+    create_file(file_dcp, 3);
+    remove(path1);
+    remove(path2);
+
+    eq(sched_open(&h1, path1, 0), SCHED_OK);
+    eq(sched_open(&h2, path2, 0), SCHED_OK);
+
+    sched_hmm_init(&hmm);
+    eq(sched_hmm_set_file(&hmm, file_hmm), SCHED_OK);
+    sched_job_init(&job, SCHED_HMM);
+    eq(sched_h_job_submit(h1, &job, &hmm), SCHED_OK);
+    eq(job.id, 1);
+    eq(sched_h_job_set_run(h1, job.id), SCHED_OK);
+    eq(sched_h_job_set_done(h1, job.id), SCHED_OK);
+    sched_db_init(&db);
+    eq(sched_h_db_add(h1, &db, file_dcp), SCHED_OK);
+
+    eq(sched_h_job_get_by_id(h2, &job, 1), SCHED_JOB_NOT_FOUND);
+    eq(sched_h_db_get_by_id(h2, &db, 1), SCHED_DB_NOT_FOUND);
+    eq(sched_close(h2), SCHED_OK);
+
+    struct worker workers[4] = {0};
+    for (int i = 0; i < 4; ++i)
+    {
+        workers[i] = (struct worker){0, path1, 1, 25, SCHED_OK};
+        eq(pthread_create(&workers[i].thread, 0, submit_scans, workers + i),
+           0);
+    }
+    for (int i = 0; i < 4; ++i)
+    {
+        eq(pthread_join(workers[i].thread, 0), 0);
+        eq(workers[i].rc, SCHED_OK);
+    }
+
+    int njobs = 0;
+    eq(sched_h_job_get_all(h1, count_job, &job, &njobs), SCHED_OK);
+    eq(njobs, 101);
+    eq(sched_close(h1), SCHED_OK);
+}
+
+struct reader
+{
+    pthread_t thread;
+    struct sched *h;
+    int64_t scan_id;
+    int nseqs;
+    enum sched_rc rc;
+};
+
+static void count_seq(struct sched_seq_dyn *x, void *arg)
+{
+    (void)x;
+    ++*(int *)arg;
+}
+
+static void *read_seqs(void *arg)
+{
+    struct reader *r = arg;
+    struct sched_seq_dyn x = {0};
+    sched_seq_dyn_init(&x);
+    for (int i = 0; i < 20 && !r->rc; ++i)
+    {
+        int n = 0;
+        r->rc = sched_h_scan_get_seqs_dyn(r->h, r->scan_id, count_seq, &x, &n);
+        if (!r->rc && n != r->nseqs) r->rc = SCHED_FAIL_EVAL_STMT;
+    }
+    sched_seq_dyn_cleanup(&x);
+    return 0;
+}
+
+static void fail_job(struct sched_job *x, void *arg)
+{
+    struct sched *h = arg;
+    if (x->state[0] == 'p') sched_h_job_set_fail(h, x->id, "stopped");
+}
+
+static void test_pool(void)
+{
+    char const sched_path[] = TMPDIR "/pool.sched";
+    char const file_hmm[] = "pool.hmm";
+    char const file_dcp[] = "pool.dcp";
+    struct sched_options opts = {0};
+    struct sched *h = 0;
+
+    create_file(file_hmm, 4);
+    create_file(file_dcp, 5);
+    remove(sched_path);
+
+    sched_options_init(&opts);
+    opts.readers = 2;
+    eq(sched_open(&h, sched_path, &opts), SCHED_OK);
+
+    sched_hmm_init(&hmm);
+    eq(sched_hmm_set_file(&hmm, file_hmm), SCHED_OK);
+    sched_job_init(&job, SCHED_HMM);
+    eq(sched_h_job_submit(h, &job, &hmm), SCHED_OK);
+    eq(sched_h_job_set_run(h, job.id), SCHED_OK);
+    eq(sched_h_job_set_done(h, job.id), SCHED_OK);
+    sched_db_init(&db);
+    eq(sched_h_db_add(h, &db, file_dcp), SCHED_OK);
+
+    sched_scan_init(&scan, db.id, true, false);
+    eq(sched_h_scan_begin(h, &scan, &job), SCHED_OK);
+    for (int i = 0; i < 100; ++i)
+        eq(sched_h_scan_push_seq(h, "seq", "ACGT"), SCHED_OK);
+    eq(sched_h_scan_commit(h), SCHED_OK);
+
+    /* Queries see committed rows only; readers run beside the writer. */
+    struct reader readers[4] = {0};
+    for (int i = 0; i < 4; ++i)
+    {
+        readers[i] = (struct reader){0, h, scan.id, 100, SCHED_OK};
+        eq(pthread_create(&readers[i].thread, 0, read_seqs, readers + i), 0);
+    }
+    struct worker writer = {0, sched_path, db.id, 10, SCHED_OK};
+    eq(pthread_create(&writer.thread, 0, submit_scans, &writer), 0);
+    for (int i = 0; i < 4; ++i)
+    {
+        eq(pthread_join(readers[i].thread, 0), 0);
+        eq(readers[i].rc, SCHED_OK);
+    }
+    eq(pthread_join(writer.thread, 0), 0);
+    eq(writer.rc, SCHED_OK);
+
+    /* A mutation from inside a query goes to the writer. */
+    eq(sched_h_job_get_all(h, fail_job, &job, h), SCHED_OK);
+    enum sched_job_state state = SCHED_PEND;
+    eq(sched_h_job_state(h, job.id, &state), SCHED_OK);
+    eq(state, SCHED_FAIL);
+
+    eq(sched_close(h), SCHED_OK);
+}
+
+static void count_done(enum sched_rc rc, void *arg)
+{
+    if (!rc) ++*(int *)arg;
+}
+
+static void test_async(void)
+{
+    char const sched_path[] = TMPDIR "/async.sched";
+    char const file_hmm[] = "async.hmm";
+    struct sched *h = 0;
+    struct sched_future run = {0};
+    struct sched_future done = {0};
+    int ndone = 0;
+
+    create_file(file_hmm, 6);
+    remove(sched_path);
+
+    eq(sched_open(&h, sched_path, 0), SCHED_OK);
+    sched_hmm_init(&hmm);
+    eq(sched_hmm_set_file(&hmm, file_hmm), SCHED_OK);
+    sched_job_init(&job, SCHED_HMM);
+    eq(sched_h_job_submit(h, &job, &hmm), SCHED_OK);
+
+    eq(sched_async_job_set_run(h, job.id, 0), SCHED_ASYNC_NOT_RUNNING);
+    sched_future_init(&run, 0, 0);
+    eq(sched_async_job_set_run(h, job.id, &run), SCHED_ASYNC_NOT_RUNNING);
+    eq((int)sched_future_done(&run), 1);
+    eq(sched_future_wait(&run), SCHED_ASYNC_NOT_RUNNING);
+    eq(sched_async_stop(h), SCHED_ASYNC_NOT_RUNNING);
+    eq(sched_async_start(h, 5), SCHED_OK);
+
+    sched_future_init(&run, 0, 0);
+    eq(sched_async_job_set_run(h, job.id, &run), SCHED_OK);
+    eq(sched_future_wait(&run), SCHED_OK);
+    eq((int)sched_future_done(&run), 1);
+
+    for (int i = 0; i < 100; ++i)
+        eq(sched_async_job_increment_progress(h, job.id, 1, 0), SCHED_OK);
+    sched_future_init(&run, 0, 0);
+    eq(sched_async_job_set_done_claimed(h, job.id, 1, &run), SCHED_OK);
+    eq(sched_future_wait(&run), SCHED_JOB_NOT_FOUND);
+    sched_future_init(&done, count_done, &ndone);
+    eq(sched_async_job_set_done(h, job.id, &done), SCHED_OK);
+    eq(sched_future_wait(&done), SCHED_OK);
+    eq(ndone, 1);
+
+    eq(sched_h_job_get_by_id(h, &job, job.id), SCHED_OK);
+    eq(job.state, "done");
+    eq(job.progress, 100);
+
+    /* Stopping commits what is still queued. */
+    eq(sched_async_job_set_fail(h, job.id, "late", 0), SCHED_OK);
+    eq(sched_async_stop(h), SCHED_OK);
+    eq(sched_h_job_get_by_id(h, &job, job.id), SCHED_OK);
+    eq(job.state, "fail");
+    eq(job.error, "late");
+
+    eq(sched_async_start(h, 0), SCHED_OK);
+    eq(sched_close(h), SCHED_OK);
+}
+
+static void test_progress(void)
+{
+    char const sched_path[] = TMPDIR "/progress.sched";
+    char const file_hmm[] = "progress.hmm";
+    struct sched_options opts = {0};
+    struct sched *h = 0;
+    struct sched *other = 0;
+    struct sched_job x = {0};
+
+    create_file(file_hmm, 7);
+    remove(sched_path);
+
+    sched_options_init(&opts);
+    opts.progress_flush_ms = 60 * 60 * 1000;
+    eq(sched_open(&h, sched_path, &opts), SCHED_OK);
+    eq(sched_open(&other, sched_path, 0), SCHED_OK);
+
+    sched_hmm_init(&hmm);
+    eq(sched_hmm_set_file(&hmm, file_hmm), SCHED_OK);
+    sched_job_init(&job, SCHED_HMM);
+    eq(sched_h_job_submit(h, &job, &hmm), SCHED_OK);
+    eq(sched_h_job_set_run(h, job.id), SCHED_OK);
+
+    for (int i = 0; i < 3; ++i)
+        eq(sched_h_job_increment_progress(h, job.id, 30), SCHED_OK);
+    eq(sched_h_job_get_by_id(h, &x, job.id), SCHED_OK);
+    eq(x.progress, 90);
+    eq(sched_h_job_get_by_id(other, &x, job.id), SCHED_OK);
+    eq(x.progress, 0);
+    eq(sched_h_job_increment_progress_claimed(h, job.id, 1, 5),
+       SCHED_JOB_NOT_FOUND);
+
+    eq(sched_h_job_flush_progress(h), SCHED_OK);
+    eq(sched_h_job_get_by_id(other, &x, job.id), SCHED_OK);
+    eq(x.progress, 90);
+
+    /* Increments written in a transaction that rolls back are kept. */
+    eq(sched_h_job_increment_progress(h, job.id, 5), SCHED_OK);
+    struct sched *prev = sched_use(h);
+    eq(xsql_begin_transaction(), SCHED_OK);
+    eq(sched_h_job_flush_progress(h), SCHED_OK);
+    eq(xsql_rollback_transaction(), SCHED_OK);
+    sched_use(prev);
+    eq(sched_h_job_get_by_id(other, &x, job.id), SCHED_OK);
+    eq(x.progress, 90);
+    eq(sched_h_job_flush_progress(h), SCHED_OK);
+    eq(sched_h_job_get_by_id(other, &x, job.id), SCHED_OK);
+    eq(x.progress, 95);
+
+    /* A decrement is not merged, so MIN(progress + ?, 100) still holds. */
+    eq(sched_h_job_increment_progress(h, job.id, 50), SCHED_OK);
+    eq(sched_h_job_increment_progress(h, job.id, -20), SCHED_OK);
+    eq(sched_h_job_get_by_id(other, &x, job.id), SCHED_OK);
+    eq(x.progress, 80);
+
+    /* The async writer commits an increment before completing its future. */
+    struct sched_future f = {0};
+    eq(sched_async_start(h, 5), SCHED_OK);
+    sched_future_init(&f, 0, 0);
+    eq(sched_async_job_increment_progress(h, job.id, 2, &f), SCHED_OK);
+    eq(sched_future_wait(&f), SCHED_OK);
+    eq(sched_h_job_get_by_id(other, &x, job.id), SCHED_OK);
+    eq(x.progress, 82);
+    sched_future_init(&f, 0, 0);
+    eq(sched_async_job_increment_progress_claimed(h, job.id, 1, 2, &f),
+       SCHED_OK);
+    eq(sched_future_wait(&f), SCHED_JOB_NOT_FOUND);
+    eq(sched_async_stop(h), SCHED_OK);
+
+    eq(sched_h_job_increment_progress(h, job.id, 3), SCHED_OK);
+    eq(sched_h_job_set_done(h, job.id), SCHED_OK);
+    eq(sched_h_job_get_by_id(other, &x, job.id), SCHED_OK);
+    eq(x.progress, 85);
+    eq(x.state, "done");
+
+    eq(sched_h_job_increment_progress(h, job.id, 1), SCHED_OK);
+    eq(sched_close(h), SCHED_OK);
+    eq(sched_h_job_get_by_id(other, &x, job.id), SCHED_OK);
+    eq(x.progress, 86);
+
+    /* The async writer flushes once the interval has passed. */
+    create_file("progress2.hmm", 8);
+    opts.progress_flush_ms = 5;
+    eq(sched_open(&h, sched_path, &opts), SCHED_OK);
+    sched_hmm_init(&hmm);
+    eq(sched_hmm_set_file(&hmm, "progress2.hmm"), SCHED_OK);
+    sched_job_init(&job, SCHED_HMM);
+    eq(sched_h_job_submit(h, &job, &hmm), SCHED_OK);
+    eq(sched_h_job_set_run(h, job.id), SCHED_OK);
+    eq(sched_async_start(h, 5), SCHED_OK);
+    eq(sched_h_job_increment_progress(h, job.id, 10), SCHED_OK);
+    eq(sched_h_job_increment_progress(h, job.id, 10), SCHED_OK);
+    for (int i = 0; i < 200; ++i)
+    {
+        eq(sched_h_job_get_by_id(other, &x, job.id), SCHED_OK);
+        if (x.progress == 20) break;
+        nanosleep(&(struct timespec){0, 10 * 1000 * 1000}, 0);
+    }
+    eq(x.progress, 20);
+    eq(sched_close(h), SCHED_OK);
+    eq(sched_close(other), SCHED_OK);
+}
+
+struct waiter
+{
+    pthread_t thread;
+    struct sched *h;
+    struct sched_job job;
+    enum sched_rc rc;
+};
+
+static void *wait_pend(void *arg)
+{
+    struct waiter *w = arg;
+    w->rc = sched_h_job_wait_pend(w->h, &w->job, 10000);
+    return 0;
+}
+
+static void test_wait_pend(void)
+{
+    char const sched_path[] = TMPDIR "/wait_pend.sched";
+    char const file_hmm[] = "wait_pend.hmm";
+    struct sched *h = 0;
+    struct sched *other = 0;
+    struct waiter w[2] = {0};
+
+    create_file(file_hmm, 11);
+    remove(sched_path);
+
+    eq(sched_open(&h, sched_path, 0), SCHED_OK);
+    eq(sched_open(&other, sched_path, 0), SCHED_OK);
+
+    /* Both waiters start the watcher of the same handle. */
+    for (int i = 0; i < 2; ++i)
+    {
+        w[i].h = h;
+        eq(pthread_create(&w[i].thread, 0, wait_pend, w + i), 0);
+    }
+    nanosleep(&(struct timespec){0, 50 * 1000 * 1000}, 0);
+
+    sched_hmm_init(&hmm);
+    eq(sched_hmm_set_file(&hmm, file_hmm), SCHED_OK);
+    sched_job_init(&job, SCHED_HMM);
+    eq(sched_h_job_submit(other, &job, &hmm), SCHED_OK);
+
+    for (int i = 0; i < 2; ++i)
+    {
+        eq(pthread_join(w[i].thread, 0), 0);
+        eq(w[i].rc, SCHED_OK);
+        eq(w[i].job.id, job.id);
+        eq(w[i].job.state, "pend");
+    }
+
+    eq(sched_h_job_claim_next(other, &w[0].job), SCHED_OK);
+    eq(sched_h_job_wait_pend(h, &w[0].job, 20), SCHED_JOB_NOT_FOUND);
+
+    eq(sched_close(other), SCHED_OK);
+    eq(sched_close(h), SCHED_OK);
+
+    /*
+     * A submission from another process reaches this one only through the
+     * watcher. The child forks before any connection is open here.
+     */
+    create_file("wait_pend2.hmm", 12);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        nanosleep(&(struct timespec){0, 200 * 1000 * 1000}, 0);
+        if (sched_open(&other, sched_path, 0)) _exit(1);
+        sched_hmm_init(&hmm);
+        sched_job_init(&job, SCHED_HMM);
+        if (sched_hmm_set_file(&hmm, "wait_pend2.hmm")) _exit(2);
+        if (sched_h_job_submit(other, &job, &hmm)) _exit(3);
+        _exit(sched_close(other) ? 4 : 0);
+    }
+    eq((int)(pid > 0), 1);
+    eq(sched_open(&h, sched_path, 0), SCHED_OK);
+    eq(sched_h_job_wait_pend(h, &w[0].job, 10 * 1000), SCHED_OK);
+    eq((int)h->notify.started, 1);
+    eq(w[0].job.state, "pend");
+    int status = -1;
+    eq(waitpid(pid, &status, 0), pid);
+    eq(status, 0);
+
+    /* An announcement inside a transaction waits for the commit. */
+    struct sched *prev = sched_use(h);
+    eq(xsql_begin_transaction(), SCHED_OK);
+    notify_post();
+    eq((int)h->notify.pending, 1);
+    eq(xsql_end_transaction(), SCHED_OK);
+    eq((int)h->notify.pending, 0);
+    sched_use(prev);
+    eq(sched_close(h), SCHED_OK);
+}
+
+static void test_dispatch(void)
+{
+    char const sched_path[] = TMPDIR "/dispatch.sched";
+    char const file_hmm[] = "dispatch.hmm";
+    char const file_dcp[] = "dispatch.dcp";
+    char const name[] = "/sched_test_dispatch";
+    struct sched_dispatch *producer = 0;
+    struct sched_dispatch *worker = 0;
+    struct sched_seq_view view = {0};
+
+    remove(sched_path);
+    create_file(file_hmm, 13);
+    create_file(file_dcp, 13);
+    sched_dispatch_unlink(name);
+
+    eq(sched_init(sched_path), SCHED_OK);
+    sched_hmm_init(&hmm);
+    eq(sched_hmm_set_file(&hmm, file_hmm), SCHED_OK);
+    sched_job_init(&job, SCHED_HMM);
+    eq(sched_job_submit(&job, &hmm), SCHED_OK);
+    sched_db_init(&db);
+    eq(sched_db_add(&db, file_dcp), SCHED_OK);
+
+    sched_scan_init(&scan, db.id, true, false);
+    sched_scan_add_seq("seq0", "ACAAGCAG");
+    sched_scan_add_seq("seq1", "ACTTGCCG");
+    sched_scan_add_seq("seq2", "");
+    sched_job_init(&job, SCHED_SCAN);
+    eq(sched_job_submit(&job, &scan), SCHED_OK);
+
+    eq(sched_dispatch_create(&producer, name, scan.id + 1), SCHED_SCAN_NOT_FOUND);
+    eq(sched_dispatch_create(&producer, name, scan.id), SCHED_OK);
+    eq(sched_dispatch_create(&worker, name, scan.id), SCHED_FAIL_OPEN_FILE);
+    eq(sched_dispatch_open(&worker, name), SCHED_OK);
+    eq(sched_dispatch_size(worker), 3);
+    eq(sched_dispatch_scan_id(worker), scan.id);
+
+    eq(sched_dispatch_next(producer, &view), SCHED_OK);
+    eq(view.id, 1);
+    eq(view.scan_id, scan.id);
+    eq(view.name, "seq0");
+    eq(view.data_len, 8);
+    eq(view.data, "ACAAGCAG");
+
+    eq(sched_dispatch_next(worker, &view), SCHED_OK);
+    eq(view.id, 2);
+    eq(view.name, "seq1");
+    eq(view.data, "ACTTGCCG");
+
+    eq(sched_dispatch_next(producer, &view), SCHED_OK);
+    eq(view.id, 3);
+    eq(view.data_len, 0);
+    eq(view.data, "");
+
+    eq(sched_dispatch_next(worker, &view), SCHED_END);
+    eq(sched_dispatch_next(producer, &view), SCHED_END);
+
+    sched_dispatch_close(worker);
+    sched_dispatch_close(producer);
+    eq(sched_dispatch_unlink(name), SCHED_OK);
+    eq(sched_dispatch_open(&worker, name), SCHED_FAIL_OPEN_FILE);
+    eq(sched_cleanup(), SCHED_OK);
+}
+
+static void test_unit(void)
+{
+    char const sched_path[] = TMPDIR "/unit.sched";
+    char const file_hmm[] = "unit.hmm";
+    char const file_dcp[] = "unit.dcp";
+    struct sched_unit unit = {0};
+    int64_t ids[8] = {0};
+    int n = 0;
+
+    remove(sched_path);
+    create_file(file_hmm, 14);
+    create_file(file_dcp, 14);
+
+    eq(sched_init(sched_path), SCHED_OK);
+    sched_hmm_init(&hmm);
+    eq(sched_hmm_set_file(&hmm, file_hmm), SCHED_OK);
+    sched_job_init(&job, SCHED_HMM);
+    eq(sched_job_submit(&job, &hmm), SCHED_OK);
+    sched_db_init(&db);
+    eq(sched_db_add(&db, file_dcp), SCHED_OK);
+
+    sched_scan_init(&scan, db.id, true, false);
+    for (int i = 0; i < 5; ++i)
+        eq(sched_scan_add_seq("seq", "ACGT"), SCHED_OK);
+    sched_job_init(&job, SCHED_SCAN);
+    eq(sched_job_submit(&job, &scan), SCHED_OK);
+    int64_t job_id = job.id;
+
+    sched_scan_init(&scan, db.id, true, false);
+    eq(sched_scan_add_seq("other", "ACGT"), SCHED_OK);
+    sched_job_init(&job, SCHED_SCAN);
+    eq(sched_job_submit(&job, &scan), SCHED_OK);
+
+    eq(sched_unit_claim_next(&unit), SCHED_UNIT_NOT_FOUND);
+    eq(sched_unit_split(job_id, 2, &n), SCHED_OK);
+    eq(n, 3);
+    eq(sched_unit_heartbeat(1, 0), SCHED_UNIT_NOT_FOUND);
+    eq(sched_unit_split(job_id, 2, &n), SCHED_JOB_NOT_FOUND);
+    eq(n, 0);
+    eq(sched_job_get_by_id(&job, job_id), SCHED_OK);
+    eq(job.state, "run");
+
+    sched_set_page_size(1);
+    eq(sched_unit_claim_next(&unit), SCHED_OK);
+    eq(unit.job_id, job_id);
+    eq(unit.state, "run");
+    eq(sched_unit_get_seqs(&unit, collect_seq, &seq, ids), SCHED_OK);
+    eq(ids[0], 2);
+    eq(ids[1], 1);
+    eq(ids[2], 2);
+    eq(sched_unit_set_done(unit.id, unit.retries), SCHED_OK);
+    eq(sched_unit_set_done(unit.id, unit.retries), SCHED_UNIT_NOT_FOUND);
+    eq(sched_job_get_by_id(&job, job_id), SCHED_OK);
+    eq(job.state, "run");
+    eq(job.progress, 33);
+
+    eq(sched_unit_claim_next(&unit), SCHED_OK);
+    int64_t failed = unit.id;
+    eq(sched_unit_claim_next(&unit), SCHED_OK);
+    int64_t last = unit.id;
+    ids[0] = 0;
+    eq(sched_unit_get_seqs(&unit, collect_seq, &seq, ids), SCHED_OK);
+    eq(ids[0], 1);
+    eq(ids[1], 5);
+    eq(sched_unit_claim_next(&unit), SCHED_UNIT_NOT_FOUND);
+    sched_set_page_size(SCHED_PAGE_SIZE);
+
+    eq(sched_unit_set_fail(failed, 0, "boom"), SCHED_OK);
+    eq(sched_unit_get_by_id(&unit, failed), SCHED_OK);
+    eq(unit.state, "fail");
+    eq(unit.error, "boom");
+    eq(sched_job_get_by_id(&job, job_id), SCHED_OK);
+    eq(job.state, "run");
+    eq(job.progress, 66);
+
+    eq(sched_unit_set_done(last + 1, 0), SCHED_UNIT_NOT_FOUND);
+    eq(sched_unit_set_done(last, 0), SCHED_OK);
+    eq(sched_job_get_by_id(&job, job_id), SCHED_OK);
+    eq(job.state, "fail");
+    eq(job.error, "boom");
+    eq(job.progress, 100);
+
+    /* Units of a job that is no longer running are not claimed. */
+    eq(sched_unit_split(job.id + 1, 1, &n), SCHED_OK);
+    eq(n, 1);
+    eq(sched_job_set_fail(job.id + 1, "gone"), SCHED_OK);
+    eq(sched_unit_claim_next(&unit), SCHED_UNIT_NOT_FOUND);
+
+    eq(sched_cleanup(), SCHED_OK);
+}
+
+static void test_lease(void)
+{
+    char const sched_path[] = TMPDIR "/lease.sched";
+    char const file_hmm[] = "lease.hmm";
+    char const file_dcp[] = "lease.dcp";
+    struct sched_options opts = {0};
+    struct timespec const expire = {1, 100 * 1000 * 1000};
+    int n = 0;
+
+    remove(sched_path);
+    create_file(file_hmm, 15);
+    create_file(file_dcp, 15);
+
+    sched_options_init(&opts);
+    opts.lease_secs = 1;
+    opts.max_retries = 1;
+    eq(sched_init_ex(sched_path, &opts), SCHED_OK);
+
+    sched_hmm_init(&hmm);
+    eq(sched_hmm_set_file(&hmm, file_hmm), SCHED_OK);
+    sched_job_init(&job, SCHED_HMM);
+    eq(sched_job_submit(&job, &hmm), SCHED_OK);
+    int64_t first = job.id;
+    sched_db_init(&db);
+    eq(sched_db_add(&db, file_dcp), SCHED_OK);
+    sched_scan_init(&scan, db.id, true, false);
+    eq(sched_scan_add_seq("seq0", "ACAAGCAG"), SCHED_OK);
+    sched_job_init(&job, SCHED_SCAN);
+    eq(sched_job_submit(&job, &scan), SCHED_OK);
+    int64_t second = job.id;
+
+    eq(sched_job_claim_next(&job), SCHED_OK);
+    eq(job.id, first);
+    eq(job.lease_expiry, job.exec_started + 1);
+    eq(sched_job_heartbeat(first, job.retries), SCHED_OK);
+    eq(sched_job_heartbeat(second, 0), SCHED_JOB_NOT_FOUND);
+    eq(sched_job_reap_expired(&n), SCHED_OK);
+    eq(n, 0);
+
+    nanosleep(&expire, 0);
+    eq(sched_job_reap_expired(&n), SCHED_OK);
+    eq(n, 1);
+    eq(sched_job_get_by_id(&job, first), SCHED_OK);
+    eq(job.state, "pend");
+    eq(job.retries, 1);
+    eq(job.lease_expiry, 0);
+
+    eq(sched_job_claim_next(&job), SCHED_OK);
+    eq(job.id, first);
+    eq(job.retries, 1);
+
+    /* The worker whose lease expired can no longer touch the job. */
+    eq(sched_job_heartbeat(first, 0), SCHED_JOB_NOT_FOUND);
+    eq(sched_job_increment_progress_claimed(first, 0, 10),
+       SCHED_JOB_NOT_FOUND);
+    eq(sched_job_set_done_claimed(first, 0), SCHED_JOB_NOT_FOUND);
+    eq(sched_job_set_fail_claimed(first, 0, "stale"), SCHED_JOB_NOT_FOUND);
+    eq(sched_job_increment_progress_claimed(first, 1, 10), SCHED_OK);
+    eq(sched_job_get_by_id(&job, first), SCHED_OK);
+    eq(job.state, "run");
+    eq(job.progress, 10);
+
+    eq(sched_job_set_run(second), SCHED_OK);
+    nanosleep(&expire, 0);
+    eq(sched_job_heartbeat(second, 0), SCHED_OK);
+    eq(sched_job_reap_expired(&n), SCHED_OK);
+    eq(n, 1);
+
+    eq(sched_job_get_by_id(&job, first), SCHED_OK);
+    eq(job.state, "fail");
+    eq(job.error, "lease expired");
+    eq(job.retries, 2);
+    eq(sched_job_get_by_id(&job, second), SCHED_OK);
+    eq(job.state, "run");
+    eq(job.retries, 0);
+
+    /* Units are leased and reaped the same way. */
+    struct sched_unit unit = {0};
+    sched_scan_init(&scan, db.id, true, false);
+    eq(sched_scan_add_seq("seq1", "ACAAGCAG"), SCHED_OK);
+    sched_job_init(&job, SCHED_SCAN);
+    eq(sched_job_submit(&job, &scan), SCHED_OK);
+    int64_t third = job.id;
+    eq(sched_unit_split(third, 1, &n), SCHED_OK);
+    eq(n, 1);
+
+    eq(sched_unit_claim_next(&unit), SCHED_OK);
+    eq(unit.lease_expiry, unit.exec_started + 1);
+    eq(sched_unit_heartbeat(unit.id, unit.retries), SCHED_OK);
+    eq(sched_unit_reap_expired(&n), SCHED_OK);
+    eq(n, 0);
+
+    nanosleep(&expire, 0);
+    eq(sched_unit_reap_expired(&n), SCHED_OK);
+    eq(n, 1);
+    eq(sched_unit_get_by_id(&unit, unit.id), SCHED_OK);
+    eq(unit.state, "pend");
+    eq(unit.retries, 1);
+    eq(unit.lease_expiry, 0);
+
+    /* The stale worker neither finishes nor renews the reclaimed unit. */
+    eq(sched_unit_claim_next(&unit), SCHED_OK);
+    eq(unit.retries, 1);
+    eq(sched_unit_set_done(unit.id, 0), SCHED_UNIT_NOT_FOUND);
+    eq(sched_unit_heartbeat(unit.id, 0), SCHED_UNIT_NOT_FOUND);
+    eq(sched_unit_get_by_id(&unit, unit.id), SCHED_OK);
+    eq(unit.state, "run");
+    eq(sched_job_get_by_id(&job, third), SCHED_OK);
+    eq(job.state, "run");
+    eq(job.progress, 0);
+    nanosleep(&expire, 0);
+    eq(sched_unit_reap_expired(&n), SCHED_OK);
+    eq(n, 1);
+    eq(sched_unit_get_by_id(&unit, unit.id), SCHED_OK);
+    eq(unit.state, "fail");
+    eq(unit.error, "lease expired");
+    eq(sched_job_get_by_id(&job, third), SCHED_OK);
+    eq(job.state, "fail");
+    eq(job.error, "lease expired");
 
-    sched_prodset_add(dir);
     eq(sched_cleanup(), SCHED_OK);
 }
 
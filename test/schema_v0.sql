@@ -0,0 +1,97 @@
+-- A sched file as written before schema versioning, with a few rows.
+
+PRAGMA foreign_keys = off;
+
+BEGIN TRANSACTION;
+
+CREATE TABLE job (
+    id INTEGER PRIMARY KEY UNIQUE NOT NULL,
+    -- type: 0 for scan jobs; 1 for hmm jobs.
+    type INTEGER CHECK(type IN (0, 1)) NOT NULL,
+
+    state TEXT CHECK(state IN ('pend', 'run', 'done', 'fail')) NOT NULL,
+    progress INTEGER CHECK(0 <= progress AND progress <= 100) NOT NULL,
+    error TEXT NOT NULL,
+
+    submission INTEGER NOT NULL,
+    exec_started INTEGER NOT NULL,
+    exec_ended INTEGER NOT NULL
+);
+
+CREATE TABLE hmm (
+    id INTEGER PRIMARY KEY UNIQUE NOT NULL,
+    xxh3 INTEGER UNIQUE NOT NULL,
+    filename TEXT UNIQUE CHECK(length(filename) > 4 AND substr(filename, -4) == '.hmm') NOT NULL,
+
+    job_id INTEGER REFERENCES job (id) NOT NULL
+);
+
+CREATE TABLE db (
+    id INTEGER PRIMARY KEY UNIQUE NOT NULL,
+    xxh3 INTEGER UNIQUE NOT NULL,
+    filename TEXT UNIQUE CHECK(length(filename) > 4 AND substr(filename, -4) == '.dcp') NOT NULL,
+
+    hmm_id INTEGER REFERENCES hmm (id) NOT NULL
+);
+
+CREATE TABLE scan (
+    id INTEGER PRIMARY KEY UNIQUE NOT NULL,
+    db_id INTEGER REFERENCES db (id) NOT NULL,
+
+    multi_hits INTEGER NOT NULL,
+    hmmer3_compat INTEGER NOT NULL,
+
+    job_id INTEGER REFERENCES job (id) NOT NULL
+);
+
+CREATE TABLE seq (
+    id INTEGER PRIMARY KEY UNIQUE NOT NULL,
+    scan_id INTEGER REFERENCES scan (id) NOT NULL,
+    name TEXT NOT NULL,
+    data TEXT NOT NULL
+);
+
+CREATE TABLE prod (
+    id INTEGER PRIMARY KEY UNIQUE NOT NULL,
+
+    scan_id INTEGER REFERENCES scan (id) NOT NULL,
+    seq_id INTEGER REFERENCES seq (id) NOT NULL,
+
+    profile_name TEXT NOT NULL,
+    abc_name TEXT NOT NULL,
+
+    alt_loglik REAL NOT NULL,
+    null_loglik REAL NOT NULL,
+    evalue_log REAL NOT NULL,
+
+    profile_typeid TEXT NOT NULL,
+    version TEXT NOT NULL,
+
+    match TEXT NOT NULL,
+
+    UNIQUE(scan_id, seq_id, profile_name)
+);
+
+CREATE TABLE hmmer (
+    id INTEGER PRIMARY KEY UNIQUE NOT NULL,
+    data BLOB NOT NULL,
+    prod_id INTEGER REFERENCES prod (id) NOT NULL
+);
+
+INSERT INTO job VALUES (1, 1, 'done', 100, '', 10, 11, 12);
+INSERT INTO job VALUES (2, 0, 'pend', 0, '', 20, 0, 0);
+INSERT INTO job VALUES (3, 0, 'run', 40, '', 30, 31, 0);
+INSERT INTO job VALUES (4, 0, 'fail', 10, 'boom', 40, 41, 42);
+
+INSERT INTO hmm VALUES (1, 7, 'legacy.hmm', 1);
+INSERT INTO db VALUES (1, 8, 'legacy.dcp', 1);
+INSERT INTO scan VALUES (1, 1, 1, 0, 2);
+INSERT INTO scan VALUES (2, 1, 1, 0, 3);
+INSERT INTO scan VALUES (3, 1, 1, 0, 4);
+INSERT INTO seq VALUES (1, 1, 'seq0', 'ACGT');
+INSERT INTO prod VALUES (1, 1, 1, 'PF00742.20', 'dna', -1.5, -2.5, -3.5, 'protein', '1.0.0', ',S,,');
+INSERT INTO hmmer VALUES (1, X'00FF', 1);
+
+COMMIT TRANSACTION;
+
+PRAGMA foreign_keys = ON;
@@ -0,0 +1,223 @@
+#include "to.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hope.h"
+
+static void test_int64(void);
+static void test_double_edges(void);
+static void test_double_random(void);
+static void test_double_long(void);
+static void test_double_invalid(void);
+
+int main(void)
+{
+    test_int64();
+    test_double_edges();
+    test_double_random();
+    test_double_long();
+    test_double_invalid();
+    return hope_status();
+}
+
+static uint64_t state = 0x853c49e6748fea9bu;
+
+static uint64_t next(void)
+{
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+static int64_t parse_int64(char const *str)
+{
+    int64_t val = 0;
+    eq((int)to_int64l((unsigned)strlen(str), str, &val), 1);
+    return val;
+}
+
+static void test_int64(void)
+{
+    int64_t val = 0;
+    eq(parse_int64("0"), 0);
+    eq(parse_int64("-0"), 0);
+    eq(parse_int64("+17"), 17);
+    eq(parse_int64("9223372036854775807"), INT64_MAX);
+    eq(parse_int64("-9223372036854775808"), INT64_MIN);
+    eq((int)to_int64l(19, "9223372036854775808", &val), 0);
+    eq((int)to_int64l(20, "-9223372036854775809", &val), 0);
+    eq((int)to_int64l(0, "", &val), 0);
+    eq((int)to_int64l(1, "-", &val), 0);
+    eq((int)to_int64l(3, "12a", &val), 0);
+    eq((int)to_int64l(4, "1 23", &val), 0);
+
+    /* Not NUL-terminated: the length alone delimits the number. */
+    eq((int)to_int64l(2, "4242", &val), 1);
+    eq(val, 42);
+
+    char str[32] = {0};
+    for (int i = 0; i < 100000; ++i)
+    {
+        int64_t x = (int64_t)next() >> (next() % 64);
+        snprintf(str, sizeof str, "%" PRId64, x);
+        eq(parse_int64(str), strtoll(str, NULL, 10));
+    }
+}
+
+static int same_as_strtod(char const *str)
+{
+    double actual = 0;
+    if (!to_doublel((unsigned)strlen(str), str, &actual)) return 0;
+    double desired = strtod(str, NULL);
+    if (isnan(desired)) return isnan(actual);
+    return !memcmp(&actual, &desired, sizeof actual);
+}
+
+static void check(char const *str)
+{
+    if (!same_as_strtod(str))
+    {
+        fprintf(stderr, "Mismatch for %s\n", str);
+        eq(0, 1);
+    }
+}
+
+static void test_double_edges(void)
+{
+    static char const *const cases[] = {
+        "0",
+        "-0",
+        "0.0",
+        "+0e100",
+        "1",
+        "-1",
+        "1.5",
+        ".5",
+        "5.",
+        "0.1",
+        "0.3",
+        "1e22",
+        "1e23",
+        "1E-22",
+        "9007199254740992",
+        "9007199254740993",
+        "9007199254740995",
+        "-547.87713623046875",
+        "-690.86773681640625",
+        "-196.11220625901211",
+        "7.038531e-26",
+        "2.2250738585072011e-308",
+        "2.2250738585072014e-308",
+        "4.9406564584124654e-324",
+        "2.4703282292062327e-324",
+        "2.4703282292062328e-324",
+        "1.7976931348623157e308",
+        "1.7976931348623158e308",
+        "1.7976931348623159e308",
+        "1e-400",
+        "1e400",
+        "1e99999999999",
+        "-1e-99999999999",
+        "123456789012345678901234567890",
+        "0.000000000000000000000000000001",
+        "3.14159265358979323846264338327950288419716939937510",
+        "9007199254740993.0000000000000000000000000000001",
+        "1.00000000000000011102230246251565404236316680908203125",
+        "1.00000000000000011102230246251565404236316680908203124",
+        "1.00000000000000011102230246251565404236316680908203126",
+        "inf",
+        "-Infinity",
+        "NaN",
+    };
+    for (size_t i = 0; i < sizeof cases / sizeof cases[0]; ++i)
+        check(cases[i]);
+
+    double val = 0;
+    eq((int)to_doublel(4, "-1.5e3", &val), 1);
+    close(val, -1.5);
+}
+
+static void random_digits(char *str, size_t size)
+{
+    int n = 1 + (int)(next() % 30);
+    int dot = (int)(next() % (uint64_t)(n + 1));
+    size_t k = 0;
+    if (next() % 2) str[k++] = '-';
+    for (int i = 0; i < n && k + 12 < size; ++i)
+    {
+        if (i == dot) str[k++] = '.';
+        str[k++] = (char)('0' + next() % 10);
+    }
+    int exp = (int)(next() % 701) - 350;
+    snprintf(str + k, size - k, "e%d", exp);
+}
+
+static void test_double_random(void)
+{
+    char str[64] = {0};
+    for (int i = 0; i < 200000; ++i)
+    {
+        uint64_t bits = next();
+        double x = 0;
+        memcpy(&x, &bits, sizeof x);
+        if (isnan(x) || isinf(x)) continue;
+
+        snprintf(str, sizeof str, "%.17g", x);
+        check(str);
+        snprintf(str, sizeof str, "%.*e", (int)(next() % 20), x);
+        check(str);
+        snprintf(str, sizeof str, "%.*f", (int)(next() % 8),
+                 (double)(int64_t)next() / 1e9);
+        check(str);
+        random_digits(str, sizeof str);
+        check(str);
+    }
+}
+
+/* Digits far past any stack buffer, where the last one decides rounding. */
+static void test_double_long(void)
+{
+    static char const halfway[] = "1.00000000000000011102230246251565404236316"
+                                  "680908203125";
+    char str[4096] = {0};
+
+    for (size_t zeros = 400; zeros < 3000; zeros += 650)
+    {
+        size_t k = (size_t)snprintf(str, sizeof str, "%s", halfway);
+        memset(str + k, '0', zeros);
+        k += zeros;
+        str[k] = '\0';
+        check(str);
+        snprintf(str + k, sizeof str - k, "1");
+        check(str);
+        snprintf(str + k, sizeof str - k, "1e-5");
+        check(str);
+    }
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        size_t n = 500 + (size_t)(next() % 3000);
+        size_t dot = (size_t)(next() % n);
+        size_t k = 0;
+        for (size_t j = 0; j < n; ++j)
+        {
+            if (j == dot) str[k++] = '.';
+            str[k++] = (char)('0' + next() % 10);
+        }
+        snprintf(str + k, sizeof str - k, "e%d", (int)(next() % 701) - 350);
+        check(str);
+    }
+}
+
+static void test_double_invalid(void)
+{
+    static char const *const cases[] = {
+        "", "-", "+", ".", "-.", "e5", "1e", "1e+", "1.2.3", "1,5", " 1", "1 ",
+        "0x1p3", "infinit", "nana", "1e5x",
+    };
+    double val = 0;
+    for (size_t i = 0; i < sizeof cases / sizeof cases[0]; ++i)
+        eq((int)to_doublel((unsigned)strlen(cases[i]), cases[i], &val), 0);
+}